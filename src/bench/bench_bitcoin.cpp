@@ -4,6 +4,7 @@
 
 #include <bench/bench.h>
 
+#include <crypto/aes.h>
 #include <crypto/sha256.h>
 #include <key.h>
 #include <validation.h>
@@ -43,6 +44,7 @@ main(int argc, char** argv)
     }
 
     SHA256AutoDetect();
+    AESAutoDetect();
     RandomInit();
     ECC_Start();
     SetupEnvironment();
@@ -6,10 +6,12 @@
 #include <util.h>
 #include <validation.h>
 #include <checkqueue.h>
+#include <crypto/sha256.h>
 #include <prevector.h>
 #include <vector>
 #include <boost/thread/thread.hpp>
 #include <random.h>
+#include <uint256.h>
 
 
 static const int MIN_CORES = 2;
@@ -60,3 +62,50 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.join_all();
 }
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+
+// This Benchmark measures how the CheckQueue scales with the number of
+// threads (the master included), on checks that each do a little hashing so
+// that the work itself, not only the queue, is spread over the threads.
+static void CCheckQueueScaling(benchmark::State& state, int nThreads)
+{
+    struct HashJob {
+        uint256 hash;
+        bool operator()()
+        {
+            for (int i = 0; i < 16; ++i) {
+                CSHA256().Write(hash.begin(), hash.size()).Finalize(hash.begin());
+            }
+            return true;
+        }
+        void swap(HashJob& x) { std::swap(hash, x.hash); }
+    };
+    CCheckQueue<HashJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < nThreads - 1; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<HashJob> control(&queue);
+        for (size_t b = 0; b < BATCHES; ++b) {
+            std::vector<HashJob> vChecks(BATCH_SIZE);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void CCheckQueueScaling_1(benchmark::State& state) { CCheckQueueScaling(state, 1); }
+static void CCheckQueueScaling_2(benchmark::State& state) { CCheckQueueScaling(state, 2); }
+static void CCheckQueueScaling_4(benchmark::State& state) { CCheckQueueScaling(state, 4); }
+static void CCheckQueueScaling_8(benchmark::State& state) { CCheckQueueScaling(state, 8); }
+static void CCheckQueueScaling_16(benchmark::State& state) { CCheckQueueScaling(state, 16); }
+static void CCheckQueueScaling_32(benchmark::State& state) { CCheckQueueScaling(state, 32); }
+
+BENCHMARK(CCheckQueueScaling_1, 100);
+BENCHMARK(CCheckQueueScaling_2, 200);
+BENCHMARK(CCheckQueueScaling_4, 400);
+BENCHMARK(CCheckQueueScaling_8, 800);
+BENCHMARK(CCheckQueueScaling_16, 800);
+BENCHMARK(CCheckQueueScaling_32, 800);
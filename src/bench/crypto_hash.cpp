@@ -10,6 +10,7 @@
 #include <random.h>
 #include <uint256.h>
 #include <utiltime.h>
+#include <crypto/aes.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -52,6 +53,14 @@ static void SHA256_32b(benchmark::State& state)
     }
 }
 
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -60,6 +69,27 @@ static void SHA512(benchmark::State& state)
         CSHA512().Write(in.data(), in.size()).Finalize(hash);
 }
 
+/* Decrypt a wallet key: a 32-byte secret padded to three blocks, with its own IV */
+static void AES256CBC_DecryptKey(benchmark::State& state)
+{
+    std::vector<uint8_t> key(AES256_KEYSIZE, 1), iv(AES_BLOCKSIZE, 2), in(48, 3), out(48);
+    AES256CBCDecrypt dec(key.data(), false);
+    while (state.KeepRunning()) {
+        dec.Decrypt(iv.data(), in.data(), in.size(), out.data());
+        iv[0] = out[0];
+    }
+}
+
+/* The same, expanding the key for every decryption */
+static void AES256CBC_DecryptKeyWithSetup(benchmark::State& state)
+{
+    std::vector<uint8_t> key(AES256_KEYSIZE, 1), iv(AES_BLOCKSIZE, 2), in(48, 3), out(48);
+    while (state.KeepRunning()) {
+        AES256CBCDecrypt(key.data(), iv.data(), false).Decrypt(in.data(), in.size(), out.data());
+        key[0] = out[0];
+    }
+}
+
 static void SipHash_32b(benchmark::State& state)
 {
     uint256 x;
@@ -91,8 +121,11 @@ BENCHMARK(RIPEMD160, 440);
 BENCHMARK(SHA1, 570);
 BENCHMARK(SHA256, 340);
 BENCHMARK(SHA512, 330);
+BENCHMARK(AES256CBC_DecryptKey, 300 * 1000);
+BENCHMARK(AES256CBC_DecryptKeyWithSetup, 250 * 1000);
 
 BENCHMARK(SHA256_32b, 4700 * 1000);
+BENCHMARK(SHA256D64_1024, 7400);
 BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
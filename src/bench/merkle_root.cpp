@@ -0,0 +1,31 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <consensus/merkle.h>
+#include <random.h>
+#include <uint256.h>
+
+static void MerkleRoot(benchmark::State& state, size_t nLeaves)
+{
+    FastRandomContext rng(true);
+    std::vector<uint256> leaves;
+    leaves.resize(nLeaves);
+    for (auto& item : leaves) {
+        item = rng.rand256();
+    }
+    while (state.KeepRunning()) {
+        bool mutation = false;
+        uint256 hash = ComputeMerkleRoot(std::vector<uint256>(leaves), &mutation);
+        leaves[mutation] = hash;
+    }
+}
+
+// Roughly a busy block, and the largest that fit in 1 MB of simple payments
+static void MerkleRoot_2000(benchmark::State& state) { MerkleRoot(state, 2000); }
+static void MerkleRoot_9001(benchmark::State& state) { MerkleRoot(state, 9001); }
+
+BENCHMARK(MerkleRoot_2000, 3600);
+BENCHMARK(MerkleRoot_9001, 800);
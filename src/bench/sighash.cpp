@@ -0,0 +1,60 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <pubkey.h>
+#include <random.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+
+// Signature hashes of every input of a transaction spending nInputs P2PKH
+// outputs, as signing or verifying all of them computes them.
+static void LegacySigHash(benchmark::State& state, size_t nInputs, bool fPrecompute)
+{
+    FastRandomContext rng(true);
+    const CScript scriptCode = GetScriptForDestination(CKeyID(uint160(rng.randbytes(20))));
+    CMutableTransaction mtx;
+    mtx.nVersion = 1;
+    mtx.vin.resize(nInputs);
+    for (auto& txin : mtx.vin) {
+        txin.prevout = COutPoint(rng.rand256(), 0);
+        // A typical signature and public key push
+        txin.scriptSig = CScript() << rng.randbytes(72) << rng.randbytes(33);
+    }
+    mtx.vout.resize(2);
+    for (auto& txout : mtx.vout) {
+        txout.scriptPubKey = scriptCode;
+        txout.nValue = 1;
+    }
+    const CTransaction tx(mtx);
+
+    while (state.KeepRunning()) {
+        if (fPrecompute) {
+            PrecomputedTransactionData txdata(tx);
+            txdata.PrecomputeLegacy(tx);
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                SignatureHash(scriptCode, tx, i, SIGHASH_ALL, 0, SIGVERSION_BASE, &txdata);
+            }
+        } else {
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                SignatureHash(scriptCode, tx, i, SIGHASH_ALL, 0, SIGVERSION_BASE);
+            }
+        }
+    }
+}
+
+static void LegacySigHash_1(benchmark::State& state) { LegacySigHash(state, 1, true); }
+static void LegacySigHash_10(benchmark::State& state) { LegacySigHash(state, 10, true); }
+static void LegacySigHash_100(benchmark::State& state) { LegacySigHash(state, 100, true); }
+static void LegacySigHash_500(benchmark::State& state) { LegacySigHash(state, 500, true); }
+static void LegacySigHashUncached_100(benchmark::State& state) { LegacySigHash(state, 100, false); }
+static void LegacySigHashUncached_500(benchmark::State& state) { LegacySigHash(state, 500, false); }
+
+BENCHMARK(LegacySigHash_1, 370 * 1000);
+BENCHMARK(LegacySigHash_10, 37 * 1000);
+BENCHMARK(LegacySigHash_100, 570);
+BENCHMARK(LegacySigHash_500, 23);
+BENCHMARK(LegacySigHashUncached_100, 320);
+BENCHMARK(LegacySigHashUncached_500, 10);
@@ -9,6 +9,7 @@
 #endif
 #include <script/script.h>
 #include <script/sign.h>
+#include <script/standard.h>
 #include <streams.h>
 
 #include <array>
@@ -105,4 +106,72 @@ static void VerifyScriptBench(benchmark::State& state)
     }
 }
 
+/** Accepts every signature, so that only the interpreter itself is measured. */
+class AcceptingSignatureChecker : public BaseSignatureChecker
+{
+public:
+    bool CheckSig(const CScriptStackElement& scriptSig, const CScriptStackElement& vchPubKey, const CScript& scriptCode, SigVersion sigversion) const override
+    {
+        return true;
+    }
+};
+
+enum class StackBenchType { P2PKH, P2WPKH, P2SH_MULTISIG };
+
+// Microbenchmark for the script interpreter on standard inputs, without the
+// ECDSA verification that otherwise dominates VerifyScriptBench. Shows the
+// cost of moving stack elements around.
+static void VerifyScriptStack(benchmark::State& state, StackBenchType type)
+{
+    const int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_DERSIG |
+                      SCRIPT_VERIFY_LOW_S | SCRIPT_VERIFY_MINIMALDATA | SCRIPT_VERIFY_NULLDUMMY | SCRIPT_VERIFY_CLEANSTACK;
+
+    std::vector<CPubKey> pubkeys;
+    std::vector<unsigned char> vchSig;
+    for (unsigned char i = 1; i <= 3; i++) {
+        std::array<unsigned char, 32> vchKey{};
+        vchKey[31] = i;
+        CKey key;
+        key.Set(vchKey.begin(), vchKey.end(), true);
+        pubkeys.push_back(key.GetPubKey());
+        if (vchSig.empty()) {
+            key.Sign(uint256S("1"), vchSig, 0);
+            vchSig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+        }
+    }
+    uint160 pubkeyHash;
+    CHash160().Write(pubkeys[0].begin(), pubkeys[0].size()).Finalize(pubkeyHash.begin());
+
+    CScript scriptSig;
+    CScript scriptPubKey;
+    CScriptWitness witness;
+    if (type == StackBenchType::P2PKH) {
+        scriptSig << vchSig << ToByteVector(pubkeys[0]);
+        scriptPubKey << OP_DUP << OP_HASH160 << ToByteVector(pubkeyHash) << OP_EQUALVERIFY << OP_CHECKSIG;
+    } else if (type == StackBenchType::P2WPKH) {
+        witness.stack.push_back(vchSig);
+        witness.stack.push_back(ToByteVector(pubkeys[0]));
+        scriptPubKey << OP_0 << ToByteVector(pubkeyHash);
+    } else {
+        CScript redeemScript = GetScriptForMultisig(2, pubkeys);
+        scriptSig << OP_0 << vchSig << vchSig << std::vector<unsigned char>(redeemScript.begin(), redeemScript.end());
+        scriptPubKey = GetScriptForDestination(CScriptID(redeemScript));
+    }
+
+    const AcceptingSignatureChecker checker;
+    while (state.KeepRunning()) {
+        ScriptError err;
+        bool success = VerifyScript(scriptSig, scriptPubKey, &witness, flags, checker, &err);
+        assert(err == SCRIPT_ERR_OK);
+        assert(success);
+    }
+}
+
+static void VerifyScriptStackP2PKH(benchmark::State& state) { VerifyScriptStack(state, StackBenchType::P2PKH); }
+static void VerifyScriptStackP2WPKH(benchmark::State& state) { VerifyScriptStack(state, StackBenchType::P2WPKH); }
+static void VerifyScriptStackP2SHMultisig(benchmark::State& state) { VerifyScriptStack(state, StackBenchType::P2SH_MULTISIG); }
+
 BENCHMARK(VerifyScriptBench, 6300);
+BENCHMARK(VerifyScriptStackP2PKH, 650 * 1000);
+BENCHMARK(VerifyScriptStackP2WPKH, 700 * 1000);
+BENCHMARK(VerifyScriptStackP2SHMultisig, 280 * 1000);
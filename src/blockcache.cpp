@@ -0,0 +1,86 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcache.h>
+
+#include <core_memusage.h>
+#include <undo.h>
+
+CBlockCache g_block_cache(DEFAULT_BLOCK_CACHE_SIZE << 20);
+CBlockUndoCache g_block_undo_cache(DEFAULT_UNDO_CACHE_SIZE << 20);
+
+template <typename T>
+std::shared_ptr<const T> CBlockDataCache<T>::Get(const uint256& hash)
+{
+    LOCK(cs);
+    auto it = mapEntries.find(hash);
+    if (it == mapEntries.end()) {
+        nMisses++;
+        return nullptr;
+    }
+    nHits++;
+    entries.splice(entries.begin(), entries, it->second.first);
+    return it->second.first->second;
+}
+
+template <typename T>
+void CBlockDataCache<T>::Insert(const uint256& hash, const std::shared_ptr<const T>& pentry)
+{
+    // Block transactions may be shared with the mempool or other blocks, so this
+    // overestimates what the cache keeps alive; that errs on the safe side.
+    size_t nEntryUsage = RecursiveDynamicUsage(pentry);
+
+    LOCK(cs);
+    if (nEntryUsage > nMaxUsage || mapEntries.count(hash))
+        return;
+    entries.emplace_front(hash, pentry);
+    mapEntries.emplace(hash, std::make_pair(entries.begin(), nEntryUsage));
+    nUsage += nEntryUsage;
+    Trim();
+}
+
+template <typename T>
+void CBlockDataCache<T>::Clear()
+{
+    LOCK(cs);
+    entries.clear();
+    mapEntries.clear();
+    nUsage = 0;
+}
+
+template <typename T>
+void CBlockDataCache<T>::SetMaxUsage(size_t nMaxUsageIn)
+{
+    LOCK(cs);
+    nMaxUsage = nMaxUsageIn;
+    Trim();
+}
+
+template <typename T>
+typename CBlockDataCache<T>::Stats CBlockDataCache<T>::GetStats() const
+{
+    LOCK(cs);
+    Stats stats;
+    stats.hits = nHits;
+    stats.misses = nMisses;
+    stats.count = mapEntries.size();
+    stats.usage = nUsage;
+    stats.max_usage = nMaxUsage;
+    return stats;
+}
+
+template <typename T>
+void CBlockDataCache<T>::Trim()
+{
+    AssertLockHeld(cs);
+    while (nUsage > nMaxUsage) {
+        auto it = mapEntries.find(entries.back().first);
+        nUsage -= it->second.second;
+        mapEntries.erase(it);
+        entries.pop_back();
+    }
+}
+
+template class CBlockDataCache<CBlock>;
+template class CBlockDataCache<CBlockUndo>;
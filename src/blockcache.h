@@ -0,0 +1,83 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef DONU_BLOCKCACHE_H
+#define DONU_BLOCKCACHE_H
+
+#include <primitives/block.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <list>
+#include <memory>
+#include <stdint.h>
+#include <unordered_map>
+
+class CBlockUndo;
+
+/** Default for -blockcachesize, in MiB */
+static const int64_t DEFAULT_BLOCK_CACHE_SIZE = 32;
+/** Default for -undocachesize, in MiB */
+static const int64_t DEFAULT_UNDO_CACHE_SIZE = 16;
+
+/**
+ * Memory-bounded, least recently used cache of full blocks or their undo
+ * data, keyed by block hash.
+ *
+ * Both are immutable once stored (the undo data of a block only depends on
+ * the chain it extends, which its hash commits to), so cached entries are
+ * shared with callers and never need to be invalidated.
+ */
+template <typename T>
+class CBlockDataCache
+{
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        size_t count;
+        size_t usage;
+        size_t max_usage;
+    };
+
+    explicit CBlockDataCache(size_t nMaxUsageIn) : nMaxUsage(nMaxUsageIn), nUsage(0), nHits(0), nMisses(0) {}
+
+    //! Look up an entry, counting a hit or a miss.
+    std::shared_ptr<const T> Get(const uint256& hash);
+    //! Add an entry (a no-op if it does not fit or is already present).
+    void Insert(const uint256& hash, const std::shared_ptr<const T>& pentry);
+    void Clear();
+
+    void SetMaxUsage(size_t nMaxUsageIn);
+    Stats GetStats() const;
+
+private:
+    struct BlockHasher
+    {
+        size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+    };
+    typedef std::list<std::pair<uint256, std::shared_ptr<const T> > > EntryList;
+
+    void Trim();
+
+    mutable CCriticalSection cs;
+    size_t nMaxUsage;
+    size_t nUsage;
+    uint64_t nHits;
+    uint64_t nMisses;
+    //! Most recently used first
+    EntryList entries;
+    std::unordered_map<uint256, std::pair<typename EntryList::iterator, size_t>, BlockHasher> mapEntries;
+};
+
+typedef CBlockDataCache<CBlock> CBlockCache;
+typedef CBlockDataCache<CBlockUndo> CBlockUndoCache;
+
+/** Recently read or connected blocks, shared by everything that loads full blocks */
+extern CBlockCache g_block_cache;
+
+/** Undo data of recently read or connected blocks, which reorgs and the
+ *  indexes built from undo data read again soon after it is written */
+extern CBlockUndoCache g_block_undo_cache;
+
+#endif // DONU_BLOCKCACHE_H
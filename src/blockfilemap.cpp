@@ -0,0 +1,145 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilemap.h>
+
+#include <util.h>
+
+#include <errno.h>
+#include <limits>
+#include <string.h>
+
+#ifdef WIN32
+#ifdef _WIN32_WINNT
+#undef _WIN32_WINNT
+#endif
+#define _WIN32_WINNT 0x0501
+#define WIN32_LEAN_AND_MEAN 1
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CMappedFile::~CMappedFile()
+{
+#ifdef WIN32
+    UnmapViewOfFile(pData);
+#else
+    munmap(const_cast<unsigned char*>(pData), nSize);
+#endif
+}
+
+std::shared_ptr<const CMappedFile> CMappedFile::Open(const fs::path& path)
+{
+#ifdef WIN32
+    HANDLE hFile = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return nullptr;
+    LARGE_INTEGER nFileSize;
+    if (!GetFileSizeEx(hFile, &nFileSize) || nFileSize.QuadPart <= 0 || (uint64_t)nFileSize.QuadPart > std::numeric_limits<size_t>::max()) {
+        CloseHandle(hFile);
+        return nullptr;
+    }
+    HANDLE hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(hFile);
+    if (hMapping == nullptr)
+        return nullptr;
+    void* addr = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    // The view keeps the mapping object alive.
+    CloseHandle(hMapping);
+    if (addr == nullptr)
+        return nullptr;
+    size_t nSize = (size_t)nFileSize.QuadPart;
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size > std::numeric_limits<size_t>::max()) {
+        close(fd);
+        return nullptr;
+    }
+    size_t nSize = (size_t)st.st_size;
+    void* addr = mmap(nullptr, nSize, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file.
+    close(fd);
+    if (addr == MAP_FAILED) {
+        LogPrintf("Unable to map %s: %s\n", path.string(), strerror(errno));
+        return nullptr;
+    }
+#endif
+    return std::shared_ptr<const CMappedFile>(new CMappedFile(static_cast<const unsigned char*>(addr), nSize));
+}
+
+std::shared_ptr<const CMappedFile> CMappedFileCache::Get(int nFile, const fs::path& path)
+{
+    LOCK(cs);
+    if (nMaxFiles == 0)
+        return nullptr;
+    auto it = mapFiles.find(nFile);
+    if (it != mapFiles.end()) {
+        lruFiles.splice(lruFiles.begin(), lruFiles, it->second.second);
+        return it->second.first;
+    }
+    // Mapping is cheap compared to a read, so this is done under the lock to
+    // avoid mapping the same file twice.
+    std::shared_ptr<const CMappedFile> mapped = CMappedFile::Open(path);
+    if (!mapped)
+        return nullptr;
+    lruFiles.push_front(nFile);
+    mapFiles.emplace(nFile, std::make_pair(mapped, lruFiles.begin()));
+    Trim();
+    return mapped;
+}
+
+void CMappedFileCache::Erase(int nFile)
+{
+    LOCK(cs);
+    auto it = mapFiles.find(nFile);
+    if (it != mapFiles.end()) {
+        lruFiles.erase(it->second.second);
+        mapFiles.erase(it);
+    }
+}
+
+void CMappedFileCache::Clear()
+{
+    LOCK(cs);
+    lruFiles.clear();
+    mapFiles.clear();
+}
+
+void CMappedFileCache::SetMaxFiles(size_t nMaxFilesIn)
+{
+    LOCK(cs);
+    nMaxFiles = nMaxFilesIn;
+    Trim();
+}
+
+size_t CMappedFileCache::GetMaxFiles() const
+{
+    LOCK(cs);
+    return nMaxFiles;
+}
+
+size_t CMappedFileCache::Size() const
+{
+    LOCK(cs);
+    return mapFiles.size();
+}
+
+void CMappedFileCache::Trim()
+{
+    AssertLockHeld(cs);
+    while (mapFiles.size() > nMaxFiles) {
+        mapFiles.erase(lruFiles.back());
+        lruFiles.pop_back();
+    }
+}
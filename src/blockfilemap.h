@@ -0,0 +1,67 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef DONU_BLOCKFILEMAP_H
+#define DONU_BLOCKFILEMAP_H
+
+#include <fs.h>
+#include <sync.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <utility>
+
+/** Read-only memory mapping of a whole file, unmapped when the last reference goes away. */
+class CMappedFile
+{
+public:
+    ~CMappedFile();
+    CMappedFile(const CMappedFile&) = delete;
+    CMappedFile& operator=(const CMappedFile&) = delete;
+
+    //! Map the file at path, or return nullptr if it is empty or cannot be mapped.
+    static std::shared_ptr<const CMappedFile> Open(const fs::path& path);
+
+    const unsigned char* data() const { return pData; }
+    size_t size() const { return nSize; }
+
+private:
+    CMappedFile(const unsigned char* pDataIn, size_t nSizeIn) : pData(pDataIn), nSize(nSizeIn) {}
+
+    const unsigned char* pData;
+    size_t nSize;
+};
+
+/**
+ * Bounded, least recently used set of file mappings keyed by file number.
+ *
+ * Only files that are no longer written to may be put in here. A mapping that
+ * is evicted stays valid for readers still holding a reference to it.
+ */
+class CMappedFileCache
+{
+public:
+    explicit CMappedFileCache(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn) {}
+
+    //! Return the mapping of file nFile, mapping path if needed. Returns nullptr if disabled or mapping failed.
+    std::shared_ptr<const CMappedFile> Get(int nFile, const fs::path& path);
+    //! Drop the mapping of file nFile, e.g. because it was deleted.
+    void Erase(int nFile);
+    void Clear();
+
+    void SetMaxFiles(size_t nMaxFilesIn);
+    size_t GetMaxFiles() const;
+    size_t Size() const;
+
+private:
+    void Trim();
+
+    mutable CCriticalSection cs;
+    size_t nMaxFiles;
+    //! File numbers, most recently used first
+    std::list<int> lruFiles;
+    std::map<int, std::pair<std::shared_ptr<const CMappedFile>, std::list<int>::iterator> > mapFiles;
+};
+
+#endif // DONU_BLOCKFILEMAP_H
@@ -0,0 +1,165 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockstats.h>
+
+#include <arith_uint256.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <consensus/consensus.h>
+#include <consensus/validation.h>
+#include <primitives/block.h>
+#include <undo.h>
+#include <version.h>
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+/** Memory a coin takes besides its output: outpoint, height, time and flags */
+static constexpr size_t PER_UTXO_OVERHEAD = sizeof(COutPoint) + 2 * sizeof(uint32_t) + 2 * sizeof(bool);
+
+void CBlockStats::SetNull()
+{
+    nTxs = nInputs = nOutputs = 0;
+    nTotalSize = nTotalWeight = 0;
+    nSegwitTxs = nSegwitTotalSize = nSegwitTotalWeight = 0;
+    nTotalOut = nTotalFee = 0;
+    nMinFee = nMaxFee = nAvgFee = nMedianFee = 0;
+    nMinFeeRate = nMaxFeeRate = nAvgFeeRate = nMedianFeeRate = 0;
+    nMinTxSize = nMaxTxSize = nAvgTxSize = nMedianTxSize = 0;
+    nUTXOIncrease = nUTXOSizeIncrease = 0;
+    nStakeAmount = nStakeReward = 0;
+    nCoinAgeDestroyed = 0;
+}
+
+template<typename T>
+static T CalculateTruncatedMedian(std::vector<T>& scores)
+{
+    size_t size = scores.size();
+    if (size == 0) {
+        return 0;
+    }
+
+    std::sort(scores.begin(), scores.end());
+    if (size % 2 == 0) {
+        return (scores[size / 2 - 1] + scores[size / 2]) / 2;
+    } else {
+        return scores[size / 2];
+    }
+}
+
+bool ComputeBlockStats(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo, CBlockStats& stats)
+{
+    if (block.vtx.empty() || blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+        return false;
+    }
+
+    stats.SetNull();
+    stats.nTxs = block.vtx.size();
+    stats.nMinFee = std::numeric_limits<CAmount>::max();
+    stats.nMinFeeRate = std::numeric_limits<CAmount>::max();
+    stats.nMinTxSize = std::numeric_limits<int64_t>::max();
+
+    std::vector<CAmount> fee_array;
+    std::vector<CAmount> feerate_array;
+    std::vector<int64_t> txsize_array;
+    int64_t fee_tx_weight = 0;
+    arith_uint256 bnCentSecond = 0;
+
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransaction& tx = *block.vtx[i];
+        stats.nOutputs += tx.vout.size();
+
+        CAmount tx_total_out = 0;
+        for (const CTxOut& out : tx.vout) {
+            tx_total_out += out.nValue;
+            if (!out.scriptPubKey.IsUnspendable()) {
+                stats.nUTXOIncrease += 1;
+                stats.nUTXOSizeIncrease += GetSerializeSize(out, SER_NETWORK, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
+            }
+        }
+
+        const int64_t tx_size = GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        const int64_t weight = GetTransactionWeight(tx);
+        stats.nTotalSize += tx_size;
+        stats.nTotalWeight += weight;
+        if (tx.HasWitness()) {
+            stats.nSegwitTxs += 1;
+            stats.nSegwitTotalSize += tx_size;
+            stats.nSegwitTotalWeight += weight;
+        }
+
+        if (tx.IsCoinBase()) {
+            continue;
+        }
+
+        stats.nInputs += tx.vin.size();
+
+        const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        if (txundo.vprevout.size() != tx.vin.size()) {
+            return false;
+        }
+        CAmount tx_total_in = 0;
+        for (const Coin& coin : txundo.vprevout) {
+            tx_total_in += coin.out.nValue;
+            stats.nUTXOIncrease -= 1;
+            stats.nUTXOSizeIncrease -= GetSerializeSize(coin.out, SER_NETWORK, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
+
+            // As in GetCoinAge, coins younger than the minimum stake age have none
+            const CBlockIndex* pindexFrom = pindex->GetAncestor(coin.nHeight);
+            if (!pindexFrom) {
+                return false;
+            }
+            if (pindexFrom->GetBlockTime() + Params().GetConsensus().nStakeMinAge > tx.nTime) {
+                continue;
+            }
+            if (tx.nTime > coin.nTime) {
+                bnCentSecond += arith_uint256(coin.out.nValue) * (tx.nTime - coin.nTime) / CENT;
+            }
+        }
+
+        if (tx.IsCoinStake()) {
+            stats.nStakeAmount += tx_total_in;
+            stats.nStakeReward += tx_total_out - tx_total_in;
+            continue;
+        }
+
+        // Fees are destroyed rather than collected by the block's creator,
+        // so they are only counted here, over the ordinary transactions.
+        stats.nTotalOut += tx_total_out;
+        const CAmount txfee = tx_total_in - tx_total_out;
+        const CAmount feerate = weight ? (txfee * WITNESS_SCALE_FACTOR) / weight : 0;
+
+        fee_array.push_back(txfee);
+        feerate_array.push_back(feerate);
+        txsize_array.push_back(tx_size);
+        fee_tx_weight += weight;
+
+        stats.nTotalFee += txfee;
+        stats.nMinFee = std::min(stats.nMinFee, txfee);
+        stats.nMaxFee = std::max(stats.nMaxFee, txfee);
+        stats.nMinFeeRate = std::min(stats.nMinFeeRate, feerate);
+        stats.nMaxFeeRate = std::max(stats.nMaxFeeRate, feerate);
+        stats.nMinTxSize = std::min(stats.nMinTxSize, tx_size);
+        stats.nMaxTxSize = std::max(stats.nMaxTxSize, tx_size);
+    }
+
+    const int64_t num_fee_txs = fee_array.size();
+    if (num_fee_txs == 0) {
+        stats.nMinFee = stats.nMinFeeRate = stats.nMinTxSize = 0;
+    } else {
+        stats.nAvgFee = stats.nTotalFee / num_fee_txs;
+        stats.nAvgTxSize = std::accumulate(txsize_array.begin(), txsize_array.end(), int64_t(0)) / num_fee_txs;
+    }
+    stats.nAvgFeeRate = fee_tx_weight ? (stats.nTotalFee * WITNESS_SCALE_FACTOR) / fee_tx_weight : 0;
+    stats.nMedianFee = CalculateTruncatedMedian(fee_array);
+    stats.nMedianFeeRate = CalculateTruncatedMedian(feerate_array);
+    stats.nMedianTxSize = CalculateTruncatedMedian(txsize_array);
+    stats.nCoinAgeDestroyed = (bnCentSecond * CENT / COIN / (24 * 60 * 60)).GetLow64();
+
+    return true;
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DONU_BLOCKSTATS_H
+#define DONU_BLOCKSTATS_H
+
+#include <amount.h>
+#include <serialize.h>
+
+#include <stdint.h>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+
+/**
+ * Statistics over the transactions of a block. They are computed from the
+ * block and its undo data, so no previous output has to be looked up.
+ *
+ * Fee, fee rate and transaction size statistics leave out the coinbase and
+ * the coinstake; fee rates are in satoshis per virtual byte. Coin age is
+ * measured in coin-days, as in GetCoinAge.
+ */
+struct CBlockStats
+{
+    int64_t nTxs;
+    int64_t nInputs;
+    int64_t nOutputs;
+    int64_t nTotalSize;
+    int64_t nTotalWeight;
+    int64_t nSegwitTxs;
+    int64_t nSegwitTotalSize;
+    int64_t nSegwitTotalWeight;
+    CAmount nTotalOut;
+    CAmount nTotalFee;
+    CAmount nMinFee;
+    CAmount nMaxFee;
+    CAmount nAvgFee;
+    CAmount nMedianFee;
+    CAmount nMinFeeRate;
+    CAmount nMaxFeeRate;
+    CAmount nAvgFeeRate;
+    CAmount nMedianFeeRate;
+    int64_t nMinTxSize;
+    int64_t nMaxTxSize;
+    int64_t nAvgTxSize;
+    int64_t nMedianTxSize;
+    //! Change in the number and the serialized size of unspent outputs.
+    int64_t nUTXOIncrease;
+    int64_t nUTXOSizeIncrease;
+    //! Value of the outputs spent by the coinstake, and what it gained.
+    CAmount nStakeAmount;
+    CAmount nStakeReward;
+    //! Coin age of all the outputs spent by the block.
+    uint64_t nCoinAgeDestroyed;
+
+    CBlockStats() { SetNull(); }
+
+    void SetNull();
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nTxs);
+        READWRITE(nInputs);
+        READWRITE(nOutputs);
+        READWRITE(nTotalSize);
+        READWRITE(nTotalWeight);
+        READWRITE(nSegwitTxs);
+        READWRITE(nSegwitTotalSize);
+        READWRITE(nSegwitTotalWeight);
+        READWRITE(nTotalOut);
+        READWRITE(nTotalFee);
+        READWRITE(nMinFee);
+        READWRITE(nMaxFee);
+        READWRITE(nAvgFee);
+        READWRITE(nMedianFee);
+        READWRITE(nMinFeeRate);
+        READWRITE(nMaxFeeRate);
+        READWRITE(nAvgFeeRate);
+        READWRITE(nMedianFeeRate);
+        READWRITE(nMinTxSize);
+        READWRITE(nMaxTxSize);
+        READWRITE(nAvgTxSize);
+        READWRITE(nMedianTxSize);
+        READWRITE(nUTXOIncrease);
+        READWRITE(nUTXOSizeIncrease);
+        READWRITE(nStakeAmount);
+        READWRITE(nStakeReward);
+        READWRITE(nCoinAgeDestroyed);
+    }
+};
+
+/** Compute the statistics of a block, whose index entry is pindex. Fails if
+ *  the undo data does not match the block. */
+bool ComputeBlockStats(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo, CBlockStats& stats);
+
+#endif // DONU_BLOCKSTATS_H
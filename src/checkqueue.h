@@ -8,6 +8,9 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -16,21 +19,40 @@
 template <typename T>
 class CCheckQueueControl;
 
-/** 
+/** Size assumed for cache lines when keeping shared counters apart */
+static const size_t CHECKQUEUE_CACHE_LINE = 64;
+
+/** Number of work deques; workers beyond this share them */
+static const unsigned int CHECKQUEUE_MAX_SLOTS = 64;
+
+/**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
   * operator(), returning a bool.
   *
   * One thread (the master) is assumed to push batches of verifications
   * onto the queue, where they are processed by N-1 worker threads. When
-  * the master is done adding work, it temporarily joins the worker pool
-  * as an N'th worker, until all jobs are done.
+  * the master is done adding work, it joins the worker pool as an N'th
+  * worker until all jobs are done; while adding, it also runs checks itself
+  * whenever the workers are all busy and have a backlog.
+  *
+  * Every worker owns a deque of checks. The master hands each batch to the
+  * next worker's deque in turn, a worker takes work from the back of its
+  * own deque, and when that is empty it steals from the front of the others.
+  * Each deque has its own lock, so workers rarely contend; the shared mutex
+  * is only used to put idle threads to sleep and wake them.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! The work owned by one worker, on cache lines of its own
+    struct alignas(CHECKQUEUE_CACHE_LINE) Slot {
+        std::mutex mutex;
+        std::deque<T> checks;
+    };
+
+    //! Mutex used to sleep and wake idle threads, and to register workers
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,87 +61,137 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! Slot 0 belongs to the master, the others to the workers.
+    Slot slots[CHECKQUEUE_MAX_SLOTS];
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of slots handed out (at least the master's)
+    std::atomic<unsigned int> nSlots;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of worker threads that are idle.
+    alignas(CHECKQUEUE_CACHE_LINE) std::atomic<int> nIdle;
 
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! The number of checks sitting in the deques
+    alignas(CHECKQUEUE_CACHE_LINE) std::atomic<unsigned int> nQueued;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    alignas(CHECKQUEUE_CACHE_LINE) std::atomic<unsigned int> nTodo;
+
+    //! The temporary evaluation result.
+    alignas(CHECKQUEUE_CACHE_LINE) std::atomic<bool> fAllOk;
+
+    //! The number of worker threads that ever registered
+    unsigned int nWorkers;
+
+    //! The slot the next batch goes to (only used by the master)
+    unsigned int nNextSlot;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    /** Move up to nBatchSize checks out of slot nSlot into vChecks, taking
+     *  newest first from the own slot and oldest first when stealing. */
+    bool Take(unsigned int nSlot, bool fOwn, std::vector<T>& vChecks)
+    {
+        Slot& slot = slots[nSlot];
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        const size_t nSize = slot.checks.size();
+        if (nSize == 0) return false;
+        // Leave about half for the other workers to steal, but never do
+        // batches smaller than 1 or larger than nBatchSize.
+        const size_t nNow = std::max<size_t>(1, std::min<size_t>(nBatchSize, nSize / 2));
+        vChecks.resize(nNow);
+        for (size_t i = 0; i < nNow; i++) {
+            // Swap rather than copy, to keep the critical section short
+            if (fOwn) {
+                vChecks[i].swap(slot.checks.back());
+                slot.checks.pop_back();
+            } else {
+                vChecks[i].swap(slot.checks.front());
+                slot.checks.pop_front();
+            }
+        }
+        nQueued -= nNow;
+        return true;
+    }
+
+    /** Find a batch of work: from the own slot first, then from the others. */
+    bool Grab(unsigned int nOwn, std::vector<T>& vChecks)
+    {
+        if (Take(nOwn, true, vChecks)) return true;
+        const unsigned int nSlotsNow = nSlots;
+        for (unsigned int i = 1; i < nSlotsNow; i++) {
+            if (Take((nOwn + i) % nSlotsNow, false, vChecks)) return true;
+        }
+        return false;
+    }
+
+    /** Run (or after a failure, just discard) a batch of checks. They are
+     *  destroyed before being counted as done, so no check outlives Wait(). */
+    void Run(std::vector<T>& vChecks, bool fMaster)
+    {
+        bool fOk = fAllOk;
+        for (T& check : vChecks) {
+            if (fOk)
+                fOk = check();
+        }
+        if (!fOk) fAllOk = false;
+        const unsigned int nNow = vChecks.size();
+        vChecks.clear();
+        if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+            // We processed the last element; inform the master it can exit and return the result
+            boost::unique_lock<boost::mutex> lock(mutex);
+            condMaster.notify_one();
+        }
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        unsigned int nOwn = 0;
+        if (!fMaster) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nOwn = 1 + nWorkers++ % (CHECKQUEUE_MAX_SLOTS - 1);
+            if (nSlots <= nOwn) nSlots = nOwn + 1;
+        }
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
+            if (Grab(nOwn, vChecks)) {
+                Run(vChecks, fMaster);
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                // Nothing left to take: wait for the batches still running
+                while (nTodo != 0 && nQueued == 0) {
+                    condMaster.wait(lock);
                 }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
+                if (nTodo == 0) {
+                    bool fRet = fAllOk;
+                    // reset the status for new work later
+                    fAllOk = true;
+                    // return the current status
+                    return fRet;
+                }
+            } else {
+                // Add checks nIdle after publishing work, so announce being
+                // idle before the final look at nQueued.
+                nIdle++;
+                try {
+                    while (nQueued == 0) {
+                        condWorker.wait(lock); // wait
                     }
-                    nIdle++;
-                    cond.wait(lock); // wait
+                } catch (...) {
+                    // interrupted
                     nIdle--;
+                    throw;
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                nIdle--;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
         } while (true);
     }
 
@@ -128,7 +200,7 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nSlots(1), nIdle(0), nQueued(0), nTodo(0), fAllOk(true), nWorkers(0), nNextSlot(0), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
@@ -145,16 +217,46 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty()) return;
+        const unsigned int nSlotsNow = nSlots;
+        const unsigned int nWorkerSlots = nSlotsNow - 1;
+        // Count the work before it becomes visible, so a worker can never
+        // finish it first and see nTodo reach zero early.
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        nQueued += vChecks.size();
+
+        // Spread the batch over the worker deques, continuing round-robin
+        // from where the previous batch ended.
+        const size_t nPer = nWorkerSlots ? std::max<size_t>(1, (vChecks.size() + nWorkerSlots - 1) / nWorkerSlots) : vChecks.size();
+        size_t nPos = 0;
+        while (nPos < vChecks.size()) {
+            unsigned int nSlot = 0;
+            if (nWorkerSlots) {
+                nSlot = 1 + nNextSlot++ % nWorkerSlots;
+            }
+            const size_t nEnd = std::min(vChecks.size(), nPos + nPer);
+            Slot& slot = slots[nSlot];
+            std::lock_guard<std::mutex> lock(slot.mutex);
+            for (; nPos < nEnd; nPos++) {
+                slot.checks.emplace_back();
+                vChecks[nPos].swap(slot.checks.back());
+            }
+        }
+
+        if (nIdle > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        } else if (nQueued > nBatchSize * std::max(1u, nWorkerSlots)) {
+            // Every worker is busy and there is a backlog: help instead of
+            // only adding to it.
+            std::vector<T> vRun;
+            if (Grab(0, vRun)) {
+                Run(vRun, true);
+            }
+        }
     }
 
     ~CCheckQueue()
@@ -163,7 +265,7 @@ public:
 
 };
 
-/** 
+/**
  * RAII-style controller object for a CCheckQueue that guarantees the passed
  * queue is finished before continuing.
  */
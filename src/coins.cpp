@@ -6,6 +6,8 @@
 
 #include <consensus/consensus.h>
 #include <random.h>
+#include <streams.h>
+#include <version.h>
 
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
@@ -257,3 +259,42 @@ const Coin& AccessByTxid(const CCoinsViewCache& view, const uint256& txid)
     }
     return coinEmpty;
 }
+
+static void SerializeUTXOCommitmentElement(const COutPoint& outpoint, const Coin& coin, CDataStream& ss)
+{
+    ss << outpoint;
+    ss << coin;
+}
+
+static uint64_t GetBogoSize(const CScript& scriptPubKey)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+           2 /* scriptPubKey len */ + scriptPubKey.size() /* scriptPubKey */;
+}
+
+void CUTXOCommitment::AddCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    SerializeUTXOCommitmentElement(outpoint, coin, ss);
+    muhash.Insert((const unsigned char*)ss.data(), ss.size());
+    nTransactionOutputs++;
+    nBogoSize += GetBogoSize(coin.out.scriptPubKey);
+    nTotalAmount += coin.out.nValue;
+}
+
+void CUTXOCommitment::RemoveCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    SerializeUTXOCommitmentElement(outpoint, coin, ss);
+    muhash.Remove((const unsigned char*)ss.data(), ss.size());
+    nTransactionOutputs--;
+    nBogoSize -= GetBogoSize(coin.out.scriptPubKey);
+    nTotalAmount -= coin.out.nValue;
+}
+
+uint256 CUTXOCommitment::GetHash() const
+{
+    uint256 hash;
+    muhash.Finalize(hash);
+    return hash;
+}
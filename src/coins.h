@@ -9,6 +9,7 @@
 #include <primitives/transaction.h>
 #include <compressor.h>
 #include <core_memusage.h>
+#include <crypto/muhash.h>
 #include <hash.h>
 #include <memusage.h>
 #include <serialize.h>
@@ -336,4 +337,37 @@ void AddCoins(CCoinsViewCache& cache, const CTransaction& tx, int nHeight, bool
 // lookups to database, so it should be used with care.
 const Coin& AccessByTxid(const CCoinsViewCache& cache, const uint256& txid);
 
+/**
+ * Running statistics of a UTXO set: a MuHash3072 over all of its coins plus
+ * the totals reported by gettxoutsetinfo. Coins can be added and removed in
+ * any order, so the statistics can follow the set block by block instead of
+ * being recomputed from a full scan.
+ */
+class CUTXOCommitment
+{
+public:
+    MuHash3072 muhash;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    CAmount nTotalAmount;
+
+    CUTXOCommitment() : nTransactionOutputs(0), nBogoSize(0), nTotalAmount(0) {}
+
+    void AddCoin(const COutPoint& outpoint, const Coin& coin);
+    void RemoveCoin(const COutPoint& outpoint, const Coin& coin);
+
+    //! Hash of the set; costs a modular inversion, so callers should not hold locks.
+    uint256 GetHash() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(muhash);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nBogoSize);
+        READWRITE(nTotalAmount);
+    }
+};
+
 #endif // BITCOIN_COINS_H
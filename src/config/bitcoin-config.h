@@ -47,9 +47,21 @@
 /* Donu build revision */
 #define DONU_VERSION_REVISION 3
 
+/* Define this symbol to build code that uses AES-NI intrinsics */
+/* #undef ENABLE_AESNI */
+
+/* Define this symbol to build code that uses AVX2 intrinsics */
+/* #undef ENABLE_AVX2 */
+
 /* Define to 1 to enable sync checkpoints */
 #define ENABLE_CHECKPOINTS 1
 
+/* Define this symbol to build code that uses SHA-NI intrinsics */
+/* #undef ENABLE_SHANI */
+
+/* Define this symbol to build code that uses SSE4.1 intrinsics */
+/* #undef ENABLE_SSE41 */
+
 /* Define to 1 to enable wallet functions */
 #define ENABLE_WALLET 1
 
@@ -8,10 +8,30 @@
 #include <assert.h>
 #include <string.h>
 
+#if defined(ENABLE_AESNI) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+#ifdef ENABLE_AESNI
+namespace aes256_ni
+{
+void InitEncrypt(unsigned char* rks, const unsigned char* key);
+void InitDecrypt(unsigned char* rks, const unsigned char* key);
+void Encrypt(const unsigned char* rks, size_t blocks, unsigned char* out, const unsigned char* in);
+void Decrypt(const unsigned char* rks, size_t blocks, unsigned char* out, const unsigned char* in);
+}
+#endif
+
 extern "C" {
 #include <crypto/ctaes/ctaes.c>
 }
 
+namespace
+{
+/** Whether AES-256 uses the AES-NI backend. Only set by AESAutoDetect. */
+bool fUseAESNI = false;
+} // namespace
+
 AES128Encrypt::AES128Encrypt(const unsigned char key[16])
 {
     AES128_init(&ctx, key);
@@ -42,34 +62,70 @@ void AES128Decrypt::Decrypt(unsigned char plaintext[16], const unsigned char cip
     AES128_decrypt(&ctx, 1, plaintext, ciphertext);
 }
 
-AES256Encrypt::AES256Encrypt(const unsigned char key[32])
+void AES128Decrypt::Decrypt(unsigned char* plaintext, const unsigned char* ciphertext, size_t blocks) const
+{
+    AES128_decrypt(&ctx, blocks, plaintext, ciphertext);
+}
+
+AES256Encrypt::AES256Encrypt(const unsigned char key[32]) : fHardware(fUseAESNI)
 {
+#ifdef ENABLE_AESNI
+    if (fHardware) {
+        aes256_ni::InitEncrypt(rk, key);
+        return;
+    }
+#endif
     AES256_init(&ctx, key);
 }
 
 AES256Encrypt::~AES256Encrypt()
 {
     memset(&ctx, 0, sizeof(ctx));
+    memset(rk, 0, sizeof(rk));
 }
 
 void AES256Encrypt::Encrypt(unsigned char ciphertext[16], const unsigned char plaintext[16]) const
 {
+#ifdef ENABLE_AESNI
+    if (fHardware) {
+        aes256_ni::Encrypt(rk, 1, ciphertext, plaintext);
+        return;
+    }
+#endif
     AES256_encrypt(&ctx, 1, ciphertext, plaintext);
 }
 
-AES256Decrypt::AES256Decrypt(const unsigned char key[32])
+AES256Decrypt::AES256Decrypt(const unsigned char key[32]) : fHardware(fUseAESNI)
 {
+#ifdef ENABLE_AESNI
+    if (fHardware) {
+        aes256_ni::InitDecrypt(rk, key);
+        return;
+    }
+#endif
     AES256_init(&ctx, key);
 }
 
 AES256Decrypt::~AES256Decrypt()
 {
     memset(&ctx, 0, sizeof(ctx));
+    memset(rk, 0, sizeof(rk));
 }
 
 void AES256Decrypt::Decrypt(unsigned char plaintext[16], const unsigned char ciphertext[16]) const
 {
-    AES256_decrypt(&ctx, 1, plaintext, ciphertext);
+    Decrypt(plaintext, ciphertext, 1);
+}
+
+void AES256Decrypt::Decrypt(unsigned char* plaintext, const unsigned char* ciphertext, size_t blocks) const
+{
+#ifdef ENABLE_AESNI
+    if (fHardware) {
+        aes256_ni::Decrypt(rk, blocks, plaintext, ciphertext);
+        return;
+    }
+#endif
+    AES256_decrypt(&ctx, blocks, plaintext, ciphertext);
 }
 
 
@@ -122,9 +178,10 @@ static int CBCDecrypt(const T& dec, const unsigned char iv[AES_BLOCKSIZE], const
     if (size % AES_BLOCKSIZE != 0)
         return 0;
 
-    // Decrypt all data. Padding will be checked in the output.
+    // Decrypt all blocks at once, as they do not depend on each other, then
+    // undo the chaining. Padding will be checked in the output.
+    dec.Decrypt(out, data, size / AES_BLOCKSIZE);
     while (written != size) {
-        dec.Decrypt(out, data + written);
         for (int i = 0; i != AES_BLOCKSIZE; i++)
             *out++ ^= prev[i];
         prev = data + written;
@@ -172,12 +229,22 @@ AES256CBCDecrypt::AES256CBCDecrypt(const unsigned char key[AES256_KEYSIZE], cons
     memcpy(iv, ivIn, AES_BLOCKSIZE);
 }
 
+AES256CBCDecrypt::AES256CBCDecrypt(const unsigned char key[AES256_KEYSIZE], bool padIn)
+    : dec(key), pad(padIn)
+{
+    memset(iv, 0, sizeof(iv));
+}
 
 int AES256CBCDecrypt::Decrypt(const unsigned char* data, int size, unsigned char* out) const
 {
     return CBCDecrypt(dec, iv, data, size, pad, out);
 }
 
+int AES256CBCDecrypt::Decrypt(const unsigned char ivIn[AES_BLOCKSIZE], const unsigned char* data, int size, unsigned char* out) const
+{
+    return CBCDecrypt(dec, ivIn, data, size, pad, out);
+}
+
 AES256CBCDecrypt::~AES256CBCDecrypt()
 {
     memset(iv, 0, sizeof(iv));
@@ -214,3 +281,50 @@ int AES128CBCDecrypt::Decrypt(const unsigned char* data, int size, unsigned char
 {
     return CBCDecrypt(dec, iv, data, size, pad, out);
 }
+
+namespace
+{
+/** Check the active implementation against the AES-256 example of FIPS-197
+ *  (appendix C.3), and multi-block decryption against ctaes. */
+bool SelfTest()
+{
+    static const unsigned char key[32] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f};
+    static const unsigned char plain[16] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+    static const unsigned char cipher[16] = {0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf, 0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89};
+
+    unsigned char buf[16];
+    AES256Encrypt enc(key);
+    enc.Encrypt(buf, plain);
+    if (memcmp(buf, cipher, 16)) return false;
+    AES256Decrypt dec(key);
+    dec.Decrypt(buf, cipher);
+    if (memcmp(buf, plain, 16)) return false;
+
+    // Enough blocks to go through both the interleaved and the single block
+    // paths of the hardware backend.
+    unsigned char in[16 * 7], out[16 * 7], ref[16 * 7];
+    for (size_t i = 0; i < sizeof(in); i++) {
+        in[i] = (unsigned char)(i * 7 + 3);
+    }
+    AES256_ctx ctx;
+    AES256_init(&ctx, key);
+    AES256_decrypt(&ctx, 7, ref, in);
+    dec.Decrypt(out, in, 7);
+    return memcmp(out, ref, sizeof(out)) == 0;
+}
+} // namespace
+
+std::string AESAutoDetect()
+{
+    std::string ret = "standard";
+#if defined(ENABLE_AESNI) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+    uint32_t eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && ((ecx >> 25) & 1)) {
+        fUseAESNI = true;
+        ret = "aes-ni";
+    }
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
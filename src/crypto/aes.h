@@ -7,6 +7,9 @@
 #ifndef BITCOIN_CRYPTO_AES_H
 #define BITCOIN_CRYPTO_AES_H
 
+#include <stddef.h>
+#include <string>
+
 extern "C" {
 #include <crypto/ctaes/ctaes.h>
 }
@@ -15,6 +18,11 @@ static const int AES_BLOCKSIZE = 16;
 static const int AES128_KEYSIZE = 16;
 static const int AES256_KEYSIZE = 32;
 
+/** Autodetect the best available AES implementation.
+ *  Returns the name of the implementation.
+ */
+std::string AESAutoDetect();
+
 /** An encryption class for AES-128. */
 class AES128Encrypt
 {
@@ -37,6 +45,7 @@ public:
     explicit AES128Decrypt(const unsigned char key[16]);
     ~AES128Decrypt();
     void Decrypt(unsigned char plaintext[16], const unsigned char ciphertext[16]) const;
+    void Decrypt(unsigned char* plaintext, const unsigned char* ciphertext, size_t blocks) const;
 };
 
 /** An encryption class for AES-256. */
@@ -44,6 +53,9 @@ class AES256Encrypt
 {
 private:
     AES256_ctx ctx;
+    //! Round keys for the AES-NI backend, used instead of ctx when available
+    unsigned char rk[15 * 16];
+    bool fHardware;
 
 public:
     explicit AES256Encrypt(const unsigned char key[32]);
@@ -56,11 +68,16 @@ class AES256Decrypt
 {
 private:
     AES256_ctx ctx;
+    //! Round keys for the AES-NI backend, used instead of ctx when available
+    unsigned char rk[15 * 16];
+    bool fHardware;
 
 public:
     explicit AES256Decrypt(const unsigned char key[32]);
     ~AES256Decrypt();
     void Decrypt(unsigned char plaintext[16], const unsigned char ciphertext[16]) const;
+    //! Decrypt independent blocks, which the hardware backend does in parallel
+    void Decrypt(unsigned char* plaintext, const unsigned char* ciphertext, size_t blocks) const;
 };
 
 class AES256CBCEncrypt
@@ -80,8 +97,12 @@ class AES256CBCDecrypt
 {
 public:
     AES256CBCDecrypt(const unsigned char key[AES256_KEYSIZE], const unsigned char ivIn[AES_BLOCKSIZE], bool padIn);
+    //! Without an IV, for decrypting many messages under one key with the overload below
+    AES256CBCDecrypt(const unsigned char key[AES256_KEYSIZE], bool padIn);
     ~AES256CBCDecrypt();
     int Decrypt(const unsigned char* data, int size, unsigned char* out) const;
+    //! Decrypt with the given IV instead of the one passed at construction
+    int Decrypt(const unsigned char ivIn[AES_BLOCKSIZE], const unsigned char* data, int size, unsigned char* out) const;
 
 private:
     const AES256Decrypt dec;
@@ -0,0 +1,136 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// AES-256 using the x86 AES instructions. The key schedule follows Intel's
+// AES-NI white paper; the round instructions do not use tables, so like
+// ctaes this runs in constant time. Round keys are stored as 15 16-byte
+// blocks, the decryption ones already passed through aesimc in reverse order.
+
+#ifdef ENABLE_AESNI
+
+#include <stddef.h>
+#include <immintrin.h>
+
+namespace {
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+/** Derive the next even round key from the previous even one (a) and the
+ *  output of aeskeygenassist on the odd one (b). */
+__m128i ALWAYS_INLINE ExpandEven(__m128i a, __m128i b)
+{
+    b = _mm_shuffle_epi32(b, 0xff);
+    a = _mm_xor_si128(a, _mm_slli_si128(a, 4));
+    a = _mm_xor_si128(a, _mm_slli_si128(a, 8));
+    return _mm_xor_si128(a, b);
+}
+
+/** Derive the next odd round key from the previous odd one (a) and the new
+ *  even one (c). */
+__m128i ALWAYS_INLINE ExpandOdd(__m128i a, __m128i c)
+{
+    const __m128i b = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(c, 0x00), 0xaa);
+    a = _mm_xor_si128(a, _mm_slli_si128(a, 4));
+    a = _mm_xor_si128(a, _mm_slli_si128(a, 8));
+    return _mm_xor_si128(a, b);
+}
+
+void ALWAYS_INLINE Store(unsigned char* out, __m128i x) { _mm_storeu_si128((__m128i*)out, x); }
+__m128i ALWAYS_INLINE Load(const unsigned char* in) { return _mm_loadu_si128((const __m128i*)in); }
+
+/** Expand a 32-byte key into the 15 encryption round keys. */
+void ExpandKey(__m128i rk[15], const unsigned char* key)
+{
+    rk[0] = Load(key);
+    rk[1] = Load(key + 16);
+    rk[2] = ExpandEven(rk[0], _mm_aeskeygenassist_si128(rk[1], 0x01));
+    rk[3] = ExpandOdd(rk[1], rk[2]);
+    rk[4] = ExpandEven(rk[2], _mm_aeskeygenassist_si128(rk[3], 0x02));
+    rk[5] = ExpandOdd(rk[3], rk[4]);
+    rk[6] = ExpandEven(rk[4], _mm_aeskeygenassist_si128(rk[5], 0x04));
+    rk[7] = ExpandOdd(rk[5], rk[6]);
+    rk[8] = ExpandEven(rk[6], _mm_aeskeygenassist_si128(rk[7], 0x08));
+    rk[9] = ExpandOdd(rk[7], rk[8]);
+    rk[10] = ExpandEven(rk[8], _mm_aeskeygenassist_si128(rk[9], 0x10));
+    rk[11] = ExpandOdd(rk[9], rk[10]);
+    rk[12] = ExpandEven(rk[10], _mm_aeskeygenassist_si128(rk[11], 0x20));
+    rk[13] = ExpandOdd(rk[11], rk[12]);
+    rk[14] = ExpandEven(rk[12], _mm_aeskeygenassist_si128(rk[13], 0x40));
+}
+
+} // namespace
+
+namespace aes256_ni {
+void InitEncrypt(unsigned char* rks, const unsigned char* key)
+{
+    __m128i rk[15];
+    ExpandKey(rk, key);
+    for (int i = 0; i < 15; i++) {
+        Store(rks + 16 * i, rk[i]);
+    }
+}
+
+void InitDecrypt(unsigned char* rks, const unsigned char* key)
+{
+    __m128i rk[15];
+    ExpandKey(rk, key);
+    Store(rks, rk[14]);
+    for (int i = 1; i < 14; i++) {
+        Store(rks + 16 * i, _mm_aesimc_si128(rk[14 - i]));
+    }
+    Store(rks + 16 * 14, rk[0]);
+}
+
+void Encrypt(const unsigned char* rks, size_t blocks, unsigned char* out, const unsigned char* in)
+{
+    // CBC encryption is sequential, so there is nothing to interleave here.
+    while (blocks--) {
+        __m128i x = _mm_xor_si128(Load(in), Load(rks));
+        for (int r = 1; r < 14; r++) {
+            x = _mm_aesenc_si128(x, Load(rks + 16 * r));
+        }
+        Store(out, _mm_aesenclast_si128(x, Load(rks + 16 * 14)));
+        in += 16;
+        out += 16;
+    }
+}
+
+void Decrypt(const unsigned char* rks, size_t blocks, unsigned char* out, const unsigned char* in)
+{
+    // Keep four independent blocks in flight to hide the aesdec latency.
+    while (blocks >= 4) {
+        __m128i k = Load(rks);
+        __m128i x0 = _mm_xor_si128(Load(in), k);
+        __m128i x1 = _mm_xor_si128(Load(in + 16), k);
+        __m128i x2 = _mm_xor_si128(Load(in + 32), k);
+        __m128i x3 = _mm_xor_si128(Load(in + 48), k);
+        for (int r = 1; r < 14; r++) {
+            k = Load(rks + 16 * r);
+            x0 = _mm_aesdec_si128(x0, k);
+            x1 = _mm_aesdec_si128(x1, k);
+            x2 = _mm_aesdec_si128(x2, k);
+            x3 = _mm_aesdec_si128(x3, k);
+        }
+        k = Load(rks + 16 * 14);
+        Store(out, _mm_aesdeclast_si128(x0, k));
+        Store(out + 16, _mm_aesdeclast_si128(x1, k));
+        Store(out + 32, _mm_aesdeclast_si128(x2, k));
+        Store(out + 48, _mm_aesdeclast_si128(x3, k));
+        in += 64;
+        out += 64;
+        blocks -= 4;
+    }
+    while (blocks--) {
+        __m128i x = _mm_xor_si128(Load(in), Load(rks));
+        for (int r = 1; r < 14; r++) {
+            x = _mm_aesdec_si128(x, Load(rks + 16 * r));
+        }
+        Store(out, _mm_aesdeclast_si128(x, Load(rks + 16 * 14)));
+        in += 16;
+        out += 16;
+    }
+}
+} // namespace aes256_ni
+
+#endif
@@ -0,0 +1,196 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/muhash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+#include <uint256.h>
+
+#include <limits>
+
+namespace {
+
+/** 2^3072 - 1103717, the largest 3072-bit safe prime number, is used as the modulus. */
+constexpr uint32_t MAX_PRIME_DIFF = 1103717;
+
+/** Add a small value to a little-endian limb array; returns the carry out of the top limb. */
+uint32_t AddSmall(uint32_t* limbs, uint64_t x)
+{
+    for (int i = 0; i < Num3072::LIMBS && x; ++i) {
+        x += limbs[i];
+        limbs[i] = (uint32_t)x;
+        x >>= Num3072::LIMB_SIZE;
+    }
+    return (uint32_t)x;
+}
+
+} // namespace
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        limbs[i] = ReadLE32(data + 4 * i);
+    }
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i) {
+        limbs[i] = 0;
+    }
+}
+
+/** Indicates whether the value is at least the modulus. */
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= std::numeric_limits<uint32_t>::max() - MAX_PRIME_DIFF) return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != std::numeric_limits<uint32_t>::max()) return false;
+    }
+    return true;
+}
+
+/** Subtract the modulus once; only valid when IsOverflow(). */
+void Num3072::FullReduce()
+{
+    // x - p = x + MAX_PRIME_DIFF - 2^3072, so add and drop the carry.
+    AddSmall(limbs, MAX_PRIME_DIFF);
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // Schoolbook multiplication into a double-width product.
+    uint32_t tmp[2 * LIMBS] = {0};
+    for (int i = 0; i < LIMBS; ++i) {
+        uint64_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            uint64_t v = (uint64_t)limbs[i] * a.limbs[j] + tmp[i + j] + carry;
+            tmp[i + j] = (uint32_t)v;
+            carry = v >> LIMB_SIZE;
+        }
+        tmp[i + LIMBS] = (uint32_t)carry;
+    }
+
+    // 2^3072 is congruent to MAX_PRIME_DIFF, so fold the high half into the low half.
+    uint64_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        uint64_t v = (uint64_t)tmp[i + LIMBS] * MAX_PRIME_DIFF + tmp[i] + carry;
+        limbs[i] = (uint32_t)v;
+        carry = v >> LIMB_SIZE;
+    }
+    while (carry) {
+        carry = AddSmall(limbs, carry * MAX_PRIME_DIFF);
+    }
+
+    if (IsOverflow()) FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Fermat's little theorem: the inverse is this^(p-2), with
+    // p - 2 = 2^3072 - 1103719. The exponent is processed in 4-bit windows,
+    // most significant first.
+    uint32_t exp[LIMBS];
+    exp[0] = std::numeric_limits<uint32_t>::max() - (MAX_PRIME_DIFF + 1);
+    for (int i = 1; i < LIMBS; ++i) {
+        exp[i] = std::numeric_limits<uint32_t>::max();
+    }
+
+    Num3072 table[16];
+    for (int i = 1; i < 16; ++i) {
+        table[i] = table[i - 1];
+        table[i].Multiply(*this);
+    }
+
+    Num3072 out;
+    for (int i = LIMBS * LIMB_SIZE / 4 - 1; i >= 0; --i) {
+        for (int j = 0; j < 4; ++j) {
+            out.Multiply(out);
+        }
+        uint32_t window = (exp[i / 8] >> (4 * (i % 8))) & 0xf;
+        if (window) out.Multiply(table[window]);
+    }
+    return out;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    if (IsOverflow()) FullReduce();
+
+    Num3072 inv;
+    if (a.IsOverflow()) {
+        Num3072 b = a;
+        b.FullReduce();
+        inv = b.GetInverse();
+    } else {
+        inv = a.GetInverse();
+    }
+
+    Multiply(inv);
+    if (IsOverflow()) FullReduce();
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        WriteLE32(out + 4 * i, limbs[i]);
+    }
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char tmp[Num3072::BYTE_SIZE];
+
+    uint256 hashed_in;
+    CSHA256().Write(data, len).Finalize(hashed_in.begin());
+    ChaCha20(hashed_in.begin(), hashed_in.size()).Output(tmp, Num3072::BYTE_SIZE);
+    Num3072 out{tmp};
+
+    return out;
+}
+
+MuHash3072::MuHash3072(const unsigned char* data, size_t len)
+{
+    m_numerator = ToNum3072(data, len);
+}
+
+void MuHash3072::Finalize(uint256& out) const
+{
+    Num3072 result = m_numerator;
+    result.Divide(m_denominator);
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    result.ToBytes(data);
+
+    CSHA256().Write(data, sizeof(data)).Finalize(out.begin());
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    m_numerator.Multiply(mul.m_numerator);
+    m_denominator.Multiply(mul.m_denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    m_numerator.Multiply(div.m_denominator);
+    m_denominator.Multiply(div.m_numerator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    m_numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    m_denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
@@ -0,0 +1,101 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DONU_CRYPTO_MUHASH_H
+#define DONU_CRYPTO_MUHASH_H
+
+#include <serialize.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+class uint256;
+
+/** An element of the multiplicative group of integers modulo 2^3072 - 1103717. */
+class Num3072
+{
+private:
+    void FullReduce();
+    bool IsOverflow() const;
+    Num3072 GetInverse() const;
+
+public:
+    static constexpr size_t BYTE_SIZE = 384;
+    static constexpr int LIMBS = 96;
+    static constexpr int LIMB_SIZE = 32;
+    uint32_t limbs[LIMBS];
+
+    Num3072() { SetToOne(); }
+    Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    void SetToOne();
+    void Multiply(const Num3072& a);
+    void Divide(const Num3072& a);
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        for (int i = 0; i < LIMBS; i++)
+            READWRITE(limbs[i]);
+    }
+};
+
+/** A class representing MuHash sets
+ *
+ * MuHash is a hashing algorithm that supports adding set elements in any
+ * order but also deleting in any order. As a result, it can maintain a
+ * running sum for a set of data as a whole, and add/remove when data
+ * is added to or removed from it. A downside of MuHash is that computing
+ * an inverse is relatively expensive. This is solved by representing
+ * the running value as a fraction, and multiplying added elements into
+ * the numerator and removed elements into the denominator. Only when the
+ * final hash is desired, a single modular inverse and multiplication is
+ * needed to combine the two.
+ *
+ * Each element is hashed with SHA256 and expanded into a 3072-bit group
+ * element with the ChaCha20 keystream keyed by that hash. The final hash
+ * is the SHA256 of the 384-byte little-endian encoding of the result.
+ */
+class MuHash3072
+{
+private:
+    Num3072 m_numerator;
+    Num3072 m_denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    /* The empty set. */
+    MuHash3072() {}
+
+    /* A singleton with a variable sized data in it. */
+    MuHash3072(const unsigned char* data, size_t len);
+
+    /* Insert a single piece of data into the set. */
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+
+    /* Remove a single piece of data from the set. */
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    /* Multiply (resulting in a hash for the union of two sets) */
+    MuHash3072& operator*=(const MuHash3072& mul);
+
+    /* Divide (resulting in a hash for the difference of two sets) */
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    /* Finalize into a 32-byte hash. Does not change this object's value. */
+    void Finalize(uint256& out) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(m_numerator);
+        READWRITE(m_denominator);
+    }
+};
+
+#endif // DONU_CRYPTO_MUHASH_H
@@ -0,0 +1,163 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// Double SHA-256 of eight 64-byte inputs at once, one per lane of the AVX2
+// registers.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <crypto/common.h>
+
+namespace sha256d64_avx2 {
+namespace {
+
+__m256i inline K(uint32_t x) { return _mm256_set1_epi32(x); }
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z) { return Add(Add(x, y), z); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z, __m256i w) { return Add(Add(x, y), Add(z, w)); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+__m256i inline Or(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+__m256i inline And(__m256i x, __m256i y) { return _mm256_and_si256(x, y); }
+__m256i inline ShR(__m256i x, int n) { return _mm256_srli_epi32(x, n); }
+__m256i inline ShL(__m256i x, int n) { return _mm256_slli_epi32(x, n); }
+
+__m256i inline Ch(__m256i x, __m256i y, __m256i z) { return Xor(z, And(x, Xor(y, z))); }
+__m256i inline Maj(__m256i x, __m256i y, __m256i z) { return Or(And(x, y), And(z, Or(x, y))); }
+__m256i inline Sigma0(__m256i x) { return Xor(Or(ShR(x, 2), ShL(x, 30)), Or(ShR(x, 13), ShL(x, 19)), Or(ShR(x, 22), ShL(x, 10))); }
+__m256i inline Sigma1(__m256i x) { return Xor(Or(ShR(x, 6), ShL(x, 26)), Or(ShR(x, 11), ShL(x, 21)), Or(ShR(x, 25), ShL(x, 7))); }
+__m256i inline sigma0(__m256i x) { return Xor(Or(ShR(x, 7), ShL(x, 25)), Or(ShR(x, 18), ShL(x, 14)), ShR(x, 3)); }
+__m256i inline sigma1(__m256i x) { return Xor(Or(ShR(x, 17), ShL(x, 15)), Or(ShR(x, 19), ShL(x, 13)), ShR(x, 10)); }
+
+/** SHA-256 round constants */
+const uint32_t ROUND_K[64] = {
+    0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul,
+    0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul, 0x2de92c6ful, 0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul,
+    0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul, 0xc6e00bf3ul, 0xd5a79147ul, 0x06ca6351ul, 0x14292967ul,
+    0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul, 0x650a7354ul, 0x766a0abbul, 0x81c2c92eul, 0x92722c85ul,
+    0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul, 0xd192e819ul, 0xd6990624ul, 0xf40e3585ul, 0x106aa070ul,
+    0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul, 0x391c0cb3ul, 0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul,
+    0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul, 0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul,
+};
+
+/** Round constants plus the message schedule of the block that pads a
+ *  64-byte message, which is the same for every input */
+const uint32_t ROUND_KPAD[64] = {
+    0xc28a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf374ul,
+    0x649b69c1ul, 0xf0fe4786ul, 0x0fe1edc6ul, 0x240cf254ul, 0x4fe9346ful, 0x6cc984beul, 0x61b9411eul, 0x16f988faul,
+    0xf2c65152ul, 0xa88e5a6dul, 0xb019fc65ul, 0xb9d99ec7ul, 0x9a1231c3ul, 0xe70eeaa0ul, 0xfdb1232bul, 0xc7353eb0ul,
+    0x3069bad5ul, 0xcb976d5ful, 0x5a0f118ful, 0xdc1eeefdul, 0x0a35b689ul, 0xde0b7a04ul, 0x58f4ca9dul, 0xe15d5b16ul,
+    0x007f3e86ul, 0x37088980ul, 0xa507ea32ul, 0x6fab9537ul, 0x17406110ul, 0x0d8cd6f1ul, 0xcdaa3b6dul, 0xc0bbbe37ul,
+    0x83613bdaul, 0xdb48a363ul, 0x0b02e931ul, 0x6fd15ca7ul, 0x521afacaul, 0x31338431ul, 0x6ed41a95ul, 0x6d437890ul,
+    0xc39c91f2ul, 0x9eccabbdul, 0xb5c9a0e6ul, 0x532fb63cul, 0xd2c741c6ul, 0x07237ea3ul, 0xa4954b68ul, 0x4c191d76ul,
+};
+
+const uint32_t INIT[8] = {0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul};
+
+/** One round of SHA-256. */
+void inline __attribute__((always_inline)) Round(__m256i a, __m256i b, __m256i c, __m256i& d, __m256i e, __m256i f, __m256i g, __m256i& h, __m256i k)
+{
+    __m256i t1 = Add(h, Sigma1(e), Ch(e, f, g), k);
+    __m256i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Round constant plus message word i, expanding the message schedule in
+ *  place. Without a message, kw already includes the schedule. */
+__m256i inline __attribute__((always_inline)) Word(__m256i* w, const uint32_t* kw, int i)
+{
+    if (!w) return K(kw[i]);
+    if (i >= 16) {
+        w[i & 15] = Add(w[i & 15], sigma1(w[(i + 14) & 15]), w[(i + 9) & 15], sigma0(w[(i + 1) & 15]));
+    }
+    return Add(K(kw[i]), w[i & 15]);
+}
+
+/** Run the 64 rounds of one block on eight states at once. */
+void inline __attribute__((always_inline)) Transform(__m256i* s, __m256i* w, const uint32_t* kw)
+{
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i += 8) {
+        Round(a, b, c, d, e, f, g, h, Word(w, kw, i));
+        Round(h, a, b, c, d, e, f, g, Word(w, kw, i + 1));
+        Round(g, h, a, b, c, d, e, f, Word(w, kw, i + 2));
+        Round(f, g, h, a, b, c, d, e, Word(w, kw, i + 3));
+        Round(e, f, g, h, a, b, c, d, Word(w, kw, i + 4));
+        Round(d, e, f, g, h, a, b, c, Word(w, kw, i + 5));
+        Round(c, d, e, f, g, h, a, b, Word(w, kw, i + 6));
+        Round(b, c, d, e, f, g, h, a, Word(w, kw, i + 7));
+    }
+    s[0] = Add(s[0], a);
+    s[1] = Add(s[1], b);
+    s[2] = Add(s[2], c);
+    s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e);
+    s[5] = Add(s[5], f);
+    s[6] = Add(s[6], g);
+    s[7] = Add(s[7], h);
+}
+
+/** Load the same big-endian word of each of the eight 64-byte inputs. */
+__m256i inline Read8(const unsigned char* in, int offset)
+{
+    return _mm256_set_epi32(
+        ReadBE32(in + 448 + offset),
+        ReadBE32(in + 384 + offset),
+        ReadBE32(in + 320 + offset),
+        ReadBE32(in + 256 + offset),
+        ReadBE32(in + 192 + offset),
+        ReadBE32(in + 128 + offset),
+        ReadBE32(in + 64 + offset),
+        ReadBE32(in + 0 + offset)
+    );
+}
+
+/** Store the lanes of v as the same big-endian word of eight 32-byte outputs. */
+void inline Write8(unsigned char* out, int offset, __m256i v)
+{
+    WriteBE32(out + 0 + offset, _mm256_extract_epi32(v, 0));
+    WriteBE32(out + 32 + offset, _mm256_extract_epi32(v, 1));
+    WriteBE32(out + 64 + offset, _mm256_extract_epi32(v, 2));
+    WriteBE32(out + 96 + offset, _mm256_extract_epi32(v, 3));
+    WriteBE32(out + 128 + offset, _mm256_extract_epi32(v, 4));
+    WriteBE32(out + 160 + offset, _mm256_extract_epi32(v, 5));
+    WriteBE32(out + 192 + offset, _mm256_extract_epi32(v, 6));
+    WriteBE32(out + 224 + offset, _mm256_extract_epi32(v, 7));
+}
+
+} // namespace
+
+void Transform_8way(unsigned char* out, const unsigned char* in)
+{
+    __m256i s[8], w[16];
+
+    // Transform 1: the 64-byte inputs
+    for (int i = 0; i < 8; ++i) s[i] = K(INIT[i]);
+    for (int i = 0; i < 16; ++i) w[i] = Read8(in, 4 * i);
+    Transform(s, w, ROUND_K);
+
+    // Transform 2: their padding, whose schedule is precomputed
+    Transform(s, nullptr, ROUND_KPAD);
+
+    // Transform 3: the padded 32-byte hashes
+    for (int i = 0; i < 8; ++i) w[i] = s[i];
+    w[8] = K(0x80000000ul);
+    for (int i = 9; i < 15; ++i) w[i] = K(0);
+    w[15] = K(0x100ul);
+    for (int i = 0; i < 8; ++i) s[i] = K(INIT[i]);
+    Transform(s, w, ROUND_K);
+
+    for (int i = 0; i < 8; ++i) Write8(out, 4 * i, s[i]);
+}
+
+} // namespace sha256d64_avx2
+
+#endif
@@ -0,0 +1,383 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// SHA-256 using the x86 SHA extensions, following the structure of Intel's
+// reference code: each sha256rnds2 performs two rounds on a state split into
+// ABEF and CDGH halves, and sha256msg1/sha256msg2 expand the schedule.
+
+#ifdef ENABLE_SHANI
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <crypto/common.h>
+
+namespace {
+
+/** SHA-256 round constants */
+alignas(16) const uint32_t ROUND_K[64] = {
+    0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul,
+    0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul, 0x2de92c6ful, 0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul,
+    0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul, 0xc6e00bf3ul, 0xd5a79147ul, 0x06ca6351ul, 0x14292967ul,
+    0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul, 0x650a7354ul, 0x766a0abbul, 0x81c2c92eul, 0x92722c85ul,
+    0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul, 0xd192e819ul, 0xd6990624ul, 0xf40e3585ul, 0x106aa070ul,
+    0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul, 0x391c0cb3ul, 0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul,
+    0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul, 0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul,
+};
+
+/** Round constants plus the message schedule of the block that pads a
+ *  64-byte message, which is the same for every input */
+alignas(16) const uint32_t ROUND_KPAD[64] = {
+    0xc28a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf374ul,
+    0x649b69c1ul, 0xf0fe4786ul, 0x0fe1edc6ul, 0x240cf254ul, 0x4fe9346ful, 0x6cc984beul, 0x61b9411eul, 0x16f988faul,
+    0xf2c65152ul, 0xa88e5a6dul, 0xb019fc65ul, 0xb9d99ec7ul, 0x9a1231c3ul, 0xe70eeaa0ul, 0xfdb1232bul, 0xc7353eb0ul,
+    0x3069bad5ul, 0xcb976d5ful, 0x5a0f118ful, 0xdc1eeefdul, 0x0a35b689ul, 0xde0b7a04ul, 0x58f4ca9dul, 0xe15d5b16ul,
+    0x007f3e86ul, 0x37088980ul, 0xa507ea32ul, 0x6fab9537ul, 0x17406110ul, 0x0d8cd6f1ul, 0xcdaa3b6dul, 0xc0bbbe37ul,
+    0x83613bdaul, 0xdb48a363ul, 0x0b02e931ul, 0x6fd15ca7ul, 0x521afacaul, 0x31338431ul, 0x6ed41a95ul, 0x6d437890ul,
+    0xc39c91f2ul, 0x9eccabbdul, 0xb5c9a0e6ul, 0x532fb63cul, 0xd2c741c6ul, 0x07237ea3ul, 0xa4954b68ul, 0x4c191d76ul,
+};
+
+/** Byte swap of every 32-bit word */
+const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+/** The initial state, in ABEF and CDGH order */
+const __m128i INIT0 = _mm_set_epi64x(0x6a09e667bb67ae85ull, 0x510e527f9b05688cull);
+const __m128i INIT1 = _mm_set_epi64x(0x3c6ef372a54ff53aull, 0x1f83d9ab5be0cd19ull);
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+/** Four rounds on message words m (already big-endian decoded) with their constants at k. */
+void ALWAYS_INLINE QuadRound(__m128i& state0, __m128i& state1, __m128i m, const uint32_t* k)
+{
+    const __m128i msg = _mm_add_epi32(m, _mm_load_si128((const __m128i*)k));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+/** Four rounds whose message schedule is already included in kw. */
+void ALWAYS_INLINE QuadRound(__m128i& state0, __m128i& state1, const uint32_t* kw)
+{
+    const __m128i msg = _mm_load_si128((const __m128i*)kw);
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+void ALWAYS_INLINE ShiftMessageA(__m128i& m0, __m128i m1)
+{
+    m0 = _mm_sha256msg1_epu32(m0, m1);
+}
+
+void ALWAYS_INLINE ShiftMessageC(__m128i& m0, __m128i m1, __m128i& m2)
+{
+    m2 = _mm_sha256msg2_epu32(_mm_add_epi32(m2, _mm_alignr_epi8(m1, m0, 4)), m1);
+}
+
+void ALWAYS_INLINE ShiftMessageB(__m128i& m0, __m128i m1, __m128i& m2)
+{
+    ShiftMessageC(m0, m1, m2);
+    ShiftMessageA(m0, m1);
+}
+
+/** Convert the state from ABCD/EFGH word order to ABEF/CDGH. */
+void ALWAYS_INLINE Shuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0xB1);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0x1B);
+    s0 = _mm_alignr_epi8(t1, t2, 0x08);
+    s1 = _mm_blend_epi16(t2, t1, 0xF0);
+}
+
+/** Convert the state from ABEF/CDGH back to ABCD/EFGH word order. */
+void ALWAYS_INLINE Unshuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0x1B);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0xB1);
+    s0 = _mm_blend_epi16(t1, t2, 0xF0);
+    s1 = _mm_alignr_epi8(t2, t1, 0x08);
+}
+
+__m128i ALWAYS_INLINE Load(const unsigned char* in)
+{
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), MASK);
+}
+
+void ALWAYS_INLINE Save(unsigned char* out, __m128i s)
+{
+    _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(s, MASK));
+}
+
+} // namespace
+
+namespace sha256_shani {
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i m0, m1, m2, m3, s0, s1, so0, so1;
+
+    s0 = _mm_loadu_si128((const __m128i*)s);
+    s1 = _mm_loadu_si128((const __m128i*)(s + 4));
+    Shuffle(s0, s1);
+
+    while (blocks--) {
+        so0 = s0;
+        so1 = s1;
+
+        m0 = Load(chunk);
+        m1 = Load(chunk + 16);
+        m2 = Load(chunk + 32);
+        m3 = Load(chunk + 48);
+        QuadRound(s0, s1, m0, ROUND_K + 0);
+        QuadRound(s0, s1, m1, ROUND_K + 4);
+        ShiftMessageA(m0, m1);
+        QuadRound(s0, s1, m2, ROUND_K + 8);
+        ShiftMessageA(m1, m2);
+        QuadRound(s0, s1, m3, ROUND_K + 12);
+        ShiftMessageB(m2, m3, m0);
+        QuadRound(s0, s1, m0, ROUND_K + 16);
+        ShiftMessageB(m3, m0, m1);
+        QuadRound(s0, s1, m1, ROUND_K + 20);
+        ShiftMessageB(m0, m1, m2);
+        QuadRound(s0, s1, m2, ROUND_K + 24);
+        ShiftMessageB(m1, m2, m3);
+        QuadRound(s0, s1, m3, ROUND_K + 28);
+        ShiftMessageB(m2, m3, m0);
+        QuadRound(s0, s1, m0, ROUND_K + 32);
+        ShiftMessageB(m3, m0, m1);
+        QuadRound(s0, s1, m1, ROUND_K + 36);
+        ShiftMessageB(m0, m1, m2);
+        QuadRound(s0, s1, m2, ROUND_K + 40);
+        ShiftMessageB(m1, m2, m3);
+        QuadRound(s0, s1, m3, ROUND_K + 44);
+        ShiftMessageB(m2, m3, m0);
+        QuadRound(s0, s1, m0, ROUND_K + 48);
+        ShiftMessageB(m3, m0, m1);
+        QuadRound(s0, s1, m1, ROUND_K + 52);
+        ShiftMessageC(m0, m1, m2);
+        QuadRound(s0, s1, m2, ROUND_K + 56);
+        ShiftMessageC(m1, m2, m3);
+        QuadRound(s0, s1, m3, ROUND_K + 60);
+
+        s0 = _mm_add_epi32(s0, so0);
+        s1 = _mm_add_epi32(s1, so1);
+        chunk += 64;
+    }
+
+    Unshuffle(s0, s1);
+    _mm_storeu_si128((__m128i*)s, s0);
+    _mm_storeu_si128((__m128i*)(s + 4), s1);
+}
+} // namespace sha256_shani
+
+namespace sha256d64_shani {
+/** Double SHA-256 of two 64-byte inputs, interleaved so that each hides the
+ *  latency of the other's dependent round instructions. */
+void Transform_2way(unsigned char* out, const unsigned char* in)
+{
+    __m128i am0, am1, am2, am3, as0, as1, aso0, aso1;
+    __m128i bm0, bm1, bm2, bm3, bs0, bs1, bso0, bso1;
+
+    // Transform 1: the 64-byte inputs
+    bs0 = as0 = INIT0;
+    bs1 = as1 = INIT1;
+    am0 = Load(in);
+    bm0 = Load(in + 64);
+    am1 = Load(in + 16);
+    bm1 = Load(in + 80);
+    am2 = Load(in + 32);
+    bm2 = Load(in + 96);
+    am3 = Load(in + 48);
+    bm3 = Load(in + 112);
+    QuadRound(as0, as1, am0, ROUND_K + 0);
+    QuadRound(bs0, bs1, bm0, ROUND_K + 0);
+    QuadRound(as0, as1, am1, ROUND_K + 4);
+    QuadRound(bs0, bs1, bm1, ROUND_K + 4);
+    ShiftMessageA(am0, am1);
+    ShiftMessageA(bm0, bm1);
+    QuadRound(as0, as1, am2, ROUND_K + 8);
+    QuadRound(bs0, bs1, bm2, ROUND_K + 8);
+    ShiftMessageA(am1, am2);
+    ShiftMessageA(bm1, bm2);
+    QuadRound(as0, as1, am3, ROUND_K + 12);
+    QuadRound(bs0, bs1, bm3, ROUND_K + 12);
+    ShiftMessageB(am2, am3, am0);
+    ShiftMessageB(bm2, bm3, bm0);
+    QuadRound(as0, as1, am0, ROUND_K + 16);
+    QuadRound(bs0, bs1, bm0, ROUND_K + 16);
+    ShiftMessageB(am3, am0, am1);
+    ShiftMessageB(bm3, bm0, bm1);
+    QuadRound(as0, as1, am1, ROUND_K + 20);
+    QuadRound(bs0, bs1, bm1, ROUND_K + 20);
+    ShiftMessageB(am0, am1, am2);
+    ShiftMessageB(bm0, bm1, bm2);
+    QuadRound(as0, as1, am2, ROUND_K + 24);
+    QuadRound(bs0, bs1, bm2, ROUND_K + 24);
+    ShiftMessageB(am1, am2, am3);
+    ShiftMessageB(bm1, bm2, bm3);
+    QuadRound(as0, as1, am3, ROUND_K + 28);
+    QuadRound(bs0, bs1, bm3, ROUND_K + 28);
+    ShiftMessageB(am2, am3, am0);
+    ShiftMessageB(bm2, bm3, bm0);
+    QuadRound(as0, as1, am0, ROUND_K + 32);
+    QuadRound(bs0, bs1, bm0, ROUND_K + 32);
+    ShiftMessageB(am3, am0, am1);
+    ShiftMessageB(bm3, bm0, bm1);
+    QuadRound(as0, as1, am1, ROUND_K + 36);
+    QuadRound(bs0, bs1, bm1, ROUND_K + 36);
+    ShiftMessageB(am0, am1, am2);
+    ShiftMessageB(bm0, bm1, bm2);
+    QuadRound(as0, as1, am2, ROUND_K + 40);
+    QuadRound(bs0, bs1, bm2, ROUND_K + 40);
+    ShiftMessageB(am1, am2, am3);
+    ShiftMessageB(bm1, bm2, bm3);
+    QuadRound(as0, as1, am3, ROUND_K + 44);
+    QuadRound(bs0, bs1, bm3, ROUND_K + 44);
+    ShiftMessageB(am2, am3, am0);
+    ShiftMessageB(bm2, bm3, bm0);
+    QuadRound(as0, as1, am0, ROUND_K + 48);
+    QuadRound(bs0, bs1, bm0, ROUND_K + 48);
+    ShiftMessageB(am3, am0, am1);
+    ShiftMessageB(bm3, bm0, bm1);
+    QuadRound(as0, as1, am1, ROUND_K + 52);
+    QuadRound(bs0, bs1, bm1, ROUND_K + 52);
+    ShiftMessageC(am0, am1, am2);
+    ShiftMessageC(bm0, bm1, bm2);
+    QuadRound(as0, as1, am2, ROUND_K + 56);
+    QuadRound(bs0, bs1, bm2, ROUND_K + 56);
+    ShiftMessageC(am1, am2, am3);
+    ShiftMessageC(bm1, bm2, bm3);
+    QuadRound(as0, as1, am3, ROUND_K + 60);
+    QuadRound(bs0, bs1, bm3, ROUND_K + 60);
+    as0 = _mm_add_epi32(as0, INIT0);
+    bs0 = _mm_add_epi32(bs0, INIT0);
+    as1 = _mm_add_epi32(as1, INIT1);
+    bs1 = _mm_add_epi32(bs1, INIT1);
+
+    // Transform 2: their padding, whose schedule is precomputed
+    aso0 = as0;
+    bso0 = bs0;
+    aso1 = as1;
+    bso1 = bs1;
+    QuadRound(as0, as1, ROUND_KPAD + 0);
+    QuadRound(bs0, bs1, ROUND_KPAD + 0);
+    QuadRound(as0, as1, ROUND_KPAD + 4);
+    QuadRound(bs0, bs1, ROUND_KPAD + 4);
+    QuadRound(as0, as1, ROUND_KPAD + 8);
+    QuadRound(bs0, bs1, ROUND_KPAD + 8);
+    QuadRound(as0, as1, ROUND_KPAD + 12);
+    QuadRound(bs0, bs1, ROUND_KPAD + 12);
+    QuadRound(as0, as1, ROUND_KPAD + 16);
+    QuadRound(bs0, bs1, ROUND_KPAD + 16);
+    QuadRound(as0, as1, ROUND_KPAD + 20);
+    QuadRound(bs0, bs1, ROUND_KPAD + 20);
+    QuadRound(as0, as1, ROUND_KPAD + 24);
+    QuadRound(bs0, bs1, ROUND_KPAD + 24);
+    QuadRound(as0, as1, ROUND_KPAD + 28);
+    QuadRound(bs0, bs1, ROUND_KPAD + 28);
+    QuadRound(as0, as1, ROUND_KPAD + 32);
+    QuadRound(bs0, bs1, ROUND_KPAD + 32);
+    QuadRound(as0, as1, ROUND_KPAD + 36);
+    QuadRound(bs0, bs1, ROUND_KPAD + 36);
+    QuadRound(as0, as1, ROUND_KPAD + 40);
+    QuadRound(bs0, bs1, ROUND_KPAD + 40);
+    QuadRound(as0, as1, ROUND_KPAD + 44);
+    QuadRound(bs0, bs1, ROUND_KPAD + 44);
+    QuadRound(as0, as1, ROUND_KPAD + 48);
+    QuadRound(bs0, bs1, ROUND_KPAD + 48);
+    QuadRound(as0, as1, ROUND_KPAD + 52);
+    QuadRound(bs0, bs1, ROUND_KPAD + 52);
+    QuadRound(as0, as1, ROUND_KPAD + 56);
+    QuadRound(bs0, bs1, ROUND_KPAD + 56);
+    QuadRound(as0, as1, ROUND_KPAD + 60);
+    QuadRound(bs0, bs1, ROUND_KPAD + 60);
+    as0 = _mm_add_epi32(as0, aso0);
+    bs0 = _mm_add_epi32(bs0, bso0);
+    as1 = _mm_add_epi32(as1, aso1);
+    bs1 = _mm_add_epi32(bs1, bso1);
+
+    // Transform 3: the padded 32-byte hashes
+    Unshuffle(as0, as1);
+    Unshuffle(bs0, bs1);
+    am0 = as0;
+    bm0 = bs0;
+    am1 = as1;
+    bm1 = bs1;
+    am2 = bm2 = _mm_set_epi64x(0x0ull, 0x80000000ull);
+    am3 = bm3 = _mm_set_epi64x(0x10000000000ull, 0x0ull);
+    bs0 = as0 = INIT0;
+    bs1 = as1 = INIT1;
+    QuadRound(as0, as1, am0, ROUND_K + 0);
+    QuadRound(bs0, bs1, bm0, ROUND_K + 0);
+    QuadRound(as0, as1, am1, ROUND_K + 4);
+    QuadRound(bs0, bs1, bm1, ROUND_K + 4);
+    ShiftMessageA(am0, am1);
+    ShiftMessageA(bm0, bm1);
+    QuadRound(as0, as1, am2, ROUND_K + 8);
+    QuadRound(bs0, bs1, bm2, ROUND_K + 8);
+    ShiftMessageA(am1, am2);
+    ShiftMessageA(bm1, bm2);
+    QuadRound(as0, as1, am3, ROUND_K + 12);
+    QuadRound(bs0, bs1, bm3, ROUND_K + 12);
+    ShiftMessageB(am2, am3, am0);
+    ShiftMessageB(bm2, bm3, bm0);
+    QuadRound(as0, as1, am0, ROUND_K + 16);
+    QuadRound(bs0, bs1, bm0, ROUND_K + 16);
+    ShiftMessageB(am3, am0, am1);
+    ShiftMessageB(bm3, bm0, bm1);
+    QuadRound(as0, as1, am1, ROUND_K + 20);
+    QuadRound(bs0, bs1, bm1, ROUND_K + 20);
+    ShiftMessageB(am0, am1, am2);
+    ShiftMessageB(bm0, bm1, bm2);
+    QuadRound(as0, as1, am2, ROUND_K + 24);
+    QuadRound(bs0, bs1, bm2, ROUND_K + 24);
+    ShiftMessageB(am1, am2, am3);
+    ShiftMessageB(bm1, bm2, bm3);
+    QuadRound(as0, as1, am3, ROUND_K + 28);
+    QuadRound(bs0, bs1, bm3, ROUND_K + 28);
+    ShiftMessageB(am2, am3, am0);
+    ShiftMessageB(bm2, bm3, bm0);
+    QuadRound(as0, as1, am0, ROUND_K + 32);
+    QuadRound(bs0, bs1, bm0, ROUND_K + 32);
+    ShiftMessageB(am3, am0, am1);
+    ShiftMessageB(bm3, bm0, bm1);
+    QuadRound(as0, as1, am1, ROUND_K + 36);
+    QuadRound(bs0, bs1, bm1, ROUND_K + 36);
+    ShiftMessageB(am0, am1, am2);
+    ShiftMessageB(bm0, bm1, bm2);
+    QuadRound(as0, as1, am2, ROUND_K + 40);
+    QuadRound(bs0, bs1, bm2, ROUND_K + 40);
+    ShiftMessageB(am1, am2, am3);
+    ShiftMessageB(bm1, bm2, bm3);
+    QuadRound(as0, as1, am3, ROUND_K + 44);
+    QuadRound(bs0, bs1, bm3, ROUND_K + 44);
+    ShiftMessageB(am2, am3, am0);
+    ShiftMessageB(bm2, bm3, bm0);
+    QuadRound(as0, as1, am0, ROUND_K + 48);
+    QuadRound(bs0, bs1, bm0, ROUND_K + 48);
+    ShiftMessageB(am3, am0, am1);
+    ShiftMessageB(bm3, bm0, bm1);
+    QuadRound(as0, as1, am1, ROUND_K + 52);
+    QuadRound(bs0, bs1, bm1, ROUND_K + 52);
+    ShiftMessageC(am0, am1, am2);
+    ShiftMessageC(bm0, bm1, bm2);
+    QuadRound(as0, as1, am2, ROUND_K + 56);
+    QuadRound(bs0, bs1, bm2, ROUND_K + 56);
+    ShiftMessageC(am1, am2, am3);
+    ShiftMessageC(bm1, bm2, bm3);
+    QuadRound(as0, as1, am3, ROUND_K + 60);
+    QuadRound(bs0, bs1, bm3, ROUND_K + 60);
+    as0 = _mm_add_epi32(as0, INIT0);
+    bs0 = _mm_add_epi32(bs0, INIT0);
+    as1 = _mm_add_epi32(as1, INIT1);
+    bs1 = _mm_add_epi32(bs1, INIT1);
+
+    Unshuffle(as0, as1);
+    Unshuffle(bs0, bs1);
+    Save(out, as0);
+    Save(out + 16, as1);
+    Save(out + 32, bs0);
+    Save(out + 48, bs1);
+}
+} // namespace sha256d64_shani
+
+#endif
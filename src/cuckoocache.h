@@ -176,6 +176,13 @@ private:
      */
     mutable std::vector<bool> epoch_flags;
 
+    /** aged_flags marks the slots whose element was aged out by epoch_check
+     * before anything used it. Such an element stays findable until insert
+     * overwrites it, which is when insert reports it as evicted (even if a
+     * lookup found it in the meantime).
+     */
+    std::vector<bool> aged_flags;
+
     /** epoch_heuristic_counter is used to determine when an epoch might be aged
      * & an expensive scan should be done.  epoch_heuristic_counter is
      * decremented on insert and reset to the new number of inserts which would
@@ -306,8 +313,11 @@ private:
             for (uint32_t i = 0; i < size; ++i)
                 if (epoch_flags[i])
                     epoch_flags[i] = false;
-                else
+                else {
+                    if (!collection_flags.bit_is_set(i))
+                        aged_flags[i] = true;
                     allow_erase(i);
+                }
             epoch_heuristic_counter = epoch_size;
         } else
             // reset the epoch_heuristic_counter to next do a scan when worst
@@ -324,7 +334,7 @@ public:
     /** You must always construct a cache with some elements via a subsequent
      * call to setup or setup_bytes, otherwise operations may segfault.
      */
-    cache() : table(), size(), collection_flags(0), epoch_flags(),
+    cache() : table(), size(), collection_flags(0), epoch_flags(), aged_flags(),
     epoch_heuristic_counter(), epoch_size(), depth_limit(0), hash_function()
     {
     }
@@ -345,6 +355,7 @@ public:
         table.resize(size);
         collection_flags.setup(size);
         epoch_flags.resize(size);
+        aged_flags.resize(size);
         // Set to 45% as described above
         epoch_size = std::max((uint32_t)1, (45 * size) / 100);
         // Initially set to wait for a whole epoch
@@ -387,9 +398,12 @@ public:
      * @post one of the following: All previously inserted elements and e are
      * now in the table, one previously inserted element is evicted from the
      * table, the entry attempted to be inserted is evicted.
+     * @returns the number of elements evicted before anything used them: one
+     * if e or an element it displaced is dropped for lack of depth, or if e
+     * overwrites an element that was aged out unused, and zero otherwise
      *
      */
-    inline void insert(Element e)
+    inline uint32_t insert(Element e)
     {
         epoch_check();
         uint32_t last_loc = invalid();
@@ -401,7 +415,8 @@ public:
             if (table[loc] == e) {
                 please_keep(loc);
                 epoch_flags[loc] = last_epoch;
-                return;
+                aged_flags[loc] = false;
+                return 0;
             }
         for (uint8_t depth = 0; depth < depth_limit; ++depth) {
             // First try to insert to an empty slot, if one exists
@@ -411,7 +426,9 @@ public:
                 table[loc] = std::move(e);
                 please_keep(loc);
                 epoch_flags[loc] = last_epoch;
-                return;
+                const uint32_t evicted = aged_flags[loc];
+                aged_flags[loc] = false;
+                return evicted;
             }
             /** Swap with the element at the location that was
             * not the last one looked at. Example:
@@ -437,6 +454,48 @@ public:
             // Recompute the locs -- unfortunately happens one too many times!
             locs = compute_hashes(e);
         }
+        return 1;
+    }
+
+    /** resize_bytes is like setup_bytes, but re-inserts the elements that
+     * are not marked for erasure instead of dropping everything, e.g. to grow
+     * the cache without losing its contents.
+     *
+     * @param bytes the approximate number of bytes to use for this data
+     * structure
+     * @param evicted set to the number of elements dropped before anything
+     * used them: those aged out unused, and those that did not fit
+     * @returns the maximum number of elements storable
+     */
+    uint32_t resize_bytes(size_t bytes, uint32_t& evicted)
+    {
+        std::vector<Element> old_table;
+        old_table.swap(table);
+        bit_packed_atomic_flags old_flags(1);
+        std::swap(old_flags, collection_flags);
+        std::vector<bool> old_aged_flags;
+        old_aged_flags.swap(aged_flags);
+        const uint32_t old_size = size;
+        epoch_flags.clear();
+        const uint32_t new_size = setup_bytes(bytes);
+        evicted = 0;
+        for (uint32_t i = 0; i < old_size; ++i)
+            if (!old_flags.bit_is_set(i))
+                evicted += insert(std::move(old_table[i]));
+            else
+                evicted += old_aged_flags[i];
+        return new_size;
+    }
+
+    /** count_live returns the number of elements not marked for erasure.
+     * It scans the whole table, so it is meant for statistics only.
+     */
+    uint32_t count_live() const
+    {
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < size; ++i)
+            count += !collection_flags.bit_is_set(i);
+        return count;
     }
 
     /* contains iterates through the hash locations for a given element
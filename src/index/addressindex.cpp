@@ -0,0 +1,278 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/addressindex.h>
+
+#include <hash.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+static const char DB_ADDRESS_ENTRY = 'a';
+static const char DB_ADDRESS_UNSPENT = 'u';
+
+std::unique_ptr<AddressIndex> g_addressindex;
+
+uint160 GetAddressIndexKey(const CScript& scriptPubKey)
+{
+    return Hash160(scriptPubKey);
+}
+
+/** Whether outputs with this script are recorded: they must be able to enter
+ *  the UTXO set, and the empty coinstake marker output is left out. */
+static bool IsIndexedScript(const CScript& scriptPubKey)
+{
+    return !scriptPubKey.empty() && !scriptPubKey.IsUnspendable();
+}
+
+namespace {
+
+/** Key of a funding or spending; heights and indices are stored big-endian so
+ *  that the entries of a script iterate in block order. */
+struct AddressEntryKey {
+    char key;
+    uint160 script_key;
+    CAddressIndexEntry* entry;
+
+    AddressEntryKey(const uint160& script_key_in, CAddressIndexEntry* entry_in) :
+        key(DB_ADDRESS_ENTRY), script_key(script_key_in), entry(entry_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        s << key;
+        s << script_key;
+        ser_writedata32be(s, entry->nHeight);
+        s << entry->txid;
+        ser_writedata32be(s, entry->nIndex);
+        s << entry->fSpending;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key;
+        s >> script_key;
+        entry->nHeight = ser_readdata32be(s);
+        s >> entry->txid;
+        entry->nIndex = ser_readdata32be(s);
+        s >> entry->fSpending;
+    }
+};
+
+struct AddressUnspentKey {
+    char key;
+    uint160 script_key;
+    COutPoint outpoint;
+
+    AddressUnspentKey() : key(DB_ADDRESS_UNSPENT) {}
+    AddressUnspentKey(const uint160& script_key_in, const COutPoint& outpoint_in) :
+        key(DB_ADDRESS_UNSPENT), script_key(script_key_in), outpoint(outpoint_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(key);
+        READWRITE(script_key);
+        READWRITE(outpoint);
+    }
+};
+
+} // namespace
+
+/**
+ * Access to the addressindex database (indexes/addressindex/)
+ *
+ * Besides the best block locator, the database holds one entry per funding
+ * or spending of a script and one per output still unspent at the best block.
+ */
+class AddressIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Add (or with f_rewind, remove) the entries of a block.
+    bool WriteBlock(const CBlock& block, const CBlockUndo& blockundo, int height, bool f_rewind);
+
+    bool ReadEntries(const uint160& script_key, int start_height, int end_height,
+                     std::vector<CAddressIndexEntry>& entries) const;
+
+    bool ReadUnspent(const uint160& script_key, std::vector<std::pair<COutPoint, Coin>>& unspent) const;
+};
+
+AddressIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "addressindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool AddressIndex::DB::WriteBlock(const CBlock& block, const CBlockUndo& blockundo, int height, bool f_rewind)
+{
+    CDBBatch batch(*this);
+
+    // Rewinding walks the block backwards, so that an output created and
+    // spent within the block is restored by its spend before it is erased.
+    for (size_t k = 0; k < block.vtx.size(); ++k) {
+        const size_t i = f_rewind ? block.vtx.size() - 1 - k : k;
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+
+        if (f_rewind) {
+            for (uint32_t n = 0; n < tx.vout.size(); ++n) {
+                const CTxOut& out = tx.vout[n];
+                if (!IsIndexedScript(out.scriptPubKey)) continue;
+                const uint160 script_key = GetAddressIndexKey(out.scriptPubKey);
+                CAddressIndexEntry entry;
+                entry.nHeight = height;
+                entry.txid = txid;
+                entry.nIndex = n;
+                batch.Erase(AddressEntryKey(script_key, &entry));
+                batch.Erase(AddressUnspentKey(script_key, COutPoint(txid, n)));
+            }
+        }
+
+        if (!tx.IsCoinBase()) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (uint32_t n = 0; n < tx.vin.size(); ++n) {
+                const Coin& prev = txundo.vprevout[n];
+                if (!IsIndexedScript(prev.out.scriptPubKey)) continue;
+                const uint160 script_key = GetAddressIndexKey(prev.out.scriptPubKey);
+                CAddressIndexEntry entry;
+                entry.nHeight = height;
+                entry.txid = txid;
+                entry.nIndex = n;
+                entry.fSpending = true;
+                if (f_rewind) {
+                    batch.Erase(AddressEntryKey(script_key, &entry));
+                    batch.Write(AddressUnspentKey(script_key, tx.vin[n].prevout), prev);
+                } else {
+                    batch.Write(AddressEntryKey(script_key, &entry), -prev.out.nValue);
+                    batch.Erase(AddressUnspentKey(script_key, tx.vin[n].prevout));
+                }
+            }
+        }
+
+        if (!f_rewind) {
+            for (uint32_t n = 0; n < tx.vout.size(); ++n) {
+                const CTxOut& out = tx.vout[n];
+                if (!IsIndexedScript(out.scriptPubKey)) continue;
+                const uint160 script_key = GetAddressIndexKey(out.scriptPubKey);
+                CAddressIndexEntry entry;
+                entry.nHeight = height;
+                entry.txid = txid;
+                entry.nIndex = n;
+                batch.Write(AddressEntryKey(script_key, &entry), out.nValue);
+                batch.Write(AddressUnspentKey(script_key, COutPoint(txid, n)),
+                            Coin(out, height, tx.IsCoinBase(), tx.IsCoinStake(), tx.nTime));
+            }
+        }
+    }
+    return WriteBatch(batch);
+}
+
+bool AddressIndex::DB::ReadEntries(const uint160& script_key, int start_height, int end_height,
+                                   std::vector<CAddressIndexEntry>& entries) const
+{
+    CAddressIndexEntry entry;
+    entry.nHeight = start_height;
+    std::unique_ptr<CDBIterator> cursor(const_cast<DB&>(*this).NewIterator());
+    for (cursor->Seek(AddressEntryKey(script_key, &entry)); cursor->Valid(); cursor->Next()) {
+        AddressEntryKey key(uint160(), &entry);
+        if (!cursor->GetKey(key) || key.key != DB_ADDRESS_ENTRY || key.script_key != script_key) {
+            break;
+        }
+        if (end_height > 0 && entry.nHeight > end_height) {
+            break;
+        }
+        if (!cursor->GetValue(entry.nValue)) {
+            return error("%s: cannot parse address index record", __func__);
+        }
+        entries.push_back(entry);
+    }
+    return true;
+}
+
+bool AddressIndex::DB::ReadUnspent(const uint160& script_key, std::vector<std::pair<COutPoint, Coin>>& unspent) const
+{
+    std::unique_ptr<CDBIterator> cursor(const_cast<DB&>(*this).NewIterator());
+    for (cursor->Seek(std::make_pair(DB_ADDRESS_UNSPENT, script_key)); cursor->Valid(); cursor->Next()) {
+        AddressUnspentKey key;
+        if (!cursor->GetKey(key) || key.key != DB_ADDRESS_UNSPENT || key.script_key != script_key) {
+            break;
+        }
+        Coin coin;
+        if (!cursor->GetValue(coin)) {
+            return error("%s: cannot parse address index record", __func__);
+        }
+        unspent.emplace_back(key.outpoint, std::move(coin));
+    }
+    return true;
+}
+
+AddressIndex::AddressIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(new AddressIndex::DB(n_cache_size, f_memory, f_wipe))
+{}
+
+AddressIndex::~AddressIndex()
+{
+    // Stop the sync thread here, while the database it writes to still exists.
+    Interrupt();
+    Stop();
+}
+
+bool AddressIndex::ReadUndo(const CBlock& block, const CBlockIndex* pindex, CBlockUndo& blockundo) const
+{
+    if (pindex->nHeight == 0) {
+        return true;
+    }
+    if (!ReadBlockUndo(pindex, blockundo)) {
+        return error("%s: Failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: Undo data of block %s does not match the block", __func__, pindex->GetBlockHash().ToString());
+    }
+    return true;
+}
+
+bool AddressIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // Outputs of the genesis block never enter the UTXO set.
+    if (pindex->nHeight == 0) {
+        return true;
+    }
+
+    CBlockUndo blockundo;
+    if (!ReadUndo(block, pindex, blockundo)) {
+        return false;
+    }
+    return m_db->WriteBlock(block, blockundo, pindex->nHeight, false);
+}
+
+bool AddressIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlock(pindex, block)) {
+            return error("%s: Failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+        }
+        CBlockUndo blockundo;
+        if (!ReadUndo(block, pindex, blockundo)) {
+            return false;
+        }
+        if (!m_db->WriteBlock(block, blockundo, pindex->nHeight, true)) {
+            return error("%s: Failed to rewind block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+    }
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB& AddressIndex::GetDB() const { return *m_db; }
+
+bool AddressIndex::FindEntries(const uint160& script_key, int start_height, int end_height,
+                               std::vector<CAddressIndexEntry>& entries) const
+{
+    return m_db->ReadEntries(script_key, start_height, end_height, entries);
+}
+
+bool AddressIndex::FindUnspent(const uint160& script_key, std::vector<std::pair<COutPoint, Coin>>& unspent) const
+{
+    return m_db->ReadUnspent(script_key, unspent);
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef DONU_INDEX_ADDRESSINDEX_H
+#define DONU_INDEX_ADDRESSINDEX_H
+
+#include <amount.h>
+#include <coins.h>
+#include <index/base.h>
+#include <script/script.h>
+#include <uint256.h>
+
+#include <memory>
+#include <vector>
+
+class CBlockUndo;
+
+//! -addressindex default
+static const bool DEFAULT_ADDRESSINDEX = false;
+
+/** Key of the script index under which both outputs and spends are recorded */
+uint160 GetAddressIndexKey(const CScript& scriptPubKey);
+
+/** A funding or spending of a script, in block order */
+struct CAddressIndexEntry
+{
+    int nHeight;
+    uint256 txid;
+    //! Output index when funding, input index when spending.
+    uint32_t nIndex;
+    bool fSpending;
+    //! Value of the output, negative when it is spent.
+    CAmount nValue;
+
+    CAddressIndexEntry() : nHeight(0), nIndex(0), fSpending(false), nValue(0) {}
+};
+
+/**
+ * AddressIndex records, for each scriptPubKey, the outputs paying to it and
+ * the inputs spending those outputs, as well as the outputs that are still
+ * unspent. Entries are keyed by GetAddressIndexKey so that any script can be
+ * looked up, not only those that have an address encoding.
+ *
+ * Spends are resolved from the block undo data, so the index cannot be used
+ * together with pruning.
+ */
+class AddressIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+    /// Read the undo data of a block; the genesis block has none and spends nothing.
+    bool ReadUndo(const CBlock& block, const CBlockIndex* pindex, CBlockUndo& blockundo) const;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "addressindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit AddressIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~AddressIndex() override;
+
+    /// Look up the fundings and spendings of a script with a height in
+    /// [start_height, end_height], ordered by height. An end_height of zero
+    /// means no upper bound.
+    bool FindEntries(const uint160& script_key, int start_height, int end_height,
+                     std::vector<CAddressIndexEntry>& entries) const;
+
+    /// Look up the unspent outputs paying to a script.
+    bool FindUnspent(const uint160& script_key, std::vector<std::pair<COutPoint, Coin>>& unspent) const;
+};
+
+/// The global address index, used by the getaddress* RPCs. May be null.
+extern std::unique_ptr<AddressIndex> g_addressindex;
+
+#endif // DONU_INDEX_ADDRESSINDEX_H
@@ -0,0 +1,497 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/base.h>
+
+#include <chainparams.h>
+#include <init.h>
+#include <tinyformat.h>
+#include <ui_interface.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+#include <warnings.h>
+
+#include <functional>
+
+static const char DB_BEST_BLOCK = 'B';
+
+static const int64_t SYNC_LOG_INTERVAL = 30; // seconds
+static const int64_t SYNC_LOCATOR_WRITE_INTERVAL = 30; // seconds
+
+template<typename... Args>
+static void FatalError(const char* fmt, const Args&... args)
+{
+    std::string strMessage = tfm::format(fmt, args...);
+    SetMiscWarning(strMessage);
+    LogPrintf("*** %s\n", strMessage);
+    uiInterface.ThreadSafeMessageBox(
+        "Error: A fatal internal error occurred, see debug.log for details",
+        "", CClientUIInterface::MSG_ERROR);
+    StartShutdown();
+}
+
+BaseIndex::DB::DB(const fs::path& path, size_t n_cache_size, bool f_memory, bool f_wipe, bool f_obfuscate) :
+    CDBWrapper(path, n_cache_size, f_memory, f_wipe, f_obfuscate)
+{}
+
+bool BaseIndex::DB::ReadBestBlock(CBlockLocator& locator) const
+{
+    bool success = Read(DB_BEST_BLOCK, locator);
+    if (!success) {
+        locator.SetNull();
+    }
+    return success;
+}
+
+bool BaseIndex::DB::WriteBestBlock(const CBlockLocator& locator)
+{
+    return Write(DB_BEST_BLOCK, locator);
+}
+
+BaseIndex::~BaseIndex()
+{
+    Interrupt();
+    Stop();
+}
+
+bool BaseIndex::Init()
+{
+    CBlockLocator locator;
+    if (!GetDB().ReadBestBlock(locator)) {
+        locator.SetNull();
+    }
+
+    LOCK(cs_main);
+    if (locator.IsNull()) {
+        m_best_block_index = nullptr;
+    } else {
+        m_best_block_index = FindForkInGlobalIndex(chainActive, locator);
+    }
+    m_synced = m_best_block_index.load() == chainActive.Tip();
+    return true;
+}
+
+/** The block of the active chain that follows pindex_prev, stepping back to the fork first if needed */
+static const CBlockIndex* NextSyncBlock(const CBlockIndex* pindex_prev)
+{
+    AssertLockHeld(cs_main);
+
+    if (!pindex_prev) {
+        return chainActive.Genesis();
+    }
+
+    const CBlockIndex* pindex = chainActive.Next(pindex_prev);
+    if (pindex) {
+        return pindex;
+    }
+
+    return chainActive.Next(chainActive.FindFork(pindex_prev));
+}
+
+void BaseIndex::CollectDiskPos(const CBlockIndex* pindex, const CBlockIndex* stop, DiskPosMap& disk_pos)
+{
+    AssertLockHeld(cs_main);
+
+    for (; pindex && pindex != stop; pindex = pindex->pprev) {
+        DiskPos& pos = disk_pos[pindex];
+        pos.block_pos = pindex->GetBlockPos();
+        pos.undo_pos = pindex->GetUndoPos();
+        pos.undo_compact = pindex->nStatus & BLOCK_UNDO_COMPACT;
+    }
+}
+
+void BaseIndex::CollectAppendDiskPos(const CBlockIndex* best_block_index, const CBlockIndex* pindex, DiskPosMap& disk_pos)
+{
+    CollectDiskPos(pindex, pindex->pprev, disk_pos);
+    if (best_block_index && pindex->pprev && best_block_index->GetAncestor(pindex->pprev->nHeight) == pindex->pprev) {
+        CollectDiskPos(best_block_index, pindex->pprev, disk_pos);
+    }
+}
+
+bool BaseIndex::AppendBlock(const CBlock& block, const CBlockIndex* pindex, DiskPosMap& disk_pos)
+{
+    AssertLockHeld(cs_index);
+
+    m_disk_pos.swap(disk_pos);
+    bool success = true;
+
+    // After a reorg the next block extends the fork point rather than the
+    // block indexed last (see NextSyncBlock and BlockConnected).
+    const CBlockIndex* best_block_index = m_best_block_index.load();
+    if (best_block_index && best_block_index != pindex->pprev) {
+        if (!pindex->pprev || best_block_index->GetAncestor(pindex->pprev->nHeight) != pindex->pprev) {
+            success = error("%s: %s cannot append block %s, which does not extend an indexed block",
+                            __func__, GetName(), pindex->GetBlockHash().ToString());
+        } else {
+            success = Rewind(best_block_index, pindex->pprev);
+        }
+    }
+
+    if (success) {
+        success = WriteBlock(block, pindex);
+    }
+    if (success) {
+        m_best_block_index = pindex;
+    }
+    m_disk_pos.clear();
+    return success;
+}
+
+bool BaseIndex::RewindTo(const CBlockIndex* new_tip, DiskPosMap& disk_pos)
+{
+    AssertLockHeld(cs_index);
+
+    m_disk_pos.swap(disk_pos);
+    bool success = Rewind(m_best_block_index.load(), new_tip);
+    m_disk_pos.clear();
+    return success;
+}
+
+bool BaseIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    AssertLockHeld(cs_index);
+
+    m_best_block_index = new_tip;
+    return true;
+}
+
+bool BaseIndex::ReadBlock(const CBlockIndex* pindex, CBlock& block) const
+{
+    DiskPosMap::const_iterator it = m_disk_pos.find(pindex);
+    if (it == m_disk_pos.end()) {
+        return error("%s: %s has no disk position for block %s",
+                     __func__, GetName(), pindex->GetBlockHash().ToString());
+    }
+
+    std::shared_ptr<const CBlock> pblock;
+    if (!ReadBlockFromDisk(pblock, pindex, it->second.block_pos, Params().GetConsensus())) {
+        return false;
+    }
+    block = *pblock;
+    return true;
+}
+
+bool BaseIndex::ReadBlockUndo(const CBlockIndex* pindex, CBlockUndo& blockundo) const
+{
+    DiskPosMap::const_iterator it = m_disk_pos.find(pindex);
+    if (it == m_disk_pos.end()) {
+        return error("%s: %s has no disk position for block %s",
+                     __func__, GetName(), pindex->GetBlockHash().ToString());
+    }
+
+    std::shared_ptr<const CBlockUndo> pblockundo;
+    if (!UndoReadFromDisk(pblockundo, pindex, it->second.undo_pos, it->second.undo_compact)) {
+        return false;
+    }
+    blockundo = *pblockundo;
+    return true;
+}
+
+void BaseIndex::ThreadSync()
+{
+    if (!m_synced) {
+        const Consensus::Params& consensus_params = Params().GetConsensus();
+
+        int64_t last_log_time = 0;
+        int64_t last_locator_write_time = 0;
+        while (true) {
+            if (m_interrupt) {
+                WriteBestBlock(m_best_block_index.load());
+                return;
+            }
+
+            // Readers may catch the index up themselves (see
+            // BlockUntilSyncedToHeight), so always continue from the current
+            // best block rather than the one written last by this thread.
+            const CBlockIndex* pindex;
+            const CBlockIndex* pindex_next;
+            DiskPosMap disk_pos;
+            {
+                LOCK(cs_main);
+                pindex = m_best_block_index.load();
+                pindex_next = NextSyncBlock(pindex);
+                if (!pindex_next) {
+                    WriteBestBlock(pindex);
+                    m_synced = true;
+                    break;
+                }
+                CollectAppendDiskPos(pindex, pindex_next, disk_pos);
+            }
+
+            int64_t current_time = GetTime();
+            if (last_log_time + SYNC_LOG_INTERVAL < current_time) {
+                LogPrintf("Syncing %s with block chain from height %d\n",
+                          GetName(), pindex_next->nHeight);
+                last_log_time = current_time;
+            }
+
+            if (last_locator_write_time + SYNC_LOCATOR_WRITE_INTERVAL < current_time) {
+                WriteBestBlock(pindex);
+                last_locator_write_time = current_time;
+            }
+
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindex_next, consensus_params)) {
+                FatalError("%s: Failed to read block %s from disk",
+                           __func__, pindex_next->GetBlockHash().ToString());
+                return;
+            }
+
+            LOCK(cs_index);
+            if (m_best_block_index.load() != pindex) {
+                continue;
+            }
+            if (!AppendBlock(block, pindex_next, disk_pos)) {
+                FatalError("%s: Failed to write block %s to index database",
+                           __func__, pindex_next->GetBlockHash().ToString());
+                return;
+            }
+        }
+    }
+
+    const CBlockIndex* pindex = m_best_block_index.load();
+    if (pindex) {
+        LogPrintf("%s is enabled at height %d\n", GetName(), pindex->nHeight);
+    } else {
+        LogPrintf("%s is enabled\n", GetName());
+    }
+}
+
+bool BaseIndex::WriteBestBlock(const CBlockIndex* block_index)
+{
+    // An empty index has nothing to record yet, and GetLocator(nullptr)
+    // would describe the tip instead.
+    if (!block_index) {
+        return true;
+    }
+
+    LOCK(cs_main);
+    if (!GetDB().WriteBestBlock(chainActive.GetLocator(block_index))) {
+        return error("%s: Failed to write locator to disk", __func__);
+    }
+    return true;
+}
+
+void BaseIndex::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex,
+                               const std::vector<CTransactionRef>& txn_conflicted)
+{
+    if (!IsSynced()) {
+        return;
+    }
+
+    while (true) {
+        const CBlockIndex* best_block_index;
+        DiskPosMap disk_pos;
+        {
+            LOCK(cs_main);
+            best_block_index = m_best_block_index.load();
+            CollectAppendDiskPos(best_block_index, pindex, disk_pos);
+        }
+
+        LOCK(cs_index);
+        // A reader may have moved the index on while the positions were
+        // collected without cs_index.
+        if (m_best_block_index.load() != best_block_index) {
+            continue;
+        }
+
+        if (!best_block_index) {
+            if (pindex->nHeight != 0) {
+                FatalError("%s: First block connected is not the genesis block (height=%d)",
+                           __func__, pindex->nHeight);
+                return;
+            }
+        } else {
+            // A reader that needed the index up to date may have indexed this
+            // block already.
+            if (best_block_index->GetAncestor(pindex->nHeight) == pindex) {
+                return;
+            }
+
+            // Ensure block connects to an ancestor of the current best block. This should be the case
+            // most of the time, but may not be immediately after the sync thread catches up and sets
+            // m_synced. Consider the case where there is a reorg and the blocks on the stale branch are
+            // in the ValidationInterface queue backlog even after the sync thread has caught up to the
+            // new chain tip. In this unlikely event, log a warning and let the queue clear.
+            if (best_block_index->GetAncestor(pindex->nHeight - 1) != pindex->pprev) {
+                LogPrintf("%s: WARNING: Block %s does not connect to an ancestor of " /* Continued */
+                          "known best chain (tip=%s); not updating index\n",
+                          __func__, pindex->GetBlockHash().ToString(),
+                          best_block_index->GetBlockHash().ToString());
+                return;
+            }
+        }
+
+        if (!AppendBlock(*block, pindex, disk_pos)) {
+            FatalError("%s: Failed to write block %s to index",
+                       __func__, pindex->GetBlockHash().ToString());
+        }
+        return;
+    }
+}
+
+void BaseIndex::BlockDisconnected(const std::shared_ptr<const CBlock>& block)
+{
+    if (!IsSynced()) {
+        return;
+    }
+
+    while (true) {
+        const CBlockIndex* best_block_index;
+        DiskPosMap disk_pos;
+        {
+            LOCK(cs_main);
+            best_block_index = m_best_block_index.load();
+            // Blocks the index has not reached yet or has already rewound are
+            // left alone; connecting the next block handles any other reorg.
+            if (!best_block_index || !best_block_index->pprev ||
+                best_block_index->GetBlockHash() != block->GetHash()) {
+                return;
+            }
+            CollectDiskPos(best_block_index, best_block_index->pprev, disk_pos);
+        }
+
+        LOCK(cs_index);
+        if (m_best_block_index.load() != best_block_index) {
+            continue;
+        }
+        if (!RewindTo(best_block_index->pprev, disk_pos)) {
+            FatalError("%s: Failed to rewind block %s from index",
+                       __func__, best_block_index->GetBlockHash().ToString());
+        }
+        return;
+    }
+}
+
+void BaseIndex::SetBestChain(const CBlockLocator& locator)
+{
+    if (!IsSynced() || locator.IsNull()) {
+        return;
+    }
+
+    const uint256& locator_tip_hash = locator.vHave.front();
+    const CBlockIndex* locator_tip_index;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(locator_tip_hash);
+        locator_tip_index = it != mapBlockIndex.end() ? it->second : nullptr;
+    }
+
+    if (!locator_tip_index) {
+        FatalError("%s: First block (hash=%s) in locator was not found",
+                   __func__, locator_tip_hash.ToString());
+        return;
+    }
+
+    // This checks that SetBestChain callbacks are received after BlockConnected. The check may fail
+    // immediately after the sync thread catches up and sets m_synced. Consider the case where
+    // there is a reorg and the blocks on the stale branch are in the ValidationInterface queue
+    // backlog even after the sync thread has caught up to the new chain tip. In this unlikely
+    // event, log a warning and let the queue clear.
+    const CBlockIndex* best_block_index = m_best_block_index.load();
+    if (!best_block_index || best_block_index->GetAncestor(locator_tip_index->nHeight) != locator_tip_index) {
+        LogPrintf("%s: WARNING: Locator contains block (hash=%s) not on known best " /* Continued */
+                  "chain (tip=%s); not writing index locator\n",
+                  __func__, locator_tip_hash.ToString(),
+                  best_block_index ? best_block_index->GetBlockHash().ToString() : "null");
+        return;
+    }
+
+    if (!GetDB().WriteBestBlock(locator)) {
+        error("%s: Failed to write locator to disk", __func__);
+    }
+}
+
+bool BaseIndex::BlockUntilSyncedToHeight(int height)
+{
+    AssertLockHeld(cs_main);
+
+    const CBlockIndex* pindex_target = chainActive[std::min(height, chainActive.Height())];
+    if (!pindex_target) {
+        return true;
+    }
+
+    const Consensus::Params& consensus_params = Params().GetConsensus();
+    LOCK(cs_index);
+    while (true) {
+        const CBlockIndex* best_block_index = m_best_block_index.load();
+        if (best_block_index && best_block_index->GetAncestor(pindex_target->nHeight) == pindex_target) {
+            return true;
+        }
+
+        const CBlockIndex* pindex_next = NextSyncBlock(best_block_index);
+        if (!pindex_next) {
+            return error("%s: %s cannot reach height %d", __func__, GetName(), pindex_target->nHeight);
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex_next, consensus_params)) {
+            return error("%s: Failed to read block %s from disk",
+                         __func__, pindex_next->GetBlockHash().ToString());
+        }
+        DiskPosMap disk_pos;
+        CollectAppendDiskPos(best_block_index, pindex_next, disk_pos);
+        if (!AppendBlock(block, pindex_next, disk_pos)) {
+            return error("%s: Failed to write block %s to index database",
+                         __func__, pindex_next->GetBlockHash().ToString());
+        }
+    }
+}
+
+bool BaseIndex::BlockUntilSyncedToCurrentChain()
+{
+    if (!IsSynced()) {
+        return false;
+    }
+
+    LOCK(cs_main);
+    const CBlockIndex* tip = chainActive.Tip();
+    {
+        // Blocks disconnected without others being connected, as by
+        // invalidateblock, leave the index ahead of the tip until their
+        // BlockDisconnected notifications are processed.
+        LOCK(cs_index);
+        const CBlockIndex* best_block_index = m_best_block_index.load();
+        if (tip && best_block_index && best_block_index != tip &&
+            best_block_index->GetAncestor(tip->nHeight) == tip) {
+            DiskPosMap disk_pos;
+            CollectDiskPos(best_block_index, tip, disk_pos);
+            if (!RewindTo(tip, disk_pos)) {
+                return error("%s: %s failed to rewind to block %s",
+                             __func__, GetName(), tip->GetBlockHash().ToString());
+            }
+        }
+    }
+    return BlockUntilSyncedToHeight(chainActive.Height());
+}
+
+void BaseIndex::Interrupt()
+{
+    m_interrupt();
+}
+
+bool BaseIndex::Start()
+{
+    // Need to register this ValidationInterface before running Init(), so that
+    // callbacks are not missed if Init sets m_synced to true.
+    RegisterValidationInterface(this);
+    if (!Init()) {
+        return error("%s: %s failed to initialize", __func__, GetName());
+    }
+
+    m_interrupt.reset();
+    m_thread_sync = std::thread(&TraceThread<std::function<void()> >, GetName(),
+                                std::function<void()>(std::bind(&BaseIndex::ThreadSync, this)));
+    return true;
+}
+
+void BaseIndex::Stop()
+{
+    UnregisterValidationInterface(this);
+
+    if (m_thread_sync.joinable()) {
+        m_thread_sync.join();
+    }
+}
@@ -0,0 +1,168 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef DONU_INDEX_BASE_H
+#define DONU_INDEX_BASE_H
+
+#include <chain.h>
+#include <dbwrapper.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <sync.h>
+#include <threadinterrupt.h>
+#include <validationinterface.h>
+
+#include <atomic>
+#include <map>
+#include <thread>
+
+class CBlockUndo;
+
+/**
+ * Base class for indices of blockchain data, kept in a database of their own
+ * and maintained off the block connection path.
+ *
+ * After startup the index catches up with the active chain on a thread of its
+ * own, then follows it through validation interface notifications. Readers
+ * that must not see a stale index (for example consensus code) can bring it
+ * up to date with a given height on their own thread.
+ */
+class BaseIndex : public CValidationInterface
+{
+protected:
+    class DB : public CDBWrapper
+    {
+    public:
+        DB(const fs::path& path, size_t n_cache_size, bool f_memory = false, bool f_wipe = false, bool f_obfuscate = false);
+
+        /// Read block locator of the chain that the index is in sync with.
+        bool ReadBestBlock(CBlockLocator& locator) const;
+
+        /// Write block locator of the chain that the index is in sync with.
+        bool WriteBestBlock(const CBlockLocator& locator);
+    };
+
+    /// Where a block and its undo data are stored on disk.
+    struct DiskPos
+    {
+        CDiskBlockPos block_pos;
+        CDiskBlockPos undo_pos;
+        bool undo_compact;
+    };
+    typedef std::map<const CBlockIndex*, DiskPos> DiskPosMap;
+
+private:
+    /// Serializes writes to the index between the sync thread, validation
+    /// interface callbacks and callers catching the index up themselves.
+    /// Lock order: cs_main before cs_index, so nothing that runs under
+    /// cs_index may take cs_main unless the caller already holds it.
+    CCriticalSection cs_index;
+
+    /// Whether the index is in sync with the main chain. The flag is flipped
+    /// from false to true once, after which notifications keep it up to date.
+    std::atomic<bool> m_synced;
+
+    /// The last block that has been written to the index.
+    std::atomic<const CBlockIndex*> m_best_block_index;
+
+    /// Disk positions of the blocks being written or rewound. Reading them
+    /// from the block index requires cs_main, which must not be taken while
+    /// holding cs_index, so they are copied beforehand (see CollectDiskPos).
+    /// Guarded by cs_index.
+    DiskPosMap m_disk_pos;
+
+    std::thread m_thread_sync;
+    CThreadInterrupt m_interrupt;
+
+    /// Sync the index with the block index starting from the current best
+    /// block. Intended to be run in its own thread, m_thread_sync, and can be
+    /// interrupted with m_interrupt. Once the index gets in sync, the m_synced
+    /// flag is set and the BlockConnected callback takes over.
+    void ThreadSync();
+
+    /// Copy the disk positions of the blocks from pindex back to, but not
+    /// including, stop. Requires cs_main.
+    static void CollectDiskPos(const CBlockIndex* pindex, const CBlockIndex* stop, DiskPosMap& disk_pos);
+
+    /// Copy the disk positions AppendBlock needs to append pindex to an index
+    /// whose best block is best_block_index. Requires cs_main.
+    static void CollectAppendDiskPos(const CBlockIndex* best_block_index, const CBlockIndex* pindex, DiskPosMap& disk_pos);
+
+    /// Write the current chain block locator to the DB.
+    bool WriteBestBlock(const CBlockIndex* block_index);
+
+    /// Write the entries of a block and make it the best block, rewinding the
+    /// index first if the block does not extend it. disk_pos must hold the
+    /// positions collected for the block and the current best block. Requires
+    /// cs_index.
+    bool AppendBlock(const CBlock& block, const CBlockIndex* pindex, DiskPosMap& disk_pos);
+
+    /// Take the blocks after new_tip, an ancestor of the best block, out of
+    /// the index. disk_pos must hold the positions of the blocks from the best
+    /// block back to new_tip. Requires cs_index.
+    bool RewindTo(const CBlockIndex* new_tip, DiskPosMap& disk_pos);
+
+protected:
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex,
+                        const std::vector<CTransactionRef>& txn_conflicted) override;
+
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block) override;
+
+    void SetBestChain(const CBlockLocator& locator) override;
+
+    /// Initialize internal state from the database and block index.
+    virtual bool Init();
+
+    /// Write index entries for a newly connected block.
+    virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) { return true; }
+
+    /// Take the blocks after new_tip, up to and including current_tip, out of
+    /// the index. new_tip must be an ancestor of current_tip. Indices whose
+    /// entries are keyed by block data alone can leave stale entries behind
+    /// and rely on this default, which only moves the best block back.
+    /// Requires cs_index.
+    virtual bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip);
+
+    /// Read a block being written or rewound. Requires cs_index.
+    bool ReadBlock(const CBlockIndex* pindex, CBlock& block) const;
+
+    /// Read the undo data of a block being written or rewound. Requires
+    /// cs_index.
+    bool ReadBlockUndo(const CBlockIndex* pindex, CBlockUndo& blockundo) const;
+
+    virtual DB& GetDB() const = 0;
+
+    /// Get the name of the index for display in logs.
+    virtual const char* GetName() const = 0;
+
+public:
+    BaseIndex() : m_synced(false), m_best_block_index(nullptr) {}
+    /// Destructor interrupts sync thread if running and blocks until it exits.
+    virtual ~BaseIndex();
+
+    /// Whether the background sync has caught up with the active chain.
+    bool IsSynced() const { return m_synced; }
+
+    /// Make sure the index covers the active chain up to the given height,
+    /// indexing any missing blocks on the calling thread. Requires cs_main.
+    /// Returns false if a block could not be read or written.
+    bool BlockUntilSyncedToHeight(int height);
+
+    /// Bring the index up to the current tip of the active chain, rewinding
+    /// blocks that have been disconnected from it, for example by
+    /// invalidateblock. This only does work if the index has gotten in sync
+    /// once and merely trails the ValidationInterface queue. If the index is
+    /// catching up from far behind, this method returns false immediately.
+    bool BlockUntilSyncedToCurrentChain();
+
+    void Interrupt();
+
+    /// Start initializes the sync state and registers the instance as a
+    /// ValidationInterface so that it stays in sync with blockchain updates.
+    bool Start();
+
+    /// Stops the instance from staying in sync with blockchain updates.
+    void Stop();
+};
+
+#endif // DONU_INDEX_BASE_H
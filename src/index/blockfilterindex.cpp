@@ -0,0 +1,133 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/blockfilterindex.h>
+
+#include <chain.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+static const char DB_BLOCK_FILTER = 's';
+
+std::unique_ptr<BlockFilterIndex> g_blockfilterindex;
+
+namespace {
+
+struct DBVal {
+    uint256 hash;
+    uint256 header;
+    std::vector<unsigned char> encoded_filter;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hash);
+        READWRITE(header);
+        READWRITE(encoded_filter);
+    }
+};
+
+} // namespace
+
+/**
+ * Access to the block filter database (indexes/blockfilter/<filter type>/)
+ *
+ * Besides the best block locator, the database holds one entry per indexed
+ * block, with the filter hash, the filter header and the encoded filter.
+ */
+class BlockFilterIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(const fs::path& path, size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    bool ReadFilter(const uint256& block_hash, DBVal& value) const;
+
+    bool WriteFilter(const uint256& block_hash, const DBVal& value);
+};
+
+BlockFilterIndex::DB::DB(const fs::path& path, size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(path, n_cache_size, f_memory, f_wipe)
+{}
+
+bool BlockFilterIndex::DB::ReadFilter(const uint256& block_hash, DBVal& value) const
+{
+    return Read(std::make_pair(DB_BLOCK_FILTER, block_hash), value);
+}
+
+bool BlockFilterIndex::DB::WriteFilter(const uint256& block_hash, const DBVal& value)
+{
+    return Write(std::make_pair(DB_BLOCK_FILTER, block_hash), value);
+}
+
+BlockFilterIndex::BlockFilterIndex(BlockFilterType filter_type, size_t n_cache_size,
+                                   bool f_memory, bool f_wipe)
+    : m_filter_type(filter_type)
+    , m_db(new BlockFilterIndex::DB(GetDataDir() / "indexes" / "blockfilter" / BlockFilterTypeName(filter_type),
+                                    n_cache_size, f_memory, f_wipe))
+{}
+
+BlockFilterIndex::~BlockFilterIndex()
+{
+    // Stop the sync thread here, while the database it writes to still exists.
+    Interrupt();
+    Stop();
+}
+
+bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block spends nothing and has no undo data.
+    CBlockUndo blockundo;
+    uint256 prev_header;
+
+    if (pindex->nHeight > 0) {
+        if (!ReadBlockUndo(pindex, blockundo)) {
+            return error("%s: Failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+        if (blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("%s: Undo data of block %s does not match the block", __func__, pindex->GetBlockHash().ToString());
+        }
+
+        DBVal prev_value;
+        if (!m_db->ReadFilter(pindex->pprev->GetBlockHash(), prev_value)) {
+            return error("%s: Failed to read filter of block %s", __func__, pindex->pprev->GetBlockHash().ToString());
+        }
+        prev_header = prev_value.header;
+    }
+
+    BlockFilter filter(m_filter_type, block, blockundo);
+
+    DBVal value;
+    value.hash = filter.GetHash();
+    value.header = filter.ComputeHeader(prev_header);
+    value.encoded_filter = filter.GetEncodedFilter();
+    return m_db->WriteFilter(pindex->GetBlockHash(), value);
+}
+
+BaseIndex::DB& BlockFilterIndex::GetDB() const { return *m_db; }
+
+bool BlockFilterIndex::LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const
+{
+    DBVal value;
+    if (!m_db->ReadFilter(block_index->GetBlockHash(), value)) {
+        return false;
+    }
+    try {
+        filter_out = BlockFilter(m_filter_type, block_index->GetBlockHash(), std::move(value.encoded_filter));
+    } catch (const std::exception& e) {
+        return error("%s: Cannot parse filter of block %s: %s", __func__, block_index->GetBlockHash().ToString(), e.what());
+    }
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const
+{
+    DBVal value;
+    if (!m_db->ReadFilter(block_index->GetBlockHash(), value)) {
+        return false;
+    }
+    header_out = value.header;
+    return true;
+}
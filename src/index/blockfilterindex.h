@@ -0,0 +1,61 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef DONU_INDEX_BLOCKFILTERINDEX_H
+#define DONU_INDEX_BLOCKFILTERINDEX_H
+
+#include <blockfilter.h>
+#include <index/base.h>
+#include <uint256.h>
+
+#include <memory>
+
+//! -blockfilterindex default
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+
+/**
+ * BlockFilterIndex keeps the BIP 157 filter of each block of the main chain,
+ * together with the filter hash and the filter header committing to all the
+ * filters before it. Entries are keyed by block hash, so filters of blocks
+ * that have been reorganized away stay readable.
+ *
+ * Filters commit to the scripts of spent outputs, which are read from the
+ * block undo data, so the index cannot be used together with pruning.
+ */
+class BlockFilterIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    BlockFilterType m_filter_type;
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "blockfilterindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit BlockFilterIndex(BlockFilterType filter_type, size_t n_cache_size,
+                              bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~BlockFilterIndex() override;
+
+    BlockFilterType GetFilterType() const { return m_filter_type; }
+
+    /// Look up the filter of a block.
+    bool LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const;
+
+    /// Look up the filter header of a block.
+    bool LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const;
+};
+
+/// The global basic block filter index, used by getblockfilter and REST. May be null.
+extern std::unique_ptr<BlockFilterIndex> g_blockfilterindex;
+
+#endif // DONU_INDEX_BLOCKFILTERINDEX_H
@@ -0,0 +1,77 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/blockstatsindex.h>
+
+#include <chain.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+static const char DB_BLOCK_STATS = 's';
+
+std::unique_ptr<BlockStatsIndex> g_blockstatsindex;
+
+/**
+ * Access to the block statistics database (indexes/blockstats/)
+ *
+ * Besides the best block locator, the database holds the CBlockStats of
+ * every indexed block.
+ */
+class BlockStatsIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    bool ReadStats(const uint256& block_hash, CBlockStats& stats) const;
+
+    bool WriteStats(const uint256& block_hash, const CBlockStats& stats);
+};
+
+BlockStatsIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "blockstats", n_cache_size, f_memory, f_wipe)
+{}
+
+bool BlockStatsIndex::DB::ReadStats(const uint256& block_hash, CBlockStats& stats) const
+{
+    return Read(std::make_pair(DB_BLOCK_STATS, block_hash), stats);
+}
+
+bool BlockStatsIndex::DB::WriteStats(const uint256& block_hash, const CBlockStats& stats)
+{
+    return Write(std::make_pair(DB_BLOCK_STATS, block_hash), stats);
+}
+
+BlockStatsIndex::BlockStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(new BlockStatsIndex::DB(n_cache_size, f_memory, f_wipe))
+{}
+
+BlockStatsIndex::~BlockStatsIndex()
+{
+    // Stop the sync thread here, while the database it writes to still exists.
+    Interrupt();
+    Stop();
+}
+
+bool BlockStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block spends nothing and has no undo data.
+    CBlockUndo blockundo;
+    if (pindex->nHeight > 0 && !ReadBlockUndo(pindex, blockundo)) {
+        return error("%s: Failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    CBlockStats stats;
+    if (!ComputeBlockStats(block, pindex, blockundo, stats)) {
+        return error("%s: Undo data of block %s does not match the block", __func__, pindex->GetBlockHash().ToString());
+    }
+    return m_db->WriteStats(pindex->GetBlockHash(), stats);
+}
+
+BaseIndex::DB& BlockStatsIndex::GetDB() const { return *m_db; }
+
+bool BlockStatsIndex::LookupStats(const CBlockIndex* block_index, CBlockStats& stats) const
+{
+    return m_db->ReadStats(block_index->GetBlockHash(), stats);
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef DONU_INDEX_BLOCKSTATSINDEX_H
+#define DONU_INDEX_BLOCKSTATSINDEX_H
+
+#include <blockstats.h>
+#include <index/base.h>
+
+#include <memory>
+
+//! -blockstatsindex default
+static const bool DEFAULT_BLOCKSTATSINDEX = false;
+
+/**
+ * BlockStatsIndex keeps the CBlockStats of each block of the main chain, so
+ * that getblockstats can answer without reading the block and its undo data.
+ * Entries are keyed by block hash.
+ *
+ * The statistics are computed from the block undo data, so the index cannot
+ * be used together with pruning.
+ */
+class BlockStatsIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "blockstatsindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit BlockStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~BlockStatsIndex() override;
+
+    /// Look up the statistics of a block.
+    bool LookupStats(const CBlockIndex* block_index, CBlockStats& stats) const;
+};
+
+/// The global block statistics index, used by getblockstats. May be null.
+extern std::unique_ptr<BlockStatsIndex> g_blockstatsindex;
+
+#endif // DONU_INDEX_BLOCKSTATSINDEX_H
@@ -0,0 +1,77 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef DONU_INDEX_TXINDEX_H
+#define DONU_INDEX_TXINDEX_H
+
+#include <index/base.h>
+#include <txdb.h>
+
+#include <memory>
+
+/**
+ * TxIndex is used to look up transactions included in the blockchain by hash.
+ * The index is written to a LevelDB database and records the filesystem
+ * location of each transaction by transaction hash.
+ *
+ * donu: proof-of-stake validation reads the kernel's previous transaction and
+ * block header through this index.
+ */
+class TxIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    /// Override base class init to migrate from old database.
+    bool Init() override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    /// Whether the block a position of this index points into is on the
+    /// active chain up to the given height. Requires cs_main.
+    bool IsTxPosInActiveChain(const CDiskTxPos& pos, int height) const;
+
+    const char* GetName() const override { return "txindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit TxIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~TxIndex() override;
+
+    /// Look up the on-disk location of a transaction by hash.
+    bool FindTxPosition(const uint256& tx_hash, CDiskTxPos& pos) const;
+
+    /// Like FindTxPosition, but unless the transaction is found in a block of
+    /// the active chain up to the given height, first make sure the index
+    /// covers the active chain up to that height and look again. The entry
+    /// found then may still point into a block off the active chain if the
+    /// transaction is not in it, so callers must check the block themselves.
+    /// Requires cs_main.
+    bool FindTxPositionSynced(const uint256& tx_hash, CDiskTxPos& pos, int height);
+
+    /// Look up the hash of the block stored at a position, such as the block
+    /// a transaction position is relative to. The index keeps the positions
+    /// of the blocks it has covered, including pruned ones.
+    bool FindBlockHash(const CDiskBlockPos& pos, uint256& block_hash) const;
+
+    /// Look up a transaction by hash.
+    ///
+    /// @param[in]   tx_hash  The hash of the transaction to be returned.
+    /// @param[out]  block_hash  The hash of the block the transaction is found in.
+    /// @param[out]  tx  The transaction itself.
+    /// @return  true if transaction is found, false otherwise
+    bool FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRef& tx) const;
+};
+
+/// The global transaction index, used in GetTransaction and proof-of-stake validation.
+extern std::unique_ptr<TxIndex> g_txindex;
+
+#endif // DONU_INDEX_TXINDEX_H
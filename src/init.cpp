@@ -11,14 +11,21 @@
 
 #include <addrman.h>
 #include <amount.h>
+#include <blockcache.h>
+#include <blockfilemap.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
+#include <crypto/aes.h>
 #include <fs.h>
 #include <httpserver.h>
 #include <httprpc.h>
+#include <index/addressindex.h>
+#include <index/blockfilterindex.h>
+#include <index/blockstatsindex.h>
+#include <index/txindex.h>
 #include <key.h>
 #include <validation.h>
 #include <miner.h>
@@ -120,6 +127,10 @@ void StartShutdown()
 {
     fRequestShutdown = true;
 }
+void AbortShutdown()
+{
+    fRequestShutdown = false;
+}
 bool ShutdownRequested()
 {
     return fRequestShutdown;
@@ -165,6 +176,14 @@ void Interrupt()
     InterruptTorControl();
     if (g_connman)
         g_connman->Interrupt();
+    if (g_txindex)
+        g_txindex->Interrupt();
+    if (g_addressindex)
+        g_addressindex->Interrupt();
+    if (g_blockfilterindex)
+        g_blockfilterindex->Interrupt();
+    if (g_blockstatsindex)
+        g_blockstatsindex->Interrupt();
 }
 
 void Shutdown()
@@ -200,6 +219,8 @@ void Shutdown()
 
     StopTorControl();
 
+    StopBackgroundVerify();
+
     // After everything has been shut down, but before things get flushed, stop the
     // CScheduler/checkqueue threadGroup
     threadGroup.interrupt_all();
@@ -224,6 +245,23 @@ void Shutdown()
     // up with our current chain to avoid any strange pruning edge cases and make
     // next startup faster by avoiding rescan.
 
+    if (g_txindex) {
+        g_txindex->Stop();
+        g_txindex.reset();
+    }
+    if (g_addressindex) {
+        g_addressindex->Stop();
+        g_addressindex.reset();
+    }
+    if (g_blockfilterindex) {
+        g_blockfilterindex->Stop();
+        g_blockfilterindex.reset();
+    }
+    if (g_blockstatsindex) {
+        g_blockstatsindex->Stop();
+        g_blockstatsindex.reset();
+    }
+
     {
         LOCK(cs_main);
         if (pcoinsTip != nullptr) {
@@ -327,10 +365,14 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-blockcachesize=<n>", strprintf(_("Keep recently used blocks in memory, up to <n> megabytes (0 to disable, default: %u)"), DEFAULT_BLOCK_CACHE_SIZE));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-blockfilemaps=<n>", strprintf("Keep up to <n> finalized block files memory-mapped for reading blocks (0 to disable, default: %u)", DEFAULT_BLOCKFILE_MAPS));
     strUsage +=HelpMessageOpt("-assumevalid=<hex>", strprintf(_("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)"), defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()));
+    strUsage += HelpMessageOpt("-compactundo", strprintf(_("Write new undo data in a more compact encoding; rev*.dat files written this way cannot be read by older versions (default: %u)"), DEFAULT_COMPACT_UNDO));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), BITCOIN_CONF_FILENAME));
     if (mode == HMM_BITCOIND)
     {
@@ -340,6 +382,7 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     if (showDebug) {
+        strUsage += HelpMessageOpt("-backgroundflush", strprintf("Write the coins cache to disk from a background thread; memory use may peak at about twice -dbcache while a write is in flight (default: %u)", DEFAULT_BACKGROUND_FLUSH));
         strUsage += HelpMessageOpt("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize));
     }
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
@@ -350,6 +393,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-undocachesize=<n>", strprintf(_("Keep the undo data of recently used blocks in memory, up to <n> megabytes (0 to disable, default: %u)"), DEFAULT_UNDO_CACHE_SIZE));
     if (showDebug) {
         strUsage += HelpMessageOpt("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()));
     }
@@ -360,11 +404,20 @@ std::string HelpMessage(HelpMessageMode mode)
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. "
+            "Blocks within %u blocks of the tip or after the last sync checkpoint are always kept. This mode is incompatible with -rescan. "
+            "Warning: Reverting this setting requires re-downloading the entire blockchain. "
+            "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >%u = automatically prune block files to stay under the specified target size in MiB)"), MIN_BLOCKS_TO_KEEP, MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-fastprune", "Use smaller block files, so that pruning can be tested on short chains (default: 0)");
     strUsage += HelpMessageOpt("-reindex-chainstate", _("Rebuild chain state from the currently indexed blocks"));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild chain state and block index from the blk*.dat files on disk"));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain an index of the outputs and spends of every script, used by the getaddress* rpc calls (default: %u)"), DEFAULT_ADDRESSINDEX));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain an index of BIP 158 basic block filters, used by the getblockfilter rpc call and the REST interface (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
+    strUsage += HelpMessageOpt("-blockstatsindex", strprintf(_("Maintain an index of per block statistics, used by the getblockstats rpc call (default: %u)"), DEFAULT_BLOCKSTATSINDEX));
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
@@ -424,6 +477,7 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug)
     {
         strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
+        strUsage += HelpMessageOpt("-checkblocksbackground", strprintf(_("Finish reading and checking the block and undo files of -checkblocks in the background, after the node has started (default: %u)"), DEFAULT_CHECKBLOCKS_BACKGROUND));
         strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
@@ -452,6 +506,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-adaptivesigcache=<n>", strprintf("Let the signature and script execution caches grow to <n> MiB together when connected blocks miss them (0 to disable, default: %u)", DEFAULT_ADAPTIVE_SIG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
     strUsage += HelpMessageOpt("-printtoconsole", _("Send trace/debug info to console instead of debug.log file"));
@@ -493,6 +548,7 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
+        strUsage += HelpMessageOpt("-scanthreads=<n>", "Set the number of threads the scantxoutset RPC splits the UTXO set over (default: number of cores)");
     }
     strUsage += HelpMessageOpt("-nominting", _("Disable minting of POS blocks"));
 
@@ -548,6 +604,47 @@ static void BlockNotifyGenesisWait(bool, const CBlockIndex *pBlockIndex)
     }
 }
 
+// If we're using -prune with -reindex, then delete block files that will be ignored by the
+// reindex.  Since reindexing works by starting at block file 0 and looping until a blockfile
+// is missing, do the same here to delete any later block files after a gap.  Also delete all
+// rev files since they'll be rewritten by the reindex anyway.  This ensures that vinfoBlockFile
+// is in sync with what's actually on disk by the time we start downloading, so that pruning
+// works correctly.
+static void CleanupBlockRevFiles()
+{
+    std::map<std::string, fs::path> mapBlockFiles;
+
+    // Glob all blk?????.dat and rev?????.dat files from the blocks directory.
+    // Remove the rev files immediately and insert the blk file paths into an
+    // ordered map keyed by block file index.
+    LogPrintf("Removing unusable blk?????.dat and rev?????.dat files for -reindex with -prune\n");
+    fs::path blocksdir = GetDataDir() / "blocks";
+    for (fs::directory_iterator it(blocksdir); it != fs::directory_iterator(); it++) {
+        if (fs::is_regular_file(*it) &&
+            it->path().filename().string().length() == 12 &&
+            it->path().filename().string().substr(8,4) == ".dat")
+        {
+            if (it->path().filename().string().substr(0,3) == "blk")
+                mapBlockFiles[it->path().filename().string().substr(3,5)] = it->path();
+            else if (it->path().filename().string().substr(0,3) == "rev")
+                remove(it->path());
+        }
+    }
+
+    // Remove all block files that aren't part of a contiguous set starting at
+    // zero by walking the ordered map (keys are block file indices) by
+    // keeping a separate counter.  Once we hit a gap (or if 0 doesn't exist)
+    // start removing block files.
+    int nContigCounter = 0;
+    for (const std::pair<const std::string, fs::path>& item : mapBlockFiles) {
+        if (atoi(item.first) == nContigCounter) {
+            nContigCounter++;
+            continue;
+        }
+        remove(item.second);
+    }
+}
+
 struct CImportingNow
 {
     CImportingNow() {
@@ -914,6 +1011,7 @@ bool AppInitParameterInteraction()
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fCompactUndo = gArgs.GetBoolArg("-compactundo", DEFAULT_COMPACT_UNDO);
 
     hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
     if (!hashAssumeValid.IsNull())
@@ -950,6 +1048,38 @@ bool AppInitParameterInteraction()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // donu: the transaction index is needed to validate proof-of-stake blocks
+    if (!gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
+        return InitError(_("The transaction index is required for proof-of-stake validation and cannot be disabled."));
+
+    // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
+    int64_t nPruneArg = gArgs.GetArg("-prune", 0);
+    if (nPruneArg < 0) {
+        return InitError(_("Prune cannot be configured with a negative value."));
+    }
+    nPruneTarget = (uint64_t) nPruneArg * 1024 * 1024;
+    if (nPruneArg == 1) {  // manual pruning: -prune=1
+        LogPrintf("Block pruning enabled.  Use RPC call pruneblockchain(height) to manually prune block and undo files.\n");
+        nPruneTarget = std::numeric_limits<uint64_t>::max();
+        fPruneMode = true;
+    } else if (nPruneTarget) {
+        if (nPruneTarget < MIN_DISK_SPACE_FOR_BLOCK_FILES) {
+            return InitError(strprintf(_("Prune configured below the minimum of %d MiB.  Please use a higher number."), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+        }
+        LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
+        fPruneMode = true;
+    }
+    if (fPruneMode && gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+        return InitError(_("Prune mode is incompatible with -addressindex."));
+    if (fPruneMode && gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+        return InitError(_("Prune mode is incompatible with -blockfilterindex."));
+    if (fPruneMode && gArgs.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX))
+        return InitError(_("Prune mode is incompatible with -blockstatsindex."));
+
+    g_block_cache.SetMaxUsage(std::max<int64_t>(0, gArgs.GetArg("-blockcachesize", DEFAULT_BLOCK_CACHE_SIZE)) << 20);
+    g_block_undo_cache.SetMaxUsage(std::max<int64_t>(0, gArgs.GetArg("-undocachesize", DEFAULT_UNDO_CACHE_SIZE)) << 20);
+    g_mapped_block_files.SetMaxFiles(std::max<int64_t>(0, gArgs.GetArg("-blockfilemaps", DEFAULT_BLOCKFILE_MAPS)));
+
     nConnectTimeout = gArgs.GetArg("-timeout", DEFAULT_CONNECT_TIMEOUT);
     if (nConnectTimeout <= 0)
         nConnectTimeout = DEFAULT_CONNECT_TIMEOUT;
@@ -1012,6 +1142,8 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string aes_algo = AESAutoDetect();
+    LogPrintf("Using the '%s' AES implementation\n", aes_algo);
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1250,9 +1382,16 @@ bool AppInitMain()
     int64_t nTotalCache = (gArgs.GetArg("-dbcache", nDefaultDbCache) << 20);
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greater than nMaxDbcache
-    int64_t nBlockTreeDBCache = nTotalCache / 8;
-    nBlockTreeDBCache = std::min(nBlockTreeDBCache, (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
+    int64_t nBlockTreeDBCache = std::min(nTotalCache / 8, nMaxBlockDBCache << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nTxIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxTxIndexCache << 20 : 0);
+    nTotalCache -= nTxIndexCache;
+    int64_t nAddressIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) ? nMaxTxIndexCache << 20 : 0);
+    nTotalCache -= nAddressIndexCache;
+    int64_t nFilterIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX) ? nMaxFilterIndexCache << 20 : 0);
+    nTotalCache -= nFilterIndexCache;
+    int64_t nStatsIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX) ? nMaxStatsIndexCache << 20 : 0);
+    nTotalCache -= nStatsIndexCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1260,6 +1399,13 @@ bool AppInitMain()
     int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for transaction index database\n", nTxIndexCache * (1.0 / 1024 / 1024));
+    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+        LogPrintf("* Using %.1fMiB for address index database\n", nAddressIndexCache * (1.0 / 1024 / 1024));
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+        LogPrintf("* Using %.1fMiB for block filter index database\n", nFilterIndexCache * (1.0 / 1024 / 1024));
+    if (gArgs.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX))
+        LogPrintf("* Using %.1fMiB for block stats index database\n", nStatsIndexCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
@@ -1273,6 +1419,8 @@ bool AppInitMain()
         nStart = GetTimeMillis();
         do {
             try {
+                // The transaction index holds on to entries of the block index
+                g_txindex.reset();
                 UnloadBlockIndex();
                 pcoinsTip.reset();
                 pcoinsdbview.reset();
@@ -1282,14 +1430,16 @@ bool AppInitMain()
                 pblocktree.reset();
                 pblocktree.reset(new CBlockTreeDB(nBlockTreeDBCache, false, fReset));
 
-                if (fReset)
+                if (fReset) {
                     pblocktree->WriteReindexing(true);
+                    //If we're reindexing in prune mode, wipe away unusable block files and all undo data files
+                    if (fPruneMode)
+                        CleanupBlockRevFiles();
+                }
 
                 if (fRequestShutdown) break;
 
-                // LoadBlockIndex will load fTxIndex from the db, or set it if
-                // we're reindexing.
-                // Note that it also sets fReindex based on the disk flag!
+                // LoadBlockIndex will set fReindex based on the disk flag!
                 // From here on out fReindex and fReset mean something different!
                 if (!LoadBlockIndex(chainparams)) {
                     strLoadError = _("Error loading block database");
@@ -1301,9 +1451,10 @@ bool AppInitMain()
                 if (!mapBlockIndex.empty() && mapBlockIndex.count(chainparams.GetConsensus().hashGenesisBlock) == 0)
                     return InitError(_("Incorrect or no genesis block found. Wrong datadir for network?"));
 
-                // Check for changed -txindex state
-                if (fTxIndex != gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex to change -txindex");
+                // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
+                // in the past, but is now trying to run unpruned.
+                if (fHavePruned && !fPruneMode) {
+                    strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
                     break;
                 }
 
@@ -1348,6 +1499,11 @@ bool AppInitMain()
                 // The on-disk coinsdb is now in a good state, create the cache
                 pcoinsTip.reset(new CCoinsViewCache(pcoinscatcher.get()));
 
+                if (!LoadUTXOCommitment()) {
+                    strLoadError = _("Error loading the UTXO set commitment");
+                    break;
+                }
+
                 bool is_coinsview_empty = fReset || fReindexChainState || pcoinsTip->GetBestBlock().IsNull();
                 if (!is_coinsview_empty) {
                     // LoadChainTip sets chainActive based on pcoinsTip's best block
@@ -1369,6 +1525,15 @@ bool AppInitMain()
                     }
                 }
 
+                // The transaction index catches up with the chain in the background
+                // from here on. Proof-of-stake checks need it, so it has to exist
+                // before any block is connected, including by VerifyDB below.
+                g_txindex.reset(new TxIndex(nTxIndexCache, false, fReset));
+                if (!g_txindex->Start()) {
+                    strLoadError = _("Error initializing transaction index");
+                    break;
+                }
+
                 if (!is_coinsview_empty) {
                     uiInterface.InitMessage(_("Verifying blocks..."));
 
@@ -1384,8 +1549,14 @@ bool AppInitMain()
                         }
                     }
 
+                    if (fHavePruned && gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS) > MIN_BLOCKS_TO_KEEP) {
+                        LogPrintf("Prune: pruned datadir may not have more than %d blocks; only checking available blocks\n",
+                            MIN_BLOCKS_TO_KEEP);
+                    }
+
                     if (!CVerifyDB().VerifyDB(chainparams, pcoinsdbview.get(), gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL),
-                                  gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS))) {
+                                  gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS), std::max(1, nScriptCheckThreads),
+                                  gArgs.GetBoolArg("-checkblocksbackground", DEFAULT_CHECKBLOCKS_BACKGROUND))) {
                         strLoadError = _("Corrupted block database detected");
                         break;
                     }
@@ -1399,6 +1570,11 @@ bool AppInitMain()
             fLoaded = true;
         } while(false);
 
+        if (!fLoaded) {
+            // Block files may be about to be rebuilt
+            StopBackgroundVerify();
+        }
+
         if (!fLoaded && !fRequestShutdown) {
             // first suggest a reindex
             if (!fReset) {
@@ -1431,6 +1607,28 @@ bool AppInitMain()
         LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
     }
 
+    // The address, block filter and block stats indices are not needed for
+    // validation, so they only start catching up with the chain once
+    // everything else has been loaded.
+    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        g_addressindex.reset(new AddressIndex(nAddressIndexCache, false, fReindex));
+        if (!g_addressindex->Start()) {
+            return InitError(_("Error initializing address index"));
+        }
+    }
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        g_blockfilterindex.reset(new BlockFilterIndex(BlockFilterType::BASIC, nFilterIndexCache, false, fReindex));
+        if (!g_blockfilterindex->Start()) {
+            return InitError(_("Error initializing block filter index"));
+        }
+    }
+    if (gArgs.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX)) {
+        g_blockstatsindex.reset(new BlockStatsIndex(nStatsIndexCache, false, fReindex));
+        if (!g_blockstatsindex->Start()) {
+            return InitError(_("Error initializing block stats index"));
+        }
+    }
+
     // ********************************************************* Step 8: load wallet
 #ifdef ENABLE_WALLET
     if (!OpenWallets())
@@ -1441,6 +1639,17 @@ bool AppInitMain()
 
     // ********************************************************* Step 9: data directory maintenance
 
+    // if pruning, unset the service bit and perform the initial blockstore prune
+    // after any wallet rescanning has taken place.
+    if (fPruneMode) {
+        LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
+        nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
+        if (!fReindex) {
+            uiInterface.InitMessage(_("Pruning blockstore..."));
+            PruneAndFlush();
+        }
+    }
+
     // Note that setting NODE_WITNESS is never required: the only downside from not
     // doing so is that after activation, no upgraded nodes will fetch from you.
     nLocalServices = ServiceFlags(nLocalServices | NODE_WITNESS);
@@ -1466,6 +1675,9 @@ bool AppInitMain()
         vImportFiles.push_back(strFile);
     }
 
+    if (gArgs.GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH))
+        pcoinsdbview->StartBackgroundFlush();
+
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
 
     // Wait for genesis block to be processed
@@ -1570,6 +1782,7 @@ bool AppInitMain()
     // ********************************************************* Step 12: finished
 
     SetRPCWarmupFinished();
+    LogPrintf("RPC ready %ds after startup\n", GetTime() - GetStartupTime());
     uiInterface.InitMessage(_("Done loading"));
 
 #ifdef ENABLE_WALLET
@@ -17,6 +17,8 @@ class thread_group;
 } // namespace boost
 
 void StartShutdown();
+/** Clear a shutdown request that has not been acted on yet */
+void AbortShutdown();
 bool ShutdownRequested();
 /** Interrupt threads */
 void Interrupt();
@@ -9,7 +9,7 @@
 #include <streams.h>
 #include <timedata.h>
 #include <bignum.h>
-#include <txdb.h>
+#include <index/txindex.h>
 #include <consensus/validation.h>
 #include <random.h>
 #include <script/interpreter.h>
@@ -391,6 +391,103 @@ static bool GetKernelStakeModifier(CBlockIndex* pindexPrev, uint256 hashBlockFro
         return GetKernelStakeModifierV03(pindexPrev, hashBlockFrom, nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake);
 }
 
+// Read txPrev and the header of its block at a transaction index position
+static bool ReadStakeKernelPrevout(const CDiskTxPos& postx, const COutPoint& prevout, CStakeKernelPrevout& kernel)
+{
+    CBlockHeader header;
+    CTransactionRef txPrev;
+    {
+        CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+            return false;
+        try {
+            file >> header;
+            fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+            file >> txPrev;
+        } catch (std::exception &e) {
+            return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+        }
+    }
+    if (txPrev->GetHash() != prevout.hash)
+        return error("%s() : txid mismatch", __PRETTY_FUNCTION__);
+    if (prevout.n >= txPrev->vout.size())
+        return error("%s() : prevout index out of range", __PRETTY_FUNCTION__);
+
+    BlockMap::const_iterator mi = mapBlockIndex.find(header.GetHash());
+    if (mi == mapBlockIndex.end())
+        return error("%s() : block of txPrev not found", __PRETTY_FUNCTION__);
+
+    kernel.pindexFrom = mi->second;
+    kernel.nTxPrevOffset = postx.nTxOffset + CBlockHeader::NORMAL_SERIALIZE_SIZE;
+    kernel.nTimeTxPrev = txPrev->nTime;
+    kernel.txout = txPrev->vout[prevout.n];
+    return true;
+}
+
+// Take the kernel data from a coin created by a block that pindexPrev builds
+// on. The transaction index still supplies the offset of txPrev, and has to
+// agree with the coin on the block, which it can tell even once that block
+// has been pruned.
+static bool KernelPrevoutFromCoin(const Coin& coin, const CDiskTxPos& postx, const CBlockIndex* pindexPrev, CStakeKernelPrevout& kernel)
+{
+    const CBlockIndex* pindexFrom = chainActive[coin.nHeight];
+    if (!pindexFrom || pindexPrev->GetAncestor(coin.nHeight) != pindexFrom)
+        return false;
+    if (pindexFrom->nStatus & BLOCK_HAVE_DATA) {
+        if (pindexFrom->nFile != postx.nFile || pindexFrom->nDataPos != postx.nPos)
+            return false;
+    } else {
+        uint256 hashBlock;
+        if (!g_txindex->FindBlockHash(postx, hashBlock) || hashBlock != pindexFrom->GetBlockHash())
+            return false;
+    }
+
+    kernel.pindexFrom = pindexFrom;
+    kernel.nTxPrevOffset = postx.nTxOffset + CBlockHeader::NORMAL_SERIALIZE_SIZE;
+    kernel.nTimeTxPrev = coin.nTime;
+    kernel.txout = coin.out;
+    return true;
+}
+
+bool GetStakeKernelPrevout(const COutPoint& prevout, const CBlockIndex* pindexPrev, CStakeKernelPrevout& kernel)
+{
+    AssertLockHeld(cs_main);
+
+    // Transaction index is required to get the offset of txPrev
+    if (!g_txindex)
+        return error("GetStakeKernelPrevout() : transaction index not available");
+
+    // Get transaction index for the previous transaction; the index is
+    // brought up to pindexPrev first if it has not caught up with it yet
+    CDiskTxPos postx;
+    if (!g_txindex->FindTxPositionSynced(prevout.hash, postx, pindexPrev->nHeight))
+        return error("GetStakeKernelPrevout() : tx index not found");
+
+    // Usually the output is still unspent, and everything else is in memory.
+    // The UTXO set is that of the active chain, so it only describes the
+    // outputs pindexPrev can spend if pindexPrev is on it.
+    Coin coin;
+    if (chainActive.Contains(pindexPrev) && pcoinsTip->GetCoin(prevout, coin) && KernelPrevoutFromCoin(coin, postx, pindexPrev, kernel))
+        return true;
+
+    // Spent in the active chain, or staked on another branch. The index keeps
+    // the entries of disconnected blocks, so the block found has to be one
+    // that pindexPrev builds on; if it is not, the index may not have caught
+    // up with the block that holds txPrev now, so look again once it has.
+    if (ReadStakeKernelPrevout(postx, prevout, kernel) && pindexPrev->GetAncestor(kernel.pindexFrom->nHeight) == kernel.pindexFrom)
+        return true;
+    if (g_txindex->BlockUntilSyncedToHeight(pindexPrev->nHeight) && g_txindex->FindTxPosition(prevout.hash, postx) &&
+        ReadStakeKernelPrevout(postx, prevout, kernel) && pindexPrev->GetAncestor(kernel.pindexFrom->nHeight) == kernel.pindexFrom)
+        return true;
+
+    // The block of txPrev may have been pruned; the output can then only have
+    // been spent by one of the recent blocks that are still on disk
+    if (fHavePruned && GetCoinSpentSince(prevout, chainActive.FindFork(pindexPrev), coin) && KernelPrevoutFromCoin(coin, postx, pindexPrev, kernel))
+        return true;
+
+    return false;
+}
+
 // donu kernel protocol
 // coinstake must meet hash target according to the protocol:
 // kernel (input 0) must meet the formula
@@ -417,23 +514,25 @@ static bool GetKernelStakeModifier(CBlockIndex* pindexPrev, uint256 hashBlockFro
 //   quantities so as to generate blocks faster, degrading the system back into
 //   a proof-of-work situation.
 //
-bool CheckStakeKernelHash(unsigned int nBits, CBlockIndex* pindexPrev, const CBlockHeader& blockFrom, unsigned int nTxPrevOffset, const CTransactionRef& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, bool fPrintProofOfStake)
+bool CheckStakeKernelHash(unsigned int nBits, CBlockIndex* pindexPrev, const CStakeKernelPrevout& kernel, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, bool fPrintProofOfStake)
 {
     const Consensus::Params& params = Params().GetConsensus();
-    if (nTimeTx < txPrev->nTime)  // Transaction timestamp violation
+    const unsigned int nTxPrevOffset = kernel.nTxPrevOffset;
+    const unsigned int nTimeTxPrev = kernel.nTimeTxPrev;
+    if (nTimeTx < nTimeTxPrev)  // Transaction timestamp violation
         return error("CheckStakeKernelHash() : nTime violation");
 
-    unsigned int nTimeBlockFrom = blockFrom.GetBlockTime();
+    unsigned int nTimeBlockFrom = kernel.pindexFrom->GetBlockTime();
     if (nTimeBlockFrom + params.nStakeMinAge > nTimeTx) // Min age requirement
         return error("CheckStakeKernelHash() : min age violation");
 
     CBigNum bnTargetPerCoinDay;
     bnTargetPerCoinDay.SetCompact(nBits);
-    int64_t nValueIn = txPrev->vout[prevout.n].nValue;
+    int64_t nValueIn = kernel.txout.nValue;
     // v0.3 protocol kernel hash weight starts from 0 at the 30-day min age
     // this change increases active coins participating the hash and helps
     // to secure the network when proof-of-stake difficulty is low
-    int64_t nTimeWeight = min((int64_t)nTimeTx - txPrev->nTime, params.nStakeMaxAge) - (IsProtocolV03(nTimeTx)? params.nStakeMinAge : 0);
+    int64_t nTimeWeight = min((int64_t)nTimeTx - nTimeTxPrev, params.nStakeMaxAge) - (IsProtocolV03(nTimeTx)? params.nStakeMinAge : 0);
     CBigNum bnCoinDayWeight = CBigNum(nValueIn) * nTimeWeight / COIN / (24 * 60 * 60) * 1000;
     // Calculate hash
     CDataStream ss(SER_GETHASH, 0);
@@ -442,7 +541,7 @@ bool CheckStakeKernelHash(unsigned int nBits, CBlockIndex* pindexPrev, const CBl
     int64_t nStakeModifierTime = 0;
     if (IsProtocolV03(nTimeTx))  // v0.3 protocol
     {
-        if (!GetKernelStakeModifier(pindexPrev, blockFrom.GetHash(), nTimeTx, nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake))
+        if (!GetKernelStakeModifier(pindexPrev, kernel.pindexFrom->GetBlockHash(), nTimeTx, nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake))
             return false;
         ss << nStakeModifier;
     }
@@ -451,7 +550,7 @@ bool CheckStakeKernelHash(unsigned int nBits, CBlockIndex* pindexPrev, const CBl
         ss << nBits;
     }
 
-    ss << nTimeBlockFrom << nTxPrevOffset << txPrev->nTime << prevout.n << nTimeTx;
+    ss << nTimeBlockFrom << nTxPrevOffset << nTimeTxPrev << prevout.n << nTimeTx;
     hashProofOfStake = Hash(ss.begin(), ss.end());
     if (fPrintProofOfStake)
     {
@@ -459,12 +558,12 @@ bool CheckStakeKernelHash(unsigned int nBits, CBlockIndex* pindexPrev, const CBl
             LogPrintf("CheckStakeKernelHash() : using modifier 0x%016x at height=%d timestamp=%s for block from height=%d timestamp=%s\n",
                 nStakeModifier, nStakeModifierHeight,
                 DateTimeStrFormat(nStakeModifierTime),
-                mapBlockIndex[blockFrom.GetHash()]->nHeight,
-                DateTimeStrFormat(blockFrom.GetBlockTime()));
+                kernel.pindexFrom->nHeight,
+                DateTimeStrFormat(nTimeBlockFrom));
         LogPrintf("CheckStakeKernelHash() : check protocol=%s modifier=0x%016x nTimeBlockFrom=%u nTxPrevOffset=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             IsProtocolV05(nTimeTx)? "0.5" : (IsProtocolV03(nTimeTx)? "0.3" : "0.2"),
             IsProtocolV03(nTimeTx)? nStakeModifier : (uint64_t) nBits,
-            nTimeBlockFrom, nTxPrevOffset, txPrev->nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, nTxPrevOffset, nTimeTxPrev, prevout.n, nTimeTx,
             hashProofOfStake.ToString());
     }
 
@@ -477,12 +576,12 @@ bool CheckStakeKernelHash(unsigned int nBits, CBlockIndex* pindexPrev, const CBl
             LogPrintf("CheckStakeKernelHash() : using modifier 0x%016x at height=%d timestamp=%s for block from height=%d timestamp=%s\n",
                 nStakeModifier, nStakeModifierHeight, 
                 DateTimeStrFormat(nStakeModifierTime),
-                mapBlockIndex[blockFrom.GetHash()]->nHeight,
-                DateTimeStrFormat(blockFrom.GetBlockTime()));
+                kernel.pindexFrom->nHeight,
+                DateTimeStrFormat(nTimeBlockFrom));
         LogPrintf("CheckStakeKernelHash() : pass protocol=%s modifier=0x%016x nTimeBlockFrom=%u nTxPrevOffset=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             IsProtocolV03(nTimeTx)? "0.3" : "0.2",
             IsProtocolV03(nTimeTx)? nStakeModifier : (uint64_t) nBits,
-            nTimeBlockFrom, nTxPrevOffset, txPrev->nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, nTxPrevOffset, nTimeTxPrev, prevout.n, nTimeTx,
             hashProofOfStake.ToString());
     }
     return true;
@@ -497,42 +596,22 @@ bool CheckProofOfStake(CValidationState &state, CBlockIndex* pindexPrev, const C
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
     const CTxIn& txin = tx->vin[0];
 
-    // Transaction index is required to get to block header
-    if (!fTxIndex)
-        return error("CheckProofOfStake() : transaction index not available");
-
-    // Get transaction index for the previous transaction
-    CDiskTxPos postx;
-    if (!pblocktree->ReadTxIndex(txin.prevout.hash, postx))
-        return error("CheckProofOfStake() : tx index not found");  // tx index not found
-
-    // Read txPrev and header of its block
-    CBlockHeader header;
-    CTransactionRef txPrev;
-    {
-        CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-        try {
-            file >> header;
-            fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-            file >> txPrev;
-        } catch (std::exception &e) {
-            return error("%s() : deserialize or I/O error in CheckProofOfStake()", __PRETTY_FUNCTION__);
-        }
-        if (txPrev->GetHash() != txin.prevout.hash)
-            return error("%s() : txid mismatch in CheckProofOfStake()", __PRETTY_FUNCTION__);
-    }
+    // Look up the kernel data of the staked output
+    CStakeKernelPrevout kernel;
+    if (!GetStakeKernelPrevout(txin.prevout, pindexPrev, kernel))
+        return error("CheckProofOfStake() : kernel prevout %s not found", txin.prevout.ToString());
 
     // Verify signature
     {
         int nIn = 0;
-        const CTxOut& prevOut = txPrev->vout[tx->vin[nIn].prevout.n];
+        const CTxOut& prevOut = kernel.txout;
         TransactionSignatureChecker checker(&(*tx), nIn, prevOut.nValue, PrecomputedTransactionData(*tx));
 
         if (!VerifyScript(tx->vin[nIn].scriptSig, prevOut.scriptPubKey, &(tx->vin[nIn].scriptWitness), SCRIPT_VERIFY_P2SH, checker, nullptr))
             return state.DoS(100, false, REJECT_INVALID, "invalid-pos-script", false, strprintf("%s: VerifyScript failed on coinstake %s", __func__, tx->GetHash().ToString()));
     }
 
-    if (!CheckStakeKernelHash(nBits, pindexPrev, header, postx.nTxOffset + CBlockHeader::NORMAL_SERIALIZE_SIZE, txPrev, txin.prevout, tx->nTime, hashProofOfStake, gArgs.GetBoolArg("-debug", false)))
+    if (!CheckStakeKernelHash(nBits, pindexPrev, kernel, txin.prevout, tx->nTime, hashProofOfStake, gArgs.GetBoolArg("-debug", false)))
         return state.DoS(1, error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s", tx->GetHash().ToString(), hashProofOfStake.ToString())); // may occur during initial download or if behind on block chain sync
 
     return true;
@@ -33,9 +33,24 @@ bool IsBTC16BIPsEnabled(uint32_t nTimeTx);
 // Compute the hash modifier for proof-of-stake
 bool ComputeNextStakeModifier(const CBlockIndex* pindexCurrent, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier);
 
+// The parts of a staked output and of the transaction and block that created
+// it which go into the kernel hash
+struct CStakeKernelPrevout
+{
+    const CBlockIndex* pindexFrom;  // block containing txPrev
+    unsigned int nTxPrevOffset;     // offset of txPrev in that block, including the header
+    unsigned int nTimeTxPrev;
+    CTxOut txout;
+};
+
+// Look up the kernel data of a prevout as seen from pindexPrev, from the UTXO
+// set, the transaction index and the block index; block data is only read
+// when the output is not unspent in the active chain
+bool GetStakeKernelPrevout(const COutPoint& prevout, const CBlockIndex* pindexPrev, CStakeKernelPrevout& kernel);
+
 // Check whether stake kernel meets hash target
 // Sets hashProofOfStake on success return
-bool CheckStakeKernelHash(unsigned int nBits, CBlockIndex* pindexPrev, const CBlockHeader& blockFrom, unsigned int nTxPrevOffset, const CTransactionRef& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, bool fPrintProofOfStake=false);
+bool CheckStakeKernelHash(unsigned int nBits, CBlockIndex* pindexPrev, const CStakeKernelPrevout& kernel, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, bool fPrintProofOfStake=false);
 
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
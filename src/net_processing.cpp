@@ -8,6 +8,7 @@
 #include <alert.h>
 #include <addrman.h>
 #include <arith_uint256.h>
+#include <blockcache.h>
 #include <blockencodings.h>
 #include <chainparams.h>
 #include <consensus/validation.h>
@@ -1051,6 +1052,23 @@ static void RelayAddress(const CAddress& addr, bool fReachable, CConnman* connma
     connman->ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+/**
+ * Build a BLOCK message from a block as stored on disk. Peers that understand
+ * PoS headers expect the header flags after the 80 byte header; a block read
+ * from disk always has them cleared, so zero is what serializing it would give.
+ */
+static CSerializedNetMsg MakeRawBlockMsg(int nSendVersion, std::vector<uint8_t>&& vBlock)
+{
+    CSerializedNetMsg msg;
+    msg.command = NetMsgType::BLOCK;
+    msg.data = std::move(vBlock);
+    if (nSendVersion > OLD_VERSION) {
+        assert(msg.data.size() >= (size_t)CBlockHeader::NORMAL_SERIALIZE_SIZE);
+        msg.data.insert(msg.data.begin() + CBlockHeader::NORMAL_SERIALIZE_SIZE, sizeof(int32_t), 0);
+    }
+    return msg;
+}
+
 void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensusParams, const CInv& inv, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     bool send = false;
@@ -1120,16 +1138,23 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
     if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
     {
         std::shared_ptr<const CBlock> pblock;
+        std::vector<uint8_t> vRawBlock;
         if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
             pblock = a_recent_block;
+        } else if (inv.type == MSG_WITNESS_BLOCK) {
+            // Unless the block is cached, send it as stored on disk: that is
+            // its witness serialization, so it need not be deserialized first
+            pblock = g_block_cache.Get((*mi).second->GetBlockHash());
+            if (!pblock && !ReadRawBlockFromDisk(vRawBlock, (*mi).second, Params().MessageStart()))
+                assert(!"cannot load block from disk");
         } else {
             // Send block from disk
-            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, (*mi).second, consensusParams))
+            if (!ReadBlockFromDisk(pblock, (*mi).second, consensusParams))
                 assert(!"cannot load block from disk");
-            pblock = pblockRead;
         }
-        if (inv.type == MSG_BLOCK)
+        if (!pblock)
+            connman->PushMessage(pfrom, MakeRawBlockMsg(pfrom->GetSendVersion(), std::move(vRawBlock)));
+        else if (inv.type == MSG_BLOCK)
             connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
         else if (inv.type == MSG_WITNESS_BLOCK)
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
@@ -2032,6 +2057,14 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     pfrom->PushInventory(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
                 break;
             }
+            // If pruning, don't inv blocks unless we have on disk and are likely to still have
+            // for some reasonable time window (1 hour) that block relay might require.
+            const int nPrunedBlocksLikelyToHave = MIN_BLOCKS_TO_KEEP - 3600 / chainparams.GetConsensus().nTargetSpacing;
+            if (fPruneMode && (!(pindex->nStatus & BLOCK_HAVE_DATA) || pindex->nHeight <= chainActive.Tip()->nHeight - nPrunedBlocksLikelyToHave))
+            {
+                LogPrint(BCLog::NET, " getblocks stopping, pruned or too old block at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                break;
+            }
             pfrom->PushInventory(CInv(MSG_BLOCK, pindex->GetBlockHash()));
             if (--nLimit <= 0)
             {
@@ -2087,11 +2120,11 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             return true;
         }
 
-        CBlock block;
-        bool ret = ReadBlockFromDisk(block, it->second, chainparams.GetConsensus());
+        std::shared_ptr<const CBlock> pblock;
+        bool ret = ReadBlockFromDisk(pblock, it->second, chainparams.GetConsensus());
         assert(ret);
 
-        SendBlockTransactions(block, req, pfrom, connman);
+        SendBlockTransactions(*pblock, req, pfrom, connman);
     }
 
 
@@ -3537,10 +3570,10 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                         }
                     }
                     if (!fGotBlockFromCache) {
-                        CBlock block;
-                        bool ret = ReadBlockFromDisk(block, pBestIndex, consensusParams);
+                        std::shared_ptr<const CBlock> pblock;
+                        bool ret = ReadBlockFromDisk(pblock, pBestIndex, consensusParams);
                         assert(ret);
-                        CBlockHeaderAndShortTxIDs cmpctblock(block, state.fWantsCmpctWitness);
+                        CBlockHeaderAndShortTxIDs cmpctblock(*pblock, state.fWantsCmpctWitness);
                         connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
                     }
                     state.pindexBestHeaderSent = pBestIndex;
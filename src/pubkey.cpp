@@ -166,14 +166,10 @@ static int ecdsa_signature_parse_der_lax(const secp256k1_context* ctx, secp256k1
     return 1;
 }
 
-bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
-    if (!IsValid())
-        return false;
-    secp256k1_pubkey pubkey;
+/** Verify a DER signature against an already parsed public key. */
+static bool VerifyParsed(const secp256k1_pubkey& pubkey, const uint256 &hash, const std::vector<unsigned char>& vchSig)
+{
     secp256k1_ecdsa_signature sig;
-    if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, &(*this)[0], size())) {
-        return false;
-    }
     if (!ecdsa_signature_parse_der_lax(secp256k1_context_verify, &sig, vchSig.data(), vchSig.size())) {
         return false;
     }
@@ -183,6 +179,16 @@ bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchS
     return secp256k1_ecdsa_verify(secp256k1_context_verify, &sig, hash.begin(), &pubkey);
 }
 
+bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
+    if (!IsValid())
+        return false;
+    secp256k1_pubkey pubkey;
+    if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, &(*this)[0], size())) {
+        return false;
+    }
+    return VerifyParsed(pubkey, hash, vchSig);
+}
+
 bool CPubKey::RecoverCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) {
     if (vchSig.size() != COMPACT_SIGNATURE_SIZE)
         return false;
@@ -272,13 +278,37 @@ bool CExtPubKey::Derive(CExtPubKey &out, unsigned int _nChild) const {
 }
 
 /* static */ bool CPubKey::CheckLowS(const std::vector<unsigned char>& vchSig) {
+    return CheckLowS(vchSig.data(), vchSig.size());
+}
+
+/* static */ bool CPubKey::CheckLowS(const unsigned char* vchSig, size_t size) {
     secp256k1_ecdsa_signature sig;
-    if (!ecdsa_signature_parse_der_lax(secp256k1_context_verify, &sig, vchSig.data(), vchSig.size())) {
+    if (!ecdsa_signature_parse_der_lax(secp256k1_context_verify, &sig, vchSig, size)) {
         return false;
     }
     return (!secp256k1_ecdsa_signature_normalize(secp256k1_context_verify, nullptr, &sig));
 }
 
+static_assert(sizeof(secp256k1_pubkey) == 64, "CParsedPubKey::data must hold a secp256k1_pubkey");
+
+CParsedPubKey::CParsedPubKey(const CPubKey& pubkey) : fValid(false)
+{
+    secp256k1_pubkey parsed;
+    if (pubkey.IsValid() && secp256k1_ec_pubkey_parse(secp256k1_context_verify, &parsed, pubkey.begin(), pubkey.size())) {
+        memcpy(data, parsed.data, sizeof(data));
+        fValid = true;
+    }
+}
+
+bool CParsedPubKey::Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const
+{
+    if (!fValid)
+        return false;
+    secp256k1_pubkey parsed;
+    memcpy(parsed.data, data, sizeof(data));
+    return VerifyParsed(parsed, hash, vchSig);
+}
+
 /* static */ int ECCVerifyHandle::refcount = 0;
 
 ECCVerifyHandle::ECCVerifyHandle()
@@ -186,6 +186,7 @@ public:
      * Check whether a signature is normalized (lower-S).
      */
     static bool CheckLowS(const std::vector<unsigned char>& vchSig);
+    static bool CheckLowS(const unsigned char* sig, size_t size);
 
     //! Recover a public key from a compact signature.
     bool RecoverCompact(const uint256& hash, const std::vector<unsigned char>& vchSig);
@@ -197,6 +198,27 @@ public:
     bool Derive(CPubKey& pubkeyChild, ChainCode &ccChild, unsigned int nChild, const ChainCode& cc) const;
 };
 
+/** A public key kept in the parsed form libsecp256k1 verifies against, for
+ *  keys that sign many messages (such as block signers). Verify() gives the
+ *  same result as CPubKey::Verify() without parsing the key again. */
+class CParsedPubKey
+{
+private:
+    //! The opaque secp256k1_pubkey
+    unsigned char data[64];
+    bool fValid;
+
+public:
+    CParsedPubKey() : fValid(false) {}
+
+    //! Parse a public key; the result is invalid if it is not fully valid.
+    explicit CParsedPubKey(const CPubKey& pubkey);
+
+    bool IsValid() const { return fValid; }
+
+    bool Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const;
+};
+
 struct CExtPubKey {
     unsigned char nDepth;
     unsigned char vchFingerprint[4];
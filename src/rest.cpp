@@ -6,6 +6,7 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <core_io.h>
+#include <index/blockfilterindex.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <validation.h>
@@ -210,6 +211,10 @@ static bool rest_block(HTTPRequest* req,
 
     CBlock block;
     CBlockIndex* pblockindex = nullptr;
+    // The on-disk serialization includes witness data, so it can be returned
+    // as is unless witness data is to be stripped.
+    const bool fRawBlock = rf != RF_JSON && RPCSerializationFlags() == 0;
+    std::vector<uint8_t> vRawBlock;
     {
         LOCK(cs_main);
         if (mapBlockIndex.count(hash) == 0)
@@ -217,12 +222,18 @@ static bool rest_block(HTTPRequest* req,
 
         pblockindex = mapBlockIndex[hash];
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        if (fRawBlock) {
+            if (!ReadRawBlockFromDisk(vRawBlock, pblockindex, Params().MessageStart()))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        } else if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
     CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ssBlock << block;
+    if (fRawBlock)
+        ssBlock.write((const char*)vRawBlock.data(), vRawBlock.size());
+    else if (rf != RF_JSON)
+        ssBlock << block;
 
     switch (rf) {
     case RF_BINARY: {
@@ -293,6 +304,131 @@ static bool rest_chaininfo(HTTPRequest* req, const std::string& strURIPart)
     }
 }
 
+UniValue getaddresstxids(const JSONRPCRequest& request);
+UniValue getaddressbalance(const JSONRPCRequest& request);
+UniValue getaddressutxos(const JSONRPCRequest& request);
+
+/** Serve an address index query for the single address in the URI through the matching RPC */
+static bool rest_address(HTTPRequest* req, const std::string& strURIPart, UniValue (*rpcfn)(const JSONRPCRequest&))
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string address;
+    const RetFormat rf = ParseDataFormat(address, strURIPart);
+
+    switch (rf) {
+    case RF_JSON: {
+        JSONRPCRequest jsonRequest;
+        jsonRequest.params = UniValue(UniValue::VARR);
+        jsonRequest.params.push_back(address);
+        UniValue result;
+        try {
+            result = rpcfn(jsonRequest);
+        } catch (const UniValue& objError) {
+            return RESTERR(req, HTTP_BAD_REQUEST, find_value(objError, "message").get_str());
+        }
+        std::string strJSON = result.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+}
+
+static bool rest_address_txids(HTTPRequest* req, const std::string& strURIPart)
+{
+    return rest_address(req, strURIPart, getaddresstxids);
+}
+
+static bool rest_address_balance(HTTPRequest* req, const std::string& strURIPart)
+{
+    return rest_address(req, strURIPart, getaddressbalance);
+}
+
+static bool rest_address_utxos(HTTPRequest* req, const std::string& strURIPart)
+{
+    return rest_address(req, strURIPart, getaddressutxos);
+}
+
+static bool rest_block_filter(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    // request is sent over URI scheme /rest/blockfilter/filtertype/blockhash
+    std::vector<std::string> uri_parts;
+    boost::split(uri_parts, param, boost::is_any_of("/"));
+    if (uri_parts.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/blockfilter/<filtertype>/<blockhash>");
+
+    uint256 block_hash;
+    if (!ParseHashStr(uri_parts[1], block_hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + uri_parts[1]);
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(uri_parts[0], filtertype))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Unknown filtertype " + uri_parts[0]);
+
+    if (!g_blockfilterindex || g_blockfilterindex->GetFilterType() != filtertype)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Index is not enabled for filtertype " + uri_parts[0]);
+
+    const CBlockIndex* block_index;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(block_hash);
+        if (it == mapBlockIndex.end())
+            return RESTERR(req, HTTP_NOT_FOUND, uri_parts[1] + " not found");
+        block_index = it->second;
+    }
+
+    bool index_ready = g_blockfilterindex->BlockUntilSyncedToCurrentChain();
+
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!g_blockfilterindex->LookupFilter(block_index, filter) ||
+        !g_blockfilterindex->LookupFilterHeader(block_index, filter_header)) {
+        if (!index_ready)
+            return RESTERR(req, HTTP_NOT_FOUND, "Block filters are still in the process of being indexed");
+        return RESTERR(req, HTTP_NOT_FOUND, "Filter of block " + uri_parts[1] + " not found");
+    }
+
+    switch (rf) {
+    case RF_BINARY: {
+        CDataStream ssResp(SER_NETWORK, PROTOCOL_VERSION);
+        ssResp << filter;
+        std::string binaryResp = ssResp.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryResp);
+        return true;
+    }
+    case RF_HEX: {
+        CDataStream ssResp(SER_NETWORK, PROTOCOL_VERSION);
+        ssResp << filter;
+        std::string strHex = HexStr(ssResp.begin(), ssResp.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    case RF_JSON: {
+        UniValue ret(UniValue::VOBJ);
+        ret.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+        ret.push_back(Pair("header", filter_header.GetHex()));
+        std::string strJSON = ret.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
 static bool rest_mempool_info(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -580,6 +716,10 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/address/txids/", rest_address_txids},
+      {"/rest/address/balance/", rest_address_balance},
+      {"/rest/address/utxos/", rest_address_utxos},
+      {"/rest/blockfilter/", rest_block_filter},
 };
 
 bool StartREST()
@@ -6,6 +6,7 @@
 #include <rpc/blockchain.h>
 
 #include <amount.h>
+#include <blockstats.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -16,6 +17,7 @@
 #include <policy/policy.h>
 #include <primitives/transaction.h>
 #include <rpc/server.h>
+#include <script/sigcache.h>
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
@@ -23,6 +25,11 @@
 #include <util.h>
 #include <utilstrencodings.h>
 #include <hash.h>
+#include <index/addressindex.h>
+#include <index/blockfilterindex.h>
+#include <index/blockstatsindex.h>
+#include <base58.h>
+#include <random.h>
 #include <validationinterface.h>
 #include <warnings.h>
 
@@ -38,6 +45,9 @@
 #include <memory>
 #include <mutex>
 #include <condition_variable>
+#include <thread>
+#include <set>
+#include <unordered_set>
 
 struct CUpdatedBlock
 {
@@ -788,6 +798,9 @@ UniValue getblock(const JSONRPCRequest& request)
     CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+
     if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
@@ -807,6 +820,247 @@ UniValue getblock(const JSONRPCRequest& request)
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
+UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block.\n"
+            "Requires -blockfilterindex.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"          (string, required) The hash of the block\n"
+            "2. \"filtertype\"         (string, optional, default=\"basic\") The type name of the filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",     (string) the hex-encoded filter data\n"
+            "  \"header\" : \"hash\",    (string) the hex-encoded filter header\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\"")
+        );
+
+    uint256 block_hash = ParseHashV(request.params[0], "blockhash");
+    std::string filtertype_name = "basic";
+    if (!request.params[1].isNull()) {
+        filtertype_name = request.params[1].get_str();
+    }
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(filtertype_name, filtertype)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    if (!g_blockfilterindex || g_blockfilterindex->GetFilterType() != filtertype) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + filtertype_name);
+    }
+
+    const CBlockIndex* block_index;
+    bool block_was_connected;
+    {
+        LOCK(cs_main);
+        auto it = mapBlockIndex.find(block_hash);
+        if (it == mapBlockIndex.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        block_index = it->second;
+        block_was_connected = block_index->IsValid(BLOCK_VALID_SCRIPTS);
+    }
+
+    bool index_ready = g_blockfilterindex->BlockUntilSyncedToCurrentChain();
+
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!g_blockfilterindex->LookupFilter(block_index, filter) ||
+        !g_blockfilterindex->LookupFilterHeader(block_index, filter_header)) {
+        int err_code;
+        std::string errmsg = "Filter not found.";
+
+        if (!block_was_connected) {
+            err_code = RPC_INVALID_ADDRESS_OR_KEY;
+            errmsg += " Block was not connected to active chain.";
+        } else if (!index_ready) {
+            err_code = RPC_MISC_ERROR;
+            errmsg += " Block filters are still in the process of being indexed.";
+        } else {
+            err_code = RPC_INTERNAL_ERROR;
+            errmsg += " This error is unexpected and indicates index corruption.";
+        }
+
+        throw JSONRPCError(err_code, errmsg);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+    ret.push_back(Pair("header", filter_header.GetHex()));
+    return ret;
+}
+
+UniValue getblockstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getblockstats hash_or_height ( stats )\n"
+            "\nCompute statistics for a single block. All amounts are in satoshis.\n"
+            "The statistics are computed from the block undo data, and are read from the block statistics index\n"
+            "instead when -blockstatsindex is enabled.\n"
+            "Fee and size statistics leave out the coinbase and the coinstake.\n"
+            "It won't work for some heights with pruning.\n"
+            "\nArguments:\n"
+            "1. \"hash_or_height\"     (string or numeric, required) The block hash or height of the target block\n"
+            "2. \"stats\"              (array,  optional) Values to plot, by default all values (see result below)\n"
+            "    [\n"
+            "      \"height\",         (string, optional) Selected statistic\n"
+            "      \"time\",           (string, optional) Selected statistic\n"
+            "      ,...\n"
+            "    ]\n"
+            "\nResult:\n"
+            "{                           (json object)\n"
+            "  \"avgfee\": xxxxx,          (numeric) Average fee in the block\n"
+            "  \"avgfeerate\": xxxxx,      (numeric) Average feerate (in satoshis per virtual byte)\n"
+            "  \"avgtxsize\": xxxxx,       (numeric) Average transaction size\n"
+            "  \"blockhash\": xxxxx,       (string) The block hash (to check for potential reorgs)\n"
+            "  \"coinagedestroyed\": xxxxx, (numeric) Coin age of the outputs spent in the block, in coin-days\n"
+            "  \"height\": xxxxx,          (numeric) The height of the block\n"
+            "  \"ins\": xxxxx,             (numeric) The number of inputs (excluding coinbase)\n"
+            "  \"maxfee\": xxxxx,          (numeric) Maximum fee in the block\n"
+            "  \"maxfeerate\": xxxxx,      (numeric) Maximum feerate (in satoshis per virtual byte)\n"
+            "  \"maxtxsize\": xxxxx,       (numeric) Maximum transaction size\n"
+            "  \"medianfee\": xxxxx,       (numeric) Truncated median fee in the block\n"
+            "  \"medianfeerate\": xxxxx,   (numeric) Truncated median feerate (in satoshis per virtual byte)\n"
+            "  \"mediantime\": xxxxx,      (numeric) The block median time past\n"
+            "  \"mediantxsize\": xxxxx,    (numeric) Truncated median transaction size\n"
+            "  \"minfee\": xxxxx,          (numeric) Minimum fee in the block\n"
+            "  \"minfeerate\": xxxxx,      (numeric) Minimum feerate (in satoshis per virtual byte)\n"
+            "  \"mintxsize\": xxxxx,       (numeric) Minimum transaction size\n"
+            "  \"minted\": xxxxx,          (numeric) The amount created by the block\n"
+            "  \"moneysupply\": xxxxx,     (numeric) The money supply after the block\n"
+            "  \"outs\": xxxxx,            (numeric) The number of outputs\n"
+            "  \"proofofstake\": xxxxx,    (boolean) Whether the block is proof-of-stake\n"
+            "  \"stakeamount\": xxxxx,     (numeric) The value of the outputs spent by the coinstake\n"
+            "  \"stakereward\": xxxxx,     (numeric) The value gained by the coinstake\n"
+            "  \"swtotal_size\": xxxxx,    (numeric) Total size of all segwit transactions\n"
+            "  \"swtotal_weight\": xxxxx,  (numeric) Total weight of all segwit transactions divided by segwit scale factor (4)\n"
+            "  \"swtxs\": xxxxx,           (numeric) The number of segwit transactions\n"
+            "  \"time\": xxxxx,            (numeric) The block time\n"
+            "  \"total_out\": xxxxx,       (numeric) Total amount in all outputs (excluding coinbase and coinstake and thus reward [ie subsidy + totalfee])\n"
+            "  \"total_size\": xxxxx,      (numeric) Total size of all transactions\n"
+            "  \"total_weight\": xxxxx,    (numeric) Total weight of all transactions\n"
+            "  \"totalfee\": xxxxx,        (numeric) The fee total, which is destroyed\n"
+            "  \"txs\": xxxxx,             (numeric) The number of transactions (including coinbase and coinstake)\n"
+            "  \"utxo_increase\": xxxxx,   (numeric) The increase/decrease in the number of unspent outputs\n"
+            "  \"utxo_size_inc\": xxxxx,   (numeric) The increase/decrease in size for the utxo index (not discounting op_return and similar)\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockstats", "1000 '[\"minfeerate\",\"avgfeerate\"]'")
+            + HelpExampleRpc("getblockstats", "1000 '[\"minfeerate\",\"avgfeerate\"]'")
+        );
+
+    CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        if (request.params[0].isNum()) {
+            const int height = request.params[0].get_int();
+            const int current_tip = chainActive.Height();
+            if (height < 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is negative", height));
+            }
+            if (height > current_tip) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", height, current_tip));
+            }
+
+            pindex = chainActive[height];
+        } else {
+            const uint256 hash = ParseHashV(request.params[0], "hash_or_height");
+            if (mapBlockIndex.count(hash) == 0)
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+            pindex = mapBlockIndex[hash];
+            if (!chainActive.Contains(pindex)) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Block is not in chain %s", Params().NetworkIDString()));
+            }
+        }
+    }
+    assert(pindex != nullptr);
+
+    std::set<std::string> stats;
+    if (!request.params[1].isNull()) {
+        const UniValue stats_univalue = request.params[1].get_array();
+        for (unsigned int i = 0; i < stats_univalue.size(); i++) {
+            const std::string stat = stats_univalue[i].get_str();
+            stats.insert(stat);
+        }
+    }
+
+    // Blocks the index has not caught up with yet are computed below.
+    CBlockStats blockstats;
+    if (!g_blockstatsindex || !g_blockstatsindex->LookupStats(pindex, blockstats)) {
+        LOCK(cs_main);
+        if (fHavePruned && !(pindex->nStatus & BLOCK_HAVE_UNDO) && pindex->nHeight > 0)
+            throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
+            throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+
+        CBlockUndo blockundo;
+        if (pindex->nHeight > 0 && !UndoReadFromDisk(blockundo, pindex))
+            throw JSONRPCError(RPC_MISC_ERROR, "Can't read undo data from disk");
+
+        if (!ComputeBlockStats(block, pindex, blockundo, blockstats))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Undo data does not match the block");
+    }
+
+    UniValue ret_all(UniValue::VOBJ);
+    ret_all.push_back(Pair("avgfee", blockstats.nAvgFee));
+    ret_all.push_back(Pair("avgfeerate", blockstats.nAvgFeeRate));
+    ret_all.push_back(Pair("avgtxsize", blockstats.nAvgTxSize));
+    ret_all.push_back(Pair("blockhash", pindex->GetBlockHash().GetHex()));
+    ret_all.push_back(Pair("coinagedestroyed", blockstats.nCoinAgeDestroyed));
+    ret_all.push_back(Pair("height", (int64_t)pindex->nHeight));
+    ret_all.push_back(Pair("ins", blockstats.nInputs));
+    ret_all.push_back(Pair("maxfee", blockstats.nMaxFee));
+    ret_all.push_back(Pair("maxfeerate", blockstats.nMaxFeeRate));
+    ret_all.push_back(Pair("maxtxsize", blockstats.nMaxTxSize));
+    ret_all.push_back(Pair("medianfee", blockstats.nMedianFee));
+    ret_all.push_back(Pair("medianfeerate", blockstats.nMedianFeeRate));
+    ret_all.push_back(Pair("mediantime", pindex->GetMedianTimePast()));
+    ret_all.push_back(Pair("mediantxsize", blockstats.nMedianTxSize));
+    ret_all.push_back(Pair("minfee", blockstats.nMinFee));
+    ret_all.push_back(Pair("minfeerate", blockstats.nMinFeeRate));
+    ret_all.push_back(Pair("mintxsize", blockstats.nMinTxSize));
+    ret_all.push_back(Pair("minted", pindex->nMint));
+    ret_all.push_back(Pair("moneysupply", pindex->nMoneySupply));
+    ret_all.push_back(Pair("outs", blockstats.nOutputs));
+    ret_all.push_back(Pair("proofofstake", pindex->IsProofOfStake()));
+    ret_all.push_back(Pair("stakeamount", blockstats.nStakeAmount));
+    ret_all.push_back(Pair("stakereward", blockstats.nStakeReward));
+    ret_all.push_back(Pair("swtotal_size", blockstats.nSegwitTotalSize));
+    ret_all.push_back(Pair("swtotal_weight", blockstats.nSegwitTotalWeight));
+    ret_all.push_back(Pair("swtxs", blockstats.nSegwitTxs));
+    ret_all.push_back(Pair("time", pindex->GetBlockTime()));
+    ret_all.push_back(Pair("total_out", blockstats.nTotalOut));
+    ret_all.push_back(Pair("total_size", blockstats.nTotalSize));
+    ret_all.push_back(Pair("total_weight", blockstats.nTotalWeight));
+    ret_all.push_back(Pair("totalfee", blockstats.nTotalFee));
+    ret_all.push_back(Pair("txs", blockstats.nTxs));
+    ret_all.push_back(Pair("utxo_increase", blockstats.nUTXOIncrease));
+    ret_all.push_back(Pair("utxo_size_inc", blockstats.nUTXOSizeIncrease));
+
+    if (stats.empty()) {
+        return ret_all;
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    for (const std::string& stat : stats) {
+        const UniValue& value = ret_all[stat];
+        if (value.isNull()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid selected statistic %s", stat));
+        }
+        ret.push_back(Pair(stat, value));
+    }
+    return ret;
+}
+
 struct CCoinsStats
 {
     int nHeight;
@@ -817,6 +1071,7 @@ struct CCoinsStats
     uint256 hashSerialized;
     uint64_t nDiskSize;
     CAmount nTotalAmount;
+    CUTXOCommitment commitment;
 
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
 };
@@ -864,6 +1119,7 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
                 outputs.clear();
             }
             prevkey = key.hash;
+            stats.commitment.AddCoin(key, coin);
             outputs[key.n] = std::move(coin);
         } else {
             return error("%s: unable to read value", __func__);
@@ -880,38 +1136,79 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
 
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( verify )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "The statistics are maintained as blocks are connected, so this call is cheap\n"
+            "unless verify is set, in which case the whole set is read from disk.\n"
+            "\nArguments:\n"
+            "1. verify    (boolean, optional, default=false) Scan the full UTXO set and check it against the maintained statistics\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) The hash of the block at the tip of the chain\n"
-            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs\n"
+            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs (verify only)\n"
             "  \"txouts\": n,            (numeric) The number of unspent transaction outputs\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash (verify only)\n"
+            "  \"muhash\": \"hash\",     (string) The rolling MuHash3072 commitment to the UTXO set\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "true")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
+    bool fVerify = false;
+    if (!request.params[0].isNull())
+        fVerify = request.params[0].get_bool();
+
     UniValue ret(UniValue::VOBJ);
 
+    if (!fVerify) {
+        CUTXOCommitment commitment;
+        uint256 hashBlock;
+        int nHeight;
+        {
+            LOCK(cs_main);
+            if (!GetUTXOCommitment(commitment, hashBlock))
+                throw JSONRPCError(RPC_INTERNAL_ERROR, "UTXO set commitment is not loaded");
+            nHeight = mapBlockIndex.at(hashBlock)->nHeight;
+        }
+        ret.push_back(Pair("height", (int64_t)nHeight));
+        ret.push_back(Pair("bestblock", hashBlock.GetHex()));
+        ret.push_back(Pair("txouts", (int64_t)commitment.nTransactionOutputs));
+        ret.push_back(Pair("bogosize", (int64_t)commitment.nBogoSize));
+        ret.push_back(Pair("muhash", commitment.GetHash().GetHex()));
+        ret.push_back(Pair("disk_size", pcoinsdbview->EstimateSize()));
+        ret.push_back(Pair("total_amount", ValueFromAmount(commitment.nTotalAmount)));
+        return ret;
+    }
+
     CCoinsStats stats;
     FlushStateToDisk();
+    // Read the stored commitment before the scan; it is only comparable if
+    // no flush moved the database on in the meantime.
+    uint256 hashCommitted;
+    CUTXOCommitment committed;
+    bool fHaveCommitted = pcoinsdbview->ReadCommitment(hashCommitted, committed);
     if (GetUTXOStats(pcoinsdbview.get(), stats)) {
+        const uint256 hashMuHash = stats.commitment.GetHash();
+        if (fHaveCommitted && hashCommitted == stats.hashBlock &&
+            (committed.GetHash() != hashMuHash || committed.nTransactionOutputs != stats.nTransactionOutputs ||
+             committed.nBogoSize != stats.nBogoSize || committed.nTotalAmount != stats.nTotalAmount)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("UTXO set commitment at %s does not match the UTXO set", stats.hashBlock.GetHex()));
+        }
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bogosize", (int64_t)stats.nBogoSize));
         ret.push_back(Pair("hash_serialized_2", stats.hashSerialized.GetHex()));
+        ret.push_back(Pair("muhash", hashMuHash.GetHex()));
         ret.push_back(Pair("disk_size", stats.nDiskSize));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     } else {
@@ -1000,6 +1297,526 @@ UniValue gettxout(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue pruneblockchain(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "pruneblockchain\n"
+            "\nArguments:\n"
+            "1. \"height\"       (numeric, required) The block height to prune up to. May be set to a discrete height, or a unix timestamp\n"
+            "                  to prune blocks whose block time is at least 2 hours older than the provided timestamp.\n"
+            "                  Blocks after the last sync checkpoint are never pruned.\n"
+            "\nResult:\n"
+            "n    (numeric) Height of the last block pruned.\n"
+            "\nExamples:\n"
+            + HelpExampleCli("pruneblockchain", "1000")
+            + HelpExampleRpc("pruneblockchain", "1000"));
+
+    if (!fPruneMode)
+        throw JSONRPCError(RPC_MISC_ERROR, "Cannot prune blocks because node is not in prune mode.");
+
+    LOCK(cs_main);
+
+    int heightParam = request.params[0].get_int();
+    if (heightParam < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative block height.");
+
+    // Height value more than a billion is too high to be a block height, and
+    // too low to be a block time (corresponds to timestamp from Sep 2001).
+    if (heightParam > 1000000000) {
+        // Add a 2 hour buffer to include blocks which might have had old timestamps
+        CBlockIndex* pindex = chainActive.FindEarliestAtLeast(heightParam - TIMESTAMP_WINDOW);
+        if (!pindex) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Could not find block with at least the specified timestamp.");
+        }
+        heightParam = pindex->nHeight;
+    }
+
+    unsigned int height = (unsigned int) heightParam;
+    unsigned int chainHeight = (unsigned int) chainActive.Height();
+    if (chainHeight < Params().PruneAfterHeight())
+        throw JSONRPCError(RPC_MISC_ERROR, "Blockchain is too short for pruning.");
+    else if (height > chainHeight)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Blockchain is shorter than the attempted prune height.");
+    else if (height > chainHeight - MIN_BLOCKS_TO_KEEP) {
+        LogPrint(BCLog::RPC, "Attempt to prune blocks close to the tip.  Retaining the minimum number of blocks.\n");
+        height = chainHeight - MIN_BLOCKS_TO_KEEP;
+    }
+
+    PruneBlockFilesManual(height);
+    return uint64_t(height);
+}
+
+/** Upper bound on the number of threads a UTXO set scan splits the coin keyspace over */
+static const int MAX_SCAN_THREADS = 16;
+/** Number of coins a scan thread reads between checks for an abort request */
+static const int SCAN_ABORT_CHECK_INTERVAL = 8192;
+
+static std::atomic<bool> g_scan_in_progress;
+static std::atomic<bool> g_should_abort_scan;
+//! Progress of the running scan in units of 1/65536 of the txid space.
+static std::atomic<uint32_t> g_scan_progress;
+
+/** RAII object to prevent concurrency issue when scanning the txout set */
+class CoinsViewScanReserver
+{
+private:
+    bool m_could_reserve;
+public:
+    explicit CoinsViewScanReserver() : m_could_reserve(false) {}
+
+    bool reserve() {
+        assert (!m_could_reserve);
+        bool expected = false;
+        if (!g_scan_in_progress.compare_exchange_strong(expected, true))
+            return false;
+        m_could_reserve = true;
+        return true;
+    }
+
+    ~CoinsViewScanReserver() {
+        if (m_could_reserve) {
+            g_scan_in_progress = false;
+        }
+    }
+};
+
+/** Salted hasher for the set of scripts a UTXO set scan looks for */
+class SaltedScriptHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedScriptHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+    size_t operator()(const CScript& script) const {
+        return CSipHasher(k0, k1).Write(script.data(), script.size()).Finalize();
+    }
+};
+
+typedef std::unordered_set<CScript, SaltedScriptHasher> ScanScriptSet;
+
+/** Position of a txid in the scan progress space: its two leading key bytes. */
+static uint32_t ScanPosition(const uint256& hash)
+{
+    return 0x100 * *hash.begin() + *(hash.begin() + 1);
+}
+
+/** Scan the coins whose txid has a leading byte in [nStartByte, nEndByte),
+ *  with pcursor positioned at the first of them. */
+static bool ScanUTXOSetRange(CCoinsViewCursor* pcursor, unsigned int nStartByte, unsigned int nEndByte, const ScanScriptSet& needles,
+                             std::vector<std::pair<COutPoint, Coin>>& found, std::atomic<int64_t>& nSearched)
+{
+    uint32_t nEnd = nEndByte * 0x100;
+    uint32_t nReported = nStartByte * 0x100;
+    int64_t count = 0;
+    while (pcursor->Valid()) {
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin))
+            return false;
+        uint32_t nPos = ScanPosition(key.hash);
+        if (nPos >= nEnd)
+            break;
+        if (++count % SCAN_ABORT_CHECK_INTERVAL == 0) {
+            if (g_should_abort_scan)
+                return false;
+            nSearched += SCAN_ABORT_CHECK_INTERVAL;
+        }
+        if (nPos > nReported) {
+            g_scan_progress += nPos - nReported;
+            nReported = nPos;
+        }
+        if (needles.count(coin.out.scriptPubKey))
+            found.emplace_back(key, std::move(coin));
+        pcursor->Next();
+    }
+    nSearched += count % SCAN_ABORT_CHECK_INTERVAL;
+    g_scan_progress += nEnd - nReported;
+    return true;
+}
+
+UniValue scantxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "scantxoutset \"action\" ( [scanobjects,...] )\n"
+            "\nScans the unspent transaction output set for outputs paying to the given addresses or scripts.\n"
+            "The chainstate is split into ranges that are scanned in parallel.\n"
+            "\nArguments:\n"
+            "1. \"action\"                       (string, required) The action to execute\n"
+            "                                      \"start\" for starting a scan\n"
+            "                                      \"abort\" for aborting the current scan (returns true when abort was successful)\n"
+            "                                      \"status\" for progress report (in %) of the current scan\n"
+            "2. \"scanobjects\"                  (array, required for \"start\") Array of scan objects\n"
+            "    [                             Every scan object is either an address or an object:\n"
+            "      \"address\",                  (string) An address to scan for\n"
+            "      {                           (object) Exactly one of the following\n"
+            "        \"address\" : \"<address>\",  (string) An address to scan for\n"
+            "        \"script\"  : \"<hex>\",      (string) A raw scriptPubKey to scan for\n"
+            "      },\n"
+            "      ...\n"
+            "    ]\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"success\": true|false,         (boolean) Whether the scan was completed\n"
+            "  \"searched_items\": n,           (numeric) The number of unspent outputs scanned\n"
+            "  \"height\": n,                   (numeric) The height of the block the scanned UTXO set belongs to\n"
+            "  \"bestblock\": \"hash\",           (string) The hash of that block\n"
+            "  \"unspents\": [\n"
+            "    {\n"
+            "      \"txid\" : \"transactionid\",   (string) The transaction id\n"
+            "      \"vout\": n,                  (numeric) The vout value\n"
+            "      \"scriptPubKey\" : \"script\",  (string) The script key\n"
+            "      \"amount\" : x.xxx,           (numeric) The total amount in " + CURRENCY_UNIT + " of the unspent output\n"
+            "      \"height\" : n,               (numeric) Height of the unspent transaction output\n"
+            "      \"coinbase\" : true|false,    (boolean) Whether the output belongs to a coinbase transaction\n"
+            "      \"coinstake\" : true|false,   (boolean) Whether the output belongs to a coinstake transaction\n"
+            "      \"time\" : n,                 (numeric) The time of the transaction that created the output\n"
+            "    }\n"
+            "    ,...],\n"
+            "  \"total_amount\" : x.xxx,        (numeric) The total amount of all found unspent outputs in " + CURRENCY_UNIT + "\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("scantxoutset", "start \"[\\\"myaddress\\\",{\\\"script\\\":\\\"76a914...88ac\\\"}]\"")
+            + HelpExampleCli("scantxoutset", "status")
+            + HelpExampleRpc("scantxoutset", "\"start\", [\"myaddress\"]")
+        );
+
+    RPCTypeCheck(request.params, {UniValue::VSTR, UniValue::VARR});
+
+    UniValue result(UniValue::VOBJ);
+    if (request.params[0].get_str() == "status") {
+        CoinsViewScanReserver reserver;
+        if (reserver.reserve()) {
+            // no scan in progress
+            return NullUniValue;
+        }
+        result.push_back(Pair("progress", (int)((uint64_t)g_scan_progress * 100 / 0x10000)));
+        return result;
+    } else if (request.params[0].get_str() == "abort") {
+        CoinsViewScanReserver reserver;
+        if (reserver.reserve()) {
+            // reserve was possible which means no scan was running
+            return false;
+        }
+        // set the abort flag
+        g_should_abort_scan = true;
+        return true;
+    } else if (request.params[0].get_str() != "start") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid command");
+    }
+
+    if (request.params[1].isNull())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "scanobjects argument is required for the start action");
+
+    ScanScriptSet needles;
+    for (const UniValue& scanobject : request.params[1].get_array().getValues()) {
+        std::string strAddress;
+        if (scanobject.isStr()) {
+            strAddress = scanobject.get_str();
+        } else if (scanobject.isObject()) {
+            const UniValue& address = find_value(scanobject, "address");
+            const UniValue& script = find_value(scanobject, "script");
+            if (address.isNull() == script.isNull())
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Scan object needs exactly one of address or script");
+            if (script.isStr()) {
+                std::vector<unsigned char> data(ParseHexV(script, "script"));
+                needles.emplace(data.begin(), data.end());
+                continue;
+            }
+            strAddress = address.get_str();
+        } else {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Scan object needs to be either a string or an object");
+        }
+        CTxDestination dest = DecodeDestination(strAddress);
+        if (!IsValidDestination(dest))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, std::string("Invalid address: ") + strAddress);
+        needles.insert(GetScriptForDestination(dest));
+    }
+
+    CoinsViewScanReserver reserver;
+    if (!reserver.reserve())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Scan already in progress, use action \"abort\" or \"status\"");
+    g_scan_progress = 0;
+    g_should_abort_scan = false;
+
+    // Split the keyspace on the leading txid byte, which is uniformly
+    // distributed, and open all cursors together so they see the same state.
+    const int nThreads = std::max(1, (int)std::min<int64_t>(gArgs.GetArg("-scanthreads", GetNumCores()), MAX_SCAN_THREADS));
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
+    std::vector<unsigned int> vBoundary;
+    uint256 hashBlock;
+    int nHeight;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        for (int i = 0; i <= nThreads; ++i)
+            vBoundary.push_back(0x100 * i / nThreads);
+        for (int i = 0; i < nThreads; ++i) {
+            uint256 hashStart;
+            *hashStart.begin() = vBoundary[i];
+            cursors.emplace_back(pcoinsdbview->Cursor(hashStart));
+        }
+        hashBlock = cursors.front()->GetBestBlock();
+        nHeight = mapBlockIndex.at(hashBlock)->nHeight;
+    }
+
+    std::vector<std::vector<std::pair<COutPoint, Coin>>> vFound(nThreads);
+    std::atomic<int64_t> nSearched(0);
+    std::atomic<bool> fFailed(false);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; ++i) {
+        threads.emplace_back([&, i] {
+            try {
+                if (!ScanUTXOSetRange(cursors[i].get(), vBoundary[i], vBoundary[i + 1], needles, vFound[i], nSearched))
+                    fFailed = true;
+            } catch (const std::exception& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+                fFailed = true;
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    result.push_back(Pair("success", !fFailed));
+    result.push_back(Pair("searched_items", (int64_t)nSearched));
+    result.push_back(Pair("height", nHeight));
+    result.push_back(Pair("bestblock", hashBlock.GetHex()));
+
+    CAmount total_in = 0;
+    UniValue unspents(UniValue::VARR);
+    for (const auto& found : vFound) {
+        for (const auto& it : found) {
+            const COutPoint& outpoint = it.first;
+            const Coin& coin = it.second;
+            total_in += coin.out.nValue;
+
+            UniValue unspent(UniValue::VOBJ);
+            unspent.push_back(Pair("txid", outpoint.hash.GetHex()));
+            unspent.push_back(Pair("vout", (int32_t)outpoint.n));
+            unspent.push_back(Pair("scriptPubKey", HexStr(coin.out.scriptPubKey.begin(), coin.out.scriptPubKey.end())));
+            unspent.push_back(Pair("amount", ValueFromAmount(coin.out.nValue)));
+            unspent.push_back(Pair("height", (int32_t)coin.nHeight));
+            unspent.push_back(Pair("coinbase", (bool)coin.fCoinBase));
+            unspent.push_back(Pair("coinstake", (bool)coin.fCoinStake));
+            unspent.push_back(Pair("time", (int64_t)coin.nTime));
+            unspents.push_back(unspent);
+        }
+    }
+    result.push_back(Pair("unspents", unspents));
+    result.push_back(Pair("total_amount", ValueFromAmount(total_in)));
+
+    return result;
+}
+
+/** Resolve the addresses argument of the getaddress* calls to address index keys */
+static std::vector<std::pair<std::string, uint160>> ParseAddressIndexParam(const UniValue& param)
+{
+    std::vector<std::string> addresses;
+    if (param.isStr()) {
+        addresses.push_back(param.get_str());
+    } else if (param.isObject()) {
+        const UniValue& array = find_value(param, "addresses");
+        if (!array.isArray())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses is expected to be an array");
+        for (const UniValue& address : array.getValues())
+            addresses.push_back(address.get_str());
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Expected an address or an object with addresses");
+    }
+
+    std::vector<std::pair<std::string, uint160>> keys;
+    for (const std::string& address : addresses) {
+        CTxDestination dest = DecodeDestination(address);
+        if (!IsValidDestination(dest))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, std::string("Invalid address: ") + address);
+        keys.emplace_back(address, GetAddressIndexKey(GetScriptForDestination(dest)));
+    }
+    return keys;
+}
+
+/** The address index, once it has caught up with the active chain */
+static AddressIndex& GetSyncedAddressIndex()
+{
+    if (!g_addressindex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index is not enabled. Use -addressindex to enable it.");
+    if (!g_addressindex->BlockUntilSyncedToCurrentChain())
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index is still syncing with the block chain.");
+    return *g_addressindex;
+}
+
+UniValue getaddresstxids(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddresstxids \"address\" | {\"addresses\": [\"address\",...], \"start\": n, \"end\": n}\n"
+            "\nReturns the ids of the transactions funding or spending from the given addresses, ordered by block height.\n"
+            "Requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"            (string) A single address, or\n"
+            "   {\n"
+            "     \"addresses\": [     (array, required) The addresses\n"
+            "       \"address\"        (string) An address\n"
+            "       ,...\n"
+            "     ],\n"
+            "     \"start\": n,        (numeric, optional) The first block height to include\n"
+            "     \"end\": n           (numeric, optional) The last block height to include\n"
+            "   }\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"       (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"myaddress\"], \"start\": 1000}'")
+            + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"myaddress\"]}")
+        );
+
+    std::vector<std::pair<std::string, uint160>> keys = ParseAddressIndexParam(request.params[0]);
+    int nStart = 0;
+    int nEnd = 0;
+    if (request.params[0].isObject()) {
+        const UniValue& start = find_value(request.params[0], "start");
+        const UniValue& end = find_value(request.params[0], "end");
+        if (!start.isNull())
+            nStart = start.get_int();
+        if (!end.isNull())
+            nEnd = end.get_int();
+        if (nStart < 0 || nEnd < 0 || (nEnd > 0 && nEnd < nStart))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start or end height");
+    }
+
+    AddressIndex& index = GetSyncedAddressIndex();
+    std::vector<CAddressIndexEntry> entries;
+    for (const auto& key : keys) {
+        if (!index.FindEntries(key.second, nStart, nEnd, entries))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+    }
+
+    // Entries of several addresses are merged by height.
+    std::set<std::pair<int, uint256>> txids;
+    for (const CAddressIndexEntry& entry : entries)
+        txids.emplace(entry.nHeight, entry.txid);
+
+    UniValue result(UniValue::VARR);
+    for (const auto& txid : txids)
+        result.push_back(txid.second.GetHex());
+    return result;
+}
+
+UniValue getaddressbalance(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddressbalance \"address\" | {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the balance of the given addresses and the total they have received.\n"
+            "Requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"            (string) A single address, or\n"
+            "   {\n"
+            "     \"addresses\": [     (array, required) The addresses\n"
+            "       \"address\"        (string) An address\n"
+            "       ,...\n"
+            "     ]\n"
+            "   }\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": x.xxx,     (numeric) The current balance in " + CURRENCY_UNIT + "\n"
+            "  \"received\": x.xxx     (numeric) The total amount received in " + CURRENCY_UNIT + "\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"myaddress\"]}'")
+            + HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"myaddress\"]}")
+        );
+
+    std::vector<std::pair<std::string, uint160>> keys = ParseAddressIndexParam(request.params[0]);
+
+    AddressIndex& index = GetSyncedAddressIndex();
+    CAmount nBalance = 0;
+    CAmount nReceived = 0;
+    for (const auto& key : keys) {
+        std::vector<CAddressIndexEntry> entries;
+        if (!index.FindEntries(key.second, 0, 0, entries))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+        for (const CAddressIndexEntry& entry : entries) {
+            nBalance += entry.nValue;
+            if (!entry.fSpending)
+                nReceived += entry.nValue;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", ValueFromAmount(nBalance)));
+    result.push_back(Pair("received", ValueFromAmount(nReceived)));
+    return result;
+}
+
+UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddressutxos \"address\" | {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the unspent outputs paying to the given addresses.\n"
+            "Requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"            (string) A single address, or\n"
+            "   {\n"
+            "     \"addresses\": [     (array, required) The addresses\n"
+            "       \"address\"        (string) An address\n"
+            "       ,...\n"
+            "     ]\n"
+            "   }\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"address\",     (string) The address\n"
+            "    \"txid\": \"transactionid\",  (string) The transaction id\n"
+            "    \"vout\": n,                (numeric) The output index\n"
+            "    \"scriptPubKey\": \"hex\",    (string) The output script\n"
+            "    \"amount\": x.xxx,          (numeric) The output value in " + CURRENCY_UNIT + "\n"
+            "    \"height\": n,              (numeric) The height of the block containing the output\n"
+            "    \"coinbase\": true|false,   (boolean) Whether the output belongs to a coinbase transaction\n"
+            "    \"coinstake\": true|false,  (boolean) Whether the output belongs to a coinstake transaction\n"
+            "    \"time\": n                 (numeric) The time of the transaction that created the output\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"myaddress\"]}'")
+            + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"myaddress\"]}")
+        );
+
+    std::vector<std::pair<std::string, uint160>> keys = ParseAddressIndexParam(request.params[0]);
+
+    AddressIndex& index = GetSyncedAddressIndex();
+    UniValue result(UniValue::VARR);
+    for (const auto& key : keys) {
+        std::vector<std::pair<COutPoint, Coin>> unspent;
+        if (!index.FindUnspent(key.second, unspent))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+        for (const auto& it : unspent) {
+            const COutPoint& outpoint = it.first;
+            const Coin& coin = it.second;
+            UniValue output(UniValue::VOBJ);
+            output.push_back(Pair("address", key.first));
+            output.push_back(Pair("txid", outpoint.hash.GetHex()));
+            output.push_back(Pair("vout", (int32_t)outpoint.n));
+            output.push_back(Pair("scriptPubKey", HexStr(coin.out.scriptPubKey.begin(), coin.out.scriptPubKey.end())));
+            output.push_back(Pair("amount", ValueFromAmount(coin.out.nValue)));
+            output.push_back(Pair("height", (int32_t)coin.nHeight));
+            output.push_back(Pair("coinbase", (bool)coin.fCoinBase));
+            output.push_back(Pair("coinstake", (bool)coin.fCoinStake));
+            output.push_back(Pair("time", (int64_t)coin.nTime));
+            result.push_back(output);
+        }
+    }
+    return result;
+}
+
 UniValue verifychain(const JSONRPCRequest& request)
 {
     int nCheckLevel = gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL);
@@ -1008,6 +1825,7 @@ UniValue verifychain(const JSONRPCRequest& request)
         throw std::runtime_error(
             "verifychain ( checklevel nblocks )\n"
             "\nVerifies blockchain database.\n"
+            "Fails while the startup checks of -checkblocksbackground are still in progress.\n"
             "\nArguments:\n"
             "1. checklevel   (numeric, optional, 0-4, default=" + strprintf("%d", nCheckLevel) + ") How thorough the block verification is.\n"
             "2. nblocks      (numeric, optional, default=" + strprintf("%d", nCheckDepth) + ", 0=all) The number of blocks to check.\n"
@@ -1018,14 +1836,17 @@ UniValue verifychain(const JSONRPCRequest& request)
             + HelpExampleRpc("verifychain", "")
         );
 
-    LOCK(cs_main);
-
     if (!request.params[0].isNull())
         nCheckLevel = request.params[0].get_int();
     if (!request.params[1].isNull())
         nCheckDepth = request.params[1].get_int();
 
-    return CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), nCheckLevel, nCheckDepth);
+    size_t nChecked, nTotal;
+    if (GetBackgroundVerifyProgress(nChecked, nTotal))
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Block verification in progress (%u of %u blocks checked)", nChecked, nTotal));
+
+    // VerifyDB takes cs_main itself; its worker threads need it too.
+    return CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), nCheckLevel, nCheckDepth, std::max(1, nScriptCheckThreads));
 }
 
 /** Implementation of IsSuperMajority with better feedback */
@@ -1077,6 +1898,15 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "  \"initialblockdownload\": xxxx, (bool) (debug information) estimate of whether this node is in Initial Block Download mode.\n"
             "  \"chainwork\": \"xxxx\"           (string) total amount of work in active chain, in hexadecimal\n"
             "  \"size_on_disk\": xxxxxx,       (numeric) the estimated size of the block and undo files on disk\n"
+            "  \"pruned\": xx,                 (boolean) if the blocks are subject to pruning\n"
+            "  \"pruneheight\": xxxxxx,        (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
+            "  \"automatic_pruning\": xx,      (boolean) whether automatic pruning is enabled (only present if pruning is enabled)\n"
+            "  \"prune_target_size\": xxxxxx,  (numeric) the target size used by pruning (only present if automatic pruning is enabled)\n"
+            "  \"blockverification\": {        (object) only present while the startup checks of -checkblocksbackground are in progress\n"
+            "     \"status\": \"xxxx\",          (string) \"verification in progress\"\n"
+            "     \"checked\": xxxxxx,         (numeric) the number of blocks checked so far\n"
+            "     \"total\": xxxxxx,           (numeric) the number of blocks to check\n"
+            "  },\n"
             "  \"softforks\": [                (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",           (string) name of softfork\n"
@@ -1107,6 +1937,32 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
     obj.push_back(Pair("initialblockdownload",  IsInitialBlockDownload()));
     obj.push_back(Pair("chainwork",             chainActive.Tip()->nChainTrust.GetHex()));
     obj.push_back(Pair("size_on_disk",          CalculateCurrentUsage()));
+    obj.push_back(Pair("pruned",                fPruneMode));
+    if (fPruneMode) {
+        CBlockIndex* block = chainActive.Tip();
+        assert(block);
+        while (block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA)) {
+            block = block->pprev;
+        }
+
+        obj.push_back(Pair("pruneheight",        block->nHeight));
+
+        // if 0, execution bypasses the whole if block.
+        bool automatic_pruning = (gArgs.GetArg("-prune", 0) != 1);
+        obj.push_back(Pair("automatic_pruning",  automatic_pruning));
+        if (automatic_pruning) {
+            obj.push_back(Pair("prune_target_size",  nPruneTarget));
+        }
+    }
+
+    size_t nChecked, nTotal;
+    if (GetBackgroundVerifyProgress(nChecked, nTotal)) {
+        UniValue verification(UniValue::VOBJ);
+        verification.push_back(Pair("status",  "verification in progress"));
+        verification.push_back(Pair("checked", (uint64_t)nChecked));
+        verification.push_back(Pair("total",   (uint64_t)nTotal));
+        obj.push_back(Pair("blockverification", verification));
+    }
 
     const Consensus::Params& consensusParams = Params().GetConsensus();
     CBlockIndex* tip = chainActive.Tip();
@@ -1461,6 +2317,117 @@ UniValue getchaintxstats(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue getreorgstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getreorgstats\n"
+            "\nReturns timings of the most recent chain reorganization.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"reorgs\": xxxxx,              (numeric) The number of reorganizations since startup.\n"
+            "  \"max_depth\": xxxxx,           (numeric) The most blocks disconnected by any of them.\n"
+            "  \"last\": {                     (json object) The most recent one, if any\n"
+            "    \"time\": xxxxx,              (numeric) When it happened, in UNIX format.\n"
+            "    \"forkheight\": xxxxx,        (numeric) The height of the last block common to both chains.\n"
+            "    \"disconnected\": xxxxx,      (numeric) The number of blocks disconnected.\n"
+            "    \"connected\": xxxxx,         (numeric) The number of blocks connected in the same step.\n"
+            "    \"disconnect_ms\": x.xx,      (numeric) Time spent disconnecting blocks.\n"
+            "    \"connect_ms\": x.xx,         (numeric) Time spent connecting blocks.\n"
+            "    \"mempool_ms\": x.xx,         (numeric) Time spent re-adding disconnected transactions to the mempool.\n"
+            "    \"oldtip\": \"hash\",           (string) The tip before the reorganization.\n"
+            "    \"newtip\": \"hash\"            (string) The tip after it.\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getreorgstats", "")
+            + HelpExampleRpc("getreorgstats", "")
+        );
+
+    ReorgStats stats;
+    uint64_t nReorgs;
+    int nMaxDepth;
+    const bool fHaveReorg = GetReorgStats(stats, nReorgs, nMaxDepth);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("reorgs", nReorgs));
+    ret.push_back(Pair("max_depth", nMaxDepth));
+    if (fHaveReorg) {
+        UniValue last(UniValue::VOBJ);
+        last.push_back(Pair("time", stats.nTime));
+        last.push_back(Pair("forkheight", stats.nForkHeight));
+        last.push_back(Pair("disconnected", stats.nDisconnected));
+        last.push_back(Pair("connected", stats.nConnected));
+        last.push_back(Pair("disconnect_ms", stats.nDisconnectMicros * 0.001));
+        last.push_back(Pair("connect_ms", stats.nConnectMicros * 0.001));
+        last.push_back(Pair("mempool_ms", stats.nMempoolMicros * 0.001));
+        last.push_back(Pair("oldtip", stats.hashOldTip.GetHex()));
+        last.push_back(Pair("newtip", stats.hashNewTip.GetHex()));
+        ret.push_back(Pair("last", last));
+    }
+    return ret;
+}
+
+static UniValue ScriptCacheStatsToJSON(const ScriptCacheStats& stats)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("entries", (uint64_t)stats.nEntries));
+    obj.push_back(Pair("capacity", (uint64_t)stats.nCapacity));
+    obj.push_back(Pair("usage", (uint64_t)(stats.nCapacity * sizeof(uint256))));
+    obj.push_back(Pair("block_hits", stats.nBlockHits));
+    obj.push_back(Pair("block_misses", stats.nBlockMisses));
+    obj.push_back(Pair("hits", stats.nHits));
+    obj.push_back(Pair("misses", stats.nMisses));
+    obj.push_back(Pair("inserts", stats.nInserts));
+    obj.push_back(Pair("evictions", stats.nEvictions));
+    return obj;
+}
+
+UniValue getcachestats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getcachestats\n"
+            "\nReturns usage counters of the signature and script execution caches since startup.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"signatures\": {               (json object) The cache of verified signatures\n"
+            "    \"entries\": xxxxx,           (numeric) Entries currently cached\n"
+            "    \"capacity\": xxxxx,          (numeric) Entries the cache can hold\n"
+            "    \"usage\": xxxxx,             (numeric) Size of the cache in bytes\n"
+            "    \"block_hits\": xxxxx,        (numeric) Lookups while connecting blocks that found an entry,\n"
+            "                                i.e. verified in the mempool before\n"
+            "    \"block_misses\": xxxxx,      (numeric) Lookups while connecting blocks that had to verify\n"
+            "    \"hits\": xxxxx,              (numeric) Other lookups (mempool acceptance, block templates) that found an entry\n"
+            "    \"misses\": xxxxx,            (numeric) Other lookups that did not\n"
+            "    \"inserts\": xxxxx,           (numeric) Entries added\n"
+            "    \"evictions\": xxxxx          (numeric) Entries overwritten or dropped before they were used\n"
+            "  },\n"
+            "  \"scriptexecution\": {          (json object) The cache of transactions whose scripts were all valid,\n"
+            "    ...                         with the same fields\n"
+            "  },\n"
+            "  \"adaptive\": true|false        (boolean) Whether the caches grow when blocks miss them (-adaptivesigcache)\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcachestats", "")
+            + HelpExampleRpc("getcachestats", "")
+        );
+
+    ScriptCacheStats sigStats;
+    GetSignatureCacheStats(sigStats, true);
+    ScriptCacheStats scriptStats;
+    {
+        LOCK(cs_main);
+        GetScriptExecutionCacheStats(scriptStats, true);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("signatures", ScriptCacheStatsToJSON(sigStats)));
+    ret.push_back(Pair("scriptexecution", ScriptCacheStatsToJSON(scriptStats)));
+    ret.push_back(Pair("adaptive", gArgs.GetArg("-adaptivesigcache", DEFAULT_ADAPTIVE_SIG_CACHE_SIZE) > 0));
+    return ret;
+}
+
 UniValue savemempool(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0) {
@@ -1483,13 +2450,19 @@ UniValue savemempool(const JSONRPCRequest& request)
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
+    { "blockchain",         "getaddressbalance",      &getaddressbalance,      {"addresses"} },
+    { "blockchain",         "getaddresstxids",        &getaddresstxids,        {"addresses"} },
+    { "blockchain",         "getaddressutxos",        &getaddressutxos,        {"addresses"} },
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {} },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        {"nblocks", "blockhash"} },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       {} },
     { "blockchain",         "getblockcount",          &getblockcount,          {} },
     { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         {"blockhash", "filtertype"} },
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
+    { "blockchain",         "getblockstats",          &getblockstats,          {"hash_or_height", "stats"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
+    { "blockchain",         "getcachestats",          &getcachestats,          {} },
     { "blockchain",         "getchaintips",           &getchaintips,           {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
@@ -1497,9 +2470,12 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
+    { "blockchain",         "getreorgstats",          &getreorgstats,          {} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"verify"} },
+    { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
+    { "blockchain",         "scantxoutset",           &scantxoutset,           {"action", "scanobjects"} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
 
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },
@@ -47,7 +47,12 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listreceivedbyaccount", 2, "include_watchonly" },
     { "getbalance", 1, "minconf" },
     { "getbalance", 2, "include_watchonly" },
+    { "getaddressbalance", 0, "addresses" },
+    { "getaddresstxids", 0, "addresses" },
+    { "getaddressutxos", 0, "addresses" },
     { "getblockhash", 0, "height" },
+    { "pruneblockchain", 0, "height" },
+    { "scantxoutset", 1, "scanobjects" },
     { "waitforblockheight", 0, "height" },
     { "waitforblockheight", 1, "timeout" },
     { "waitforblock", 1, "timeout" },
@@ -83,6 +88,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listunspent", 4, "query_options" },
     { "getblock", 1, "verbosity" },
     { "getblock", 1, "verbose" },
+    { "getblockstats", 0, "hash_or_height" },
+    { "getblockstats", 1, "stats" },
     { "getblockheader", 1, "verbose" },
     { "getchaintxstats", 0, "nblocks" },
     { "gettransaction", 1, "include_watchonly" },
@@ -98,6 +105,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "fundrawtransaction", 2, "iswitness" },
     { "gettxout", 1, "n" },
     { "gettxout", 2, "include_mempool" },
+    { "gettxoutsetinfo", 0, "verify" },
     { "gettxoutproof", 0, "txids" },
     { "lockunspent", 0, "unlock" },
     { "lockunspent", 1, "transactions" },
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <base58.h>
+#include <blockcache.h>
 #include <chain.h>
 #include <clientversion.h>
 #include <core_io.h>
@@ -458,6 +459,19 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+template <typename T>
+static UniValue RPCBlockCacheInfo(const CBlockDataCache<T>& cache)
+{
+    typename CBlockDataCache<T>::Stats stats = cache.GetStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("blocks", uint64_t(stats.count)));
+    obj.push_back(Pair("usage", uint64_t(stats.usage)));
+    obj.push_back(Pair("max_usage", uint64_t(stats.max_usage)));
+    obj.push_back(Pair("hits", stats.hits));
+    obj.push_back(Pair("misses", stats.misses));
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -499,6 +513,20 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"blockcache\": {           (json object) Information about the cache of recently used blocks\n"
+            "    \"blocks\": xxxxx,        (numeric) Number of blocks cached\n"
+            "    \"usage\": xxxxx,         (numeric) Estimated memory usage of the cached blocks in bytes\n"
+            "    \"max_usage\": xxxxx,     (numeric) Configured maximum usage in bytes (-blockcachesize)\n"
+            "    \"hits\": xxxxx,          (numeric) Number of block lookups served from the cache\n"
+            "    \"misses\": xxxxx,        (numeric) Number of block lookups that went to disk\n"
+            "  },\n"
+            "  \"undocache\": {            (json object) Information about the cache of recently used undo data\n"
+            "    \"blocks\": xxxxx,        (numeric) Number of blocks whose undo data is cached\n"
+            "    \"usage\": xxxxx,         (numeric) Estimated memory usage of the cached undo data in bytes\n"
+            "    \"max_usage\": xxxxx,     (numeric) Configured maximum usage in bytes (-undocachesize)\n"
+            "    \"hits\": xxxxx,          (numeric) Number of undo data lookups served from the cache\n"
+            "    \"misses\": xxxxx,        (numeric) Number of undo data lookups that went to disk\n"
             "  }\n"
             "}\n"
             "\nResult (mode \"mallocinfo\"):\n"
@@ -512,6 +540,8 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+        obj.push_back(Pair("blockcache", RPCBlockCacheInfo(g_block_cache)));
+        obj.push_back(Pair("undocache", RPCBlockCacheInfo(g_block_undo_cache)));
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -10,9 +10,10 @@
 #include <crypto/sha256.h>
 #include <pubkey.h>
 #include <script/script.h>
+#include <streams.h>
 #include <uint256.h>
 
-typedef std::vector<unsigned char> valtype;
+typedef CScriptStackElement valtype;
 
 namespace {
 
@@ -104,7 +105,8 @@ bool static IsCompressedPubKey(const valtype &vchPubKey) {
  *
  * This function is consensus-critical since BIP66.
  */
-bool static IsValidSignatureEncoding(const std::vector<unsigned char> &sig) {
+template <typename T>
+bool static IsValidSignatureEncoding(const T &sig) {
     // Format: 0x30 [total-length] 0x02 [R-length] [R] 0x02 [S-length] [S] [sighash]
     // * total-length: 1-byte length descriptor of everything that follows,
     //   excluding the sighash byte.
@@ -169,24 +171,25 @@ bool static IsValidSignatureEncoding(const std::vector<unsigned char> &sig) {
     return true;
 }
 
-bool static IsLowDERSignature(const valtype &vchSig, ScriptError* serror) {
+template <typename T>
+bool static IsLowDERSignature(const T &vchSig, ScriptError* serror) {
     if (!IsValidSignatureEncoding(vchSig)) {
         return set_error(serror, SCRIPT_ERR_SIG_DER);
     }
     // https://bitcoin.stackexchange.com/a/12556:
     //     Also note that inside transaction signatures, an extra hashtype byte
     //     follows the actual signature data.
-    std::vector<unsigned char> vchSigCopy(vchSig.begin(), vchSig.begin() + vchSig.size() - 1);
     // If the S value is above the order of the curve divided by two, its
     // complement modulo the order could have been used instead, which is
     // one byte shorter when encoded correctly.
-    if (!CPubKey::CheckLowS(vchSigCopy)) {
+    if (!CPubKey::CheckLowS(vchSig.data(), vchSig.size() - 1)) {
         return set_error(serror, SCRIPT_ERR_SIG_HIGH_S);
     }
     return true;
 }
 
-bool static IsDefinedHashtypeSignature(const valtype &vchSig) {
+template <typename T>
+bool static IsDefinedHashtypeSignature(const T &vchSig) {
     if (vchSig.size() == 0) {
         return false;
     }
@@ -197,7 +200,8 @@ bool static IsDefinedHashtypeSignature(const valtype &vchSig) {
     return true;
 }
 
-bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned int flags, ScriptError* serror) {
+template <typename T>
+bool static CheckSignatureEncodingImpl(const T &vchSig, unsigned int flags, ScriptError* serror) {
     // Empty signature. Not strictly DER encoded, but allowed to provide a
     // compact way to provide an invalid signature for use with CHECK(MULTI)SIG
     if (vchSig.size() == 0) {
@@ -214,6 +218,14 @@ bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned i
     return true;
 }
 
+bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned int flags, ScriptError* serror) {
+    return CheckSignatureEncodingImpl(vchSig, flags, serror);
+}
+
+bool CheckSignatureEncoding(const CScriptStackElement &vchSig, unsigned int flags, ScriptError* serror) {
+    return CheckSignatureEncodingImpl(vchSig, flags, serror);
+}
+
 bool static CheckPubKeyEncoding(const valtype &vchPubKey, unsigned int flags, const SigVersion &sigversion, ScriptError* serror) {
     if ((flags & SCRIPT_VERIFY_STRICTENC) != 0 && !IsCompressedOrUncompressedPubKey(vchPubKey)) {
         return set_error(serror, SCRIPT_ERR_PUBKEYTYPE);
@@ -248,7 +260,7 @@ bool static CheckMinimalPush(const valtype& data, opcodetype opcode) {
     return true;
 }
 
-bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror)
+bool EvalScript(std::vector<valtype>& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror)
 {
     static const CScriptNum bnZero(0);
     static const CScriptNum bnOne(1);
@@ -256,7 +268,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
     // static const CScriptNum bnTrue(1);
     static const valtype vchFalse(0);
     // static const valtype vchZero(0);
-    static const valtype vchTrue(1, 1);
+    static const valtype vchTrue(1, (unsigned char)1);
 
     CScript::const_iterator pc = script.begin();
     CScript::const_iterator pend = script.end();
@@ -341,7 +353,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     // ( -- value)
                     CScriptNum bn((int)opcode - (int)(OP_1 - 1));
-                    stack.push_back(bn.getvch());
+                    stack.push_back(bn.getvch<valtype>());
                     // The result of these opcodes should always be the minimal way to push the data
                     // they push, so no need for a CheckMinimalPush here.
                 }
@@ -584,8 +596,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 x3 x4 -- x3 x4 x1 x2)
                     if (stack.size() < 4)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    swap(stacktop(-4), stacktop(-2));
-                    swap(stacktop(-3), stacktop(-1));
+                    std::swap(stacktop(-4), stacktop(-2));
+                    std::swap(stacktop(-3), stacktop(-1));
                 }
                 break;
 
@@ -604,7 +616,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     // -- stacksize
                     CScriptNum bn(stack.size());
-                    stack.push_back(bn.getvch());
+                    stack.push_back(bn.getvch<valtype>());
                 }
                 break;
 
@@ -671,8 +683,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     //  x2 x3 x1  after second swap
                     if (stack.size() < 3)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    swap(stacktop(-3), stacktop(-2));
-                    swap(stacktop(-2), stacktop(-1));
+                    std::swap(stacktop(-3), stacktop(-2));
+                    std::swap(stacktop(-2), stacktop(-1));
                 }
                 break;
 
@@ -681,7 +693,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 -- x2 x1)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    swap(stacktop(-2), stacktop(-1));
+                    std::swap(stacktop(-2), stacktop(-1));
                 }
                 break;
 
@@ -702,7 +714,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     CScriptNum bn(stacktop(-1).size());
-                    stack.push_back(bn.getvch());
+                    stack.push_back(bn.getvch<valtype>());
                 }
                 break;
 
@@ -764,7 +776,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     default:            assert(!"invalid opcode"); break;
                     }
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    stack.push_back(bn.getvch<valtype>());
                 }
                 break;
 
@@ -813,7 +825,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     }
                     popstack(stack);
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    stack.push_back(bn.getvch<valtype>());
 
                     if (opcode == OP_NUMEQUALVERIFY)
                     {
@@ -1053,6 +1065,21 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
     return set_success(serror);
 }
 
+bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror)
+{
+    std::vector<valtype> elements;
+    elements.reserve(stack.size());
+    for (const std::vector<unsigned char>& vch : stack) {
+        elements.emplace_back(vch.begin(), vch.end());
+    }
+    bool ret = EvalScript(elements, script, flags, checker, sigversion, serror);
+    stack.clear();
+    for (const valtype& vch : elements) {
+        stack.emplace_back(vch.begin(), vch.end());
+    }
+    return ret;
+}
+
 namespace {
 
 /**
@@ -1152,6 +1179,38 @@ public:
     }
 };
 
+/** A double-SHA256 writer that can start from a saved hash state */
+class CMidstateHashWriter
+{
+private:
+    CSHA256 ctx;
+
+public:
+    CMidstateHashWriter() {}
+    explicit CMidstateHashWriter(const CSHA256& ctxIn) : ctx(ctxIn) {}
+
+    int GetType() const { return SER_GETHASH; }
+    int GetVersion() const { return 0; }
+    const CSHA256& GetState() const { return ctx; }
+
+    void write(const char *pch, size_t size) {
+        ctx.Write((const unsigned char*)pch, size);
+    }
+
+    uint256 GetHash() {
+        uint256 result;
+        ctx.Finalize(result.begin());
+        CSHA256().Write(result.begin(), CSHA256::OUTPUT_SIZE).Finalize(result.begin());
+        return result;
+    }
+
+    template<typename T>
+    CMidstateHashWriter& operator<<(const T& obj) {
+        ::Serialize(*this, obj);
+        return (*this);
+    }
+};
+
 uint256 GetPrevoutHash(const CTransaction& txTo) {
     CHashWriter ss(SER_GETHASH, 0);
     for (const auto& txin : txTo.vin) {
@@ -1178,6 +1237,13 @@ uint256 GetOutputsHash(const CTransaction& txTo) {
 
 } // namespace
 
+/** Minimum number of inputs for precomputing the legacy signature hash parts */
+static const size_t LEGACY_SIGHASH_MIN_INPUTS = 3;
+
+/** Size of a blanked input in the legacy serialization: the prevout, an
+ *  empty script and nSequence */
+static const size_t LEGACY_BLANK_INPUT_SIZE = 36 + 1 + 4;
+
 PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
 {
     // Cache is calculated only for transactions with witness
@@ -1189,6 +1255,30 @@ PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
     }
 }
 
+void PrecomputedTransactionData::PrecomputeLegacy(const CTransaction& txTo)
+{
+    // Without it, every legacy input serializes the whole transaction again
+    if (!legacyReady && txTo.vin.size() >= LEGACY_SIGHASH_MIN_INPUTS) {
+        CVectorWriter inputs(SER_GETHASH, 0, legacyInputs, 0);
+        for (const auto& txin : txTo.vin) {
+            inputs << txin.prevout << CScript() << txin.nSequence;
+        }
+        assert(legacyInputs.size() == txTo.vin.size() * LEGACY_BLANK_INPUT_SIZE);
+        CVectorWriter outputs(SER_GETHASH, 0, legacyOutputs, 0);
+        outputs << txTo.vout << txTo.nLockTime;
+
+        CMidstateHashWriter ss;
+        ss << txTo.nVersion << txTo.nTime;
+        ::WriteCompactSize(ss, txTo.vin.size());
+        legacyMidstates.reserve(txTo.vin.size());
+        for (size_t i = 0; i < txTo.vin.size(); i++) {
+            legacyMidstates.push_back(ss.GetState());
+            ss.write((const char*)&legacyInputs[i * LEGACY_BLANK_INPUT_SIZE], LEGACY_BLANK_INPUT_SIZE);
+        }
+        legacyReady = true;
+    }
+}
+
 uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const CAmount& amount, SigVersion sigversion, const PrecomputedTransactionData* cache)
 {
     assert(nIn < txTo.vin.size());
@@ -1254,6 +1344,21 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    // With SIGHASH_ALL only the input being signed differs from the cached
+    // serialization: continue from the hash state before it, add it, and
+    // append the blanked inputs after it and the outputs.
+    if (cache && cache->legacyReady && !(nHashType & SIGHASH_ANYONECANPAY) && (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
+        CMidstateHashWriter ss(cache->legacyMidstates[nIn]);
+        ss << txTo.vin[nIn].prevout;
+        txTmp.SerializeScriptCode(ss);
+        ss << txTo.vin[nIn].nSequence;
+        const size_t nAfter = (nIn + 1) * LEGACY_BLANK_INPUT_SIZE;
+        ss.write((const char*)cache->legacyInputs.data() + nAfter, cache->legacyInputs.size() - nAfter);
+        ss.write((const char*)cache->legacyOutputs.data(), cache->legacyOutputs.size());
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -1265,14 +1370,14 @@ bool TransactionSignatureChecker::VerifySignature(const std::vector<unsigned cha
     return pubkey.Verify(sighash, vchSig);
 }
 
-bool TransactionSignatureChecker::CheckSig(const std::vector<unsigned char>& vchSigIn, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode, SigVersion sigversion) const
+bool TransactionSignatureChecker::CheckSig(const valtype& vchSigIn, const valtype& vchPubKey, const CScript& scriptCode, SigVersion sigversion) const
 {
-    CPubKey pubkey(vchPubKey);
+    CPubKey pubkey(vchPubKey.begin(), vchPubKey.end());
     if (!pubkey.IsValid())
         return false;
 
     // Hash type is one byte tacked on to the end of the signature
-    std::vector<unsigned char> vchSig(vchSigIn);
+    std::vector<unsigned char> vchSig(vchSigIn.begin(), vchSigIn.end());
     if (vchSig.empty())
         return false;
     int nHashType = vchSig.back();
@@ -1370,7 +1475,7 @@ bool TransactionSignatureChecker::CheckSequence(const CScriptNum& nSequence) con
 
 static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion, const std::vector<unsigned char>& program, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
-    std::vector<std::vector<unsigned char> > stack;
+    std::vector<valtype> stack;
     CScript scriptPubKey;
 
     if (witversion == 0) {
@@ -1380,7 +1485,10 @@ static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion,
                 return set_error(serror, SCRIPT_ERR_WITNESS_PROGRAM_WITNESS_EMPTY);
             }
             scriptPubKey = CScript(witness.stack.back().begin(), witness.stack.back().end());
-            stack = std::vector<std::vector<unsigned char> >(witness.stack.begin(), witness.stack.end() - 1);
+            stack.reserve(witness.stack.size() - 1);
+            for (auto it = witness.stack.begin(); it != witness.stack.end() - 1; ++it) {
+                stack.emplace_back(it->begin(), it->end());
+            }
             uint256 hashScriptPubKey;
             CSHA256().Write(&scriptPubKey[0], scriptPubKey.size()).Finalize(hashScriptPubKey.begin());
             if (memcmp(hashScriptPubKey.begin(), program.data(), 32)) {
@@ -1392,7 +1500,10 @@ static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion,
                 return set_error(serror, SCRIPT_ERR_WITNESS_PROGRAM_MISMATCH); // 2 items in witness
             }
             scriptPubKey << OP_DUP << OP_HASH160 << program << OP_EQUALVERIFY << OP_CHECKSIG;
-            stack = witness.stack;
+            stack.reserve(2);
+            for (const std::vector<unsigned char>& vch : witness.stack) {
+                stack.emplace_back(vch.begin(), vch.end());
+            }
         } else {
             return set_error(serror, SCRIPT_ERR_WITNESS_PROGRAM_WRONG_LENGTH);
         }
@@ -1435,7 +1546,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
-    std::vector<std::vector<unsigned char> > stack, stackCopy;
+    std::vector<valtype> stack, stackCopy;
     if (!EvalScript(stack, scriptSig, flags, checker, SIGVERSION_BASE, serror))
         // serror is set
         return false;
@@ -1484,7 +1595,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
         assert(!stack.empty());
 
         const valtype& pubKeySerialized = stack.back();
-        CScript pubKey2(pubKeySerialized.begin(), pubKeySerialized.end());
+        CScript pubKey2(pubKeySerialized.data(), pubKeySerialized.data() + pubKeySerialized.size());
         popstack(stack);
 
         if (!EvalScript(stack, pubKey2, flags, checker, SIGVERSION_BASE, serror))
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include <crypto/sha256.h>
 #include <script/script_error.h>
 #include <primitives/transaction.h>
 
@@ -118,13 +119,32 @@ enum
 };
 
 bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned int flags, ScriptError* serror);
+bool CheckSignatureEncoding(const CScriptStackElement &vchSig, unsigned int flags, ScriptError* serror);
 
 struct PrecomputedTransactionData
 {
     uint256 hashPrevouts, hashSequence, hashOutputs;
     bool ready = false;
 
+    /**
+     * The parts of the legacy SIGHASH_ALL serialization that are the same for
+     * every input: all inputs with their scriptSigs blanked, the outputs with
+     * nLockTime, and the hash state before each input. Only set up by
+     * PrecomputeLegacy, for transactions with enough inputs to make up for
+     * building it.
+     */
+    std::vector<unsigned char> legacyInputs;
+    std::vector<unsigned char> legacyOutputs;
+    std::vector<CSHA256> legacyMidstates;
+    bool legacyReady = false;
+
     explicit PrecomputedTransactionData(const CTransaction& tx);
+
+    /**
+     * Build the legacy parts if they are not built yet. Not thread safe, so
+     * call it before the checks sharing this data go to other threads.
+     */
+    void PrecomputeLegacy(const CTransaction& tx);
 };
 
 enum SigVersion
@@ -138,7 +158,7 @@ uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsig
 class BaseSignatureChecker
 {
 public:
-    virtual bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode, SigVersion sigversion) const
+    virtual bool CheckSig(const CScriptStackElement& scriptSig, const CScriptStackElement& vchPubKey, const CScript& scriptCode, SigVersion sigversion) const
     {
         return false;
     }
@@ -170,7 +190,7 @@ protected:
 public:
     TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn) : txTo(txToIn), nIn(nInIn), amount(amountIn), txdata(nullptr) {}
     TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, const PrecomputedTransactionData& txdataIn) : txTo(txToIn), nIn(nInIn), amount(amountIn), txdata(&txdataIn) {}
-    bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode, SigVersion sigversion) const override;
+    bool CheckSig(const CScriptStackElement& scriptSig, const CScriptStackElement& vchPubKey, const CScript& scriptCode, SigVersion sigversion) const override;
     bool CheckLockTime(const CScriptNum& nLockTime) const override;
     bool CheckSequence(const CScriptNum& nSequence) const override;
 };
@@ -184,6 +204,8 @@ public:
     MutableTransactionSignatureChecker(const CMutableTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn) : TransactionSignatureChecker(&txTo, nInIn, amountIn), txTo(*txToIn) {}
 };
 
+bool EvalScript(std::vector<CScriptStackElement>& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* error = nullptr);
+/** Same as above, for callers that keep the stack as byte vectors. Converts the stack on the way in and out. */
 bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* error = nullptr);
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror = nullptr);
 
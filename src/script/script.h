@@ -204,6 +204,14 @@ public:
     explicit scriptnum_error(const std::string& str) : std::runtime_error(str) {}
 };
 
+/**
+ * Element of the script interpreter's stacks. Any direct push fits in the
+ * inline buffer, which includes signatures (at most 73 bytes) and public keys
+ * (at most 65 bytes), so evaluating standard scripts does not allocate memory
+ * for each element; only larger ones, like P2SH redeem scripts, go to the heap.
+ */
+typedef prevector<76, unsigned char> CScriptStackElement;
+
 class CScriptNum
 {
 /**
@@ -223,7 +231,8 @@ public:
 
     static const size_t nDefaultMaxNumSize = 4;
 
-    explicit CScriptNum(const std::vector<unsigned char>& vch, bool fRequireMinimal,
+    template <typename T>
+    explicit CScriptNum(const T& vch, bool fRequireMinimal,
                         const size_t nMaxNumSize = nDefaultMaxNumSize)
     {
         if (vch.size() > nMaxNumSize) {
@@ -320,17 +329,28 @@ public:
         return m_value;
     }
 
-    std::vector<unsigned char> getvch() const
+    template <typename T = std::vector<unsigned char> >
+    T getvch() const
     {
-        return serialize(m_value);
+        T result;
+        serialize(m_value, result);
+        return result;
     }
 
     static std::vector<unsigned char> serialize(const int64_t& value)
+    {
+        std::vector<unsigned char> result;
+        serialize(value, result);
+        return result;
+    }
+
+    //! Serialize value into result, which must be empty
+    template <typename T>
+    static void serialize(const int64_t& value, T& result)
     {
         if(value == 0)
-            return std::vector<unsigned char>();
+            return;
 
-        std::vector<unsigned char> result;
         const bool neg = value < 0;
         uint64_t absvalue = neg ? -value : value;
 
@@ -354,12 +374,11 @@ public:
             result.push_back(neg ? 0x80 : 0);
         else if (neg)
             result.back() |= 0x80;
-
-        return result;
     }
 
 private:
-    static int64_t set_vch(const std::vector<unsigned char>& vch)
+    template <typename T>
+    static int64_t set_vch(const T& vch)
     {
       if (vch.empty())
           return 0;
@@ -391,6 +410,89 @@ typedef prevector<28, unsigned char> CScriptBase;
 class CScript : public CScriptBase
 {
 protected:
+    template <typename T>
+    CScript& push_data(const T& b)
+    {
+        if (b.size() < OP_PUSHDATA1)
+        {
+            insert(end(), (unsigned char)b.size());
+        }
+        else if (b.size() <= 0xff)
+        {
+            insert(end(), OP_PUSHDATA1);
+            insert(end(), (unsigned char)b.size());
+        }
+        else if (b.size() <= 0xffff)
+        {
+            insert(end(), OP_PUSHDATA2);
+            uint8_t _data[2];
+            WriteLE16(_data, b.size());
+            insert(end(), _data, _data + sizeof(_data));
+        }
+        else
+        {
+            insert(end(), OP_PUSHDATA4);
+            uint8_t _data[4];
+            WriteLE32(_data, b.size());
+            insert(end(), _data, _data + sizeof(_data));
+        }
+        insert(end(), b.begin(), b.end());
+        return *this;
+    }
+
+    template <typename T>
+    bool get_op(const_iterator& pc, opcodetype& opcodeRet, T* pvchRet) const
+    {
+        opcodeRet = OP_INVALIDOPCODE;
+        if (pvchRet)
+            pvchRet->clear();
+        if (pc >= end())
+            return false;
+
+        // Read instruction
+        if (end() - pc < 1)
+            return false;
+        unsigned int opcode = *pc++;
+
+        // Immediate operand
+        if (opcode <= OP_PUSHDATA4)
+        {
+            unsigned int nSize = 0;
+            if (opcode < OP_PUSHDATA1)
+            {
+                nSize = opcode;
+            }
+            else if (opcode == OP_PUSHDATA1)
+            {
+                if (end() - pc < 1)
+                    return false;
+                nSize = *pc++;
+            }
+            else if (opcode == OP_PUSHDATA2)
+            {
+                if (end() - pc < 2)
+                    return false;
+                nSize = ReadLE16(&pc[0]);
+                pc += 2;
+            }
+            else if (opcode == OP_PUSHDATA4)
+            {
+                if (end() - pc < 4)
+                    return false;
+                nSize = ReadLE32(&pc[0]);
+                pc += 4;
+            }
+            if (end() - pc < 0 || (unsigned int)(end() - pc) < nSize)
+                return false;
+            if (pvchRet)
+                pvchRet->assign(pc, pc + nSize);
+            pc += nSize;
+        }
+
+        opcodeRet = (opcodetype)opcode;
+        return true;
+    }
+
     CScript& push_int64(int64_t n)
     {
         if (n == -1 || (n >= 1 && n <= 16))
@@ -439,6 +541,7 @@ public:
     explicit CScript(opcodetype b)     { operator<<(b); }
     explicit CScript(const CScriptNum& b) { operator<<(b); }
     explicit CScript(const std::vector<unsigned char>& b) { operator<<(b); }
+    explicit CScript(const CScriptStackElement& b) { operator<<(b); }
 
 
     CScript& operator<<(int64_t b) { return push_int64(b); }
@@ -459,31 +562,12 @@ public:
 
     CScript& operator<<(const std::vector<unsigned char>& b)
     {
-        if (b.size() < OP_PUSHDATA1)
-        {
-            insert(end(), (unsigned char)b.size());
-        }
-        else if (b.size() <= 0xff)
-        {
-            insert(end(), OP_PUSHDATA1);
-            insert(end(), (unsigned char)b.size());
-        }
-        else if (b.size() <= 0xffff)
-        {
-            insert(end(), OP_PUSHDATA2);
-            uint8_t _data[2];
-            WriteLE16(_data, b.size());
-            insert(end(), _data, _data + sizeof(_data));
-        }
-        else
-        {
-            insert(end(), OP_PUSHDATA4);
-            uint8_t _data[4];
-            WriteLE32(_data, b.size());
-            insert(end(), _data, _data + sizeof(_data));
-        }
-        insert(end(), b.begin(), b.end());
-        return *this;
+        return push_data(b);
+    }
+
+    CScript& operator<<(const CScriptStackElement& b)
+    {
+        return push_data(b);
     }
 
     CScript& operator<<(const CScript& b)
@@ -522,56 +606,14 @@ public:
         return GetOp2(pc, opcodeRet, nullptr);
     }
 
-    bool GetOp2(const_iterator& pc, opcodetype& opcodeRet, std::vector<unsigned char>* pvchRet) const
+    bool GetOp(const_iterator& pc, opcodetype& opcodeRet, CScriptStackElement& vchRet) const
     {
-        opcodeRet = OP_INVALIDOPCODE;
-        if (pvchRet)
-            pvchRet->clear();
-        if (pc >= end())
-            return false;
-
-        // Read instruction
-        if (end() - pc < 1)
-            return false;
-        unsigned int opcode = *pc++;
-
-        // Immediate operand
-        if (opcode <= OP_PUSHDATA4)
-        {
-            unsigned int nSize = 0;
-            if (opcode < OP_PUSHDATA1)
-            {
-                nSize = opcode;
-            }
-            else if (opcode == OP_PUSHDATA1)
-            {
-                if (end() - pc < 1)
-                    return false;
-                nSize = *pc++;
-            }
-            else if (opcode == OP_PUSHDATA2)
-            {
-                if (end() - pc < 2)
-                    return false;
-                nSize = ReadLE16(&pc[0]);
-                pc += 2;
-            }
-            else if (opcode == OP_PUSHDATA4)
-            {
-                if (end() - pc < 4)
-                    return false;
-                nSize = ReadLE32(&pc[0]);
-                pc += 4;
-            }
-            if (end() - pc < 0 || (unsigned int)(end() - pc) < nSize)
-                return false;
-            if (pvchRet)
-                pvchRet->assign(pc, pc + nSize);
-            pc += nSize;
-        }
+        return get_op(pc, opcodeRet, &vchRet);
+    }
 
-        opcodeRet = (opcodetype)opcode;
-        return true;
+    bool GetOp2(const_iterator& pc, opcodetype& opcodeRet, std::vector<unsigned char>* pvchRet) const
+    {
+        return get_op(pc, opcodeRet, pvchRet);
     }
 
     /** Encode/decode small integers: */
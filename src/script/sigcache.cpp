@@ -27,10 +27,12 @@ private:
     uint256 nonce;
     typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
     map_type setValid;
+    size_t nElems;
     boost::shared_mutex cs_sigcache;
+    ScriptCacheCounters counters;
 
 public:
-    CSignatureCache()
+    CSignatureCache() : nElems(0)
     {
         GetRandBytes(nonce.begin(), 32);
     }
@@ -45,17 +47,39 @@ public:
     Get(const uint256& entry, const bool erase)
     {
         boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.contains(entry, erase);
+        const bool fHit = setValid.contains(entry, erase);
+        // Only block connection erases what it finds
+        counters.Lookup(erase, fHit);
+        return fHit;
     }
 
     void Set(uint256& entry)
     {
         boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.insert(entry);
+        counters.Insert(setValid.insert(entry));
     }
     uint32_t setup_bytes(size_t n)
     {
-        return setValid.setup_bytes(n);
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nElems = setValid.setup_bytes(n);
+        return nElems;
+    }
+
+    uint32_t resize_bytes(size_t n)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        uint32_t nEvicted;
+        nElems = setValid.resize_bytes(n, nEvicted);
+        counters.Evicted(nEvicted);
+        return nElems;
+    }
+
+    void GetStats(ScriptCacheStats& stats, bool fCountEntries)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        counters.Get(stats);
+        stats.nEntries = fCountEntries ? setValid.count_live() : 0;
+        stats.nCapacity = nElems;
     }
 };
 
@@ -92,3 +116,13 @@ bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsig
         signatureCache.Set(entry);
     return true;
 }
+
+void GetSignatureCacheStats(ScriptCacheStats& stats, bool fCountEntries)
+{
+    signatureCache.GetStats(stats, fCountEntries);
+}
+
+size_t ResizeSignatureCache(size_t nBytes)
+{
+    return signatureCache.resize_bytes(nBytes);
+}
@@ -8,6 +8,7 @@
 
 #include <script/interpreter.h>
 
+#include <atomic>
 #include <vector>
 
 // DoS prevention: limit cache size to 32MB (over 1000000 entries on 64-bit
@@ -16,6 +17,9 @@
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+// Default for -adaptivesigcache: memory in MiB the signature and script
+// execution caches may grow to together when blocks miss them (0 = fixed)
+static const int64_t DEFAULT_ADAPTIVE_SIG_CACHE_SIZE = 0;
 
 class CPubKey;
 
@@ -40,6 +44,63 @@ public:
     }
 };
 
+/** Usage counters of the signature or the script execution cache */
+struct ScriptCacheStats
+{
+    uint64_t nBlockHits = 0;    //!< Lookups while connecting blocks that hit
+    uint64_t nBlockMisses = 0;  //!< Lookups while connecting blocks that missed
+    uint64_t nHits = 0;         //!< Other lookups (mempool acceptance, block templates) that hit
+    uint64_t nMisses = 0;       //!< Other lookups that missed
+    uint64_t nInserts = 0;
+    uint64_t nEvictions = 0;    //!< Entries overwritten or dropped before they were used
+    size_t nEntries = 0;        //!< Entries not marked for erasure
+    size_t nCapacity = 0;
+};
+
+/**
+ * Counters behind ScriptCacheStats, updated from the script check threads.
+ * Hits while connecting a block are what the mempool verified before.
+ */
+class ScriptCacheCounters
+{
+private:
+    std::atomic<uint64_t> nBlockHits{0};
+    std::atomic<uint64_t> nBlockMisses{0};
+    std::atomic<uint64_t> nHits{0};
+    std::atomic<uint64_t> nMisses{0};
+    std::atomic<uint64_t> nInserts{0};
+    std::atomic<uint64_t> nEvictions{0};
+
+public:
+    void Lookup(bool fBlock, bool fHit)
+    {
+        std::atomic<uint64_t>& counter = fBlock ? (fHit ? nBlockHits : nBlockMisses) : (fHit ? nHits : nMisses);
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Insert(uint32_t nEvicted)
+    {
+        nInserts.fetch_add(1, std::memory_order_relaxed);
+        Evicted(nEvicted);
+    }
+
+    void Evicted(uint64_t n)
+    {
+        if (n)
+            nEvictions.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void Get(ScriptCacheStats& stats) const
+    {
+        stats.nBlockHits = nBlockHits.load(std::memory_order_relaxed);
+        stats.nBlockMisses = nBlockMisses.load(std::memory_order_relaxed);
+        stats.nHits = nHits.load(std::memory_order_relaxed);
+        stats.nMisses = nMisses.load(std::memory_order_relaxed);
+        stats.nInserts = nInserts.load(std::memory_order_relaxed);
+        stats.nEvictions = nEvictions.load(std::memory_order_relaxed);
+    }
+};
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
@@ -52,5 +113,10 @@ public:
 };
 
 void InitSignatureCache();
+/** Get the signature cache counters; counting the entries scans the cache. */
+void GetSignatureCacheStats(ScriptCacheStats& stats, bool fCountEntries = false);
+/** Resize the signature cache to nBytes, keeping its entries. Returns the
+ *  number of elements it can now hold. */
+size_t ResizeSignatureCache(size_t nBytes);
 
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
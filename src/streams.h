@@ -15,6 +15,7 @@
 #include <limits>
 #include <map>
 #include <set>
+#include <stdexcept>
 #include <stdint.h>
 #include <stdio.h>
 #include <string>
@@ -138,6 +139,167 @@ private:
     size_t nPos;
 };
 
+/** Minimal stream for reading from an existing, immutable byte range
+ *
+ * The referenced memory is not copied and must outlive the reader.
+ */
+class CSpanReader
+{
+private:
+    const int nType;
+    const int nVersion;
+    const unsigned char* pData;
+    size_t nSize;
+    size_t nPos;
+
+public:
+/*
+ * @param[in]  nTypeIn Serialization Type
+ * @param[in]  nVersionIn Serialization Version (including any flags)
+ * @param[in]  pDataIn Start of the referenced byte range
+ * @param[in]  nSizeIn Length of the referenced byte range
+*/
+    CSpanReader(int nTypeIn, int nVersionIn, const unsigned char* pDataIn, size_t nSizeIn) : nType(nTypeIn), nVersion(nVersionIn), pData(pDataIn), nSize(nSizeIn), nPos(0) {}
+
+    template<typename T>
+    CSpanReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+    int GetVersion() const { return nVersion; }
+    int GetType() const { return nType; }
+
+    size_t size() const { return nSize - nPos; }
+    bool empty() const { return nSize == nPos; }
+    //! Bytes consumed so far
+    size_t GetPos() const { return nPos; }
+
+    void read(char* dst, size_t n)
+    {
+        if (n == 0) {
+            return;
+        }
+        if (n > nSize - nPos) {
+            throw std::ios_base::failure("CSpanReader::read(): end of data");
+        }
+        memcpy(dst, pData + nPos, n);
+        nPos += n;
+    }
+
+    void ignore(size_t n)
+    {
+        if (n > nSize - nPos) {
+            throw std::ios_base::failure("CSpanReader::ignore(): end of data");
+        }
+        nPos += n;
+    }
+};
+
+/** Read bits, most significant first, from a byte stream */
+template <typename IStream>
+class BitStreamReader
+{
+private:
+    IStream& m_istream;
+
+    /// Buffered byte read in from the input stream. A new byte is read into the
+    /// buffer when m_offset reaches 8.
+    uint8_t m_buffer;
+
+    /// Number of high order bits in m_buffer already returned by previous
+    /// Read() calls. The next bit to be returned is at this offset from the
+    /// most significant bit position.
+    int m_offset;
+
+public:
+    explicit BitStreamReader(IStream& istream) : m_istream(istream), m_buffer(0), m_offset(8) {}
+
+    /** Read the specified number of bits from the stream. The data is returned
+     * in the nbits least significant bits of a 64-bit uint.
+     */
+    uint64_t Read(int nbits) {
+        if (nbits < 0 || nbits > 64) {
+            throw std::out_of_range("nbits must be between 0 and 64");
+        }
+
+        uint64_t data = 0;
+        while (nbits > 0) {
+            if (m_offset == 8) {
+                m_istream >> m_buffer;
+                m_offset = 0;
+            }
+
+            int bits = std::min(8 - m_offset, nbits);
+            data <<= bits;
+            data |= static_cast<uint8_t>(m_buffer << m_offset) >> (8 - bits);
+            m_offset += bits;
+            nbits -= bits;
+        }
+        return data;
+    }
+};
+
+/** Write bits, most significant first, to a byte stream */
+template <typename OStream>
+class BitStreamWriter
+{
+private:
+    OStream& m_ostream;
+
+    /// Buffered byte waiting to be written to the output stream. The byte is
+    /// written when m_offset reaches 8 or Flush() is called.
+    uint8_t m_buffer;
+
+    /// Number of high order bits in m_buffer already written by previous
+    /// Write() calls and not yet flushed to the stream. The next bit to be
+    /// written to is at this offset from the most significant bit position.
+    int m_offset;
+
+public:
+    explicit BitStreamWriter(OStream& ostream) : m_ostream(ostream), m_buffer(0), m_offset(0) {}
+
+    ~BitStreamWriter()
+    {
+        Flush();
+    }
+
+    /** Write the nbits least significant bits of a 64-bit int to the output
+     * stream. Data is buffered until it completes an octet.
+     */
+    void Write(uint64_t data, int nbits) {
+        if (nbits < 0 || nbits > 64) {
+            throw std::out_of_range("nbits must be between 0 and 64");
+        }
+
+        while (nbits > 0) {
+            int bits = std::min(8 - m_offset, nbits);
+            m_buffer |= (data << (64 - nbits)) >> (64 - 8 + m_offset);
+            m_offset += bits;
+            nbits -= bits;
+
+            if (m_offset == 8) {
+                Flush();
+            }
+        }
+    }
+
+    /** Flush any unwritten bits to the output stream, padding with 0's to the
+     * next byte boundary.
+     */
+    void Flush() {
+        if (m_offset == 0) {
+            return;
+        }
+
+        m_ostream << m_buffer;
+        m_buffer = 0;
+        m_offset = 0;
+    }
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -0,0 +1,111 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/addressindex.h>
+#include <script/sign.h>
+#include <test/test_bitcoin.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, TestChain100Setup)
+
+static void WaitForSync(AddressIndex& index)
+{
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.IsSynced()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_spend_and_rewind)
+{
+    CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const uint160 coinbase_key = GetAddressIndexKey(coinbase_script);
+
+    AddressIndex index(1 << 20, true);
+    BOOST_REQUIRE(index.Start());
+    WaitForSync(index);
+
+    std::vector<CAddressIndexEntry> entries;
+    std::vector<std::pair<COutPoint, Coin>> unspent;
+    BOOST_CHECK(index.FindEntries(coinbase_key, 0, 0, entries));
+    BOOST_CHECK(index.FindUnspent(coinbase_key, unspent));
+    BOOST_CHECK_EQUAL(entries.size(), coinbaseTxns.size());
+    BOOST_CHECK_EQUAL(unspent.size(), coinbaseTxns.size());
+    for (size_t i = 1; i < entries.size(); ++i) {
+        BOOST_CHECK(entries[i - 1].nHeight < entries[i].nHeight);
+    }
+
+    // Spend the coinbase output of block 6, the first one that is not a
+    // premine and has a subsidy, to a fresh script
+    CKey key;
+    key.MakeNewKey(true);
+    CScript dest_script = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[5].GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = coinbaseTxns[5].vout[0].nValue - CENT;
+    spend.vout[0].scriptPubKey = dest_script;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(coinbase_script, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_REQUIRE(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    CBlock block = CreateAndProcessBlock({spend}, coinbase_script);
+    BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+
+    entries.clear();
+    BOOST_CHECK(index.FindEntries(coinbase_key, chainActive.Height(), 0, entries));
+    BOOST_REQUIRE_EQUAL(entries.size(), 2U);
+    BOOST_CHECK(entries[0].fSpending || entries[1].fSpending);
+    unspent.clear();
+    BOOST_CHECK(index.FindUnspent(GetAddressIndexKey(dest_script), unspent));
+    BOOST_REQUIRE_EQUAL(unspent.size(), 1U);
+    BOOST_CHECK(unspent[0].first == COutPoint(spend.GetHash(), 0));
+
+    // Disconnecting the block takes the spend out before any other block is
+    // connected
+    {
+        CValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+    unspent.clear();
+    BOOST_CHECK(index.FindUnspent(GetAddressIndexKey(dest_script), unspent));
+    BOOST_CHECK(unspent.empty());
+    unspent.clear();
+    BOOST_CHECK(index.FindUnspent(coinbase_key, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), coinbaseTxns.size());
+
+    // Replace the block with one that does not contain the spend
+    CreateAndProcessBlock({}, coinbase_script);
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+
+    unspent.clear();
+    BOOST_CHECK(index.FindUnspent(GetAddressIndexKey(dest_script), unspent));
+    BOOST_CHECK(unspent.empty());
+    entries.clear();
+    BOOST_CHECK(index.FindEntries(coinbase_key, 0, 0, entries));
+    for (const CAddressIndexEntry& entry : entries) {
+        BOOST_CHECK(!entry.fSpending);
+    }
+    unspent.clear();
+    BOOST_CHECK(index.FindUnspent(coinbase_key, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), coinbaseTxns.size() + 1);
+
+    index.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
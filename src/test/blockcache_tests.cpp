@@ -0,0 +1,75 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcache.h>
+#include <core_memusage.h>
+#include <primitives/transaction.h>
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, BasicTestingSetup)
+
+static std::shared_ptr<const CBlock> MakeBlock(uint32_t nNonce)
+{
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    pblock->nNonce = nNonce;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << std::vector<unsigned char>(100, nNonce & 0xff);
+    pblock->vtx.push_back(MakeTransactionRef(std::move(tx)));
+    return pblock;
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_lru)
+{
+    std::vector<std::shared_ptr<const CBlock> > blocks;
+    for (uint32_t i = 0; i < 4; i++) {
+        blocks.push_back(MakeBlock(i));
+    }
+    size_t nBlockUsage = RecursiveDynamicUsage(blocks[0]);
+
+    // Room for exactly three blocks.
+    CBlockCache cache(nBlockUsage * 3);
+    for (int i = 0; i < 3; i++) {
+        cache.Insert(blocks[i]->GetHash(), blocks[i]);
+    }
+    BOOST_CHECK(cache.Get(blocks[0]->GetHash()) == blocks[0]);
+    BOOST_CHECK(cache.Get(blocks[1]->GetHash()) == blocks[1]);
+
+    // Block 2 is now the least recently used one and makes room for block 3.
+    cache.Insert(blocks[3]->GetHash(), blocks[3]);
+    BOOST_CHECK(!cache.Get(blocks[2]->GetHash()));
+    BOOST_CHECK(cache.Get(blocks[3]->GetHash()) == blocks[3]);
+
+    CBlockCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.count, 3U);
+    BOOST_CHECK_EQUAL(stats.usage, nBlockUsage * 3);
+    BOOST_CHECK_EQUAL(stats.hits, 3U);
+    BOOST_CHECK_EQUAL(stats.misses, 1U);
+
+    // Inserting a block twice does not count it twice.
+    cache.Insert(blocks[3]->GetHash(), blocks[3]);
+    BOOST_CHECK_EQUAL(cache.GetStats().usage, nBlockUsage * 3);
+
+    // Shrinking the cache evicts the oldest blocks first.
+    cache.SetMaxUsage(nBlockUsage);
+    BOOST_CHECK_EQUAL(cache.GetStats().count, 1U);
+    BOOST_CHECK(cache.Get(blocks[3]->GetHash()) == blocks[3]);
+
+    // A block larger than the whole cache is not kept.
+    cache.SetMaxUsage(nBlockUsage - 1);
+    BOOST_CHECK_EQUAL(cache.GetStats().count, 0U);
+    cache.Insert(blocks[0]->GetHash(), blocks[0]);
+    BOOST_CHECK(!cache.Get(blocks[0]->GetHash()));
+
+    cache.SetMaxUsage(nBlockUsage * 3);
+    cache.Insert(blocks[0]->GetHash(), blocks[0]);
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.GetStats().count, 0U);
+    BOOST_CHECK_EQUAL(cache.GetStats().usage, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,86 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilemap.h>
+#include <fs.h>
+#include <test/test_bitcoin.h>
+#include <util.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, BasicTestingSetup)
+
+static fs::path WriteTestFile(const fs::path& dir, int n, size_t nSize)
+{
+    fs::path path = dir / strprintf("blk%05u.dat", n);
+    FILE* file = fsbridge::fopen(path, "wb");
+    for (size_t i = 0; i < nSize; i++) {
+        fputc((int)((n + i) & 0xff), file);
+    }
+    fclose(file);
+    return path;
+}
+
+BOOST_AUTO_TEST_CASE(mapped_file)
+{
+    fs::path dir = fs::temp_directory_path() / strprintf("test_donu_blockfilemap_%lu_%i", (unsigned long)GetTime(), (int)InsecureRandRange(100000));
+    fs::create_directories(dir);
+
+    fs::path path = WriteTestFile(dir, 1, 5000);
+    std::shared_ptr<const CMappedFile> mapped = CMappedFile::Open(path);
+    BOOST_REQUIRE(mapped);
+    BOOST_CHECK_EQUAL(mapped->size(), 5000U);
+    for (size_t i = 0; i < mapped->size(); i++) {
+        BOOST_CHECK_EQUAL(mapped->data()[i], (1 + i) & 0xff);
+    }
+
+    // Empty and missing files are not mapped.
+    BOOST_CHECK(!CMappedFile::Open(WriteTestFile(dir, 2, 0)));
+    BOOST_CHECK(!CMappedFile::Open(dir / "missing.dat"));
+
+    mapped.reset();
+    fs::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(mapped_file_cache)
+{
+    fs::path dir = fs::temp_directory_path() / strprintf("test_donu_blockfilemap_%lu_%i", (unsigned long)GetTime(), (int)InsecureRandRange(100000));
+    fs::create_directories(dir);
+    std::vector<fs::path> paths;
+    for (int i = 0; i < 4; i++) {
+        paths.push_back(WriteTestFile(dir, i, 100 + i));
+    }
+
+    CMappedFileCache cache(2);
+    std::shared_ptr<const CMappedFile> first = cache.Get(0, paths[0]);
+    BOOST_REQUIRE(first);
+    BOOST_CHECK(cache.Get(0, paths[0]) == first);
+    BOOST_CHECK(cache.Get(1, paths[1]));
+    // Touch file 0 so that file 1 is the one evicted next.
+    BOOST_CHECK(cache.Get(0, paths[0]) == first);
+    BOOST_CHECK(cache.Get(2, paths[2]));
+    BOOST_CHECK_EQUAL(cache.Size(), 2U);
+    BOOST_CHECK(cache.Get(0, paths[0]) == first);
+
+    // An evicted mapping stays usable by whoever still holds it.
+    std::shared_ptr<const CMappedFile> third = cache.Get(2, paths[2]);
+    cache.Erase(2);
+    BOOST_CHECK_EQUAL(cache.Size(), 1U);
+    BOOST_CHECK_EQUAL(third->size(), 102U);
+    BOOST_CHECK_EQUAL(third->data()[101], (2 + 101) & 0xff);
+    BOOST_CHECK(cache.Get(2, paths[2]) != third);
+
+    // Shrinking the limit trims the cache; zero disables it.
+    cache.SetMaxFiles(1);
+    BOOST_CHECK_EQUAL(cache.Size(), 1U);
+    cache.SetMaxFiles(0);
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+    BOOST_CHECK(!cache.Get(3, paths[3]));
+
+    first.reset();
+    third.reset();
+    fs::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,223 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilter.h>
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/blockfilterindex.h>
+#include <test/test_bitcoin.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(gcsfilter_test)
+{
+    GCSFilter::ElementSet included_elements, excluded_elements;
+    for (int i = 0; i < 100; ++i) {
+        GCSFilter::Element element1(32);
+        element1[0] = i;
+        included_elements.insert(std::move(element1));
+
+        GCSFilter::Element element2(32);
+        element2[1] = i;
+        excluded_elements.insert(std::move(element2));
+    }
+
+    GCSFilter filter({0, 0, 10, 1 << 10}, included_elements);
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(filter.Match(element));
+
+        auto insertion = excluded_elements.insert(element);
+        BOOST_CHECK(filter.MatchAny(excluded_elements));
+        excluded_elements.erase(insertion.first);
+    }
+
+    // An encoded filter decodes to the same set
+    GCSFilter filter2(filter.GetParams(), filter.GetEncoded());
+    BOOST_CHECK_EQUAL(filter2.GetN(), filter.GetN());
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(filter2.Match(element));
+    }
+
+    // Trailing data is rejected
+    std::vector<unsigned char> encoded = filter.GetEncoded();
+    encoded.push_back(0);
+    BOOST_CHECK_THROW(GCSFilter(filter.GetParams(), encoded), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_default_constructor)
+{
+    GCSFilter filter;
+    BOOST_CHECK_EQUAL(filter.GetN(), 0U);
+    BOOST_CHECK_EQUAL(filter.GetEncoded().size(), 1U);
+
+    const GCSFilter::Params& params = filter.GetParams();
+    BOOST_CHECK_EQUAL(params.m_siphash_k0, 0U);
+    BOOST_CHECK_EQUAL(params.m_siphash_k1, 0U);
+    BOOST_CHECK_EQUAL(params.m_P, 0);
+    BOOST_CHECK_EQUAL(params.m_M, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
+{
+    CScript included_scripts[5], excluded_scripts[3];
+
+    // First two are outputs on a single transaction.
+    included_scripts[0] << std::vector<unsigned char>(0, 65) << OP_CHECKSIG;
+    included_scripts[1] << OP_DUP << OP_HASH160 << std::vector<unsigned char>(1, 20) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    // Third is an output on a second transaction.
+    included_scripts[2] << OP_1 << std::vector<unsigned char>(2, 33) << OP_1 << OP_CHECKMULTISIG;
+
+    // Last two are spent by a single transaction.
+    included_scripts[3] << OP_0 << std::vector<unsigned char>(3, 32);
+    included_scripts[4] << OP_4 << OP_ADD << OP_8 << OP_EQUAL;
+
+    // OP_RETURN output is not included.
+    excluded_scripts[0] << OP_RETURN << std::vector<unsigned char>(4, 40);
+
+    // This script is not related to the block at all.
+    excluded_scripts[1] << std::vector<unsigned char>(5, 33) << OP_CHECKSIG;
+
+    // An empty output, like the coinstake marker, is not included.
+    excluded_scripts[2] = CScript();
+
+    CMutableTransaction tx_1;
+    tx_1.vout.emplace_back(100, included_scripts[0]);
+    tx_1.vout.emplace_back(200, included_scripts[1]);
+    tx_1.vout.emplace_back(0, excluded_scripts[0]);
+
+    CMutableTransaction tx_2;
+    tx_2.vout.emplace_back(0, CScript());
+    tx_2.vout.emplace_back(300, included_scripts[2]);
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx_1));
+    block.vtx.push_back(MakeTransactionRef(tx_2));
+
+    CBlockUndo block_undo;
+    block_undo.vtxundo.emplace_back();
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(400, included_scripts[3]), 1000, true, false, 0);
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(500, included_scripts[4]), 10000, false, false, 0);
+
+    BlockFilter block_filter(BlockFilterType::BASIC, block, block_undo);
+    const GCSFilter& filter = block_filter.GetFilter();
+
+    for (const CScript& script : included_scripts) {
+        BOOST_CHECK(filter.Match(GCSFilter::Element(script.begin(), script.end())));
+    }
+    for (const CScript& script : excluded_scripts) {
+        BOOST_CHECK(!filter.Match(GCSFilter::Element(script.begin(), script.end())));
+    }
+    BOOST_CHECK_EQUAL(filter.GetN(), 5U);
+
+    // Test serialization/unserialization.
+    BlockFilter block_filter2;
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block_filter;
+    stream >> block_filter2;
+
+    BOOST_CHECK(block_filter.GetFilterType() == block_filter2.GetFilterType());
+    BOOST_CHECK_EQUAL(block_filter.GetBlockHash(), block_filter2.GetBlockHash());
+    BOOST_CHECK(block_filter.GetEncodedFilter() == block_filter2.GetEncodedFilter());
+    BOOST_CHECK_EQUAL(block_filter.GetHash(), block_filter2.GetHash());
+
+    // The header commits to the previous one.
+    uint256 header = block_filter.ComputeHeader(uint256());
+    BOOST_CHECK(header != uint256());
+    BOOST_CHECK(block_filter.ComputeHeader(header) != header);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_type_names)
+{
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(BlockFilterType::BASIC), "basic");
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(static_cast<BlockFilterType>(1)), "");
+
+    BlockFilterType filter_type;
+    BOOST_CHECK(BlockFilterTypeByName("basic", filter_type));
+    BOOST_CHECK(filter_type == BlockFilterType::BASIC);
+    BOOST_CHECK(!BlockFilterTypeByName("unknown", filter_type));
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilterindex_initial_sync, TestChain100Setup)
+{
+    BlockFilterIndex index(BlockFilterType::BASIC, 1 << 20, true);
+
+    // Lookups fail before the index has been started.
+    BlockFilter filter;
+    uint256 filter_header;
+    const CBlockIndex* tip;
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip();
+    }
+    BOOST_CHECK(!index.LookupFilter(tip, filter));
+    BOOST_CHECK(!index.LookupFilterHeader(tip, filter_header));
+
+    BOOST_REQUIRE(index.Start());
+
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.IsSynced()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+
+    // Every block has a filter, and each header commits to the one before it.
+    uint256 prev_header;
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pindex = chainActive.Genesis(); pindex; pindex = chainActive.Next(pindex)) {
+            BOOST_REQUIRE(index.LookupFilter(pindex, filter));
+            BOOST_REQUIRE(index.LookupFilterHeader(pindex, filter_header));
+            BOOST_CHECK_EQUAL(filter.GetBlockHash(), pindex->GetBlockHash());
+            BOOST_CHECK_EQUAL(filter_header, filter.ComputeHeader(prev_header));
+            prev_header = filter_header;
+        }
+    }
+
+    // Blocks mined to the coinbase script match it.
+    CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CBlock block = CreateAndProcessBlock({}, coinbase_script);
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip();
+    }
+    BOOST_REQUIRE_EQUAL(tip->GetBlockHash(), block.GetHash());
+    BOOST_REQUIRE(index.LookupFilter(tip, filter));
+    BOOST_REQUIRE(index.LookupFilterHeader(tip, filter_header));
+    BOOST_CHECK(filter.GetFilter().Match(GCSFilter::Element(coinbase_script.begin(), coinbase_script.end())));
+    BOOST_CHECK_EQUAL(filter_header, filter.ComputeHeader(prev_header));
+
+    // A block replacing the tip gets a filter of its own, while the stale
+    // block's filter stays readable.
+    const CBlockIndex* stale_tip = tip;
+    {
+        CValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), const_cast<CBlockIndex*>(stale_tip)));
+    }
+    CScript other_script = CScript() << OP_TRUE;
+    CreateAndProcessBlock({}, other_script);
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip();
+    }
+    BOOST_REQUIRE(tip != stale_tip);
+    BOOST_REQUIRE(index.LookupFilter(tip, filter));
+    BOOST_REQUIRE(index.LookupFilterHeader(tip, filter_header));
+    BOOST_CHECK(filter.GetFilter().Match(GCSFilter::Element(other_script.begin(), other_script.end())));
+    BOOST_CHECK_EQUAL(filter_header, filter.ComputeHeader(prev_header));
+    BOOST_CHECK(index.LookupFilter(stale_tip, filter));
+
+    index.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
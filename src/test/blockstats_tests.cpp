@@ -0,0 +1,176 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockstats.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <index/blockstatsindex.h>
+#include <streams.h>
+#include <test/test_bitcoin.h>
+#include <undo.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockstats_tests, BasicTestingSetup)
+
+static CTransactionRef SpendingTx(uint32_t nTime, int n_inputs, const std::vector<CTxOut>& outputs)
+{
+    CMutableTransaction tx;
+    tx.nTime = nTime;
+    for (int i = 0; i < n_inputs; ++i) {
+        tx.vin.emplace_back(COutPoint(InsecureRand256(), i));
+    }
+    tx.vout = outputs;
+    return MakeTransactionRef(tx);
+}
+
+/** Index entries of a chain whose blocks have the given times */
+static std::vector<CBlockIndex> BlockIndexChain(const std::vector<uint32_t>& times)
+{
+    std::vector<CBlockIndex> chain(times.size());
+    for (size_t i = 0; i < chain.size(); ++i) {
+        chain[i].nHeight = i;
+        chain[i].nTime = times[i];
+        chain[i].pprev = i > 0 ? &chain[i - 1] : nullptr;
+        chain[i].BuildSkip();
+    }
+    return chain;
+}
+
+BOOST_AUTO_TEST_CASE(blockstats_compute)
+{
+    const uint32_t nTime = 1500000000;
+    const CScript script = CScript() << OP_TRUE;
+
+    CMutableTransaction coinbase;
+    coinbase.nTime = nTime;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.emplace_back(0, script);
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    // Coinstake: empty marker output, then the stake returned with a reward
+    block.vtx.push_back(SpendingTx(nTime, 1, {CTxOut(0, CScript()), CTxOut(101 * COIN, script)}));
+    block.vtx.push_back(SpendingTx(nTime, 1, {CTxOut(4 * COIN, script)}));
+    block.vtx.push_back(SpendingTx(nTime, 2, {CTxOut(47 * COIN / 10, script), CTxOut(0, CScript() << OP_RETURN)}));
+    BOOST_REQUIRE(block.vtx[1]->IsCoinStake());
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(3);
+    blockundo.vtxundo[0].vprevout.emplace_back(CTxOut(100 * COIN, script), 1, false, true, nTime - 10 * 24 * 60 * 60);
+    blockundo.vtxundo[1].vprevout.emplace_back(CTxOut(5 * COIN, script), 1, false, false, nTime);
+    blockundo.vtxundo[2].vprevout.emplace_back(CTxOut(3 * COIN, script), 1, false, false, nTime);
+    blockundo.vtxundo[2].vprevout.emplace_back(CTxOut(2 * COIN, script), 1, false, false, nTime);
+
+    const std::vector<CBlockIndex> chain = BlockIndexChain({nTime - 20 * 24 * 60 * 60, nTime - 10 * 24 * 60 * 60, nTime});
+
+    CBlockStats stats;
+    BOOST_REQUIRE(ComputeBlockStats(block, &chain.back(), blockundo, stats));
+    BOOST_CHECK_EQUAL(stats.nTxs, 4);
+    BOOST_CHECK_EQUAL(stats.nInputs, 4);
+    BOOST_CHECK_EQUAL(stats.nOutputs, 6);
+    BOOST_CHECK_EQUAL(stats.nTotalOut, 87 * COIN / 10);
+    BOOST_CHECK_EQUAL(stats.nTotalFee, 13 * COIN / 10);
+    BOOST_CHECK_EQUAL(stats.nMinFee, 3 * COIN / 10);
+    BOOST_CHECK_EQUAL(stats.nMaxFee, COIN);
+    BOOST_CHECK_EQUAL(stats.nAvgFee, 65 * COIN / 100);
+    BOOST_CHECK_EQUAL(stats.nMedianFee, 65 * COIN / 100);
+    BOOST_CHECK(stats.nMinFeeRate > 0 && stats.nMinFeeRate < stats.nMaxFeeRate);
+    BOOST_CHECK(stats.nMinTxSize > 0 && stats.nMinTxSize < stats.nMaxTxSize);
+    // Five outputs enter the UTXO set, the OP_RETURN one does not, four leave it.
+    BOOST_CHECK_EQUAL(stats.nUTXOIncrease, 1);
+    BOOST_CHECK_EQUAL(stats.nStakeAmount, 100 * COIN);
+    BOOST_CHECK_EQUAL(stats.nStakeReward, COIN);
+    BOOST_CHECK_EQUAL(stats.nCoinAgeDestroyed, 1000U);
+
+    // Round trip through serialization
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << stats;
+    CBlockStats stats2;
+    ss >> stats2;
+    BOOST_CHECK_EQUAL(stats2.nMedianFee, stats.nMedianFee);
+    BOOST_CHECK_EQUAL(stats2.nCoinAgeDestroyed, stats.nCoinAgeDestroyed);
+
+    // Undo data of another block is rejected
+    blockundo.vtxundo.pop_back();
+    BOOST_CHECK(!ComputeBlockStats(block, &chain.back(), blockundo, stats));
+}
+
+BOOST_AUTO_TEST_CASE(blockstats_coin_age_min_age)
+{
+    const uint32_t nTime = 1500000000;
+    const int64_t nStakeMinAge = Params().GetConsensus().nStakeMinAge;
+    const CScript script = CScript() << OP_TRUE;
+
+    CMutableTransaction coinbase;
+    coinbase.nTime = nTime;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.emplace_back(0, script);
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.vtx.push_back(SpendingTx(nTime, 2, {CTxOut(1099 * COIN, script)}));
+
+    // Both coins are a day old, but the second one's block is younger than
+    // the minimum stake age, so only the first one counts
+    const std::vector<CBlockIndex> chain = BlockIndexChain({nTime - 2 * nStakeMinAge, nTime - 2 * nStakeMinAge, nTime - nStakeMinAge / 2, nTime});
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    blockundo.vtxundo[0].vprevout.emplace_back(CTxOut(100 * COIN, script), 1, false, false, nTime - 24 * 60 * 60);
+    blockundo.vtxundo[0].vprevout.emplace_back(CTxOut(1000 * COIN, script), 2, false, false, nTime - 24 * 60 * 60);
+
+    CBlockStats stats;
+    BOOST_REQUIRE(ComputeBlockStats(block, &chain.back(), blockundo, stats));
+    BOOST_CHECK_EQUAL(stats.nCoinAgeDestroyed, 100U);
+
+    // A coin from a block after this one means the undo data is not this block's
+    blockundo.vtxundo[0].vprevout[1].nHeight = 4;
+    BOOST_CHECK(!ComputeBlockStats(block, &chain.back(), blockundo, stats));
+}
+
+BOOST_FIXTURE_TEST_CASE(blockstatsindex_initial_sync, TestChain100Setup)
+{
+    BlockStatsIndex index(1 << 20, true);
+    BOOST_REQUIRE(index.Start());
+
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.IsSynced()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+
+    // The stored statistics match those computed from disk.
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pindex = chainActive.Genesis(); pindex; pindex = chainActive.Next(pindex)) {
+            CBlockStats stored;
+            BOOST_REQUIRE(index.LookupStats(pindex, stored));
+
+            CBlock block;
+            BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+            CBlockUndo blockundo;
+            if (pindex->nHeight > 0) {
+                BOOST_REQUIRE(UndoReadFromDisk(blockundo, pindex));
+            }
+            CBlockStats computed;
+            BOOST_REQUIRE(ComputeBlockStats(block, pindex, blockundo, computed));
+
+            CDataStream ss_stored(SER_DISK, CLIENT_VERSION), ss_computed(SER_DISK, CLIENT_VERSION);
+            ss_stored << stored;
+            ss_computed << computed;
+            BOOST_CHECK(ss_stored.str() == ss_computed.str());
+            BOOST_CHECK_EQUAL(stored.nTxs, (int64_t)block.vtx.size());
+        }
+    }
+
+    index.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,77 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <random.h>
+#include <txdb.h>
+#include <validation.h>
+#include <test/test_bitcoin.h>
+
+#include <memory>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blocktreedb_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(load_block_index_parallel)
+{
+    CBlockTreeDB blocktree(1 << 20, true);
+
+    // A chain with a fork, using random hashes so that the entries spread
+    // over the whole key range.
+    const int nBlocks = 500;
+    std::vector<uint256> vHashes(nBlocks);
+    std::vector<CBlockIndex> vIndexes(nBlocks);
+    std::vector<const CBlockIndex*> vWrite;
+    for (int i = 0; i < nBlocks; i++) {
+        vHashes[i] = GetRandHash();
+        CBlockIndex& index = vIndexes[i];
+        index.phashBlock = &vHashes[i];
+        index.pprev = i == 0 ? nullptr : &vIndexes[i % 50 == 0 ? i / 2 : i - 1];
+        index.nHeight = index.pprev ? index.pprev->nHeight + 1 : 0;
+        index.nTime = i;
+        index.nFlags = CBlockIndex::BLOCK_PROOF_OF_STAKE;
+        index.nStakeModifier = i * 7;
+        vWrite.push_back(&index);
+    }
+    BOOST_CHECK(blocktree.WriteBatchSync({}, 0, vWrite));
+
+    for (int nThreads : {1, 4}) {
+        BlockMap mapLoaded;
+        size_t nReserved = 0;
+        BOOST_CHECK(blocktree.LoadBlockIndexGuts(Params().GetConsensus(),
+            [&](size_t nEntries) { nReserved = nEntries; mapLoaded.reserve(nEntries); },
+            [&](const uint256& hash) -> CBlockIndex* {
+                if (hash.IsNull()) return nullptr;
+                auto it = mapLoaded.find(hash);
+                if (it != mapLoaded.end()) return it->second;
+                it = mapLoaded.emplace(hash, new CBlockIndex()).first;
+                it->second->phashBlock = &it->first;
+                return it->second;
+            }, nThreads));
+
+        BOOST_CHECK_EQUAL(nReserved, (size_t)nBlocks);
+        BOOST_CHECK_EQUAL(mapLoaded.size(), (size_t)nBlocks);
+        for (const CBlockIndex& index : vIndexes) {
+            auto it = mapLoaded.find(index.GetBlockHash());
+            BOOST_REQUIRE(it != mapLoaded.end());
+            const CBlockIndex* pindex = it->second;
+            BOOST_CHECK_EQUAL(pindex->nHeight, index.nHeight);
+            BOOST_CHECK_EQUAL(pindex->nTime, index.nTime);
+            BOOST_CHECK_EQUAL(pindex->nStakeModifier, index.nStakeModifier);
+            if (index.pprev) {
+                BOOST_REQUIRE(pindex->pprev);
+                BOOST_CHECK(pindex->pprev->GetBlockHash() == index.pprev->GetBlockHash());
+            } else {
+                BOOST_CHECK(!pindex->pprev);
+            }
+        }
+
+        for (const auto& entry : mapLoaded)
+            delete entry.second;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
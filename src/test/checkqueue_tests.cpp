@@ -11,6 +11,8 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/thread.hpp>
 #include <atomic>
+#include <chrono>
+#include <set>
 #include <thread>
 #include <vector>
 #include <mutex>
@@ -125,6 +127,25 @@ struct FrozenCleanupCheck {
     void swap(FrozenCleanupCheck& x){std::swap(should_freeze, x.should_freeze);};
 };
 
+struct StealCheck {
+    static std::mutex m;
+    static std::condition_variable cv;
+    static std::set<std::thread::id> threads;
+    static size_t n_threads_expected;
+    static size_t n_calls;
+    bool operator()()
+    {
+        std::unique_lock<std::mutex> l(m);
+        threads.insert(std::this_thread::get_id());
+        ++n_calls;
+        cv.notify_all();
+        // Hold on to the rest of this thread's batch until every thread has
+        // run a check, which the last ones can only do by stealing
+        return cv.wait_for(l, std::chrono::seconds(60), []{ return threads.size() >= n_threads_expected; });
+    }
+    void swap(StealCheck& x){};
+};
+
 // Static Allocations
 std::mutex FrozenCleanupCheck::m{};
 std::atomic<uint64_t> FrozenCleanupCheck::nFrozen{0};
@@ -133,6 +154,11 @@ std::mutex UniqueCheck::m;
 std::unordered_multiset<size_t> UniqueCheck::results;
 std::atomic<size_t> FakeCheckCheckCompletion::n_calls{0};
 std::atomic<size_t> MemoryCheck::fake_allocated_memory{0};
+std::mutex StealCheck::m;
+std::condition_variable StealCheck::cv;
+std::set<std::thread::id> StealCheck::threads;
+size_t StealCheck::n_threads_expected{0};
+size_t StealCheck::n_calls{0};
 
 // Queue Typedefs
 typedef CCheckQueue<FakeCheckCheckCompletion> Correct_Queue;
@@ -141,6 +167,7 @@ typedef CCheckQueue<FailingCheck> Failing_Queue;
 typedef CCheckQueue<UniqueCheck> Unique_Queue;
 typedef CCheckQueue<MemoryCheck> Memory_Queue;
 typedef CCheckQueue<FrozenCleanupCheck> FrozenCleanup_Queue;
+typedef CCheckQueue<StealCheck> Steal_Queue;
 
 
 /** This test case checks that the CCheckQueue works properly
@@ -148,17 +175,17 @@ typedef CCheckQueue<FrozenCleanupCheck> FrozenCleanup_Queue;
  */
 void Correct_Queue_range(std::vector<size_t> range)
 {
-    auto small_queue = std::unique_ptr<Correct_Queue>(new Correct_Queue {QUEUE_BATCH_SIZE});
+    Correct_Queue small_queue{QUEUE_BATCH_SIZE};
     boost::thread_group tg;
     for (auto x = 0; x < nScriptCheckThreads; ++x) {
-       tg.create_thread([&]{small_queue->Thread();});
+       tg.create_thread([&]{small_queue.Thread();});
     }
     // Make vChecks here to save on malloc (this test can be slow...)
     std::vector<FakeCheckCheckCompletion> vChecks;
     for (auto i : range) {
         size_t total = i;
         FakeCheckCheckCompletion::n_calls = 0;
-        CCheckQueueControl<FakeCheckCheckCompletion> control(small_queue.get());
+        CCheckQueueControl<FakeCheckCheckCompletion> control(&small_queue);
         while (total) {
             vChecks.resize(std::min(total, (size_t) InsecureRandRange(10)));
             total -= vChecks.size();
@@ -213,15 +240,15 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_Random)
 /** Test that failing checks are caught */
 BOOST_AUTO_TEST_CASE(test_CheckQueue_Catches_Failure)
 {
-    auto fail_queue = std::unique_ptr<Failing_Queue>(new Failing_Queue {QUEUE_BATCH_SIZE});
+    Failing_Queue fail_queue{QUEUE_BATCH_SIZE};
 
     boost::thread_group tg;
     for (auto x = 0; x < nScriptCheckThreads; ++x) {
-       tg.create_thread([&]{fail_queue->Thread();});
+       tg.create_thread([&]{fail_queue.Thread();});
     }
 
     for (size_t i = 0; i < 1001; ++i) {
-        CCheckQueueControl<FailingCheck> control(fail_queue.get());
+        CCheckQueueControl<FailingCheck> control(&fail_queue);
         size_t remaining = i;
         while (remaining) {
             size_t r = InsecureRandRange(10);
@@ -246,15 +273,15 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Catches_Failure)
 // future blocks, ie, the bad state is cleared.
 BOOST_AUTO_TEST_CASE(test_CheckQueue_Recovers_From_Failure)
 {
-    auto fail_queue = std::unique_ptr<Failing_Queue>(new Failing_Queue {QUEUE_BATCH_SIZE});
+    Failing_Queue fail_queue{QUEUE_BATCH_SIZE};
     boost::thread_group tg;
     for (auto x = 0; x < nScriptCheckThreads; ++x) {
-       tg.create_thread([&]{fail_queue->Thread();});
+       tg.create_thread([&]{fail_queue.Thread();});
     }
 
     for (auto times = 0; times < 10; ++times) {
         for (bool end_fails : {true, false}) {
-            CCheckQueueControl<FailingCheck> control(fail_queue.get());
+            CCheckQueueControl<FailingCheck> control(&fail_queue);
             {
                 std::vector<FailingCheck> vChecks;
                 vChecks.resize(100, false);
@@ -274,17 +301,17 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Recovers_From_Failure)
 // more than once as well
 BOOST_AUTO_TEST_CASE(test_CheckQueue_UniqueCheck)
 {
-    auto queue = std::unique_ptr<Unique_Queue>(new Unique_Queue {QUEUE_BATCH_SIZE});
+    Unique_Queue queue{QUEUE_BATCH_SIZE};
     boost::thread_group tg;
     for (auto x = 0; x < nScriptCheckThreads; ++x) {
-       tg.create_thread([&]{queue->Thread();});
+       tg.create_thread([&]{queue.Thread();});
 
     }
 
     size_t COUNT = 100000;
     size_t total = COUNT;
     {
-        CCheckQueueControl<UniqueCheck> control(queue.get());
+        CCheckQueueControl<UniqueCheck> control(&queue);
         while (total) {
             size_t r = InsecureRandRange(10);
             std::vector<UniqueCheck> vChecks;
@@ -310,15 +337,15 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_UniqueCheck)
 // time could leave the data hanging across a sequence of blocks.
 BOOST_AUTO_TEST_CASE(test_CheckQueue_Memory)
 {
-    auto queue = std::unique_ptr<Memory_Queue>(new Memory_Queue {QUEUE_BATCH_SIZE});
+    Memory_Queue queue{QUEUE_BATCH_SIZE};
     boost::thread_group tg;
     for (auto x = 0; x < nScriptCheckThreads; ++x) {
-       tg.create_thread([&]{queue->Thread();});
+       tg.create_thread([&]{queue.Thread();});
     }
     for (size_t i = 0; i < 1000; ++i) {
         size_t total = i;
         {
-            CCheckQueueControl<MemoryCheck> control(queue.get());
+            CCheckQueueControl<MemoryCheck> control(&queue);
             while (total) {
                 size_t r = InsecureRandRange(10);
                 std::vector<MemoryCheck> vChecks;
@@ -341,14 +368,14 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Memory)
 // have been destructed
 BOOST_AUTO_TEST_CASE(test_CheckQueue_FrozenCleanup)
 {
-    auto queue = std::unique_ptr<FrozenCleanup_Queue>(new FrozenCleanup_Queue {QUEUE_BATCH_SIZE});
+    FrozenCleanup_Queue queue{QUEUE_BATCH_SIZE};
     boost::thread_group tg;
     bool fails = false;
     for (auto x = 0; x < nScriptCheckThreads; ++x) {
-        tg.create_thread([&]{queue->Thread();});
+        tg.create_thread([&]{queue.Thread();});
     }
     std::thread t0([&]() {
-        CCheckQueueControl<FrozenCleanupCheck> control(queue.get());
+        CCheckQueueControl<FrozenCleanupCheck> control(&queue);
         std::vector<FrozenCleanupCheck> vChecks(1);
         // Freezing can't be the default initialized behavior given how the queue
         // swaps in default initialized Checks (otherwise freezing destructor
@@ -364,7 +391,7 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_FrozenCleanup)
     }
     // Try to get control of the queue a bunch of times
     for (auto x = 0; x < 100 && !fails; ++x) {
-        fails = queue->ControlMutex.try_lock();
+        fails = queue.ControlMutex.try_lock();
     }
     {
         // Unfreeze (we need lock n case of spurious wakeup)
@@ -381,10 +408,52 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_FrozenCleanup)
 }
 
 
+/** Test that threads steal checks from the deques of others: first from the
+ *  master's, which gets all work while no worker is registered, then from
+ *  the workers' while the master's is empty. Every check blocks its thread
+ *  until all threads have run one, so this only succeeds when the work was
+ *  spread over all of them. */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_WorkStealing)
+{
+    const size_t n_workers = 3;
+    const unsigned int batch_size = 8;
+    Steal_Queue queue{batch_size};
+    boost::thread_group tg;
+    StealCheck::n_threads_expected = n_workers + 1;
+
+    {
+        CCheckQueueControl<StealCheck> control(&queue);
+        std::vector<StealCheck> vChecks(batch_size);
+        control.Add(vChecks);
+        for (size_t i = 0; i < n_workers; ++i) {
+            tg.create_thread([&]{queue.Thread();});
+        }
+        BOOST_CHECK(control.Wait());
+        std::lock_guard<std::mutex> l(StealCheck::m);
+        BOOST_CHECK_EQUAL(StealCheck::n_calls, batch_size);
+        BOOST_CHECK_EQUAL(StealCheck::threads.size(), n_workers + 1);
+        StealCheck::n_calls = 0;
+        StealCheck::threads.clear();
+    }
+    {
+        // The workers are registered now, so Add skips the master's deque
+        CCheckQueueControl<StealCheck> control(&queue);
+        std::vector<StealCheck> vChecks(batch_size * n_workers);
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+        std::lock_guard<std::mutex> l(StealCheck::m);
+        BOOST_CHECK_EQUAL(StealCheck::n_calls, batch_size * n_workers);
+        BOOST_CHECK_EQUAL(StealCheck::threads.size(), n_workers + 1);
+        BOOST_CHECK(StealCheck::threads.count(std::this_thread::get_id()));
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
 /** Test that CCheckQueueControl is threadsafe */
 BOOST_AUTO_TEST_CASE(test_CheckQueueControl_Locks)
 {
-    auto queue = std::unique_ptr<Standard_Queue>(new Standard_Queue{QUEUE_BATCH_SIZE});
+    Standard_Queue queue{QUEUE_BATCH_SIZE};
     {
         boost::thread_group tg;
         std::atomic<int> nThreads {0};
@@ -392,7 +461,7 @@ BOOST_AUTO_TEST_CASE(test_CheckQueueControl_Locks)
         for (size_t i = 0; i < 3; ++i) {
             tg.create_thread(
                     [&]{
-                    CCheckQueueControl<FakeCheck> control(queue.get());
+                    CCheckQueueControl<FakeCheck> control(&queue);
                     // While sleeping, no other thread should execute to this point
                     auto observed = ++nThreads;
                     MilliSleep(10);
@@ -413,7 +482,7 @@ BOOST_AUTO_TEST_CASE(test_CheckQueueControl_Locks)
             bool done_ack {false};
             std::unique_lock<std::mutex> l(m);
             tg.create_thread([&]{
-                    CCheckQueueControl<FakeCheck> control(queue.get());
+                    CCheckQueueControl<FakeCheck> control(&queue);
                     std::unique_lock<std::mutex> ll(m);
                     has_lock = true;
                     cv.notify_one();
@@ -428,7 +497,7 @@ BOOST_AUTO_TEST_CASE(test_CheckQueueControl_Locks)
             cv.wait(l, [&](){return has_lock;});
             bool fails = false;
             for (auto x = 0; x < 100 && !fails; ++x) {
-                fails = queue->ControlMutex.try_lock();
+                fails = queue.ControlMutex.try_lock();
             }
             has_tried = true;
             cv.notify_one();
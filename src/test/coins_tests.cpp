@@ -4,6 +4,7 @@
 
 #include <coins.h>
 #include <script/standard.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <undo.h>
 #include <utilstrencodings.h>
@@ -525,6 +526,53 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     }
 }
 
+BOOST_AUTO_TEST_CASE(undo_compact_serialization)
+{
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(2);
+    CScript script = GetScriptForDestination(CKeyID(uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d35"))));
+    blockundo.vtxundo[0].vprevout.emplace_back(CTxOut(60000000000LL, script), 203998, false, false, 1541000000);
+    blockundo.vtxundo[0].vprevout.emplace_back(CTxOut(110397, script), 120891, false, true, 1540000000);
+    blockundo.vtxundo[1].vprevout.emplace_back(CTxOut(5000, CScript() << OP_TRUE), 0, true, false, 1530000000);
+
+    const int nCompactVersion = CLIENT_VERSION | SERIALIZE_UNDO_COMPACT;
+    for (int nVersion : {CLIENT_VERSION, nCompactVersion}) {
+        CDataStream ss(SER_DISK, nVersion);
+        ss << blockundo;
+        CBlockUndo blockundo2;
+        ss >> blockundo2;
+        BOOST_CHECK(ss.empty());
+        BOOST_REQUIRE_EQUAL(blockundo2.vtxundo.size(), 2U);
+        for (size_t i = 0; i < blockundo.vtxundo.size(); i++) {
+            const std::vector<Coin>& coins = blockundo.vtxundo[i].vprevout;
+            const std::vector<Coin>& coins2 = blockundo2.vtxundo[i].vprevout;
+            BOOST_REQUIRE_EQUAL(coins.size(), coins2.size());
+            for (size_t j = 0; j < coins.size(); j++) {
+                BOOST_CHECK(coins[j].out == coins2[j].out);
+                BOOST_CHECK_EQUAL(coins[j].nHeight, coins2[j].nHeight);
+                BOOST_CHECK_EQUAL(coins[j].fCoinBase, coins2[j].fCoinBase);
+                BOOST_CHECK_EQUAL(coins[j].fCoinStake, coins2[j].fCoinStake);
+                BOOST_CHECK_EQUAL(coins[j].nTime, coins2[j].nTime);
+            }
+        }
+    }
+
+    // The compact encoding adds the time base (5 bytes) but drops the
+    // version dummy of the two coins with a height, and stores their times
+    // in 1, 3 and 4 bytes instead of 5 each.
+    BOOST_CHECK_EQUAL(::GetSerializeSize(blockundo, SER_DISK, nCompactVersion) + 4,
+                      ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION));
+
+    // A coin time after the time base is rejected
+    CDataStream ssBad(SER_DISK, nCompactVersion);
+    ssBad << VARINT(100u);
+    WriteCompactSize(ssBad, 1);
+    WriteCompactSize(ssBad, 1);
+    ssBad << VARINT(4u) << VARINT(101u) << CTxOutCompressor(blockundo.vtxundo[1].vprevout[0].out);
+    CBlockUndo blockundoBad;
+    BOOST_CHECK_THROW(ssBad >> blockundoBad, std::ios_base::failure);
+}
+
 const static COutPoint OUTPOINT;
 const static CAmount PRUNED = -1;
 const static CAmount ABSENT = -2;
@@ -855,4 +903,55 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_background_flush)
+{
+    // Use tiny batches so the writer commits (and drops) entries piecemeal.
+    gArgs.ForceSetArg("-dbbatchsize", "1024");
+    CCoinsViewDB base(1 << 20, true);
+    base.StartBackgroundFlush();
+
+    std::vector<COutPoint> outpoints;
+    uint256 hashBlock;
+    for (int round = 0; round < 4; ++round) {
+        CCoinsViewCache cache(&base);
+        // Spend the coins created in the previous round.
+        for (const COutPoint& outpoint : outpoints) {
+            BOOST_CHECK(cache.HaveCoin(outpoint));
+            cache.SpendCoin(outpoint);
+        }
+        std::vector<COutPoint> spent;
+        spent.swap(outpoints);
+        for (int i = 0; i < 200; ++i) {
+            COutPoint outpoint(InsecureRand256(), i);
+            CTxOut txout(InsecureRand32() & 0xffffff, CScript() << OP_TRUE);
+            cache.AddCoin(outpoint, Coin(txout, round + 1, false, false, i), false);
+            outpoints.push_back(outpoint);
+        }
+        hashBlock = InsecureRand256();
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+
+        // Whether or not the write has completed, the view is consistent.
+        BOOST_CHECK(base.GetBestBlock() == hashBlock);
+        for (const COutPoint& outpoint : spent) {
+            BOOST_CHECK(!base.HaveCoin(outpoint));
+        }
+        for (const COutPoint& outpoint : outpoints) {
+            Coin coin;
+            BOOST_CHECK(base.GetCoin(outpoint, coin));
+            BOOST_CHECK_EQUAL((int)coin.nHeight, round + 1);
+            BOOST_CHECK_EQUAL(coin.nTime, outpoint.n);
+        }
+    }
+
+    BOOST_CHECK(base.WaitForFlush());
+    BOOST_CHECK(base.GetHeadBlocks().empty());
+    BOOST_CHECK(base.GetBestBlock() == hashBlock);
+    for (const COutPoint& outpoint : outpoints) {
+        BOOST_CHECK(base.HaveCoin(outpoint));
+    }
+    base.StopBackgroundFlush();
+    gArgs.ForceSetArg("-dbbatchsize", std::to_string(nDefaultDbBatchSize));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,8 @@
 #include <crypto/sha512.h>
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
+#include <crypto/muhash.h>
+#include <hash.h>
 #include <random.h>
 #include <utilstrencodings.h>
 #include <test/test_bitcoin.h>
@@ -169,6 +171,13 @@ void TestAES256CBC(const std::string &hexkey, const std::string &hexiv, bool pad
     BOOST_CHECK(decrypted.size() == in.size());
     BOOST_CHECK_MESSAGE(decrypted == in, HexStr(decrypted) + std::string(" != ") + hexin);
 
+    // Decrypt again with the IV given per call instead of at construction
+    std::vector<unsigned char> decrypted_iv(correctout.size());
+    AES256CBCDecrypt dec_noiv(key.data(), pad);
+    size = dec_noiv.Decrypt(iv.data(), correctout.data(), correctout.size(), decrypted_iv.data());
+    decrypted_iv.resize(size);
+    BOOST_CHECK_MESSAGE(decrypted_iv == in, HexStr(decrypted_iv) + std::string(" != ") + hexin);
+
     // Encrypt and re-decrypt substrings of the plaintext and verify that they equal each-other
     for(std::vector<unsigned char>::iterator i(in.begin()); i != in.end(); ++i)
     {
@@ -268,6 +277,22 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+        }
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -493,6 +518,28 @@ BOOST_AUTO_TEST_CASE(aes_cbc_testvectors) {
                   "b2eb05e2c39be9fcda6c19078c6a9d1b3f461796d6b0d6b2e0c2a72b4d80e644");
 }
 
+BOOST_AUTO_TEST_CASE(aes256_multiblock)
+{
+    // Decrypting many blocks in one call, which the AES-NI backend
+    // interleaves, must match decrypting them one by one.
+    unsigned char key[32];
+    GetRandBytes(key, sizeof(key));
+    std::vector<unsigned char> plain(AES_BLOCKSIZE * 11);
+    GetRandBytes(plain.data(), plain.size());
+
+    AES256Encrypt enc(key);
+    AES256Decrypt dec(key);
+    std::vector<unsigned char> cipher(plain.size());
+    for (size_t i = 0; i < plain.size(); i += AES_BLOCKSIZE) {
+        enc.Encrypt(&cipher[i], &plain[i]);
+    }
+    for (size_t blocks = 1; blocks <= plain.size() / AES_BLOCKSIZE; blocks++) {
+        std::vector<unsigned char> out(blocks * AES_BLOCKSIZE);
+        dec.Decrypt(out.data(), cipher.data(), blocks);
+        BOOST_CHECK(std::equal(out.begin(), out.end(), plain.begin()));
+    }
+}
+
 
 BOOST_AUTO_TEST_CASE(chacha20_testvector)
 {
@@ -546,4 +593,76 @@ BOOST_AUTO_TEST_CASE(countbits_tests)
     }
 }
 
+static MuHash3072 FromInt(unsigned char i) {
+    unsigned char tmp[32] = {i, 0};
+    return MuHash3072(tmp, sizeof(tmp));
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    uint256 out;
+
+    for (int iter = 0; iter < 10; ++iter) {
+        uint256 res;
+        int table[4];
+        for (int i = 0; i < 4; ++i) {
+            table[i] = InsecureRandBits(3);
+        }
+        for (int order = 0; order < 4; ++order) {
+            MuHash3072 acc;
+            for (int i = 0; i < 4; ++i) {
+                int t = table[i ^ order];
+                if (t & 4) {
+                    acc /= FromInt(t & 3);
+                } else {
+                    acc *= FromInt(t & 3);
+                }
+            }
+            acc.Finalize(out);
+            if (order == 0) {
+                res = out;
+            } else {
+                BOOST_CHECK(res == out);
+            }
+        }
+
+        MuHash3072 x = FromInt(InsecureRandBits(4)); // x=X
+        MuHash3072 y = FromInt(InsecureRandBits(4)); // x=X, y=Y
+        MuHash3072 z; // x=X, y=Y, z=1
+        z *= x; // x=X, y=Y, z=X
+        z *= y; // x=X, y=Y, z=X*Y
+        y *= x; // x=X, y=Y*X, z=X*Y
+        z /= y; // x=X, y=Y*X, z=1
+        z.Finalize(out);
+
+        uint256 out2;
+        MuHash3072 a;
+        a.Finalize(out2);
+
+        BOOST_CHECK_EQUAL(out, out2);
+    }
+
+    MuHash3072 acc = FromInt(0);
+    acc *= FromInt(1);
+    acc /= FromInt(2);
+    acc.Finalize(out);
+    BOOST_CHECK_EQUAL(out, uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+
+    MuHash3072 acc2 = FromInt(0);
+    unsigned char tmp[32] = {1, 0};
+    acc2.Insert(tmp, sizeof(tmp));
+    unsigned char tmp2[32] = {2, 0};
+    acc2.Remove(tmp2, sizeof(tmp2));
+    acc2.Finalize(out);
+    BOOST_CHECK_EQUAL(out, uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+
+    // Serialization round trip keeps the value
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << acc;
+    MuHash3072 acc3;
+    ss >> acc3;
+    acc3.Finalize(out);
+    BOOST_CHECK_EQUAL(out, uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -377,4 +377,71 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+/* Test that resizing keeps the entries that are not marked for erasure, and
+ * that insert reports the entries it gives up once the cache is overfull.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_resize_ok)
+{
+    local_rand_ctx = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    const uint32_t n_elems = cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes(n_elems / 2);
+    for (uint256& h : hashes) {
+        insecure_GetRandHash(h);
+        BOOST_CHECK_EQUAL(cc.insert(h), 0U);
+    }
+    // Erase every other one
+    for (size_t i = 0; i < hashes.size(); i += 2)
+        BOOST_CHECK(cc.contains(hashes[i], true));
+    BOOST_CHECK_EQUAL(cc.count_live(), hashes.size() - (hashes.size() + 1) / 2);
+
+    uint32_t evicted;
+    BOOST_CHECK_EQUAL(cc.resize_bytes(2 << 20, evicted), 2 * n_elems);
+    BOOST_CHECK_EQUAL(evicted, 0U);
+    BOOST_CHECK_EQUAL(cc.count_live(), hashes.size() / 2);
+    for (size_t i = 0; i < hashes.size(); ++i)
+        BOOST_CHECK_EQUAL(cc.contains(hashes[i], false), i % 2 == 1);
+
+    // Inserting far more than fits has to evict
+    uint32_t evictions = 0;
+    uint256 h;
+    for (uint32_t i = 0; i < 4 * n_elems; ++i) {
+        insecure_GetRandHash(h);
+        evictions += cc.insert(h);
+    }
+    BOOST_CHECK(evictions > 0);
+}
+
+/* Test that insert only reports entries lost before they were used: entries
+ * looked up and erased soon after their insertion never count, however many
+ * times the table turns over, while entries never used count once each when
+ * they are overwritten.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_evictions_ok)
+{
+    local_rand_ctx = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    const uint32_t n_elems = cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes(8 * n_elems);
+    uint32_t evictions = 0;
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        insecure_GetRandHash(hashes[i]);
+        evictions += cc.insert(hashes[i]);
+        if (i >= n_elems / 4)
+            BOOST_CHECK(cc.contains(hashes[i - n_elems / 4], true));
+    }
+    BOOST_CHECK_EQUAL(evictions, 0U);
+
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc_unused{};
+    cc_unused.setup_bytes(1 << 20);
+    for (uint32_t i = 0; i < 4 * n_elems; ++i) {
+        uint256 h;
+        insecure_GetRandHash(h);
+        evictions += cc_unused.insert(h);
+    }
+    // Whatever is not in the table any more was evicted
+    BOOST_CHECK(evictions <= 4 * n_elems - cc_unused.count_live());
+    BOOST_CHECK(evictions >= 3 * n_elems);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
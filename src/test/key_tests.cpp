@@ -112,6 +112,17 @@ BOOST_AUTO_TEST_CASE(key_test1)
         BOOST_CHECK(!pubkey2C.Verify(hashMsg, sign1C));
         BOOST_CHECK( pubkey2C.Verify(hashMsg, sign2C));
 
+        // parsed public keys give the same results
+
+        CParsedPubKey parsed1(pubkey1), parsed2C(pubkey2C);
+        BOOST_CHECK(parsed1.IsValid() && parsed2C.IsValid());
+        BOOST_CHECK( parsed1.Verify(hashMsg, sign1));
+        BOOST_CHECK( parsed1.Verify(hashMsg, sign1C));
+        BOOST_CHECK(!parsed1.Verify(hashMsg, sign2));
+        BOOST_CHECK( parsed2C.Verify(hashMsg, sign2C));
+        BOOST_CHECK(!parsed2C.Verify(hashMsg, sign1C));
+        BOOST_CHECK(!CParsedPubKey(CPubKey()).Verify(hashMsg, sign1));
+
         // compact signatures (with key recovery)
 
         std::vector<unsigned char> csign1, csign2, csign1C, csign2C;
@@ -0,0 +1,123 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
+#include <fs.h>
+#include <miner.h>
+#include <pow.h>
+#include <streams.h>
+#include <test/test_bitcoin.h>
+#include <ui_interface.h>
+#include <util.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+struct RegtestingSetup : public TestingSetup {
+    RegtestingSetup() : TestingSetup(CBaseChainParams::REGTEST) {}
+};
+
+/** A block on prev_hash at nHeight whose coinbase pays nValue. The chains
+ *  built here are short enough to stay at the minimum difficulty. */
+std::shared_ptr<const CBlock> CoinbaseBlock(const uint256& prev_hash, int nHeight, CAmount nValue)
+{
+    static uint32_t nTime = Params().GenesisBlock().nTime;
+
+    auto pblock = std::make_shared<CBlock>(BlockAssembler(Params()).CreateNewBlock(CScript() << OP_TRUE)->block);
+    pblock->hashPrevBlock = prev_hash;
+    pblock->nTime = ++nTime;
+    pblock->nBits = UintToArith256(Params().GetConsensus().powLimit).GetCompact();
+
+    CMutableTransaction txCoinbase(*pblock->vtx[0]);
+    txCoinbase.nTime = pblock->nTime;
+    txCoinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    txCoinbase.vout.resize(1);
+    txCoinbase.vout[0].nValue = nValue;
+    pblock->vtx.assign(1, MakeTransactionRef(std::move(txCoinbase)));
+    pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+
+    while (!CheckProofOfWork(pblock->GetHash(), pblock->nBits, Params().GetConsensus()))
+        ++pblock->nNonce;
+    return pblock;
+}
+
+/** Write blocks the way they are stored in block files */
+void WriteBlockFile(const fs::path& path, const std::vector<std::shared_ptr<const CBlock>>& blocks)
+{
+    CAutoFile fileout(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!fileout.IsNull());
+    for (const auto& pblock : blocks) {
+        unsigned int nSize = GetSerializeSize(fileout, *pblock);
+        fileout << FLATDATA(Params().MessageStart()) << nSize << *pblock;
+    }
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(loadblock_tests, RegtestingSetup)
+
+BOOST_AUTO_TEST_CASE(loadblock_out_of_order)
+{
+    const auto b1 = CoinbaseBlock(Params().GenesisBlock().GetHash(), 1, 0);
+    const auto b2 = CoinbaseBlock(b1->GetHash(), 2, 0);
+    const auto b3 = CoinbaseBlock(b2->GetHash(), 3, 0);
+
+    // As when reindexing a block file that has children before their
+    // parents: they wait until the parent is accepted and are then read back
+    CDiskBlockPos pos(1, 0);
+    const fs::path path = GetBlockPosFilename(pos, "blk");
+    WriteBlockFile(path, {b3, b2, b1});
+    BOOST_CHECK(LoadExternalBlockFile(Params(), fsbridge::fopen(path, "rb"), &pos));
+
+    CValidationState state;
+    BOOST_REQUIRE(ActivateBestChain(state, Params()));
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(chainActive.Height(), 3);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == b3->GetHash());
+    BOOST_CHECK_EQUAL(chainActive.Tip()->GetBlockPos().nFile, 1);
+}
+
+BOOST_AUTO_TEST_CASE(loadblock_rechecks_after_tip_moved)
+{
+    // The premine may only be paid at height 3. b4 pays it again, and passes
+    // CheckBlock with that for as long as the tip is at height 2.
+    bool ignored;
+    const auto b1 = CoinbaseBlock(Params().GenesisBlock().GetHash(), 1, 0);
+    const auto b2 = CoinbaseBlock(b1->GetHash(), 2, 0);
+    BOOST_REQUIRE(ProcessNewBlock(Params(), b1, true, &ignored));
+    BOOST_REQUIRE(ProcessNewBlock(Params(), b2, true, &ignored));
+    const auto b3 = CoinbaseBlock(b2->GetHash(), 3, GetProofOfWorkReward(3));
+    const auto b4 = CoinbaseBlock(b3->GetHash(), 4, GetProofOfWorkReward(3));
+
+    // Connect b3 as soon as it is accepted. The workers have usually checked
+    // b4 against the old tip by then, and that result must not be used.
+    bool fActivating = false;
+    boost::signals2::connection conn = uiInterface.NotifyHeaderTip.connect([&](bool, const CBlockIndex*) {
+        if (fActivating)
+            return;
+        fActivating = true;
+        CValidationState state;
+        ActivateBestChain(state, Params());
+        fActivating = false;
+    });
+    const fs::path path = GetDataDir() / "bootstrap.dat";
+    WriteBlockFile(path, {b3, b4});
+    BOOST_CHECK(LoadExternalBlockFile(Params(), fsbridge::fopen(path, "rb")));
+    conn.disconnect();
+
+    CValidationState state;
+    BOOST_REQUIRE(ActivateBestChain(state, Params()));
+    LOCK(cs_main);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == b3->GetHash());
+    auto it = mapBlockIndex.find(b4->GetHash());
+    BOOST_CHECK(it == mapBlockIndex.end() || (it->second->nStatus & BLOCK_FAILED_MASK));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,242 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <checkpointsync.h>
+#include <coins.h>
+#include <index/txindex.h>
+#include <kernel.h>
+#include <rpc/server.h>
+#include <script/sign.h>
+#include <test/test_bitcoin.h>
+#include <util.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <stdexcept>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+// Must be set before the block files of the test chain are written
+struct FastPruneArgs {
+    FastPruneArgs() { gArgs.ForceSetArg("-fastprune", "1"); }
+    ~FastPruneArgs() { gArgs.ForceSetArg("-fastprune", "0"); }
+};
+
+struct PruneTestingSetup : public FastPruneArgs, public TestChain100Setup {
+    CScript coinbase_script;
+    int64_t nMockTime;
+    uint256 hashSyncCheckpointSaved;
+
+    PruneTestingSetup()
+    {
+        coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+        nMockTime = GetTime();
+        {
+            LOCK(cs_hashSyncCheckpoint);
+            hashSyncCheckpointSaved = hashSyncCheckpoint;
+        }
+        g_txindex.reset(new TxIndex(1 << 20, true));
+        if (!g_txindex->Start()) {
+            throw std::runtime_error("PruneTestingSetup: failed to start the transaction index");
+        }
+        fPruneMode = true;
+    }
+
+    ~PruneTestingSetup()
+    {
+        fPruneMode = false;
+        fHavePruned = false;
+        g_txindex.reset();
+        LOCK(cs_hashSyncCheckpoint);
+        hashSyncCheckpoint = hashSyncCheckpointSaved;
+        SetMockTime(0);
+    }
+
+    // Blocks are ten minutes apart, so the test coins gather days of coin age
+    CBlock MineBlock(const std::vector<CMutableTransaction>& txns = {})
+    {
+        nMockTime += 10 * 60;
+        SetMockTime(nMockTime);
+        return CreateAndProcessBlock(txns, coinbase_script);
+    }
+
+    void MineBlocks(int count)
+    {
+        for (int i = 0; i < count; i++) {
+            MineBlock();
+        }
+    }
+
+    CMutableTransaction SpendCoinbase(const CTransaction& coinbase)
+    {
+        CMutableTransaction spend;
+        spend.nVersion = 1;
+        spend.vin.resize(1);
+        spend.vin[0].prevout = COutPoint(coinbase.GetHash(), 0);
+        spend.vout.resize(1);
+        spend.vout[0].nValue = coinbase.vout[0].nValue - CENT;
+        spend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(coinbase_script, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_REQUIRE(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        spend.vin[0].scriptSig << vchSig;
+        return spend;
+    }
+};
+
+void SetSyncCheckpoint(const CBlockIndex* pindex)
+{
+    LOCK(cs_hashSyncCheckpoint);
+    hashSyncCheckpoint = pindex->GetBlockHash();
+}
+
+UniValue CallPruneBlockchain(int height)
+{
+    JSONRPCRequest request;
+    request.strMethod = "pruneblockchain";
+    request.params = UniValue(UniValue::VARR);
+    request.params.push_back(height);
+    return tableRPC["pruneblockchain"]->actor(request);
+}
+
+bool HaveBlockData(int nHeight)
+{
+    return chainActive[nHeight]->nStatus & BLOCK_HAVE_DATA;
+}
+
+void CheckKernelsEqual(const CStakeKernelPrevout& a, const CStakeKernelPrevout& b)
+{
+    BOOST_CHECK(a.pindexFrom == b.pindexFrom);
+    BOOST_CHECK_EQUAL(a.nTxPrevOffset, b.nTxPrevOffset);
+    BOOST_CHECK_EQUAL(a.nTimeTxPrev, b.nTimeTxPrev);
+    BOOST_CHECK(a.txout == b.txout);
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(prune_tests, PruneTestingSetup)
+
+BOOST_AUTO_TEST_CASE(prune_respects_sync_checkpoint)
+{
+    MineBlocks(1000);
+
+    LOCK(cs_main);
+    const int nTipHeight = chainActive.Height();
+    BOOST_REQUIRE(chainActive.Tip()->nFile >= 3);
+
+    // Checkpoint the first block of the second file: only the first file may go
+    const CBlockIndex* pindexCheckpoint = nullptr;
+    for (int i = 0; i <= nTipHeight && !pindexCheckpoint; i++) {
+        if (chainActive[i]->nFile == 1) pindexCheckpoint = chainActive[i];
+    }
+    BOOST_REQUIRE(pindexCheckpoint);
+    const int nCheckpointHeight = pindexCheckpoint->nHeight;
+    SetSyncCheckpoint(pindexCheckpoint);
+
+    PruneBlockFilesManual(nTipHeight - MIN_BLOCKS_TO_KEEP);
+    BOOST_CHECK(fHavePruned);
+    BOOST_CHECK(!fs::exists(GetBlockPosFilename(CDiskBlockPos(0, 0), "blk")));
+    for (int i = 0; i <= nTipHeight; i++) {
+        BOOST_CHECK_EQUAL(HaveBlockData(i), i >= nCheckpointHeight);
+    }
+
+    // Nothing changes while the checkpoint stays where it is
+    PruneBlockFilesManual(nTipHeight - MIN_BLOCKS_TO_KEEP);
+    BOOST_CHECK(HaveBlockData(nCheckpointHeight));
+}
+
+BOOST_AUTO_TEST_CASE(pruneblockchain_keeps_recent_blocks)
+{
+    MineBlocks(1000);
+
+    LOCK(cs_main);
+    const int nTipHeight = chainActive.Height();
+    SetSyncCheckpoint(chainActive.Tip());
+
+    BOOST_CHECK_THROW(CallPruneBlockchain(nTipHeight + 1), UniValue);
+    BOOST_CHECK_THROW(CallPruneBlockchain(-1), UniValue);
+    fPruneMode = false;
+    BOOST_CHECK_THROW(CallPruneBlockchain(nTipHeight), UniValue);
+    fPruneMode = true;
+
+    // Asking for the whole chain is clamped to the last MIN_BLOCKS_TO_KEEP blocks
+    const int nPruneHeight = nTipHeight - MIN_BLOCKS_TO_KEEP;
+    BOOST_CHECK_EQUAL(CallPruneBlockchain(nTipHeight).get_int(), nPruneHeight);
+    BOOST_CHECK(fHavePruned);
+    BOOST_CHECK(!HaveBlockData(1));
+    for (int i = nPruneHeight + 1; i <= nTipHeight; i++) {
+        BOOST_CHECK(HaveBlockData(i));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(prune_keeps_stake_kernel_and_coin_age)
+{
+    // Spend the coinbase of block 7 in a block that stays within the blocks
+    // that are never pruned (the first blocks with a subsidy to spend that is
+    // not a premine are 6 and up)
+    MineBlocks(900);
+    const CMutableTransaction spend = SpendCoinbase(coinbaseTxns[6]);
+    MineBlock({spend});
+    MineBlocks(99);
+    BOOST_REQUIRE(g_txindex->BlockUntilSyncedToCurrentChain());
+
+    LOCK(cs_main);
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    const CBlockIndex* pindexSpend = chainActive[pindexTip->nHeight - 99];
+    BOOST_REQUIRE(pindexSpend->nTx == 2);
+
+    const COutPoint unspent(coinbaseTxns[5].GetHash(), 0);
+    const COutPoint spent(coinbaseTxns[6].GetHash(), 0);
+    const CTransaction txUnspent(SpendCoinbase(coinbaseTxns[5]));
+    const CTransaction txSpent(spend);
+
+    CStakeKernelPrevout kernelUnspent, kernelSpent;
+    uint64_t nCoinAgeUnspent = 0, nCoinAgeSpent = 0;
+    BOOST_REQUIRE(GetStakeKernelPrevout(unspent, pindexTip, kernelUnspent));
+    BOOST_REQUIRE(GetStakeKernelPrevout(spent, pindexSpend->pprev, kernelSpent));
+    BOOST_CHECK(kernelUnspent.pindexFrom == chainActive[6]);
+    BOOST_CHECK(kernelSpent.pindexFrom == chainActive[7]);
+    BOOST_REQUIRE(GetCoinAge(txUnspent, *pcoinsTip, nCoinAgeUnspent));
+    BOOST_CHECK(nCoinAgeUnspent > 0);
+    {
+        Coin coin;
+        BOOST_REQUIRE(GetCoinSpentSince(spent, pindexSpend->pprev, coin));
+        CCoinsViewCache view(pcoinsTip.get());
+        view.AddCoin(spent, std::move(coin), false);
+        BOOST_REQUIRE(GetCoinAge(txSpent, view, nCoinAgeSpent));
+        BOOST_CHECK(nCoinAgeSpent > 0);
+    }
+
+    SetSyncCheckpoint(pindexTip);
+    PruneBlockFilesManual(pindexTip->nHeight - MIN_BLOCKS_TO_KEEP);
+    BOOST_REQUIRE(!HaveBlockData(6));
+    BOOST_REQUIRE(!HaveBlockData(7));
+    BOOST_REQUIRE(HaveBlockData(pindexSpend->nHeight));
+
+    // Both coins are now only found through the index and the undo data of
+    // the blocks that are kept
+    CStakeKernelPrevout kernel;
+    BOOST_REQUIRE(GetStakeKernelPrevout(unspent, pindexTip, kernel));
+    CheckKernelsEqual(kernel, kernelUnspent);
+    BOOST_REQUIRE(GetStakeKernelPrevout(spent, pindexSpend->pprev, kernel));
+    CheckKernelsEqual(kernel, kernelSpent);
+
+    uint64_t nCoinAge = 0;
+    BOOST_REQUIRE(GetCoinAge(txUnspent, *pcoinsTip, nCoinAge));
+    BOOST_CHECK_EQUAL(nCoinAge, nCoinAgeUnspent);
+    {
+        Coin coin;
+        BOOST_REQUIRE(GetCoinSpentSince(spent, pindexSpend->pprev, coin));
+        CCoinsViewCache view(pcoinsTip.get());
+        view.AddCoin(spent, std::move(coin), false);
+        BOOST_REQUIRE(GetCoinAge(txSpent, view, nCoinAge));
+        BOOST_CHECK_EQUAL(nCoinAge, nCoinAgeSpent);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
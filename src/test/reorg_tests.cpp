@@ -0,0 +1,81 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <script/sign.h>
+#include <test/test_bitcoin.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(reorg_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(reorg_readds_transactions_and_records_stats)
+{
+    CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // Spend the coinbase output of block 6, the first one that is not a
+    // premine and has a subsidy, into a fresh script
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[5].GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = coinbaseTxns[5].vout[0].nValue - CENT;
+    spend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(coinbase_script, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_REQUIRE(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    ReorgStats stats;
+    uint64_t nReorgsBefore;
+    int nMaxDepth;
+    GetReorgStats(stats, nReorgsBefore, nMaxDepth);
+
+    // Move to a two block fork that contains the spend, leaving the longer
+    // chain invalidated
+    CBlockIndex* pindexFork;
+    CBlockIndex* pindexOld;
+    uint256 hashOldTip;
+    {
+        LOCK(cs_main);
+        hashOldTip = chainActive.Tip()->GetBlockHash();
+        pindexOld = chainActive[chainActive.Height() - 2];
+        pindexFork = pindexOld->pprev;
+        CValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), pindexOld));
+    }
+    CreateAndProcessBlock({spend}, coinbase_script);
+    CreateAndProcessBlock({}, coinbase_script);
+    BOOST_CHECK(mempool.size() == 0);
+
+    // Reconsidering the longer chain disconnects both fork blocks
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE(ResetBlockFailureFlags(pindexOld));
+    }
+    CValidationState state;
+    BOOST_REQUIRE(ActivateBestChain(state, Params()));
+
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(chainActive.Tip()->GetBlockHash() == hashOldTip);
+    }
+    BOOST_CHECK(mempool.exists(spend.GetHash()));
+
+    uint64_t nReorgs;
+    BOOST_REQUIRE(GetReorgStats(stats, nReorgs, nMaxDepth));
+    BOOST_CHECK_EQUAL(nReorgs, nReorgsBefore + 1);
+    BOOST_CHECK(nMaxDepth >= 2);
+    BOOST_CHECK_EQUAL(stats.nForkHeight, pindexFork->nHeight);
+    BOOST_CHECK_EQUAL(stats.nDisconnected, 2);
+    BOOST_CHECK_EQUAL(stats.nConnected, 3);
+    BOOST_CHECK(stats.hashNewTip == hashOldTip);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
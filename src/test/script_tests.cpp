@@ -1030,6 +1030,52 @@ BOOST_AUTO_TEST_CASE(script_PushData)
     BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_OK, ScriptErrorString(err));
 }
 
+BOOST_AUTO_TEST_CASE(script_stack_elements)
+{
+    // Elements on either side of the inline capacity of CScriptStackElement
+    // must survive every stack operation intact, and hash like any other
+    // byte string.
+    static const struct {
+        size_t size;
+        const char* sha256;
+    } tests[] = {
+        {0, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+        {1, "6e340b9cffb37a989ca544e6bb780a2c78901d3fb33738768511a30617afa01d"},
+        {33, "5d8fcfefa9aeeb711fb8ed1e4b7d5c8a9bafa46e8e76e68aa18adce5a10df6ab"},
+        {65, "4bfd2c8b6f1eec7a2afeb48b934ee4b2694182027e6d0fc075074f2fabb31781"},
+        {72, "107de2bc788e11029f7851f8e1b0b5afb4e34379c709fc840689ebd3d1f51b5b"},
+        {75, "182ab56f7739e43cee0b9ba1e92c4b2a81b088705516a5243910159744f21be9"},
+        {76, "081f6c68899a48a1be455a55416104921d2fe4bdae696f4b72f9d9626a47915e"},
+        {77, "5ce02376cc256861b78f87e34783814ba1aec6d09ab500d579ed8ee95c8afcc8"},
+        {100, "bce0aff19cf5aa6a7469a30d61d04e4376e4bbf6381052ee9e7f33925c954d52"},
+        {520, "bfcfa489be613f39578651065c33345a941dcd21dcba69db41e2ad5fd1bef356"},
+    };
+    for (const auto& test : tests) {
+        std::vector<unsigned char> vch(test.size);
+        for (size_t i = 0; i < test.size; i++) {
+            vch[i] = i & 0xff;
+        }
+        // Leaves <vch> <size of vch> <SHA256 of vch>
+        CScript script = CScript() << vch << OP_DUP << OP_TOALTSTACK << OP_SIZE << OP_SWAP << OP_FROMALTSTACK
+                                   << OP_2DUP << OP_EQUALVERIFY << OP_ROT << OP_ROT << OP_1 << OP_ROLL << OP_TUCK << OP_DROP << OP_SHA256;
+        const std::vector<std::vector<unsigned char> > expected = {vch, CScriptNum(test.size).getvch(), ParseHex(test.sha256)};
+
+        std::vector<CScriptStackElement> stack;
+        ScriptError err;
+        BOOST_CHECK(EvalScript(stack, script, SCRIPT_VERIFY_P2SH, BaseSignatureChecker(), SIGVERSION_BASE, &err));
+        BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_OK, ScriptErrorString(err));
+        BOOST_REQUIRE_EQUAL(stack.size(), expected.size());
+        for (size_t i = 0; i < stack.size(); i++) {
+            BOOST_CHECK(std::vector<unsigned char>(stack[i].begin(), stack[i].end()) == expected[i]);
+        }
+
+        std::vector<std::vector<unsigned char> > bytesStack;
+        BOOST_CHECK(EvalScript(bytesStack, script, SCRIPT_VERIFY_P2SH, BaseSignatureChecker(), SIGVERSION_BASE, &err));
+        BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_OK, ScriptErrorString(err));
+        BOOST_CHECK(bytesStack == expected);
+    }
+}
+
 CScript
 sign_multisig(CScript scriptPubKey, std::vector<CKey> keys, CTransaction transaction)
 {
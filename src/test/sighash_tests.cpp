@@ -155,6 +155,14 @@ BOOST_AUTO_TEST_CASE(sighash_test)
         std::cout << "\n";
         #endif
         BOOST_CHECK(sh == sho);
+
+        // The precomputed legacy parts must not change the result
+        PrecomputedTransactionData txdata(txTo);
+        BOOST_CHECK(!txdata.legacyReady);
+        BOOST_CHECK(SignatureHash(scriptCode, txTo, nIn, nHashType, 0, SIGVERSION_BASE, &txdata) == sho);
+        txdata.PrecomputeLegacy(txTo);
+        BOOST_CHECK_EQUAL(txdata.legacyReady, txTo.vin.size() >= 3);
+        BOOST_CHECK(SignatureHash(scriptCode, txTo, nIn, nHashType, 0, SIGVERSION_BASE, &txdata) == sho);
     }
     #if defined(PRINT_SIGHASH_JSON)
     std::cout << "]\n";
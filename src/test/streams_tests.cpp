@@ -68,6 +68,84 @@ BOOST_AUTO_TEST_CASE(streams_vector_writer)
     vch.clear();
 }
 
+BOOST_AUTO_TEST_CASE(streams_span_reader)
+{
+    std::vector<unsigned char> vch = {1, 255, 3, 4, 5, 6};
+
+    CSpanReader reader(SER_NETWORK, INIT_PROTO_VERSION, vch.data(), vch.size());
+    BOOST_CHECK_EQUAL(reader.size(), 6U);
+    BOOST_CHECK(!reader.empty());
+
+    // Read a single byte as an unsigned char.
+    unsigned char a;
+    reader >> a;
+    BOOST_CHECK_EQUAL(a, 1);
+    BOOST_CHECK_EQUAL(reader.size(), 5U);
+    BOOST_CHECK_EQUAL(reader.GetPos(), 1U);
+
+    // Read a single byte as a signed char.
+    signed char b;
+    reader >> b;
+    BOOST_CHECK_EQUAL(b, -1);
+
+    // Skip a byte, then read a 16-bit little endian integer.
+    reader.ignore(1);
+    uint16_t c;
+    reader >> c;
+    BOOST_CHECK_EQUAL(c, 0x0504);
+    BOOST_CHECK_EQUAL(reader.size(), 1U);
+
+    // Reading past the end fails without consuming anything.
+    uint16_t d;
+    BOOST_CHECK_THROW(reader >> d, std::ios_base::failure);
+    BOOST_CHECK_THROW(reader.ignore(2), std::ios_base::failure);
+    BOOST_CHECK_EQUAL(reader.size(), 1U);
+    reader >> a;
+    BOOST_CHECK_EQUAL(a, 6);
+    BOOST_CHECK(reader.empty());
+
+    // The reader does not copy the data it refers to.
+    vch[0] = 7;
+    CSpanReader reader2(SER_NETWORK, INIT_PROTO_VERSION, vch.data(), 1);
+    reader2 >> a;
+    BOOST_CHECK_EQUAL(a, 7);
+}
+
+BOOST_AUTO_TEST_CASE(bitstream_reader_writer)
+{
+    CDataStream data(SER_NETWORK, INIT_PROTO_VERSION);
+
+    BitStreamWriter<CDataStream> bit_writer(data);
+    bit_writer.Write(0, 1);
+    bit_writer.Write(2, 2);
+    bit_writer.Write(6, 3);
+    bit_writer.Write(11, 4);
+    bit_writer.Write(1, 5);
+    bit_writer.Write(32, 6);
+    bit_writer.Write(7, 7);
+    bit_writer.Write(30497, 16);
+    bit_writer.Flush();
+
+    CDataStream data_copy(data);
+    uint32_t serialized_int1;
+    data >> serialized_int1;
+    BOOST_CHECK_EQUAL(serialized_int1, (uint32_t)0x7700C35A); // NOTE: Serialized as LE
+    uint16_t serialized_int2;
+    data >> serialized_int2;
+    BOOST_CHECK_EQUAL(serialized_int2, (uint16_t)0x1072); // NOTE: Serialized as LE
+
+    BitStreamReader<CDataStream> bit_reader(data_copy);
+    BOOST_CHECK_EQUAL(bit_reader.Read(1), 0U);
+    BOOST_CHECK_EQUAL(bit_reader.Read(2), 2U);
+    BOOST_CHECK_EQUAL(bit_reader.Read(3), 6U);
+    BOOST_CHECK_EQUAL(bit_reader.Read(4), 11U);
+    BOOST_CHECK_EQUAL(bit_reader.Read(5), 1U);
+    BOOST_CHECK_EQUAL(bit_reader.Read(6), 32U);
+    BOOST_CHECK_EQUAL(bit_reader.Read(7), 7U);
+    BOOST_CHECK_EQUAL(bit_reader.Read(16), 30497U);
+    BOOST_CHECK_THROW(bit_reader.Read(8), std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
 {
     std::vector<char> in;
@@ -0,0 +1,175 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/txindex.h>
+#include <script/sign.h>
+#include <test/test_bitcoin.h>
+#include <txdb.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txindex_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(txindex_initial_sync)
+{
+    const CTransactionRef& genesis_coinbase = Params().GenesisBlock().vtx[0];
+
+    TxIndex txindex(1 << 20, true);
+
+    CTransactionRef tx_disk;
+    uint256 block_hash;
+
+    // Transaction should not be found in the index before it is started.
+    BOOST_CHECK(!txindex.FindTx(genesis_coinbase->GetHash(), block_hash, tx_disk));
+
+    txindex.Start();
+
+    // Allow tx index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!txindex.IsSynced()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    BOOST_CHECK(txindex.FindTx(genesis_coinbase->GetHash(), block_hash, tx_disk));
+    BOOST_CHECK(block_hash == Params().GenesisBlock().GetHash());
+    BOOST_CHECK(*tx_disk == *genesis_coinbase);
+    BOOST_CHECK(txindex.BlockUntilSyncedToCurrentChain());
+
+    // The index also knows which block a transaction position belongs to.
+    CDiskTxPos pos;
+    BOOST_CHECK(txindex.FindTxPosition(genesis_coinbase->GetHash(), pos));
+    block_hash.SetNull();
+    BOOST_CHECK(txindex.FindBlockHash(pos, block_hash));
+    BOOST_CHECK(block_hash == Params().GenesisBlock().GetHash());
+    BOOST_CHECK(!txindex.FindBlockHash(CDiskBlockPos(pos.nFile, pos.nPos + 1), block_hash));
+
+    txindex.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(txindex_sync_to_height)
+{
+    const uint256 genesis_coinbase_hash = Params().GenesisBlock().vtx[0]->GetHash();
+
+    TxIndex txindex(1 << 20, true);
+    CDiskTxPos pos;
+    {
+        // Holding cs_main keeps the sync thread from making progress, so the
+        // reader has to index the missing block itself.
+        LOCK(cs_main);
+        txindex.Start();
+        BOOST_CHECK(!txindex.IsSynced());
+        BOOST_CHECK(!txindex.FindTxPosition(genesis_coinbase_hash, pos));
+        BOOST_CHECK(txindex.FindTxPositionSynced(genesis_coinbase_hash, pos, chainActive.Height()));
+        BOOST_CHECK(pos.nFile == chainActive.Genesis()->GetBlockPos().nFile);
+        BOOST_CHECK(pos.nPos == chainActive.Genesis()->GetBlockPos().nPos);
+    }
+
+    // Unknown transactions are still reported missing once the index is caught up.
+    LOCK(cs_main);
+    BOOST_CHECK(!txindex.FindTxPositionSynced(uint256S("0x01"), pos, chainActive.Height()));
+}
+
+BOOST_FIXTURE_TEST_CASE(txindex_sync_after_reorg, TestChain100Setup)
+{
+    CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    TxIndex txindex(1 << 20, true);
+    BOOST_REQUIRE(txindex.Start());
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!txindex.IsSynced()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // Spend the coinbase output of block 6 (the earlier ones have no subsidy)
+    // and index the block that contains the spend
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[5].GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = coinbaseTxns[5].vout[0].nValue - CENT;
+    spend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(coinbase_script, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_REQUIRE(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    CreateAndProcessBlock({spend}, coinbase_script);
+    BOOST_REQUIRE(txindex.BlockUntilSyncedToCurrentChain());
+    CDiskBlockPos stale_pos;
+    {
+        LOCK(cs_main);
+        stale_pos = chainActive.Tip()->GetBlockPos();
+    }
+
+    // Stop following the chain, then mine the spend again in a different
+    // block at the same height
+    txindex.Stop();
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    CreateAndProcessBlock({spend}, CScript() << OP_TRUE);
+
+    LOCK(cs_main);
+    const CDiskBlockPos new_pos = chainActive.Tip()->GetBlockPos();
+    BOOST_REQUIRE(!(new_pos == stale_pos));
+
+    // The entry of the disconnected block is still there...
+    CDiskTxPos pos;
+    BOOST_CHECK(txindex.FindTxPosition(spend.GetHash(), pos));
+    BOOST_CHECK(pos.nFile == stale_pos.nFile && pos.nPos == stale_pos.nPos);
+
+    // ...but is not taken once the active chain is asked for
+    BOOST_CHECK(txindex.FindTxPositionSynced(spend.GetHash(), pos, chainActive.Height()));
+    BOOST_CHECK(pos.nFile == new_pos.nFile && pos.nPos == new_pos.nPos);
+    BOOST_CHECK(txindex.FindTxPosition(spend.GetHash(), pos));
+    BOOST_CHECK(pos.nFile == new_pos.nFile && pos.nPos == new_pos.nPos);
+}
+
+BOOST_AUTO_TEST_CASE(txindex_migrate_legacy)
+{
+    // Records written by nodes that kept the index in the block tree database
+    std::vector<std::pair<uint256, CDiskTxPos> > legacy;
+    for (unsigned int i = 1; i <= 10; i++) {
+        legacy.push_back(std::make_pair(ArithToUint256(arith_uint256(i)), CDiskTxPos(CDiskBlockPos(0, i * 1000), i)));
+    }
+    CDBBatch batch(*pblocktree);
+    for (const auto& entry : legacy) {
+        batch.Write(std::make_pair('t', entry.first), entry.second);
+    }
+    BOOST_REQUIRE(pblocktree->WriteBatch(batch));
+    BOOST_REQUIRE(pblocktree->WriteFlag("txindex", true));
+
+    TxIndex txindex(1 << 20, true);
+    BOOST_REQUIRE(txindex.Start());
+
+    // The chain the legacy index was in sync with is taken over as well
+    BOOST_CHECK(txindex.IsSynced());
+    for (const auto& entry : legacy) {
+        CDiskTxPos pos;
+        BOOST_CHECK(txindex.FindTxPosition(entry.first, pos));
+        BOOST_CHECK(pos.nPos == entry.second.nPos && pos.nTxOffset == entry.second.nTxOffset);
+        BOOST_CHECK(!pblocktree->Exists(std::make_pair('t', entry.first)));
+    }
+
+    bool f_legacy_flag = true;
+    BOOST_CHECK(pblocktree->ReadFlag("txindex", f_legacy_flag));
+    BOOST_CHECK(!f_legacy_flag);
+
+    txindex.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
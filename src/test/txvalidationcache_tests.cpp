@@ -30,7 +30,7 @@ ToMemPool(CMutableTransaction& tx)
 
     CValidationState state;
     return AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), nullptr /* pfMissingInputs */,
-                              nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */);
+                              true /* bypass_limits */);
 }
 
 BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
@@ -91,6 +91,55 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_mempool_parallel_script_checks, TestChain100Setup)
+{
+    // Transactions with several inputs have their scripts verified on the
+    // script check threads; make sure a single bad signature is still
+    // rejected with the same reason as the serial path gives.
+
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(4);
+    for (unsigned int i = 0; i < spend.vin.size(); i++) {
+        spend.vin[i].prevout.hash = coinbaseTxns[i].GetHash();
+        spend.vin[i].prevout.n = 0;
+    }
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<std::vector<unsigned char> > vSigs(spend.vin.size());
+    for (unsigned int i = 0; i < spend.vin.size(); i++) {
+        uint256 hash = SignatureHash(scriptPubKey, spend, i, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vSigs[i]));
+        vSigs[i].push_back((unsigned char)SIGHASH_ALL);
+    }
+
+    // Swapping two signatures invalidates both of those inputs
+    CMutableTransaction bad(spend);
+    for (unsigned int i = 0; i < bad.vin.size(); i++) {
+        bad.vin[i].scriptSig = CScript() << vSigs[i == 1 ? 2 : i == 2 ? 1 : i];
+    }
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(!AcceptToMemoryPool(mempool, state, MakeTransactionRef(bad), nullptr /* pfMissingInputs */,
+                                        true /* bypass_limits */));
+        BOOST_CHECK(state.GetRejectReason().find("mandatory-script-verify-flag-failed") == 0);
+        BOOST_CHECK_EQUAL(state.GetRejectCode(), REJECT_INVALID);
+    }
+    BOOST_CHECK_EQUAL(mempool.size(), 0);
+
+    for (unsigned int i = 0; i < spend.vin.size(); i++) {
+        spend.vin[i].scriptSig = CScript() << vSigs[i];
+    }
+    BOOST_CHECK(ToMemPool(spend));
+    BOOST_CHECK(mempool.exists(spend.GetHash()));
+    mempool.clear();
+}
+
 // Run CheckInputs (using pcoinsTip) on the given transaction, for all script
 // flags.  Test that CheckInputs passes for all flags that don't overlap with
 // the failing_flags argument, but otherwise fails.
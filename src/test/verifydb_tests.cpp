@@ -0,0 +1,111 @@
+// Copyright (c) 2012-2019 The Donu developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <clientversion.h>
+#include <fs.h>
+#include <init.h>
+#include <streams.h>
+#include <test/test_bitcoin.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(verifydb_tests, TestChain100Setup)
+
+/** Overwrite the first bytes of a block, or of its undo data, on disk */
+static void CorruptBlockFile(const CBlockIndex* pindex, bool fUndo)
+{
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        pos = fUndo ? pindex->GetUndoPos() : pindex->GetBlockPos();
+    }
+    BOOST_REQUIRE(!pos.IsNull());
+    CAutoFile file(fsbridge::fopen(GetBlockPosFilename(pos, fUndo ? "rev" : "blk"), "rb+"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    BOOST_REQUIRE(fseek(file.Get(), pos.nPos, SEEK_SET) == 0);
+    const unsigned char garbage[8] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    file.write((const char*)garbage, sizeof(garbage));
+}
+
+/** Wait for the background block file checks to finish */
+static void WaitForBackgroundVerify()
+{
+    size_t nChecked, nTotal;
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (GetBackgroundVerifyProgress(nChecked, nTotal)) {
+        BOOST_CHECK(nChecked <= nTotal);
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(10);
+    }
+    StopBackgroundVerify();
+}
+
+BOOST_AUTO_TEST_CASE(verifydb_threads)
+{
+    for (int nThreads : {1, 4}) {
+        for (int nCheckLevel = 0; nCheckLevel <= 4; nCheckLevel++) {
+            BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), nCheckLevel, 0, nThreads));
+        }
+    }
+    size_t nChecked, nTotal;
+    BOOST_CHECK(!GetBackgroundVerifyProgress(nChecked, nTotal));
+}
+
+BOOST_AUTO_TEST_CASE(verifydb_background)
+{
+    BOOST_REQUIRE(CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), 3, 0, 4, true));
+
+    // The block file checks finish on their own, without finding anything.
+    WaitForBackgroundVerify();
+    BOOST_CHECK(!ShutdownRequested());
+}
+
+BOOST_AUTO_TEST_CASE(verifydb_corrupt_block)
+{
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive[chainActive.Height() - 10];
+    }
+    CorruptBlockFile(pindex, false);
+
+    for (int nThreads : {1, 4}) {
+        BOOST_CHECK(!CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), 0, 0, nThreads));
+    }
+    // Blocks before the corrupted one are not read
+    BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), 0, 5, 4));
+
+    // In the background the corruption shuts the node down
+    BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), 0, 0, 4, true));
+    WaitForBackgroundVerify();
+    BOOST_CHECK(ShutdownRequested());
+    AbortShutdown();
+}
+
+BOOST_AUTO_TEST_CASE(verifydb_corrupt_undo)
+{
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive[chainActive.Height() - 10];
+    }
+    CorruptBlockFile(pindex, true);
+
+    // Undo data is only checked from level 2 on
+    for (int nThreads : {1, 4}) {
+        BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), 1, 0, nThreads));
+        BOOST_CHECK(!CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), 2, 0, nThreads));
+    }
+
+    BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), 2, 0, 4, true));
+    WaitForBackgroundVerify();
+    BOOST_CHECK(ShutdownRequested());
+    AbortShutdown();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
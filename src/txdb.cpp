@@ -15,13 +15,13 @@
 #include <init.h>
 
 #include <stdint.h>
+#include <thread>
 
 #include <boost/thread.hpp>
 
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
-static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -29,6 +29,7 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_UTXO_COMMITMENT = 'M';
 
 namespace {
 
@@ -54,19 +55,51 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true),
+    m_flushing(false), m_flush_failed(false), m_flush_interrupt(false)
 {
 }
 
+CCoinsViewDB::~CCoinsViewDB()
+{
+    StopBackgroundFlush();
+}
+
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    {
+        WaitableLock lock(cs_flush);
+        if (m_flushing) {
+            CCoinsMap::const_iterator it = m_flush_coins->find(outpoint);
+            if (it != m_flush_coins->end() && (it->second.flags & CCoinsCacheEntry::DIRTY)) {
+                if (it->second.coin.IsSpent())
+                    return false;
+                coin = it->second.coin;
+                return true;
+            }
+        }
+    }
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    {
+        WaitableLock lock(cs_flush);
+        if (m_flushing) {
+            CCoinsMap::const_iterator it = m_flush_coins->find(outpoint);
+            if (it != m_flush_coins->end() && (it->second.flags & CCoinsCacheEntry::DIRTY)) {
+                return !it->second.coin.IsSpent();
+            }
+        }
+    }
     return db.Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    {
+        WaitableLock lock(cs_flush);
+        if (m_flushing)
+            return m_flush_block;
+    }
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
@@ -82,6 +115,32 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    WaitableLock lock(cs_flush);
+    if (!m_flush_thread.joinable()) {
+        std::unique_ptr<CUTXOCommitment> commitment;
+        if (m_commitment_block == hashBlock)
+            commitment.reset(new CUTXOCommitment(m_commitment));
+        lock.unlock();
+        return WriteCoins(mapCoins, hashBlock, commitment.get());
+    }
+
+    // Only one write is kept in flight, so memory use stays bounded by two
+    // caches' worth of entries.
+    cond_flush.wait(lock, [this] { return !m_flushing; });
+    if (m_flush_failed)
+        return false;
+    assert(!hashBlock.IsNull());
+    // The hasher is not assignable, so the entries are moved into a fresh map.
+    m_flush_coins.reset(new CCoinsMap(std::move(mapCoins)));
+    mapCoins.clear();
+    m_flush_block = hashBlock;
+    m_flush_commitment.reset(m_commitment_block == hashBlock ? new CUTXOCommitment(m_commitment) : nullptr);
+    m_flushing = true;
+    cond_flush.notify_all();
+    return true;
+}
+
+bool CCoinsViewDB::WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, const CUTXOCommitment* commitment) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -89,8 +148,8 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
     assert(!hashBlock.IsNull());
 
-    uint256 old_tip = GetBestBlock();
-    if (old_tip.IsNull()) {
+    uint256 old_tip;
+    if (!db.Read(DB_BEST_BLOCK, old_tip)) {
         // We may be in the middle of replaying.
         std::vector<uint256> old_heads = GetHeadBlocks();
         if (old_heads.size() == 2) {
@@ -106,6 +165,10 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
 
+    // Entries are only dropped from mapCoins once their batch has been
+    // committed, so that a concurrent reader of a background flush never sees
+    // a coin that is neither in the map nor in the database.
+    CCoinsMap::iterator itBatch = mapCoins.begin();
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
@@ -116,12 +179,15 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        it++;
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
             batch.Clear();
+            {
+                WaitableLock lock(cs_flush);
+                itBatch = mapCoins.erase(itBatch, it);
+            }
             if (crash_simulate) {
                 static FastRandomContext rng;
                 if (rng.randrange(crash_simulate) == 0) {
@@ -135,13 +201,106 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     // In the last batch, mark the database as consistent with hashBlock again.
     batch.Erase(DB_HEAD_BLOCKS);
     batch.Write(DB_BEST_BLOCK, hashBlock);
+    if (commitment)
+        batch.Write(DB_UTXO_COMMITMENT, std::make_pair(hashBlock, *commitment));
+    else
+        batch.Erase(DB_UTXO_COMMITMENT);
 
     LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
     bool ret = db.WriteBatch(batch);
+    {
+        WaitableLock lock(cs_flush);
+        mapCoins.clear();
+    }
     LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return ret;
 }
 
+void CCoinsViewDB::ThreadFlush()
+{
+    while (true) {
+        uint256 hashBlock;
+        {
+            WaitableLock lock(cs_flush);
+            cond_flush.wait(lock, [this] { return m_flushing || m_flush_interrupt; });
+            // Always drain a pending write before honouring the interrupt.
+            if (!m_flushing)
+                return;
+            hashBlock = m_flush_block;
+        }
+
+        int64_t nStart = GetTimeMicros();
+        bool fOk = false;
+        try {
+            fOk = WriteCoins(*m_flush_coins, hashBlock, m_flush_commitment.get());
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        LogPrint(BCLog::COINDB, "Background flush of coins to %s took %.2fms\n", hashBlock.ToString(), (GetTimeMicros() - nStart) * 0.001);
+
+        {
+            WaitableLock lock(cs_flush);
+            m_flush_coins.reset();
+            m_flush_commitment.reset();
+            m_flushing = false;
+            if (!fOk)
+                m_flush_failed = true;
+            cond_flush.notify_all();
+        }
+
+        if (!fOk) {
+            LogPrintf("*** Failed to write to coin database\n");
+            uiInterface.ThreadSafeMessageBox(_("Failed to write to coin database"), "", CClientUIInterface::MSG_ERROR);
+            StartShutdown();
+            return;
+        }
+    }
+}
+
+void CCoinsViewDB::StartBackgroundFlush()
+{
+    if (m_flush_thread.joinable())
+        return;
+    m_flush_interrupt = false;
+    m_flush_thread = std::thread(&TraceThread<std::function<void()> >, "coinsflush", std::function<void()>(std::bind(&CCoinsViewDB::ThreadFlush, this)));
+}
+
+void CCoinsViewDB::StopBackgroundFlush()
+{
+    if (!m_flush_thread.joinable())
+        return;
+    {
+        WaitableLock lock(cs_flush);
+        m_flush_interrupt = true;
+        cond_flush.notify_all();
+    }
+    m_flush_thread.join();
+}
+
+bool CCoinsViewDB::WaitForFlush() const
+{
+    WaitableLock lock(cs_flush);
+    cond_flush.wait(lock, [this] { return !m_flushing; });
+    return !m_flush_failed;
+}
+
+void CCoinsViewDB::SetCommitment(const uint256& hashBlock, const CUTXOCommitment& commitment)
+{
+    WaitableLock lock(cs_flush);
+    m_commitment_block = hashBlock;
+    m_commitment = commitment;
+}
+
+bool CCoinsViewDB::ReadCommitment(uint256& hashBlock, CUTXOCommitment& commitment) const
+{
+    std::pair<uint256, CUTXOCommitment> entry;
+    if (!db.Read(DB_UTXO_COMMITMENT, entry))
+        return false;
+    hashBlock = entry.first;
+    commitment = entry.second;
+    return true;
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
@@ -172,11 +331,19 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
+    return Cursor(uint256());
+}
+
+CCoinsViewCursor *CCoinsViewDB::Cursor(const uint256 &hashStart) const
+{
+    // The cursor iterates the database directly, so it must not miss entries
+    // still queued in the background writer.
+    WaitForFlush();
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COIN);
+    i->pcursor->Seek(std::make_pair(DB_COIN, hashStart));
     // Cache key of first record
     if (i->pcursor->Valid()) {
         CoinEntry entry(&i->keyTmp.second);
@@ -236,17 +403,6 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
-    return Read(std::make_pair(DB_TXINDEX, txid), pos);
-}
-
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(std::make_pair(DB_TXINDEX, it->first), it->second);
-    return WriteBatch(batch);
-}
-
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -259,54 +415,105 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+typedef std::vector<std::pair<uint256, CDiskBlockIndex> > BlockIndexEntries;
+
+/**
+ * Read the block index entries whose hash starts with a byte in
+ * [nBegin, nEnd). The hash is taken from the database key rather than
+ * recomputed from the header.
+ */
+static bool ReadBlockIndexRange(CBlockTreeDB& db, const Consensus::Params& consensusParams, int nBegin, int nEnd, BlockIndexEntries& vEntries)
 {
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
 
-    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
+    uint256 hashBegin;
+    *hashBegin.begin() = nBegin;
+    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, hashBegin));
 
-    // Load mapBlockIndex
     while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
         std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-                 // donu related block index fields
-                pindexNew->nMint          = diskindex.nMint;
-                pindexNew->nMoneySupply   = diskindex.nMoneySupply;
-                pindexNew->nFlags         = diskindex.nFlags;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake   = diskindex.prevoutStake;
-                pindexNew->nStakeTime     = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
-
-                if (pindexNew->IsProofOfWork() && !CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
-                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
-
-                pcursor->Next();
-            } else {
-                return error("%s: failed to read value", __func__);
-            }
-        } else {
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= nEnd)
             break;
+        vEntries.emplace_back();
+        vEntries.back().first = key.second;
+        CDiskBlockIndex& diskindex = vEntries.back().second;
+        if (!pcursor->GetValue(diskindex))
+            return error("%s: failed to read value", __func__);
+        if (diskindex.IsProofOfWork() && !CheckProofOfWork(key.second, diskindex.nBits, consensusParams))
+            return error("%s: CheckProofOfWork failed: %s", __func__, diskindex.ToString());
+        pcursor->Next();
+    }
+    return true;
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<void(size_t)> reserveBlockIndex, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, int nThreads)
+{
+    // Block hashes are uniformly distributed, so splitting the key range on
+    // the first byte of the hash gives every thread a similar share.
+    nThreads = std::max(1, std::min(nThreads, 256));
+    std::vector<BlockIndexEntries> vParts(nThreads);
+    std::vector<char> vOk(nThreads, false);
+    {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < nThreads; i++) {
+            threads.emplace_back([&, i] {
+                try {
+                    vOk[i] = ReadBlockIndexRange(*this, consensusParams, 256 * i / nThreads, 256 * (i + 1) / nThreads, vParts[i]);
+                } catch (const std::exception& e) {
+                    error("%s: %s", __func__, e.what());
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+    for (int i = 0; i < nThreads; i++) {
+        if (!vOk[i])
+            return false;
+    }
+    boost::this_thread::interruption_point();
+
+    size_t nEntries = 0;
+    for (const BlockIndexEntries& vEntries : vParts)
+        nEntries += vEntries.size();
+    reserveBlockIndex(nEntries);
+
+    // Load mapBlockIndex, linking parents once all entries exist
+    std::vector<std::pair<CBlockIndex*, uint256> > vLinks;
+    vLinks.reserve(nEntries);
+    for (BlockIndexEntries& vEntries : vParts) {
+        for (const std::pair<uint256, CDiskBlockIndex>& entry : vEntries) {
+            const CDiskBlockIndex& diskindex = entry.second;
+
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(entry.first);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
+
+             // donu related block index fields
+            pindexNew->nMint          = diskindex.nMint;
+            pindexNew->nMoneySupply   = diskindex.nMoneySupply;
+            pindexNew->nFlags         = diskindex.nFlags;
+            pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            pindexNew->prevoutStake   = diskindex.prevoutStake;
+            pindexNew->nStakeTime     = diskindex.nStakeTime;
+            pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+
+            vLinks.emplace_back(pindexNew, diskindex.hashPrev);
         }
+        BlockIndexEntries().swap(vEntries);
     }
+    for (const std::pair<CBlockIndex*, uint256>& link : vLinks)
+        link.first->pprev = insertBlockIndex(link.second);
 
     return true;
 }
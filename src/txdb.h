@@ -9,10 +9,12 @@
 #include <coins.h>
 #include <dbwrapper.h>
 #include <chain.h>
+#include <sync.h>
 
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -28,14 +30,20 @@ static const int64_t nDefaultDbCache = 450;
 static const int64_t nDefaultDbBatchSize = 16 << 20;
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
+//! -backgroundflush default
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
 //! min. -dbcache (MiB)
 static const int64_t nMinDbCache = 4;
-//! Max memory allocated to block tree DB specific cache, if no -txindex (MiB)
+//! Max memory allocated to block tree DB specific cache (MiB)
 static const int64_t nMaxBlockDBCache = 2;
-//! Max memory allocated to block tree DB specific cache, if -txindex (MiB)
+//! Max memory allocated to tx index DB specific cache (MiB)
 // Unlike for the UTXO database, for the txindex scenario the leveldb cache make
 // a meaningful difference: https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
-static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
+static const int64_t nMaxTxIndexCache = 1024;
+//! Max memory allocated to block filter index DB specific cache (MiB)
+static const int64_t nMaxFilterIndexCache = 1024;
+//! Max memory allocated to block stats index DB specific cache (MiB)
+static const int64_t nMaxStatsIndexCache = 16;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
@@ -64,13 +72,55 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/** CCoinsView backed by the coin database (chainstate/)
+ *
+ * Optionally, BatchWrite can hand the dirty entries to a background thread
+ * (see StartBackgroundFlush) so the caller does not block on disk I/O. While
+ * such a write is in flight, the pending entries are still served to readers
+ * and GetBestBlock() already reports the block being flushed. A crash during
+ * the write is recovered at startup through the head blocks marker, exactly as
+ * for an interrupted synchronous flush.
+ */
 class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    mutable CWaitableCriticalSection cs_flush;
+    mutable CConditionVariable cond_flush;
+    //! Entries being written by the flush thread; erased as their batch is committed.
+    std::unique_ptr<CCoinsMap> m_flush_coins;
+    uint256 m_flush_block;
+    std::unique_ptr<CUTXOCommitment> m_flush_commitment;
+    bool m_flushing;
+    bool m_flush_failed;
+    bool m_flush_interrupt;
+    std::thread m_flush_thread;
+
+    //! Commitment to write with the coins of m_commitment_block, see SetCommitment.
+    uint256 m_commitment_block;
+    CUTXOCommitment m_commitment;
+
+    bool WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, const CUTXOCommitment* commitment);
+    void ThreadFlush();
+
 public:
     explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CCoinsViewDB();
+
+    //! Start writing future BatchWrite calls from a background thread.
+    void StartBackgroundFlush();
+    //! Finish any pending write and stop the background thread.
+    void StopBackgroundFlush();
+    //! Block until no write is in flight. Returns false if a background write failed.
+    bool WaitForFlush() const;
+
+    //! Have the next BatchWrite for hashBlock store this UTXO set commitment
+    //! in the same batch as the best block. Writes for other blocks drop the
+    //! stored commitment instead.
+    void SetCommitment(const uint256& hashBlock, const CUTXOCommitment& commitment);
+    //! Read the stored UTXO set commitment and the block it belongs to.
+    bool ReadCommitment(uint256& hashBlock, CUTXOCommitment& commitment) const;
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
@@ -78,6 +128,9 @@ public:
     std::vector<uint256> GetHeadBlocks() const override;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
+    //! Cursor positioned at the first coin whose txid is not below hashStart,
+    //! so that disjoint ranges of the coin keyspace can be scanned in parallel.
+    CCoinsViewCursor *Cursor(const uint256 &hashStart) const;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
@@ -120,11 +173,10 @@ public:
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindexing);
     bool ReadReindexing(bool &fReindexing);
-    bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    /** Load all block index entries, reading the database on nThreads threads */
+    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<void(size_t)> reserveBlockIndex, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, int nThreads);
 
     bool ReadSyncCheckpoint(uint256& hashCheckpoint);
     bool WriteSyncCheckpoint(uint256 hashCheckpoint);
@@ -6,11 +6,16 @@
 #ifndef BITCOIN_UNDO_H
 #define BITCOIN_UNDO_H
 
+#include <coins.h>
 #include <compressor.h>
 #include <consensus/consensus.h>
 #include <primitives/transaction.h>
 #include <serialize.h>
 
+/** Serialization version flag selecting the compact undo encoding of
+ *  CBlockUndo, see CompactTxInUndoSerializer. */
+static const int SERIALIZE_UNDO_COMPACT = 0x10000000;
+
 /** Undo information for a CTxIn
  *
  *  Contains the prevout's CTxOut being spent, and its metadata as well
@@ -63,6 +68,53 @@ public:
     explicit TxInUndoDeserializer(Coin* coin) : txout(coin) {}
 };
 
+/** Compact undo information for a CTxIn
+ *
+ *  Like TxInUndoSerializer but without the version dummy, and with the coin's
+ *  timestamp stored as an offset back from a time shared by the whole block,
+ *  which is never earlier than that of any coin the block spends.
+ */
+class CompactTxInUndoSerializer
+{
+    const Coin* txout;
+    unsigned int nTimeBase;
+
+public:
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        ::Serialize(s, VARINT(txout->nHeight * 4 + (txout->fCoinBase ? 1 : 0) + (txout->fCoinStake ? 2 : 0)));
+        ::Serialize(s, VARINT(nTimeBase - txout->nTime));
+        ::Serialize(s, CTxOutCompressor(REF(txout->out)));
+    }
+
+    CompactTxInUndoSerializer(const Coin* coin, unsigned int nTimeBaseIn) : txout(coin), nTimeBase(nTimeBaseIn) {}
+};
+
+class CompactTxInUndoDeserializer
+{
+    Coin* txout;
+    unsigned int nTimeBase;
+
+public:
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        unsigned int nCode = 0;
+        ::Unserialize(s, VARINT(nCode));
+        txout->nHeight = nCode / 4;
+        txout->fCoinBase = nCode & 1;
+        txout->fCoinStake = nCode & 2;
+        unsigned int nTimeOffset = 0;
+        ::Unserialize(s, VARINT(nTimeOffset));
+        if (nTimeOffset > nTimeBase) {
+            throw std::ios_base::failure("Undo record time out of range");
+        }
+        txout->nTime = nTimeBase - nTimeOffset;
+        ::Unserialize(s, REF(CTxOutCompressor(REF(txout->out))));
+    }
+
+    CompactTxInUndoDeserializer(Coin* coin, unsigned int nTimeBaseIn) : txout(coin), nTimeBase(nTimeBaseIn) {}
+};
+
 static const size_t MIN_TRANSACTION_INPUT_WEIGHT = WITNESS_SCALE_FACTOR * ::GetSerializeSize(CTxIn(), SER_NETWORK, PROTOCOL_VERSION);
 static const size_t MAX_INPUTS_PER_BLOCK = MAX_BLOCK_WEIGHT / MIN_TRANSACTION_INPUT_WEIGHT;
 
@@ -98,18 +150,80 @@ public:
     }
 };
 
-/** Undo information for a CBlock */
+/** Undo information for a CBlock
+ *
+ *  With SERIALIZE_UNDO_COMPACT, the latest timestamp of the spent coins is
+ *  written first and every coin uses CompactTxInUndoSerializer.
+ */
 class CBlockUndo
 {
 public:
     std::vector<CTxUndo> vtxundo; // for all but the coinbase
 
-    ADD_SERIALIZE_METHODS;
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        if (!(s.GetVersion() & SERIALIZE_UNDO_COMPACT)) {
+            ::Serialize(s, vtxundo);
+            return;
+        }
+        unsigned int nTimeBase = 0;
+        for (const auto& txundo : vtxundo) {
+            for (const auto& prevout : txundo.vprevout) {
+                nTimeBase = std::max(nTimeBase, prevout.nTime);
+            }
+        }
+        ::Serialize(s, VARINT(nTimeBase));
+        WriteCompactSize(s, vtxundo.size());
+        for (const auto& txundo : vtxundo) {
+            WriteCompactSize(s, txundo.vprevout.size());
+            for (const auto& prevout : txundo.vprevout) {
+                ::Serialize(s, CompactTxInUndoSerializer(&prevout, nTimeBase));
+            }
+        }
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITE(vtxundo);
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        if (!(s.GetVersion() & SERIALIZE_UNDO_COMPACT)) {
+            ::Unserialize(s, vtxundo);
+            return;
+        }
+        unsigned int nTimeBase = 0;
+        ::Unserialize(s, VARINT(nTimeBase));
+        // Every transaction but the coinbase spends at least one input
+        uint64_t count = ReadCompactSize(s);
+        if (count > MAX_INPUTS_PER_BLOCK) {
+            throw std::ios_base::failure("Too many transaction undo records");
+        }
+        vtxundo.resize(count);
+        for (auto& txundo : vtxundo) {
+            count = ReadCompactSize(s);
+            if (count > MAX_INPUTS_PER_BLOCK) {
+                throw std::ios_base::failure("Too many input undo records");
+            }
+            txundo.vprevout.resize(count);
+            for (auto& prevout : txundo.vprevout) {
+                CompactTxInUndoDeserializer deserializer(&prevout, nTimeBase);
+                ::Unserialize(s, deserializer);
+            }
+        }
     }
 };
 
+static inline size_t RecursiveDynamicUsage(const CTxUndo& txundo) {
+    size_t mem = memusage::DynamicUsage(txundo.vprevout);
+    for (const Coin& coin : txundo.vprevout) {
+        mem += coin.DynamicMemoryUsage();
+    }
+    return mem;
+}
+
+static inline size_t RecursiveDynamicUsage(const CBlockUndo& blockundo) {
+    size_t mem = memusage::DynamicUsage(blockundo.vtxundo);
+    for (const CTxUndo& txundo : blockundo.vtxundo) {
+        mem += RecursiveDynamicUsage(txundo);
+    }
+    return mem;
+}
+
 #endif // BITCOIN_UNDO_H
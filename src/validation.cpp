@@ -6,6 +6,8 @@
 #include <validation.h>
 
 #include <arith_uint256.h>
+#include <blockcache.h>
+#include <blockfilemap.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -14,8 +16,10 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
 #include <cuckoocache.h>
 #include <hash.h>
+#include <index/txindex.h>
 #include <init.h>
 #include <policy/policy.h>
 #include <pow.h>
@@ -43,8 +47,12 @@
 #include <checkpointsync.h>
 #include <keystore.h>
 
+#include <atomic>
 #include <future>
+#include <list>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/join.hpp>
@@ -92,6 +100,7 @@ enum DisconnectResult
 };
 
 class ConnectTrace;
+class DisconnectPrefetch;
 
 /**
  * CChainState stores and provides an API to update our local knowledge of the
@@ -159,6 +168,10 @@ public:
     BlockMap mapBlockIndex;
     std::multimap<CBlockIndex*, CBlockIndex*> mapBlocksUnlinked;
     CBlockIndex *pindexBestInvalid = nullptr;
+    /** Rolling commitment to the UTXO set of pcoinsTip, kept up to date by ConnectTip and DisconnectTip */
+    CUTXOCommitment utxoCommitment;
+    /** Whether utxoCommitment has been loaded and may be written back to disk */
+    bool fHaveUTXOCommitment = false;
 
     bool LoadBlockIndex(const Consensus::Params& consensus_params, CBlockTreeDB& blocktree);
 
@@ -168,12 +181,12 @@ public:
     bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock, bool fCheckPoS=true);
 
     // Block (dis)connection on a given view:
-    DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view);
+    DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, CUTXOCommitment* commitment = nullptr, const CBlockUndo* pblockUndo = nullptr);
     bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                    CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false);
+                    CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false, CUTXOCommitment* commitment = nullptr);
 
     // Block disconnection on our pcoinsTip:
-    bool DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool);
+    bool DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool, DisconnectPrefetch* prefetch = nullptr);
 
     // Manual block validity manipulation:
     bool PreciousBlock(CValidationState& state, const CChainParams& params, CBlockIndex *pindex);
@@ -210,17 +223,20 @@ CCriticalSection cs_main;
 BlockMap& mapBlockIndex = g_chainstate.mapBlockIndex;
 CChain& chainActive = g_chainstate.chainActive;
 CBlockIndex *pindexBestHeader = nullptr;
+bool fHavePruned = false;
+bool fPruneMode = false;
+uint64_t nPruneTarget = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 uint256 hashBestBlock;
 int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
-bool fTxIndex = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool fCompactUndo = DEFAULT_COMPACT_UNDO;
 size_t nCoinCacheUsage = 5000 * 300;
 bool fAlerts = DEFAULT_ALERTS;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -250,6 +266,12 @@ namespace {
     /** Dirty block index entries. */
     std::set<CBlockIndex*> setDirtyBlockIndex;
 
+    /** Global flag to indicate we should check to see if there are
+     *  block/undo files that should be deleted.  Set on startup
+     *  or if we allocate more file space when we're in prune mode
+     */
+    bool fCheckForPruning = false;
+
     /** Dirty block file entries. */
     std::set<int> setDirtyFileInfo;
 } // anon namespace
@@ -275,6 +297,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 std::unique_ptr<CCoinsViewDB> pcoinsdbview;
 std::unique_ptr<CCoinsViewCache> pcoinsTip;
 std::unique_ptr<CBlockTreeDB> pblocktree;
+CMappedFileCache g_mapped_block_files(DEFAULT_BLOCKFILE_MAPS);
 
 enum FlushStateMode {
     FLUSH_STATE_NONE,
@@ -285,6 +308,8 @@ enum FlushStateMode {
 
 // See definition for documentation
 static bool FlushStateToDisk(const CChainParams& chainParams, CValidationState &state, FlushStateMode mode, int nManualPruneHeight=0);
+static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight);
+static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr);
 static FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 
@@ -434,6 +459,9 @@ std::string FormatStateMessage(const CValidationState &state)
         state.GetRejectCode());
 }
 
+static void PrecheckDisconnectedScripts(const DisconnectedBlockTransactions& disconnectpool);
+static bool CheckInputsForMempool(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, unsigned int flags, PrecomputedTransactionData& txdata);
+
 /* Make mempool consistent after a reorg, by re-adding or recursively erasing
  * disconnected block transactions from the mempool, and also removing any
  * other transactions from the mempool that are no longer valid given the new
@@ -450,6 +478,8 @@ std::string FormatStateMessage(const CValidationState &state)
 void UpdateMempoolForReorg(DisconnectedBlockTransactions &disconnectpool, bool fAddToMempool)
 {
     AssertLockHeld(cs_main);
+    if (fAddToMempool)
+        PrecheckDisconnectedScripts(disconnectpool);
     std::vector<uint256> vHashUpdate;
     // disconnectpool's insertion_order index sorts the entries from
     // oldest to newest, but the oldest entry will be the last tx from the
@@ -694,7 +724,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
+        if (!CheckInputsForMempool(tx, state, view, scriptVerifyFlags, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
@@ -785,28 +815,12 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
             return true;
         }
 
-        if (fTxIndex) {
-            CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (const std::exception& e) {
-                    return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
-                if (txOut->GetHash() != hash)
-                    return error("%s: txid mismatch", __func__);
-                return true;
-            }
-
-            // transaction not found in index, nothing more can be done
-            return false;
+        if (g_txindex) {
+            // Index the blocks still queued for the index first, unless it is
+            // catching up from far behind
+            if (g_txindex->IsSynced() && !g_txindex->BlockUntilSyncedToHeight(chainActive.Height()))
+                return false;
+            return g_txindex->FindTx(hash, hashBlock, txOut);
         }
 
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
@@ -862,21 +876,61 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
     return true;
 }
 
+/** Return the mapping of a block file, if it is finalized and mapping is enabled */
+static std::shared_ptr<const CMappedFile> GetMappedBlockFile(int nFile)
+{
+    {
+        LOCK(cs_LastBlockFile);
+        // The file being appended to may still grow or be truncated.
+        if (nFile >= nLastBlockFile)
+            return nullptr;
+    }
+    return g_mapped_block_files.Get(nFile, GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+}
+
+/** Locate the block starting at pos within a mapped block file, checking its size prefix */
+static bool GetMappedBlockSpan(const CMappedFile& mapped, const CDiskBlockPos& pos, const unsigned char*& pbegin, unsigned int& nSize)
+{
+    if (pos.nPos < 4 || pos.nPos > mapped.size())
+        return false;
+    nSize = ReadLE32(mapped.data() + pos.nPos - 4);
+    if (nSize > mapped.size() - pos.nPos)
+        return false;
+    pbegin = mapped.data() + pos.nPos;
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
-
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    std::shared_ptr<const CMappedFile> mapped = GetMappedBlockFile(pos.nFile);
+    if (mapped) {
+        // Deserialize straight from the mapped file
+        const unsigned char* pbegin;
+        unsigned int nSize;
+        if (!GetMappedBlockSpan(*mapped, pos, pbegin, nSize))
+            return error("%s: Invalid block position %s", __func__, pos.ToString());
+        try {
+            CSpanReader reader(SER_DISK, CLIENT_VERSION, pbegin, nSize);
+            reader >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -886,22 +940,104 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+bool ReadBlockFromDisk(std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const CDiskBlockPos& blockPos, const Consensus::Params& consensusParams)
+{
+    const uint256 hash = pindex->GetBlockHash();
+    pblock = g_block_cache.Get(hash);
+    if (pblock)
+        return true;
+
+    std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*pblockRead, blockPos, consensusParams))
+        return false;
+    if (pblockRead->GetHash() != hash)
+        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
+                pindex->ToString(), blockPos.ToString());
+    pblock = pblockRead;
+    g_block_cache.Insert(hash, pblock);
+    return true;
+}
+
+bool ReadBlockFromDisk(std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
+    pblock = g_block_cache.Get(pindex->GetBlockHash());
+    if (pblock)
+        return true;
+
     CDiskBlockPos blockPos;
     {
         LOCK(cs_main);
         blockPos = pindex->GetBlockPos();
     }
+    return ReadBlockFromDisk(pblock, pindex, blockPos, consensusParams);
+}
 
-    if (!ReadBlockFromDisk(block, blockPos, consensusParams))
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    std::shared_ptr<const CBlock> pblock;
+    if (!ReadBlockFromDisk(pblock, pindex, consensusParams))
         return false;
-    if (block.GetHash() != pindex->GetBlockHash())
-        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
-                pindex->ToString(), pindex->GetBlockPos().ToString());
+    // Only the transaction references are copied
+    block = *pblock;
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start)
+{
+    if (pos.nPos < 8)
+        return error("%s: Invalid block position %s", __func__, pos.ToString());
+
+    std::shared_ptr<const CMappedFile> mapped = GetMappedBlockFile(pos.nFile);
+    if (mapped) {
+        const unsigned char* pbegin;
+        unsigned int nSize;
+        if (!GetMappedBlockSpan(*mapped, pos, pbegin, nSize))
+            return error("%s: Invalid block position %s", __func__, pos.ToString());
+        if (memcmp(pbegin - 8, message_start, CMessageHeader::MESSAGE_START_SIZE))
+            return error("%s: Block magic mismatch for %s", __func__, pos.ToString());
+        block.assign(pbegin, pbegin + nSize);
+        return true;
+    }
+
+    // Seek back to the index header written by WriteBlockToDisk
+    CDiskBlockPos hpos(pos.nFile, pos.nPos - 8);
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+    try {
+        CMessageHeader::MessageStartChars blk_start;
+        unsigned int blk_size;
+
+        filein >> FLATDATA(blk_start) >> blk_size;
+
+        if (memcmp(blk_start, message_start, CMessageHeader::MESSAGE_START_SIZE))
+            return error("%s: Block magic mismatch for %s", __func__, pos.ToString());
+
+        if (blk_size > MAX_SIZE)
+            return error("%s: Block data is larger than maximum deserialization size for %s: %s versus %s", __func__, pos.ToString(), blk_size, MAX_SIZE);
+
+        block.resize(blk_size);
+        filein.read((char*)block.data(), blk_size);
+    }
+    catch (const std::exception& e) {
+        return error("%s: Read from block file failed: %s for %s", __func__, e.what(), pos.ToString());
+    }
+
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+{
+    CDiskBlockPos blockPos;
+    {
+        LOCK(cs_main);
+        blockPos = pindex->GetBlockPos();
+    }
+
+    return ReadRawBlockFromDisk(block, blockPos, message_start);
+}
+
 int64_t GetProofOfWorkReward(int nBlockHeight)
 {
     int64_t nSubsidy;
@@ -1078,7 +1214,7 @@ void CChainState::InvalidBlockFound(CBlockIndex *pindex, const CValidationState
     }
 }
 
-void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txundo, int nHeight)
+void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txundo, int nHeight, CUTXOCommitment* commitment)
 {
     // mark inputs spent
     if (!tx.IsCoinBase()) {
@@ -1087,10 +1223,27 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txund
             txundo.vprevout.emplace_back();
             bool is_spent = inputs.SpendCoin(txin.prevout, &txundo.vprevout.back());
             assert(is_spent);
+            if (commitment)
+                commitment->RemoveCoin(txin.prevout, txundo.vprevout.back());
         }
     }
     // add outputs
     AddCoins(inputs, tx, nHeight);
+    if (commitment) {
+        const uint256& txid = tx.GetHash();
+        for (size_t i = 0; i < tx.vout.size(); ++i) {
+            // Unspendable outputs are never added to the UTXO set
+            if (tx.vout[i].scriptPubKey.IsUnspendable())
+                continue;
+            COutPoint out(txid, i);
+            commitment->AddCoin(out, inputs.AccessCoin(out));
+        }
+    }
+}
+
+void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txundo, int nHeight)
+{
+    UpdateCoins(tx, inputs, txundo, nHeight, nullptr);
 }
 
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
@@ -1115,14 +1268,71 @@ int GetSpendHeight(const CCoinsViewCache& inputs)
 
 static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
 static uint256 scriptExecutionCacheNonce(GetRandHash());
+static size_t nScriptExecutionCacheElems = 0;
+static ScriptCacheCounters scriptExecutionCacheCounters;
+/** Size each of the signature and script execution caches may grow to (-adaptivesigcache) */
+static size_t nAdaptiveSigCacheSize = 0;
 
 void InitScriptExecutionCache() {
     // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
     // setup_bytes creates the minimum possible cache (2 elements).
     size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
     size_t nElems = scriptExecutionCache.setup_bytes(nMaxCacheSize);
+    nScriptExecutionCacheElems = nElems;
     LogPrintf("Using %zu MiB out of %zu/2 requested for script execution cache, able to store %zu elements\n",
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
+    nAdaptiveSigCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-adaptivesigcache", DEFAULT_ADAPTIVE_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    if (nAdaptiveSigCacheSize > nMaxCacheSize)
+        LogPrintf("Signature and script execution caches may grow to %zu MiB each\n", nAdaptiveSigCacheSize >> 20);
+}
+
+void GetScriptExecutionCacheStats(ScriptCacheStats& stats, bool fCountEntries)
+{
+    AssertLockHeld(cs_main);
+    scriptExecutionCacheCounters.Get(stats);
+    stats.nEntries = fCountEntries ? scriptExecutionCache.count_live() : 0;
+    stats.nCapacity = nScriptExecutionCacheElems;
+}
+
+/** Signature lookups while connecting blocks between decisions to grow the caches */
+static const uint64_t SCRIPT_CACHE_ADAPT_LOOKUPS = 10000;
+/** Grow the caches when fewer of those lookups than this percentage hit */
+static const uint64_t SCRIPT_CACHE_ADAPT_MIN_HIT_PERCENT = 90;
+
+/** With -adaptivesigcache, double the signature and script execution caches,
+ *  up to the configured size, when connected blocks keep missing signatures
+ *  while the cache is evicting entries: those are likely signatures the
+ *  mempool verified, but could not keep. */
+static void AdaptScriptCaches()
+{
+    AssertLockHeld(cs_main);
+    static ScriptCacheStats last;
+    if (nAdaptiveSigCacheSize == 0)
+        return;
+
+    ScriptCacheStats stats;
+    GetSignatureCacheStats(stats);
+    const uint64_t nHits = stats.nBlockHits - last.nBlockHits;
+    const uint64_t nLookups = nHits + stats.nBlockMisses - last.nBlockMisses;
+    if (nLookups < SCRIPT_CACHE_ADAPT_LOOKUPS)
+        return;
+    const bool fEvicting = stats.nEvictions != last.nEvictions;
+    last = stats;
+    if (!fEvicting || nHits * 100 >= nLookups * SCRIPT_CACHE_ADAPT_MIN_HIT_PERCENT)
+        return;
+
+    const size_t nSize = stats.nCapacity * sizeof(uint256);
+    const size_t nNewSize = std::min(nSize * 2, nAdaptiveSigCacheSize);
+    if (nNewSize <= nSize)
+        return;
+    size_t nElems = ResizeSignatureCache(nNewSize);
+    if (nScriptExecutionCacheElems * sizeof(uint256) < nNewSize) {
+        uint32_t nEvicted;
+        nScriptExecutionCacheElems = scriptExecutionCache.resize_bytes(nNewSize, nEvicted);
+        scriptExecutionCacheCounters.Evicted(nEvicted);
+    }
+    LogPrintf("%s: %u of %u signature lookups in blocks hit, growing signature cache to %zu elements and script execution cache to %zu\n",
+        __func__, nHits, nLookups, nElems, nScriptExecutionCacheElems);
 }
 
 /**
@@ -1167,10 +1377,16 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
             static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
             CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
             AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
-            if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
+            const bool fCached = scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore);
+            // Connecting a block is the only caller that stores neither
+            scriptExecutionCacheCounters.Lookup(!cacheSigStore && !cacheFullScriptStore, fCached);
+            if (fCached) {
                 return true;
             }
 
+            // Before the checks that share it may run on other threads
+            txdata.PrecomputeLegacy(tx);
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
                 const Coin& coin = inputs.AccessCoin(prevout);
@@ -1214,7 +1430,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
             if (cacheFullScriptStore && !pvChecks) {
                 // We executed all of the provided scripts, and were told to
                 // cache the result. Do so now.
-                scriptExecutionCache.insert(hashCacheEntry);
+                scriptExecutionCacheCounters.Insert(scriptExecutionCache.insert(hashCacheEntry));
             }
         }
     }
@@ -1224,10 +1440,16 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 
 namespace {
 
-bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
+/** Serialization version of undo data, which records the encoding it uses */
+int GetUndoVersion(bool fCompact)
+{
+    return CLIENT_VERSION | (fCompact ? SERIALIZE_UNDO_COMPACT : 0);
+}
+
+bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart, bool fCompact)
 {
     // Open history file to append
-    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
+    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, GetUndoVersion(fCompact));
     if (fileout.IsNull())
         return error("%s: OpenUndoFile failed", __func__);
 
@@ -1243,7 +1465,7 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     fileout << blockundo;
 
     // calculate & write checksum
-    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION | (fCompact ? SERIALIZE_UNDO_COMPACT : 0));
     hasher << hashBlock;
     hasher << blockundo;
     fileout << hasher.GetHash();
@@ -1251,15 +1473,18 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
-static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
+} // namespace
+
+/** Read undo data from a known position, checked against the hash of the
+ *  block's parent. Does not touch the block index, so no lock is needed. */
+static bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashPrevBlock, bool fCompact)
 {
-    CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull()) {
         return error("%s: no undo data available", __func__);
     }
 
     // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, GetUndoVersion(fCompact));
     if (filein.IsNull())
         return error("%s: OpenUndoFile failed", __func__);
 
@@ -1267,7 +1492,7 @@ static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
     uint256 hashChecksum;
     CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
     try {
-        verifier << pindex->pprev->GetBlockHash();
+        verifier << hashPrevBlock;
         verifier >> blockundo;
         filein >> hashChecksum;
     }
@@ -1282,6 +1507,48 @@ static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
     return true;
 }
 
+bool UndoReadFromDisk(std::shared_ptr<const CBlockUndo>& pblockundo, const CBlockIndex *pindex, const CDiskBlockPos& undoPos, bool fCompact)
+{
+    const uint256 hash = pindex->GetBlockHash();
+    pblockundo = g_block_undo_cache.Get(hash);
+    if (pblockundo)
+        return true;
+
+    std::shared_ptr<CBlockUndo> pblockundoRead = std::make_shared<CBlockUndo>();
+    if (!UndoReadFromDisk(*pblockundoRead, undoPos, pindex->pprev->GetBlockHash(), fCompact))
+        return false;
+    pblockundo = pblockundoRead;
+    g_block_undo_cache.Insert(hash, pblockundo);
+    return true;
+}
+
+bool UndoReadFromDisk(std::shared_ptr<const CBlockUndo>& pblockundo, const CBlockIndex *pindex)
+{
+    pblockundo = g_block_undo_cache.Get(pindex->GetBlockHash());
+    if (pblockundo)
+        return true;
+
+    CDiskBlockPos undoPos;
+    bool fCompact;
+    {
+        LOCK(cs_main);
+        undoPos = pindex->GetUndoPos();
+        fCompact = pindex->nStatus & BLOCK_UNDO_COMPACT;
+    }
+    return UndoReadFromDisk(pblockundo, pindex, undoPos, fCompact);
+}
+
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
+{
+    std::shared_ptr<const CBlockUndo> pblockundo;
+    if (!UndoReadFromDisk(pblockundo, pindex))
+        return false;
+    blockundo = *pblockundo;
+    return true;
+}
+
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1302,6 +1569,35 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
 
 } // namespace
 
+bool GetCoinSpentSince(const COutPoint& outpoint, const CBlockIndex* pindexFork, Coin& coin)
+{
+    AssertLockHeld(cs_main);
+
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    for (const CBlockIndex* pindex = chainActive.Tip(); pindex && pindex != pindexFork; pindex = pindex->pprev) {
+        CBlock block;
+        std::shared_ptr<const CBlockUndo> pblockUndo;
+        if (!ReadBlockFromDisk(block, pindex, consensusParams) || !UndoReadFromDisk(pblockUndo, pindex))
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        const CBlockUndo& blockUndo = *pblockUndo;
+        if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
+            return error("%s: block and undo data inconsistent", __func__);
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            const CTransaction& tx = *block.vtx[i];
+            const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+            if (txundo.vprevout.size() != tx.vin.size())
+                return error("%s: transaction and undo data inconsistent", __func__);
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                if (tx.vin[j].prevout == outpoint) {
+                    coin = txundo.vprevout[j];
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
 /**
  * Restore the UTXO in a Coin at a given COutPoint
  * @param undo The Coin to be restored.
@@ -1339,16 +1635,21 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 }
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
+ *  The undo data is read unless pblockUndo provides it.
  *  When FAILED is returned, view is left in an indeterminate state. */
-DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
+DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, CUTXOCommitment* commitment, const CBlockUndo* pblockUndo)
 {
     bool fClean = true;
 
-    CBlockUndo blockUndo;
-    if (!UndoReadFromDisk(blockUndo, pindex)) {
-        error("DisconnectBlock(): failure reading undo data");
-        return DISCONNECT_FAILED;
+    std::shared_ptr<const CBlockUndo> pblockUndoRead;
+    if (!pblockUndo) {
+        if (!UndoReadFromDisk(pblockUndoRead, pindex)) {
+            error("DisconnectBlock(): failure reading undo data");
+            return DISCONNECT_FAILED;
+        }
+        pblockUndo = pblockUndoRead.get();
     }
+    const CBlockUndo& blockUndo = *pblockUndo;
 
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
         error("DisconnectBlock(): block and undo data inconsistent");
@@ -1372,23 +1673,27 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
                 if (!is_spent || tx.vout[o] != coin.out || pindex->nHeight != coin.nHeight || is_coinbase != coin.fCoinBase || is_coinstake != coin.fCoinStake) {
                     fClean = false; // transaction output mismatch
                 }
+                if (is_spent && commitment)
+                    commitment->RemoveCoin(out, coin);
             }
         }
 
         // restore inputs
         if (i > 0) { // not coinbases
-            CTxUndo &txundo = blockUndo.vtxundo[i-1];
+            const CTxUndo &txundo = blockUndo.vtxundo[i-1];
             if (txundo.vprevout.size() != tx.vin.size()) {
                 error("DisconnectBlock(): transaction and undo data inconsistent");
                 return DISCONNECT_FAILED;
             }
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
-                int res = ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out);
+                // The undo data may be shared with the cache, so its coins are copied
+                int res = ApplyTxInUndo(Coin(txundo.vprevout[j]), view, out);
                 if (res == DISCONNECT_FAILED) return DISCONNECT_FAILED;
                 fClean = fClean && res != DISCONNECT_UNCLEAN;
+                if (commitment)
+                    commitment->AddCoin(out, view.AccessCoin(out));
             }
-            // At this point, all of txundo.vprevout should have been moved out.
         }
     }
 
@@ -1428,45 +1733,116 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, CValidationState&
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull()) {
         CDiskBlockPos _pos;
-        if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
+        const bool fCompact = fCompactUndo;
+        if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, SER_DISK, GetUndoVersion(fCompact)) + 40))
             return error("ConnectBlock(): FindUndoPos failed");
-        if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
+        if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart(), fCompact))
             return AbortNode(state, "Failed to write undo data");
 
         // update nUndoPos in block index
         pindex->nUndoPos = _pos.nPos;
         pindex->nStatus |= BLOCK_HAVE_UNDO;
+        if (fCompact)
+            pindex->nStatus |= BLOCK_UNDO_COMPACT;
+        else
+            pindex->nStatus &= ~BLOCK_UNDO_COMPACT;
         setDirtyBlockIndex.insert(pindex);
     }
 
     return true;
 }
 
-static bool WriteTxIndexDataForBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex)
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+void ThreadScriptCheck() {
+    RenameThread("donu-scriptch");
+    scriptcheckqueue.Thread();
+}
+
+/** Number of transactions whose scripts PrecheckDisconnectedScripts queues at once */
+static const size_t REORG_PRECHECK_BATCH = 64;
+
+/** Run the script checks of disconnected transactions on the script check
+ *  threads, filling the signature cache so that re-accepting them into the
+ *  mempool one at a time mostly finds their signatures already verified.
+ *  Failures are ignored here: AcceptToMemoryPool makes the real decision. */
+static void PrecheckDisconnectedScripts(const DisconnectedBlockTransactions& disconnectpool)
 {
-    if (!fTxIndex) return true;
+    AssertLockHeld(cs_main);
+    if (nScriptCheckThreads == 0 || disconnectpool.queuedTx.empty())
+        return;
 
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
-    vPos.reserve(block.vtx.size());
-    for (const CTransactionRef& tx : block.vtx)
-    {
-        vPos.push_back(std::make_pair(tx->GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
-    }
+    LOCK(mempool.cs);
+    CCoinsViewMemPool viewMemPool(pcoinsTip.get(), mempool);
+    const auto& byTxid = disconnectpool.queuedTx.get<txid_index>();
+
+    std::vector<CTransactionRef> vBatch;
+    vBatch.reserve(REORG_PRECHECK_BATCH);
+    auto runBatch = [&]() {
+        std::vector<PrecomputedTransactionData> txdata;
+        txdata.reserve(vBatch.size()); // the checks keep pointers into txdata
+        std::vector<CScriptCheck> vChecks;
+        for (const CTransactionRef& tx : vBatch) {
+            std::vector<CTxOut> vSpent;
+            vSpent.reserve(tx->vin.size());
+            for (const CTxIn& txin : tx->vin) {
+                auto it = byTxid.find(txin.prevout.hash);
+                Coin coin;
+                if (it != byTxid.end() && txin.prevout.n < (*it)->vout.size()) {
+                    vSpent.push_back((*it)->vout[txin.prevout.n]);
+                } else if (viewMemPool.GetCoin(txin.prevout, coin) && !coin.IsSpent()) {
+                    vSpent.push_back(coin.out);
+                } else {
+                    break;
+                }
+            }
+            if (vSpent.size() != tx->vin.size())
+                continue;
+            txdata.emplace_back(*tx);
+            txdata.back().PrecomputeLegacy(*tx);
+            for (unsigned int i = 0; i < tx->vin.size(); i++)
+                vChecks.emplace_back(vSpent[i], *tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true, &txdata.back());
+        }
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+        vBatch.clear();
+    };
 
-    if (!pblocktree->WriteTxIndex(vPos)) {
-        return AbortNode(state, "Failed to write transaction index");
+    for (const CTransactionRef& tx : disconnectpool.queuedTx.get<insertion_order>()) {
+        if (tx->IsCoinBase() || tx->IsCoinStake())
+            continue;
+        vBatch.push_back(tx);
+        if (vBatch.size() == REORG_PRECHECK_BATCH)
+            runBatch();
     }
-
-    return true;
+    if (!vBatch.empty())
+        runBatch();
 }
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+/** Minimum number of inputs for a transaction's mempool script checks to be
+ *  spread over the script check threads; below it, dispatching costs more
+ *  than it saves. */
+static const size_t MEMPOOL_PARALLEL_MIN_INPUTS = 4;
 
-void ThreadScriptCheck() {
-    RenameThread("donu-scriptch");
-    scriptcheckqueue.Thread();
+/** CheckInputs for AcceptToMemoryPool, verifying the input scripts of larger
+ *  transactions in parallel on the script check threads, which are idle
+ *  between blocks since both run under cs_main. A failing transaction is
+ *  checked again serially so that state is filled in exactly as before. */
+static bool CheckInputsForMempool(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, unsigned int flags, PrecomputedTransactionData& txdata)
+{
+    AssertLockHeld(cs_main);
+    if (nScriptCheckThreads == 0 || tx.vin.size() < MEMPOOL_PARALLEL_MIN_INPUTS)
+        return CheckInputs(tx, state, view, true, flags, true, false, txdata);
+
+    std::vector<CScriptCheck> vChecks;
+    if (!CheckInputs(tx, state, view, true, flags, true, false, txdata, &vChecks))
+        return false;
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    if (control.Wait())
+        return true;
+    return CheckInputs(tx, state, view, true, flags, true, false, txdata);
 }
 
 static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& consensusparams) {
@@ -1575,7 +1951,7 @@ bool DonuContextualBlockChecks(const CBlock& block, CValidationState& state, CBl
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
 bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck)
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck, CUTXOCommitment* commitment)
 {
     AssertLockHeld(cs_main);
     assert(pindex);
@@ -1711,6 +2087,8 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+    ScriptCacheStats cacheStatsBefore;
+    scriptExecutionCacheCounters.Get(cacheStatsBefore);
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = *(block.vtx[i]);
@@ -1772,7 +2150,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
-        UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
+        UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight, commitment);
     }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs (%.2fms/blk)]\n", (unsigned)block.vtx.size(), MILLI * (nTime3 - nTime2), MILLI * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : MILLI * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * MICRO, nTimeConnect * MILLI / nBlocksTotal);
@@ -1783,10 +2161,19 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - nTime2), nInputs <= 1 ? 0 : MILLI * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * MICRO, nTimeVerify * MILLI / nBlocksTotal);
+    if (fScriptChecks && !fJustCheck) {
+        ScriptCacheStats cacheStats;
+        scriptExecutionCacheCounters.Get(cacheStats);
+        LogPrint(BCLog::BENCH, "    - Script execution cache: %u of %u txs verified before\n", cacheStats.nBlockHits - cacheStatsBefore.nBlockHits,
+            (cacheStats.nBlockHits + cacheStats.nBlockMisses) - (cacheStatsBefore.nBlockHits + cacheStatsBefore.nBlockMisses));
+    }
 
     if (fJustCheck)
         return true;
 
+    if (fScriptChecks)
+        AdaptScriptCaches();
+
     // donu: track money supply and mint amount info
     pindex->nMint = nValueOut - nValueIn + nFees;
     pindex->nMoneySupply = (pindex->pprev? pindex->pprev->nMoneySupply : 0) + nValueOut - nValueIn;
@@ -1798,15 +2185,14 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
     if (!WriteUndoDataForBlock(blockundo, state, pindex, chainparams))
         return false;
+    // The indexes, and any reorg, read this undo data again soon
+    g_block_undo_cache.Insert(pindex->GetBlockHash(), std::make_shared<const CBlockUndo>(std::move(blockundo)));
 
     if (!pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (!WriteTxIndexDataForBlock(block, state, pindex))
-        return false;
-
     assert(pindex->phashBlock);
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -1832,11 +2218,28 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
     static int64_t nLastSetChain = 0;
+    std::set<int> setFilesToPrune;
+    bool fFlushForPrune = false;
     bool fDoFullFlush = false;
     int64_t nNow = 0;
     try {
     {
         LOCK(cs_LastBlockFile);
+        if (fPruneMode && (fCheckForPruning || nManualPruneHeight > 0) && !fReindex) {
+            if (nManualPruneHeight > 0) {
+                FindFilesToPruneManual(setFilesToPrune, nManualPruneHeight);
+            } else {
+                FindFilesToPrune(setFilesToPrune, chainparams.PruneAfterHeight());
+                fCheckForPruning = false;
+            }
+            if (!setFilesToPrune.empty()) {
+                fFlushForPrune = true;
+                if (!fHavePruned) {
+                    pblocktree->WriteFlag("prunedblockfiles", true);
+                    fHavePruned = true;
+                }
+            }
+        }
         nNow = GetTimeMicros();
         // Avoid writing/flushing immediately after startup.
         if (nLastWrite == 0) {
@@ -1860,7 +2263,7 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
         // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
         bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
         // Combine all conditions that result in a full cache flush.
-        fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush;
+        fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
         // Write blocks and block index to disk.
         if (fDoFullFlush || fPeriodicWrite) {
             // Depend on nMinDiskSpace to ensure we can write block index
@@ -1897,11 +2300,23 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             // overwrite one. Still, use a conservative safety factor of 2.
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
-            // Flush the chainstate (which may refer to block index entries).
+            // Flush the chainstate (which may refer to block index entries),
+            // along with the UTXO set commitment that matches it.
+            if (g_chainstate.fHaveUTXOCommitment)
+                pcoinsdbview->SetCommitment(pcoinsTip->GetBestBlock(), g_chainstate.utxoCommitment);
             if (!pcoinsTip->Flush())
                 return AbortNode(state, "Failed to write to coin database");
+            // A forced flush must have reached the disk when we return, even
+            // if the coins are being written in the background. So must one
+            // that lets block files go, or they might be needed to replay
+            // blocks after a crash.
+            if ((mode == FLUSH_STATE_ALWAYS || fFlushForPrune) && !pcoinsdbview->WaitForFlush())
+                return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
         }
+        // Finally remove any pruned files
+        if (fFlushForPrune)
+            UnlinkPrunedFiles(setFilesToPrune);
     }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
         // Update best block in wallet (so we can detect restored wallets).
@@ -1920,6 +2335,13 @@ void FlushStateToDisk() {
     FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS);
 }
 
+void PruneAndFlush() {
+    CValidationState state;
+    fCheckForPruning = true;
+    const CChainParams& chainparams = Params();
+    FlushStateToDisk(chainparams, state, FLUSH_STATE_NONE);
+}
+
 static void DoWarning(const std::string& strWarning)
 {
     static bool fWarned = false;
@@ -1986,6 +2408,133 @@ void static UpdateTip(const CBlockIndex *pindexNew, const CChainParams& chainPar
 
 }
 
+/** Number of blocks whose data DisconnectPrefetch reads ahead at once */
+static const int DISCONNECT_PREFETCH_BLOCKS = 32;
+
+/**
+ * Blocks and undo data of a stretch of the active chain that is about to be
+ * disconnected, read on several threads at once so that a deep reorg does not
+ * wait on one block and undo read after another.
+ *
+ * The disk positions are collected under cs_main; the reads themselves only
+ * touch the block and undo files. Both are shared with the block and undo
+ * data caches.
+ */
+class DisconnectPrefetch
+{
+private:
+    struct Entry {
+        const CBlockIndex* pindex;
+        uint256 hash;
+        uint256 hashPrev;
+        CDiskBlockPos blockPos;
+        CDiskBlockPos undoPos;
+        bool fCompactUndo;
+        std::shared_ptr<const CBlock> pblock;
+        std::shared_ptr<const CBlockUndo> pblockUndo;
+    };
+
+    const Consensus::Params& m_consensus_params;
+    std::vector<Entry> m_entries;
+
+    void Read(Entry& entry) const
+    {
+        entry.pblock = g_block_cache.Get(entry.hash);
+        if (!entry.pblock) {
+            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+            if (ReadBlockFromDisk(*pblockRead, entry.blockPos, m_consensus_params) && pblockRead->GetHash() == entry.hash) {
+                entry.pblock = pblockRead;
+                g_block_cache.Insert(entry.hash, entry.pblock);
+            }
+        }
+        entry.pblockUndo = g_block_undo_cache.Get(entry.hash);
+        if (!entry.pblockUndo) {
+            std::shared_ptr<CBlockUndo> pblockUndoRead = std::make_shared<CBlockUndo>();
+            if (UndoReadFromDisk(*pblockUndoRead, entry.undoPos, entry.hashPrev, entry.fCompactUndo)) {
+                entry.pblockUndo = pblockUndoRead;
+                g_block_undo_cache.Insert(entry.hash, entry.pblockUndo);
+            }
+        }
+    }
+
+public:
+    explicit DisconnectPrefetch(const Consensus::Params& consensus_params) : m_consensus_params(consensus_params) {}
+
+    /** Read the data of up to DISCONNECT_PREFETCH_BLOCKS blocks, from pindexTip
+     *  back to (not including) pindexFork. */
+    void Fill(const CBlockIndex* pindexTip, const CBlockIndex* pindexFork)
+    {
+        AssertLockHeld(cs_main);
+        m_entries.clear();
+        for (const CBlockIndex* pindex = pindexTip; pindex && pindex != pindexFork && m_entries.size() < (size_t)DISCONNECT_PREFETCH_BLOCKS; pindex = pindex->pprev) {
+            if (!pindex->pprev)
+                break;
+            Entry entry;
+            entry.pindex = pindex;
+            entry.hash = pindex->GetBlockHash();
+            entry.hashPrev = pindex->pprev->GetBlockHash();
+            entry.blockPos = pindex->GetBlockPos();
+            entry.undoPos = pindex->GetUndoPos();
+            entry.fCompactUndo = pindex->nStatus & BLOCK_UNDO_COMPACT;
+            m_entries.push_back(std::move(entry));
+        }
+
+        std::atomic<size_t> next(0);
+        auto worker = [this, &next]() {
+            for (size_t i = next++; i < m_entries.size(); i = next++)
+                Read(m_entries[i]);
+        };
+        const int nThreads = std::max(1, std::min<int>(nScriptCheckThreads, m_entries.size()));
+        std::vector<std::thread> threads;
+        for (int i = 1; i < nThreads; i++)
+            threads.emplace_back(worker);
+        worker();
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    /** Whether the data of pindex has been read ahead, successfully or not */
+    bool Has(const CBlockIndex* pindex) const
+    {
+        for (const Entry& entry : m_entries)
+            if (entry.pindex == pindex)
+                return true;
+        return false;
+    }
+
+    /** Hand out what was read for pindex. Returns false if either the block
+     *  or its undo data could not be read, so the caller reads them itself. */
+    bool Take(const CBlockIndex* pindex, std::shared_ptr<const CBlock>& pblock, std::shared_ptr<const CBlockUndo>& pblockUndo)
+    {
+        for (Entry& entry : m_entries) {
+            if (entry.pindex != pindex)
+                continue;
+            if (!entry.pblock || !entry.pblockUndo)
+                return false;
+            pblock = std::move(entry.pblock);
+            pblockUndo = std::move(entry.pblockUndo);
+            return true;
+        }
+        return false;
+    }
+};
+
+/** The most recent reorg made by ActivateBestChainStep, see GetReorgStats */
+static ReorgStats g_last_reorg;
+static uint64_t g_reorg_count = 0;
+static int g_reorg_max_depth = 0;
+
+bool GetReorgStats(ReorgStats& stats, uint64_t& nReorgs, int& nMaxDepth)
+{
+    LOCK(cs_main);
+    nReorgs = g_reorg_count;
+    nMaxDepth = g_reorg_max_depth;
+    if (g_reorg_count == 0)
+        return false;
+    stats = g_last_reorg;
+    return true;
+}
+
 /** Disconnect chainActive's tip.
   * After calling, the mempool will be in an inconsistent state, with
   * transactions from disconnected blocks being added to disconnectpool.  You
@@ -1995,25 +2544,32 @@ void static UpdateTip(const CBlockIndex *pindexNew, const CChainParams& chainPar
   * If disconnectpool is nullptr, then no disconnected transactions are added to
   * disconnectpool (note that the caller is responsible for mempool consistency
   * in any case).
+  *
+  * If prefetch holds the block and undo data of the tip, they are used instead
+  * of reading them from disk.
   */
-bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool)
+bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool, DisconnectPrefetch* prefetch)
 {
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
     // Read block from disk.
-    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-    CBlock& block = *pblock;
-    if (!ReadBlockFromDisk(block, pindexDelete, chainparams.GetConsensus()))
+    std::shared_ptr<const CBlock> pblock;
+    std::shared_ptr<const CBlockUndo> pblockUndo;
+    const bool fPrefetched = prefetch && prefetch->Take(pindexDelete, pblock, pblockUndo);
+    if (!fPrefetched && !ReadBlockFromDisk(pblock, pindexDelete, chainparams.GetConsensus()))
         return AbortNode(state, "Failed to read block");
+    const CBlock& block = *pblock;
     // Apply the block atomically to the chain state.
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pcoinsTip.get());
+        CUTXOCommitment commitment = utxoCommitment;
         assert(view.GetBestBlock() == pindexDelete->GetBlockHash());
-        if (DisconnectBlock(block, pindexDelete, view) != DISCONNECT_OK)
+        if (DisconnectBlock(block, pindexDelete, view, &commitment, pblockUndo.get()) != DISCONNECT_OK)
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         bool flushed = view.Flush();
         assert(flushed);
+        utxoCommitment = commitment;
     }
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * MILLI);
     // Write the chain state to disk, if necessary.
@@ -2126,10 +2682,8 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     int64_t nTime1 = GetTimeMicros();
     std::shared_ptr<const CBlock> pthisBlock;
     if (!pblock) {
-        std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
-        if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
+        if (!ReadBlockFromDisk(pthisBlock, pindexNew, chainparams.GetConsensus()))
             return AbortNode(state, "Failed to read block");
-        pthisBlock = pblockNew;
     } else {
         pthisBlock = pblock;
     }
@@ -2140,7 +2694,8 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
     {
         CCoinsViewCache view(pcoinsTip.get());
-        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
+        CUTXOCommitment commitment = utxoCommitment;
+        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams, false, &commitment);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -2151,6 +2706,7 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
         LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
         bool flushed = view.Flush();
         assert(flushed);
+        utxoCommitment = commitment;
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
@@ -2170,6 +2726,9 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
     LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime1) * MILLI, nTimeTotal * MICRO, nTimeTotal * MILLI / nBlocksTotal);
 
+    // Peers and the wallet commonly ask for the new tip right away
+    g_block_cache.Insert(pindexNew->GetBlockHash(), pthisBlock);
+
     connectTrace.BlockConnected(pindexNew, std::move(pthisBlock));
     return true;
 }
@@ -2242,19 +2801,28 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
 
     const CBlockIndex *pindexOldTip = chainActive.Tip();
     const CBlockIndex *pindexFork = chainActive.FindFork(pindexMostWork);
+    const int64_t nTimeReorgStart = GetTimeMicros();
 
-    // Disconnect active blocks which are no longer in the best chain.
-    bool fBlocksDisconnected = false;
+    // Disconnect active blocks which are no longer in the best chain. When
+    // more than one block goes, their data is read ahead in batches.
+    int nDisconnected = 0;
     DisconnectedBlockTransactions disconnectpool;
+    DisconnectPrefetch prefetch(chainparams.GetConsensus());
+    const bool fPrefetch = pindexOldTip && pindexOldTip->nHeight - (pindexFork ? pindexFork->nHeight : -1) >= 2;
     while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
-        if (!DisconnectTip(state, chainparams, &disconnectpool)) {
+        if (fPrefetch && !prefetch.Has(chainActive.Tip()))
+            prefetch.Fill(chainActive.Tip(), pindexFork);
+        if (!DisconnectTip(state, chainparams, &disconnectpool, fPrefetch ? &prefetch : nullptr)) {
             // This is likely a fatal error, but keep the mempool consistent,
             // just in case. Only remove from the mempool in this case.
             UpdateMempoolForReorg(disconnectpool, false);
             return false;
         }
-        fBlocksDisconnected = true;
+        nDisconnected++;
     }
+    const bool fBlocksDisconnected = nDisconnected > 0;
+    const int64_t nTimeDisconnected = GetTimeMicros();
+    int nConnected = 0;
 
     // Build list of new blocks to connect.
     std::vector<CBlockIndex*> vpindexToConnect;
@@ -2292,6 +2860,7 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
                     return false;
                 }
             } else {
+                nConnected++;
                 if (!pindexOldTip || chainActive.Tip()->nChainTrust > pindexOldTip->nChainTrust) {
                     // We're in a better position than we were. Return temporarily to release the lock.
                     fContinue = false;
@@ -2302,9 +2871,26 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
     }
 
     if (fBlocksDisconnected) {
+        const int64_t nTimeConnected = GetTimeMicros();
         // If any blocks were disconnected, disconnectpool may be non empty.  Add
         // any disconnected transactions back to the mempool.
         UpdateMempoolForReorg(disconnectpool, true);
+        const int64_t nTimeMempool = GetTimeMicros();
+
+        g_last_reorg.nTime = GetTime();
+        g_last_reorg.nForkHeight = pindexFork ? pindexFork->nHeight : -1;
+        g_last_reorg.nDisconnected = nDisconnected;
+        g_last_reorg.nConnected = nConnected;
+        g_last_reorg.nDisconnectMicros = nTimeDisconnected - nTimeReorgStart;
+        g_last_reorg.nConnectMicros = nTimeConnected - nTimeDisconnected;
+        g_last_reorg.nMempoolMicros = nTimeMempool - nTimeConnected;
+        g_last_reorg.hashOldTip = pindexOldTip->GetBlockHash();
+        g_last_reorg.hashNewTip = chainActive.Tip()->GetBlockHash();
+        g_reorg_count++;
+        g_reorg_max_depth = std::max(g_reorg_max_depth, nDisconnected);
+        LogPrint(BCLog::BENCH, "- Reorg of %d blocks: disconnect %.2fms, connect %d blocks %.2fms, mempool %.2fms\n",
+                 nDisconnected, g_last_reorg.nDisconnectMicros * MILLI, nConnected,
+                 g_last_reorg.nConnectMicros * MILLI, g_last_reorg.nMempoolMicros * MILLI);
     }
     mempool.check(pcoinsTip.get());
 
@@ -2670,8 +3256,13 @@ static bool FindBlockPos(CDiskBlockPos &pos, unsigned int nAddSize, unsigned int
         vinfoBlockFile.resize(nFile + 1);
     }
 
+    // -fastprune spreads a short test chain over several files that can be pruned
+    const bool fFastPrune = gArgs.GetBoolArg("-fastprune", false);
+    const unsigned int nMaxBlockFileSize = fFastPrune ? 0x10000 /* 64 KiB */ : MAX_BLOCKFILE_SIZE;
+    const unsigned int nBlockFileChunkSize = fFastPrune ? 0x4000 /* 16 KiB */ : BLOCKFILE_CHUNK_SIZE;
+
     if (!fKnown) {
-        while (vinfoBlockFile[nFile].nSize + nAddSize >= MAX_BLOCKFILE_SIZE) {
+        while (vinfoBlockFile[nFile].nSize + nAddSize >= nMaxBlockFileSize) {
             nFile++;
             if (vinfoBlockFile.size() <= nFile) {
                 vinfoBlockFile.resize(nFile + 1);
@@ -2696,16 +3287,18 @@ static bool FindBlockPos(CDiskBlockPos &pos, unsigned int nAddSize, unsigned int
         vinfoBlockFile[nFile].nSize += nAddSize;
 
     if (!fKnown) {
-        unsigned int nOldChunks = (pos.nPos + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
-        unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
+        unsigned int nOldChunks = (pos.nPos + nBlockFileChunkSize - 1) / nBlockFileChunkSize;
+        unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + nBlockFileChunkSize - 1) / nBlockFileChunkSize;
         if (nNewChunks > nOldChunks) {
-            if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
+            if (CheckDiskSpace(nNewChunks * nBlockFileChunkSize - pos.nPos)) {
                 FILE *file = OpenBlockFile(pos);
                 if (file) {
-                    LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * BLOCKFILE_CHUNK_SIZE, pos.nFile);
-                    AllocateFileRange(file, pos.nPos, nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos);
+                    LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * nBlockFileChunkSize, pos.nFile);
+                    AllocateFileRange(file, pos.nPos, nNewChunks * nBlockFileChunkSize - pos.nPos);
                     fclose(file);
                 }
+                if (fPruneMode)
+                    fCheckForPruning = true;
             }
             else
                 return error("out of disk space");
@@ -2737,6 +3330,8 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
                 AllocateFileRange(file, pos.nPos, nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos);
                 fclose(file);
             }
+            if (fPruneMode)
+                fCheckForPruning = true;
         }
         else
             return state.Error("out of disk space");
@@ -2759,7 +3354,7 @@ static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state,
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSignature)
+bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSignature, int nHeight)
 {
     // These are checks that are independent of context.
 
@@ -2821,8 +3416,10 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
 
     // Check coinbase reward
     CAmount nCoinbaseCost = 0;
-    CBlockIndex* pindexPrev = chainActive.Tip();
-    const int nHeight = pindexPrev == nullptr ? 0 : pindexPrev->nHeight + 1;
+    if (nHeight < 0) {
+        LOCK(cs_main);
+        nHeight = chainActive.Height() + 1;
+    }
     if (block.IsProofOfWork())
         nCoinbaseCost = (GetMinFee(*block.vtx[0]) < PERKB_TX_FEE)? 0 : (GetMinFee(*block.vtx[0]) - PERKB_TX_FEE);
     if (block.vtx[0]->GetValueOut() > (block.IsProofOfWork()? (GetProofOfWorkReward(nHeight) - nCoinbaseCost) : 0))
@@ -3356,20 +3953,182 @@ uint64_t CalculateCurrentUsage()
     return retval;
 }
 
-bool CheckDiskSpace(uint64_t nAdditionalBytes)
+/* Prune a block file (modify associated database entries)*/
+void PruneOneBlockFile(const int fileNumber)
 {
-    uint64_t nFreeBytesAvailable = fs::space(GetDataDir()).available;
-
-    // Check for nMinDiskSpace bytes (currently 50MB)
-    if (nFreeBytesAvailable < nMinDiskSpace + nAdditionalBytes)
-        return AbortNode("Disk space is low!", _("Error: Disk space is low!"));
+    LOCK(cs_LastBlockFile);
 
-    return true;
-}
+    for (const auto& entry : mapBlockIndex) {
+        CBlockIndex* pindex = entry.second;
+        if (pindex->nFile == fileNumber) {
+            pindex->nStatus &= ~BLOCK_HAVE_DATA;
+            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nFile = 0;
+            pindex->nDataPos = 0;
+            pindex->nUndoPos = 0;
+            setDirtyBlockIndex.insert(pindex);
 
-static FILE* OpenDiskFile(const CDiskBlockPos &pos, const char *prefix, bool fReadOnly)
-{
-    if (pos.IsNull())
+            // Prune from mapBlocksUnlinked -- any block we prune would have
+            // to be downloaded again in order to consider its chain, at which
+            // point it would be considered as a candidate for
+            // mapBlocksUnlinked or setBlockIndexCandidates.
+            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex->pprev);
+            while (range.first != range.second) {
+                std::multimap<CBlockIndex *, CBlockIndex *>::iterator _it = range.first;
+                range.first++;
+                if (_it->second == pindex) {
+                    mapBlocksUnlinked.erase(_it);
+                }
+            }
+        }
+    }
+
+    vinfoBlockFile[fileNumber].SetNull();
+    setDirtyFileInfo.insert(fileNumber);
+}
+
+
+void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
+{
+    for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
+        CDiskBlockPos pos(*it, 0);
+        g_mapped_block_files.Erase(*it);
+        fs::remove(GetBlockPosFilename(pos, "blk"));
+        fs::remove(GetBlockPosFilename(pos, "rev"));
+        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
+    }
+}
+
+/**
+ * donu: highest block whose file may be pruned. Blocks within
+ * MIN_BLOCKS_TO_KEEP of the tip are kept, and so is everything after the
+ * last sync checkpoint, so that the undo data any reorganization the
+ * checkpoint still allows is at hand.
+ */
+static int GetLastBlockWeCanPrune()
+{
+    AssertLockHeld(cs_main);
+
+    int nLastBlockWeCanPrune = chainActive.Tip()->nHeight - MIN_BLOCKS_TO_KEEP;
+#ifdef ENABLE_CHECKPOINTS
+    const CBlockIndex* pindexSync = GetLastSyncCheckpoint();
+    if (pindexSync && chainActive.Contains(pindexSync))
+        nLastBlockWeCanPrune = std::min(nLastBlockWeCanPrune, pindexSync->nHeight);
+#endif
+    return nLastBlockWeCanPrune;
+}
+
+/* Calculate the block/rev files to delete based on height specified by user with RPC command pruneblockchain */
+static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight)
+{
+    assert(fPruneMode && nManualPruneHeight > 0);
+
+    LOCK2(cs_main, cs_LastBlockFile);
+    if (chainActive.Tip() == nullptr)
+        return;
+
+    // last block to prune is the lesser of (user-specified height, the last block we can prune)
+    int nLastBlockWeCanPrune = std::min(nManualPruneHeight, GetLastBlockWeCanPrune());
+    if (nLastBlockWeCanPrune < 0)
+        return;
+    int count=0;
+    for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+        if (vinfoBlockFile[fileNumber].nSize == 0 || vinfoBlockFile[fileNumber].nHeightLast > (unsigned int)nLastBlockWeCanPrune)
+            continue;
+        PruneOneBlockFile(fileNumber);
+        setFilesToPrune.insert(fileNumber);
+        count++;
+    }
+    LogPrintf("Prune (Manual): prune_height=%d removed %d blk/rev pairs\n", nLastBlockWeCanPrune, count);
+}
+
+/* This function is called from the RPC code for pruneblockchain */
+void PruneBlockFilesManual(int nManualPruneHeight)
+{
+    CValidationState state;
+    const CChainParams& chainparams = Params();
+    FlushStateToDisk(chainparams, state, FLUSH_STATE_NONE, nManualPruneHeight);
+}
+
+/**
+ * Prune block and undo files (blk???.dat and undo???.dat) so that the disk space used is less than a user-defined target.
+ * The user sets the target (in MB) on the command line or in config file.  This will be run on startup and whenever new
+ * space is allocated in a block or undo file, staying below the target. Changing back to unpruned requires a reindex
+ * (which in this case means the blockchain must be re-downloaded.)
+ *
+ * Pruning functions are called from FlushStateToDisk when the global fCheckForPruning flag has been set.
+ * Block and undo files are deleted in lock-step (when blk00003.dat is deleted, so is rev00003.dat.)
+ * Pruning cannot take place until the longest chain is at least a certain length (100000 on mainnet, 1000 on testnet, 1000 on regtest).
+ * Pruning will never delete a block within a defined distance (currently 288) from the active chain's tip,
+ * nor any block after the last sync checkpoint.
+ * The block index is updated by unsetting HAVE_DATA and HAVE_UNDO for any blocks that were stored in the deleted files.
+ * A db flag records the fact that at least some block files have been pruned.
+ *
+ * @param[out]   setFilesToPrune   The set of file indices that can be unlinked will be returned
+ */
+static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight)
+{
+    LOCK2(cs_main, cs_LastBlockFile);
+    if (chainActive.Tip() == nullptr || nPruneTarget == 0) {
+        return;
+    }
+    if ((uint64_t)chainActive.Tip()->nHeight <= nPruneAfterHeight) {
+        return;
+    }
+
+    int nLastBlockWeCanPrune = GetLastBlockWeCanPrune();
+    if (nLastBlockWeCanPrune < 0)
+        return;
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    // We don't check to prune until after we've allocated new space for files
+    // So we should leave a buffer under our target to account for another allocation
+    // before the next pruning.
+    uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    uint64_t nBytesToPrune;
+    int count=0;
+
+    if (nCurrentUsage + nBuffer >= nPruneTarget) {
+        for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+            nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
+
+            if (vinfoBlockFile[fileNumber].nSize == 0)
+                continue;
+
+            if (nCurrentUsage + nBuffer < nPruneTarget)  // are we below our target?
+                break;
+
+            // don't prune files that could have a block we must keep but keep scanning
+            if (vinfoBlockFile[fileNumber].nHeightLast > (unsigned int)nLastBlockWeCanPrune)
+                continue;
+
+            PruneOneBlockFile(fileNumber);
+            // Queue up the files for removal
+            setFilesToPrune.insert(fileNumber);
+            nCurrentUsage -= nBytesToPrune;
+            count++;
+        }
+    }
+
+    LogPrint(BCLog::PRUNE, "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+           nPruneTarget/1024/1024, nCurrentUsage/1024/1024,
+           ((int64_t)nPruneTarget - (int64_t)nCurrentUsage)/1024/1024,
+           nLastBlockWeCanPrune, count);
+}
+
+bool CheckDiskSpace(uint64_t nAdditionalBytes)
+{
+    uint64_t nFreeBytesAvailable = fs::space(GetDataDir()).available;
+
+    // Check for nMinDiskSpace bytes (currently 50MB)
+    if (nFreeBytesAvailable < nMinDiskSpace + nAdditionalBytes)
+        return AbortNode("Disk space is low!", _("Error: Disk space is low!"));
+
+    return true;
+}
+
+static FILE* OpenDiskFile(const CDiskBlockPos &pos, const char *prefix, bool fReadOnly)
+{
+    if (pos.IsNull())
         return nullptr;
     fs::path path = GetBlockPosFilename(pos, prefix);
     fs::create_directories(path.parent_path());
@@ -3424,8 +4183,13 @@ CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
 
 bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlockTreeDB& blocktree)
 {
-    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash){ return this->InsertBlockIndex(hash); }))
+    int64_t nStart = GetTimeMillis();
+    if (!blocktree.LoadBlockIndexGuts(consensus_params,
+                                      [this](size_t nEntries){ mapBlockIndex.reserve(nEntries); },
+                                      [this](const uint256& hash){ return this->InsertBlockIndex(hash); },
+                                      std::max(1, nScriptCheckThreads)))
         return false;
+    LogPrintf("%s: loaded %u block index entries in %dms\n", __func__, mapBlockIndex.size(), GetTimeMillis() - nStart);
 
     boost::this_thread::interruption_point();
 
@@ -3528,15 +4292,16 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     }
     LogPrintf("LoadBlockIndexDB(): synchronized checkpoint %s\n", hashSyncCheckpoint.ToString());
 #endif
+    // Check whether we have ever pruned block & undo files
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
     if(fReindexing) fReindex = true;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
-
     return true;
 }
 
@@ -3567,6 +4332,256 @@ bool LoadChainTip(const CChainParams& chainparams)
     return true;
 }
 
+bool LoadUTXOCommitment()
+{
+    LOCK(cs_main);
+    const uint256 hashBestBlock = pcoinsTip->GetBestBlock();
+
+    uint256 hashCommitted;
+    CUTXOCommitment commitment;
+    if (pcoinsdbview->ReadCommitment(hashCommitted, commitment) && hashCommitted == hashBestBlock) {
+        g_chainstate.utxoCommitment = commitment;
+        g_chainstate.fHaveUTXOCommitment = true;
+        return true;
+    }
+
+    // The stored commitment is missing or belongs to a different state of the
+    // coins database (older software, or a replayed flush), so rebuild it.
+    // This reads the whole UTXO set, which takes minutes on a large chainstate.
+    // Holding cs_main throughout is fine: it only runs during startup, before
+    // any peer or RPC client can use the chainstate.
+    LogPrintf("%s: computing UTXO set commitment at %s...\n", __func__, hashBestBlock.ToString());
+    uiInterface.InitMessage(_("Computing UTXO set commitment..."));
+    LogPrintf("[0%%]...");
+    uiInterface.ShowProgress(_("Computing UTXO set commitment..."), 0, false);
+    int64_t nStart = GetTimeMillis();
+    int64_t count = 0;
+    int reportDone = 0;
+    commitment = CUTXOCommitment();
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    assert(pcursor);
+    for (; pcursor->Valid(); pcursor->Next()) {
+        if (ShutdownRequested()) {
+            uiInterface.ShowProgress("", 100, false);
+            return false;
+        }
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin)) {
+            uiInterface.ShowProgress("", 100, false);
+            return error("%s: unable to read UTXO set", __func__);
+        }
+        if (count++ % 256 == 0) {
+            // coins are ordered by txid, so its leading bytes tell how far along we are
+            uint32_t high = 0x100 * *key.hash.begin() + *(key.hash.begin() + 1);
+            int percentageDone = (int)(high * 100.0 / 65536.0 + 0.5);
+            uiInterface.ShowProgress(_("Computing UTXO set commitment..."), percentageDone, false);
+            if (reportDone < percentageDone/10) {
+                // report max. every 10% step
+                LogPrintf("[%d%%]...", percentageDone);
+                reportDone = percentageDone/10;
+            }
+        }
+        commitment.AddCoin(key, coin);
+    }
+    uiInterface.ShowProgress("", 100, false);
+    LogPrintf("[DONE].\n");
+    g_chainstate.utxoCommitment = commitment;
+    g_chainstate.fHaveUTXOCommitment = true;
+    pcoinsdbview->SetCommitment(hashBestBlock, commitment);
+    LogPrintf("%s: %u outputs committed in %dms\n", __func__, commitment.nTransactionOutputs, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool GetUTXOCommitment(CUTXOCommitment& commitment, uint256& hashBlock)
+{
+    AssertLockHeld(cs_main);
+    if (!g_chainstate.fHaveUTXOCommitment)
+        return false;
+    commitment = g_chainstate.utxoCommitment;
+    hashBlock = pcoinsTip->GetBestBlock();
+    return true;
+}
+
+/**
+ * Runs the checks of VerifyDB levels 0 to 2 (block read, CheckBlock, undo
+ * read and checksum) over a list of blocks on a pool of threads. The checks
+ * of one block do not depend on any other block, so workers simply take the
+ * next unchecked block until none is left or one of them fails.
+ */
+class CBlockVerifier
+{
+private:
+    const CChainParams& m_chainparams;
+    const std::vector<const CBlockIndex*> m_blocks;
+    const int m_check_level;
+    const bool m_background;
+
+    std::atomic<size_t> m_next;
+    std::atomic<size_t> m_checked;
+    std::atomic<bool> m_failed;
+    std::atomic<bool> m_interrupted;
+    std::vector<std::thread> m_threads;
+
+    /** Whether the files of a block have been pruned. Pruning can unlink
+     *  them at any time while the workers run without cs_main. */
+    static bool IsPruned(const CBlockIndex* pindex)
+    {
+        LOCK(cs_main);
+        return !(pindex->nStatus & BLOCK_HAVE_DATA);
+    }
+
+    bool CheckBlockFiles(const CBlockIndex* pindex) const
+    {
+        CDiskBlockPos pos;
+        CDiskBlockPos undoPos;
+        bool fCompactUndo;
+        {
+            LOCK(cs_main);
+            // Blocks pruned since the list was made are skipped.
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                return true;
+            pos = pindex->GetBlockPos();
+            undoPos = pindex->GetUndoPos();
+            fCompactUndo = pindex->nStatus & BLOCK_UNDO_COMPACT;
+        }
+
+        // check level 0: read from disk, bypassing the block cache
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pos, m_chainparams.GetConsensus())) {
+            if (IsPruned(pindex))
+                return true;
+            return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        }
+        if (block.GetHash() != pindex->GetBlockHash())
+            return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        // check level 1: verify block validity
+        CValidationState state;
+        if (m_check_level >= 1 && !CheckBlock(block, state, m_chainparams.GetConsensus(), true, true, true, pindex->nHeight))
+            return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__,
+                         pindex->nHeight, pindex->GetBlockHash().ToString(), FormatStateMessage(state));
+        // check level 2: verify undo validity, again bypassing the cache
+        if (m_check_level >= 2 && !undoPos.IsNull()) {
+            CBlockUndo undo;
+            if (!UndoReadFromDisk(undo, undoPos, pindex->pprev->GetBlockHash(), fCompactUndo) && !IsPruned(pindex))
+                return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+        }
+        return true;
+    }
+
+    void ThreadVerify()
+    {
+        while (!m_failed && !m_interrupted) {
+            size_t i = m_next++;
+            if (i >= m_blocks.size())
+                break;
+            if (!CheckBlockFiles(m_blocks[i])) {
+                m_failed = true;
+                break;
+            }
+            m_checked++;
+        }
+    }
+
+public:
+    CBlockVerifier(const CChainParams& chainparams, std::vector<const CBlockIndex*> blocks, int nCheckLevel, bool fBackground)
+        : m_chainparams(chainparams), m_blocks(std::move(blocks)), m_check_level(nCheckLevel), m_background(fBackground),
+          m_next(0), m_checked(0), m_failed(false), m_interrupted(false) {}
+
+    ~CBlockVerifier()
+    {
+        Interrupt();
+        for (std::thread& thread : m_threads)
+            if (thread.joinable())
+                thread.join();
+    }
+
+    void Start(int nThreads)
+    {
+        nThreads = std::max(1, std::min<int>(nThreads, m_blocks.size()));
+        for (int i = 0; i < nThreads; i++)
+            m_threads.emplace_back(&TraceThread<std::function<void()> >, "verifydb", std::function<void()>(std::bind(&CBlockVerifier::ThreadVerify, this)));
+    }
+
+    void Interrupt() { m_interrupted = true; }
+
+    /** Wait for the workers, reporting progress meanwhile. Returns whether
+     *  every block was checked and passed. */
+    bool Wait()
+    {
+        int reportDone = 0;
+        // In the foreground, level 4 reconnects the blocks afterwards and
+        // reports the second half of the progress.
+        const int nProgressScale = (!m_background && m_check_level >= 4) ? 50 : 100;
+        while (m_checked < m_blocks.size() && !m_failed && !m_interrupted) {
+            int percentageDone = std::max(1, std::min(99, (int)(m_checked * nProgressScale / m_blocks.size())));
+            if (reportDone < percentageDone/10) {
+                // report every 10% step
+                LogPrintf("[%d%%]...", percentageDone);
+                reportDone = percentageDone/10;
+            }
+            if (!m_background)
+                uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone, false);
+            if (!m_background && ShutdownRequested())
+                Interrupt();
+            MilliSleep(100);
+        }
+        for (std::thread& thread : m_threads)
+            thread.join();
+        m_threads.clear();
+        return !m_failed && m_checked == m_blocks.size();
+    }
+
+    bool IsInterrupted() const { return m_interrupted; }
+    size_t GetChecked() const { return m_checked; }
+    size_t GetTotal() const { return m_blocks.size(); }
+};
+
+/** Verification left running by VerifyDB, and the thread waiting for it */
+static std::mutex g_block_verifier_mutex;
+static std::unique_ptr<CBlockVerifier> g_block_verifier;
+static std::thread g_block_verifier_thread;
+
+bool GetBackgroundVerifyProgress(size_t& nChecked, size_t& nTotal)
+{
+    std::lock_guard<std::mutex> lock(g_block_verifier_mutex);
+    if (!g_block_verifier)
+        return false;
+    nChecked = g_block_verifier->GetChecked();
+    nTotal = g_block_verifier->GetTotal();
+    return true;
+}
+
+void StopBackgroundVerify()
+{
+    {
+        std::lock_guard<std::mutex> lock(g_block_verifier_mutex);
+        if (g_block_verifier)
+            g_block_verifier->Interrupt();
+    }
+    if (g_block_verifier_thread.joinable())
+        g_block_verifier_thread.join();
+}
+
+static void ThreadBackgroundVerify()
+{
+    CBlockVerifier* verifier;
+    {
+        std::lock_guard<std::mutex> lock(g_block_verifier_mutex);
+        verifier = g_block_verifier.get();
+    }
+    bool fOk = verifier->Wait();
+    if (fOk) {
+        LogPrintf("[DONE].\n");
+        LogPrintf("Verified last %u blocks in the background\n", verifier->GetTotal());
+    } else if (!verifier->IsInterrupted()) {
+        AbortNode("Corrupted block database detected by background verification",
+                  _("Corrupted block database detected") + ". " + _("Please restart with -reindex or -reindex-chainstate to recover."));
+    }
+    std::lock_guard<std::mutex> lock(g_block_verifier_mutex);
+    g_block_verifier.reset();
+}
+
 CVerifyDB::CVerifyDB()
 {
     uiInterface.ShowProgress(_("Verifying blocks..."), 0, false);
@@ -3577,67 +4592,98 @@ CVerifyDB::~CVerifyDB()
     uiInterface.ShowProgress("", 100, false);
 }
 
-bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth)
+/** The last nCheckDepth blocks of the active chain that VerifyDB checks, tip first */
+static std::vector<const CBlockIndex*> GetVerifyBlocks(int nCheckDepth)
 {
-    LOCK(cs_main);
-    if (chainActive.Tip() == nullptr || chainActive.Tip()->pprev == nullptr)
+    AssertLockHeld(cs_main);
+
+    std::vector<const CBlockIndex*> vBlocks;
+    for (const CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
+        if (pindex->nHeight < chainActive.Height()-nCheckDepth)
+            break;
+        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, only go back as far as we have data.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+            break;
+        }
+        vBlocks.push_back(pindex);
+    }
+    return vBlocks;
+}
+
+bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth, int nThreads, bool fBackground)
+{
+    std::vector<const CBlockIndex*> vBlocks;
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() == nullptr || chainActive.Tip()->pprev == nullptr)
+            return true;
+
+        // Verify blocks in the best chain
+        if (nCheckDepth <= 0 || nCheckDepth > chainActive.Height())
+            nCheckDepth = chainActive.Height();
+        nCheckLevel = std::max(0, std::min(4, nCheckLevel));
+        LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
+        vBlocks = GetVerifyBlocks(nCheckDepth);
+    }
+
+    // Levels 0 to 2 only read the block files, so they run on a pool of
+    // threads without cs_main. In the background they carry on while the
+    // node starts serving.
+    if (fBackground) {
+        StopBackgroundVerify();
+        LogPrintf("Checking block and undo files in the background\n");
+        {
+            std::lock_guard<std::mutex> lock(g_block_verifier_mutex);
+            g_block_verifier.reset(new CBlockVerifier(chainparams, vBlocks, nCheckLevel, true));
+            g_block_verifier->Start(nThreads);
+        }
+        g_block_verifier_thread = std::thread(&TraceThread<void (*)()>, "verifydbwait", &ThreadBackgroundVerify);
+    } else {
+        LogPrintf("[0%%]...");
+        CBlockVerifier verifier(chainparams, vBlocks, nCheckLevel, false);
+        verifier.Start(nThreads);
+        if (!verifier.Wait())
+            return verifier.IsInterrupted();
+    }
+
+    if (nCheckLevel < 3) {
+        if (!fBackground)
+            LogPrintf("[DONE].\n");
         return true;
+    }
 
-    // Verify blocks in the best chain
-    if (nCheckDepth <= 0 || nCheckDepth > chainActive.Height())
-        nCheckDepth = chainActive.Height();
-    nCheckLevel = std::max(0, std::min(4, nCheckLevel));
-    LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
+    LOCK(cs_main);
+    // cs_main was not held while the block files were checked, so the tip may
+    // have moved on since; the disconnect checks start from the current one.
+    if (vBlocks.empty() || vBlocks.front() != chainActive.Tip())
+        vBlocks = GetVerifyBlocks(nCheckDepth);
     CCoinsViewCache coins(coinsview);
     CBlockIndex* pindexState = chainActive.Tip();
     CBlockIndex* pindexFailure = nullptr;
     int nGoodTransactions = 0;
     CValidationState state;
-    int reportDone = 0;
-    LogPrintf("[0%%]...");
-    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
+    // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
+    for (const CBlockIndex* pindexChecked : vBlocks)
     {
         boost::this_thread::interruption_point();
-        int percentageDone = std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100))));
-        if (reportDone < percentageDone/10) {
-            // report every 10% step
-            LogPrintf("[%d%%]...", percentageDone);
-            reportDone = percentageDone/10;
-        }
-        uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone, false);
-        if (pindex->nHeight < chainActive.Height()-nCheckDepth)
+        CBlockIndex* pindex = const_cast<CBlockIndex*>(pindexChecked);
+        if (pindex != pindexState || (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) > nCoinCacheUsage)
             break;
         CBlock block;
-        // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
             return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams.GetConsensus()))
-            return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__,
-                         pindex->nHeight, pindex->GetBlockHash().ToString(), FormatStateMessage(state));
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            if (!pindex->GetUndoPos().IsNull()) {
-                if (!UndoReadFromDisk(undo, pindex)) {
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-                }
-            }
+        assert(coins.GetBestBlock() == pindex->GetBlockHash());
+        DisconnectResult res = g_chainstate.DisconnectBlock(block, pindex, coins);
+        if (res == DISCONNECT_FAILED) {
+            return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
         }
-        // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
-            assert(coins.GetBestBlock() == pindex->GetBlockHash());
-            DisconnectResult res = g_chainstate.DisconnectBlock(block, pindex, coins);
-            if (res == DISCONNECT_FAILED) {
-                return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-            }
-            pindexState = pindex->pprev;
-            if (res == DISCONNECT_UNCLEAN) {
-                nGoodTransactions = 0;
-                pindexFailure = pindex;
-            } else {
-                nGoodTransactions += block.vtx.size();
-            }
+        pindexState = pindex->pprev;
+        if (res == DISCONNECT_UNCLEAN) {
+            nGoodTransactions = 0;
+            pindexFailure = pindex;
+        } else {
+            nGoodTransactions += block.vtx.size();
         }
         if (ShutdownRequested())
             return true;
@@ -3660,7 +4706,8 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         }
     }
 
-    LogPrintf("[DONE].\n");
+    if (!fBackground)
+        LogPrintf("[DONE].\n");
     LogPrintf("No coin database inconsistencies in last %i blocks (%i transactions)\n", chainActive.Height() - pindexState->nHeight, nGoodTransactions);
 
     return true;
@@ -3852,6 +4899,8 @@ void CChainState::UnloadBlockIndex() {
     nBlockSequenceId = 1;
     g_failed_blocks.clear();
     setBlockIndexCandidates.clear();
+    utxoCommitment = CUTXOCommitment();
+    fHaveUTXOCommitment = false;
 }
 
 // May NOT be used after any connections are up as much
@@ -3896,9 +4945,6 @@ bool LoadBlockIndex(const CChainParams& chainparams)
         // needs_init.
 
         LogPrintf("Initializing databases...\n");
-        // Use the provided setting for -txindex in the new database
-        fTxIndex = true; // donu: txindex is always enabled
-        pblocktree->WriteFlag("txindex", fTxIndex);
     }
     return true;
 }
@@ -3935,18 +4981,268 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return g_chainstate.LoadGenesisBlock(chainparams);
 }
 
+namespace {
+/** A block record read from an external block file, prepared for acceptance by a worker thread */
+struct CImportedBlock
+{
+    CDiskBlockPos pos;
+    std::vector<unsigned char> vData;
+    std::shared_ptr<CBlock> pblock; // null if the record could not be deserialized
+    uint256 hash;
+    std::string strError;
+    int nCheckedHeight; // chain height CheckBlock passed at, or -1
+    bool fReady;
+
+    CImportedBlock(const CDiskBlockPos& posIn, unsigned int nSize) : pos(posIn), vData(nSize), nCheckedHeight(-1), fReady(false) {}
+
+    /** nChainHeight is the height of the active chain as last seen by the
+     *  acceptance stage. It may be out of date by the time the block is
+     *  accepted; the acceptance stage then has CheckBlock run again. */
+    void Prepare(const CChainParams& chainparams, int nChainHeight)
+    {
+        try {
+            std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+            CSpanReader reader(SER_DISK, CLIENT_VERSION, vData.data(), vData.size());
+            reader >> *pblockNew;
+            hash = pblockNew->GetHash();
+            pblock = pblockNew;
+        } catch (const std::exception& e) {
+            strError = e.what();
+            return;
+        }
+
+        // The coinbase reward check in CheckBlock depends on the height of
+        // the active chain, so the cached result is only good for as long as
+        // that height does not change.
+        CValidationState state;
+        if (!CheckBlock(*pblock, state, chainparams.GetConsensus(), true, true, true, nChainHeight + 1)) {
+            // fChecked is set before the block signature is checked; leave
+            // the failure to be found and recorded again by AcceptBlock.
+            pblock->fChecked = false;
+            return;
+        }
+        nCheckedHeight = nChainHeight;
+    }
+};
+
+/**
+ * Queue of block records read from an external block file. Records are
+ * deserialized, hashed and checked on worker threads and handed back in file
+ * order, so that the acceptance stage behaves as if it read them itself.
+ */
+class CBlockImportQueue
+{
+private:
+    static const size_t MAX_QUEUED_BLOCKS = 256;
+    static const size_t MAX_QUEUED_BYTES = 64 << 20;
+
+    const CChainParams& chainparams;
+    CWaitableCriticalSection cs;
+    CConditionVariable condWork;
+    CConditionVariable condReady;
+    std::deque<std::shared_ptr<CImportedBlock> > queueWork;
+    std::deque<std::shared_ptr<CImportedBlock> > queueOrdered;
+    size_t nBytesQueued;
+    std::atomic<int> nChainHeight;
+    bool fQuit;
+    std::vector<std::thread> threads;
+
+    void Loop()
+    {
+        while (true) {
+            std::shared_ptr<CImportedBlock> item;
+            {
+                WaitableLock lock(cs);
+                condWork.wait(lock, [this] { return fQuit || !queueWork.empty(); });
+                if (fQuit)
+                    return;
+                item = queueWork.front();
+                queueWork.pop_front();
+            }
+            item->Prepare(chainparams, nChainHeight);
+            {
+                WaitableLock lock(cs);
+                item->fReady = true;
+            }
+            condReady.notify_all();
+        }
+    }
+
+public:
+    CBlockImportQueue(const CChainParams& chainparamsIn, int nThreads, int nChainHeightIn) : chainparams(chainparamsIn), nBytesQueued(0), nChainHeight(nChainHeightIn), fQuit(false)
+    {
+        for (int i = 0; i < nThreads; i++) {
+            threads.emplace_back([this] {
+                RenameThread("donu-loadblk");
+                Loop();
+            });
+        }
+    }
+
+    ~CBlockImportQueue()
+    {
+        {
+            WaitableLock lock(cs);
+            fQuit = true;
+        }
+        condWork.notify_all();
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    void Push(const std::shared_ptr<CImportedBlock>& item)
+    {
+        {
+            WaitableLock lock(cs);
+            queueWork.push_back(item);
+            queueOrdered.push_back(item);
+            nBytesQueued += item->vData.size();
+        }
+        condWork.notify_one();
+    }
+
+    bool IsFull()
+    {
+        WaitableLock lock(cs);
+        return queueOrdered.size() >= MAX_QUEUED_BLOCKS || nBytesQueued >= MAX_QUEUED_BYTES;
+    }
+
+    bool IsEmpty()
+    {
+        WaitableLock lock(cs);
+        return queueOrdered.empty();
+    }
+
+    /** Set the active chain height that records are checked against from now on */
+    void SetChainHeight(int nHeight) { nChainHeight = nHeight; }
+
+    /** Wait for the oldest record to be prepared and remove it from the queue */
+    std::shared_ptr<CImportedBlock> Pop()
+    {
+        WaitableLock lock(cs);
+        condReady.wait(lock, [this] { return queueOrdered.front()->fReady; });
+        std::shared_ptr<CImportedBlock> item = queueOrdered.front();
+        queueOrdered.pop_front();
+        nBytesQueued -= item->vData.size();
+        return item;
+    }
+};
+} // namespace
+
+// Map of disk positions for blocks with unknown parent (only used for reindex)
+static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+
+/** Accept a prepared block record. Returns false if importing should stop. */
+static bool AcceptImportedBlock(const CChainParams& chainparams, CImportedBlock& item, bool fHavePos, int& nLoaded)
+{
+    if (!item.pblock) {
+        LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, item.strError);
+        return true;
+    }
+
+    try {
+        std::shared_ptr<CBlock> pblock = item.pblock;
+        const CBlock& block = *pblock;
+        const uint256& hash = item.hash;
+        const CDiskBlockPos* dbp = fHavePos ? &item.pos : nullptr;
+
+        // detect out of order blocks, and store them for later
+        if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+            LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                    block.hashPrevBlock.ToString());
+            if (dbp)
+                mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+            return true;
+        }
+
+        // process in case the block isn't known yet
+        if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+            LOCK(cs_main);
+            if (chainActive.Height() != item.nCheckedHeight)
+                pblock->fChecked = false;
+            CValidationState state;
+            if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr, false))
+                nLoaded++;
+            if (state.IsError())
+                return false;
+        } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+            LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+        }
+
+        // Activate the genesis block so normal node progress can continue
+        if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+            CValidationState state;
+            if (!ActivateBestChain(state, chainparams)) {
+                return false;
+            }
+        }
+
+        NotifyHeaderTip();
+
+        // Recursively process earlier encountered successors of this block
+        std::deque<uint256> queue;
+        queue.push_back(hash);
+        while (!queue.empty()) {
+            uint256 head = queue.front();
+            queue.pop_front();
+            std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+            while (range.first != range.second) {
+                std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+                if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
+                {
+                    LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                            head.ToString());
+                    LOCK(cs_main);
+                    CValidationState dummy;
+                    if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr, false))
+                    {
+                        nLoaded++;
+                        queue.push_back(pblockrecursive->GetHash());
+                    }
+                }
+                range.first++;
+                mapBlocksUnknownParent.erase(it);
+                NotifyHeaderTip();
+            }
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+    }
+    return true;
+}
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
     try {
+        // Deserializing, hashing and checking blocks is spread over worker
+        // threads; only header scanning and acceptance happen on this one.
+        // The workers check against the chain height seen here, so they
+        // never need cs_main.
+        int nChainHeight;
+        {
+            LOCK(cs_main);
+            nChainHeight = chainActive.Height();
+        }
+        CBlockImportQueue importqueue(chainparams, std::max(1, nScriptCheckThreads), nChainHeight);
+        bool fStop = false;
+        auto acceptQueued = [&](bool fDrain) {
+            while (!fStop && !importqueue.IsEmpty() && (fDrain || importqueue.IsFull())) {
+                std::shared_ptr<CImportedBlock> item = importqueue.Pop();
+                if (!AcceptImportedBlock(chainparams, *item, dbp != nullptr, nLoaded))
+                    fStop = true;
+                LOCK(cs_main);
+                importqueue.SetChainHeight(chainActive.Height());
+            }
+        };
+
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        while (!blkdat.eof() && !fStop) {
             boost::this_thread::interruption_point();
 
             blkdat.SetPos(nRewind);
@@ -3972,78 +5268,24 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
             try {
                 // read block
                 uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
+                CDiskBlockPos pos;
+                if (dbp) {
                     dbp->nPos = nBlockPos;
+                    pos = *dbp;
+                }
                 blkdat.SetLimit(nBlockPos + nSize);
                 blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
+                std::shared_ptr<CImportedBlock> item = std::make_shared<CImportedBlock>(pos, nSize);
+                blkdat.read((char*)item->vData.data(), nSize);
                 nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr, false))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
-
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
-                }
-
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr, false))
-                            {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
-                }
+                importqueue.Push(item);
             } catch (const std::exception& e) {
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+
+            acceptQueued(false);
         }
+        acceptQueued(true);
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
@@ -4412,37 +5654,20 @@ bool GetCoinAge(const CTransaction& tx, const CCoinsViewCache &view, uint64_t& n
         if (tx.nTime < coin.nTime)
             return false;  // Transaction timestamp violation
 
-        // Transaction index is required to get to block header
-        if (!fTxIndex)
-            return false;  // Transaction index not available
+        // The coin records the height and timestamp of its transaction, so
+        // the block header comes from the block index rather than from disk
+        const CBlockIndex* pindexFrom = chainActive[coin.nHeight];
+        if (!pindexFrom)
+            return error("%s() : tx missing in active chain in GetCoinAge()", __PRETTY_FUNCTION__);
 
-        CDiskTxPos postx;
-        CTransactionRef txPrev;
-        if (pblocktree->ReadTxIndex(prevout.hash, postx))
-        {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            CBlockHeader header;
-            try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txPrev;
-            } catch (std::exception &e) {
-                return error("%s() : deserialize or I/O error in GetCoinAge()", __PRETTY_FUNCTION__);
-            }
-            if (txPrev->GetHash() != prevout.hash)
-                return error("%s() : txid mismatch in GetCoinAge()", __PRETTY_FUNCTION__);
-
-            if (header.GetBlockTime() + Params().GetConsensus().nStakeMinAge > tx.nTime)
-                continue; // only count coins meeting min age requirement
+        if (pindexFrom->GetBlockTime() + Params().GetConsensus().nStakeMinAge > tx.nTime)
+            continue; // only count coins meeting min age requirement
 
-            int64_t nValueIn = txPrev->vout[txin.prevout.n].nValue;
-            bnCentSecond += arith_uint256(nValueIn) * (tx.nTime-txPrev->nTime) / CENT;
+        int64_t nValueIn = coin.out.nValue;
+        bnCentSecond += arith_uint256(nValueIn) * (tx.nTime-coin.nTime) / CENT;
 
-            if (gArgs.GetBoolArg("-printcoinage", false))
-                LogPrintf("coin age nValueIn=%-12lld nTimeDiff=%d bnCentSecond=%s\n", nValueIn, tx.nTime - txPrev->nTime, bnCentSecond.ToString());
-        }
-        else
-            return error("%s() : tx missing in tx index in GetCoinAge()", __PRETTY_FUNCTION__);
+        if (gArgs.GetBoolArg("-printcoinage", false))
+            LogPrintf("coin age nValueIn=%-12lld nTimeDiff=%d bnCentSecond=%s\n", nValueIn, tx.nTime - coin.nTime, bnCentSecond.ToString());
     }
 
     arith_uint256 bnCoinDay = bnCentSecond * CENT / COIN / (24 * 60 * 60);
@@ -4466,16 +5691,51 @@ bool SignBlock(CBlock& block, const CKeyStore& keystore)
     {
         // Sign
         const valtype& vchPubKey = vSolutions[0];
+        const CKeyID keyid(Hash160(vchPubKey));
         CKey key;
-        if (!keystore.GetKey(CKeyID(Hash160(vchPubKey)), key))
+        if (!keystore.GetKey(keyid, key))
             return false;
-        if (key.GetPubKey() != CPubKey(vchPubKey))
+        // An encrypted wallet checks its keys against the stored public key
+        // when decrypting them, so ask for that rather than deriving it again.
+        CPubKey pubkey;
+        if (!keystore.GetPubKey(keyid, pubkey) || pubkey != CPubKey(vchPubKey))
             return false;
         return key.Sign(block.GetHash(), block.vchBlockSig);
     }
     return false;
 }
 
+/** Number of block signers whose parsed public keys are kept */
+static const size_t BLOCK_SIGNER_CACHE_SIZE = 64;
+
+/** Parsed public keys of recent block signers, most recently used first.
+ *  Stakers sign many blocks with the same key, which saves parsing (and for
+ *  compressed keys, decompressing) it for every block. */
+static std::mutex g_block_signers_mutex;
+static std::list<std::pair<valtype, CParsedPubKey> > g_block_signers;
+
+static CParsedPubKey GetBlockSignerKey(const valtype& vchPubKey)
+{
+    {
+        std::lock_guard<std::mutex> lock(g_block_signers_mutex);
+        for (auto it = g_block_signers.begin(); it != g_block_signers.end(); ++it) {
+            if (it->first == vchPubKey) {
+                g_block_signers.splice(g_block_signers.begin(), g_block_signers, it);
+                return it->second;
+            }
+        }
+    }
+    // Parse outside the lock; a key that fails to parse is not cached.
+    CParsedPubKey key{CPubKey(vchPubKey)};
+    if (key.IsValid()) {
+        std::lock_guard<std::mutex> lock(g_block_signers_mutex);
+        g_block_signers.emplace_front(vchPubKey, key);
+        if (g_block_signers.size() > BLOCK_SIGNER_CACHE_SIZE)
+            g_block_signers.pop_back();
+    }
+    return key;
+}
+
 // donu: check block signature
 bool CheckBlockSignature(const CBlock& block)
 {
@@ -4491,10 +5751,9 @@ bool CheckBlockSignature(const CBlock& block)
     if (whichType == TX_PUBKEY)
     {
         const valtype& vchPubKey = vSolutions[0];
-        CPubKey key(vchPubKey);
         if (block.vchBlockSig.empty())
             return false;
-        return key.Verify(block.GetHash(), block.vchBlockSig);
+        return GetBlockSignerKey(vchPubKey).Verify(block.GetHash(), block.vchBlockSig);
     }
     return false;
 }
@@ -31,9 +31,11 @@
 #include <atomic>
 
 class CBlockIndex;
+class CBlockUndo;
 class CBlockTreeDB;
 class CChainParams;
 class CCoinsViewDB;
+class CMappedFileCache;
 class CInv;
 class CConnman;
 class CScriptCheck;
@@ -43,6 +45,7 @@ class CKeyStore;
 struct ChainTxData;
 
 struct PrecomputedTransactionData;
+struct ScriptCacheStats;
 struct LockPoints;
 
 /** Default for accepting alerts from the P2P network. */
@@ -140,6 +143,8 @@ static const bool DEFAULT_PEERBLOOMFILTERS = true;
 
 /** Default for -stopatheight */
 static const int DEFAULT_STOPATHEIGHT = 0;
+/** Default for -blockfilemaps; 32-bit builds don't have the address space to spare */
+static const unsigned int DEFAULT_BLOCKFILE_MAPS = sizeof(void*) > 4 ? 64 : 0;
 
 struct BlockHasher
 {
@@ -160,11 +165,12 @@ extern uint256 hashBestBlock;
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
-extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/** Whether new undo data is written with the compact encoding (-compactundo) */
+extern bool fCompactUndo;
 extern size_t nCoinCacheUsage;
 extern bool fAlerts;
 /** If the tip is older than this (in seconds), the node is considered to be in initial block download. */
@@ -179,6 +185,14 @@ extern arith_uint256 nMinimumChainWork;
 /** Best header we've seen so far (used for getheaders queries' starting points). */
 extern CBlockIndex *pindexBestHeader;
 
+/** Pruning-related variables and constants */
+/** True if any block files have ever been pruned. */
+extern bool fHavePruned;
+/** True if we're running in -prune mode. */
+extern bool fPruneMode;
+/** Number of MiB of block files that we're trying to stay below. */
+extern uint64_t nPruneTarget;
+
 /** Minimum disk space required - used in CheckDiskSpace() */
 static const uint64_t nMinDiskSpace = 52428800;
 
@@ -190,6 +204,10 @@ static const unsigned int NODE_NETWORK_LIMITED_MIN_BLOCKS = 288;
 
 static const signed int DEFAULT_CHECKBLOCKS = 6;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
+/** Whether the block file checks of VerifyDB finish in the background at startup */
+static const bool DEFAULT_CHECKBLOCKS_BACKGROUND = false;
+/** Default for -compactundo */
+static const bool DEFAULT_COMPACT_UNDO = false;
 
 // Require that user allocate at least 550MB for block & undo files (blk???.dat and rev???.dat)
 // At 1MB per block, 288 blocks = 288MB.
@@ -250,6 +268,12 @@ bool LoadGenesisBlock(const CChainParams& chainparams);
 bool LoadBlockIndex(const CChainParams& chainparams);
 /** Update the chain tip based on database information. */
 bool LoadChainTip(const CChainParams& chainparams);
+/** Load the UTXO set commitment stored with the coins database, rebuilding it
+ * from a full scan if it does not match pcoinsTip's best block. The scan reads
+ * the whole UTXO set under cs_main, so this is only meant to run at startup. */
+bool LoadUTXOCommitment();
+/** Copy the UTXO set commitment of pcoinsTip and the block it commits to. */
+bool GetUTXOCommitment(CUTXOCommitment& commitment, uint256& hashBlock);
 /** Unload database information */
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
@@ -259,6 +283,8 @@ bool IsInitialBlockDownload();
 void AlertNotify(const std::string& strMessage, bool fUpdateUI = true);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransactionRef& tx, const Consensus::Params& params, uint256& hashBlock, bool fAllowSlow = false, CBlockIndex* blockIndex = nullptr);
+/** Find a coin as it was before it was spent by a block of the active chain after pindexFork, using the undo data of those blocks */
+bool GetCoinSpentSince(const COutPoint& outpoint, const CBlockIndex* pindexFork, Coin& coin);
 /** Find the best known block, and make it the tip of the block chain */
 bool ActivateBestChain(CValidationState& state, const CChainParams& chainparams, std::shared_ptr<const CBlock> pblock = std::shared_ptr<const CBlock>());
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
@@ -364,15 +390,33 @@ public:
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
+/** Get the script execution cache counters; counting the entries scans the cache. */
+void GetScriptExecutionCacheStats(ScriptCacheStats& stats, bool fCountEntries = false);
+
 
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read a block, sharing it with the recent block cache (see blockcache.h). Locks cs_main on a cache miss. */
+bool ReadBlockFromDisk(std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read a block from a position taken from its block index entry beforehand, without locking cs_main */
+bool ReadBlockFromDisk(std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const CDiskBlockPos& blockPos, const Consensus::Params& consensusParams);
+/** Read the serialized bytes of a block as stored on disk (and as relayed with witness data), without deserializing it */
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start);
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+/** Read the undo data of a block, which records the coins its transactions spent */
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
+/** Read the undo data of a block, sharing it with the recent undo data cache (see blockcache.h). Locks cs_main on a cache miss. */
+bool UndoReadFromDisk(std::shared_ptr<const CBlockUndo>& pblockundo, const CBlockIndex* pindex);
+/** Read the undo data of a block from its position and BLOCK_UNDO_COMPACT flag, taken from its block index entry beforehand, without locking cs_main */
+bool UndoReadFromDisk(std::shared_ptr<const CBlockUndo>& pblockundo, const CBlockIndex* pindex, const CDiskBlockPos& undoPos, bool fCompact);
 
 /** Functions for validating blocks and updating the block tree */
 
-/** Context-independent validity checks */
-bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSignature = true);
+/** Context-independent validity checks. The coinbase reward is checked at
+ *  nHeight, or, if that is -1, at the height after the active tip, which
+ *  takes cs_main. */
+bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSignature = true, int nHeight = -1);
 
 /** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
 bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
@@ -394,9 +438,19 @@ class CVerifyDB {
 public:
     CVerifyDB();
     ~CVerifyDB();
-    bool VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth);
+    /** Levels 0 to 2 (block read, CheckBlock, undo read) run on nThreads
+     *  threads. With fBackground they are left running when VerifyDB
+     *  returns, and a failure found later aborts the node. */
+    bool VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth, int nThreads = 1, bool fBackground = false);
 };
 
+/** Progress of the block checks VerifyDB left running in the background.
+ *  Returns false if none are running. */
+bool GetBackgroundVerifyProgress(size_t& nChecked, size_t& nTotal);
+
+/** Interrupt the background block checks and wait for them to exit */
+void StopBackgroundVerify();
+
 /** Replay blocks that aren't fully applied to the database. */
 bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
 
@@ -412,6 +466,26 @@ bool InvalidateBlock(CValidationState& state, const CChainParams& chainparams, C
 /** Remove invalidity status from a block and its descendants. */
 bool ResetBlockFailureFlags(CBlockIndex *pindex);
 
+/** Timings of a chain reorganization, one step of ActivateBestChain that
+ *  disconnected blocks before connecting those of a better chain */
+struct ReorgStats
+{
+    int64_t nTime = 0;
+    int nForkHeight = -1;
+    int nDisconnected = 0;
+    int nConnected = 0;
+    int64_t nDisconnectMicros = 0;
+    int64_t nConnectMicros = 0;
+    //! Time spent re-adding the disconnected transactions to the mempool
+    int64_t nMempoolMicros = 0;
+    uint256 hashOldTip;
+    uint256 hashNewTip;
+};
+
+/** The most recent reorg, along with the number of reorgs since startup and
+ *  the most blocks any of them disconnected. Returns false if there was none. */
+bool GetReorgStats(ReorgStats& stats, uint64_t& nReorgs, int& nMaxDepth);
+
 /** The currently-connected chain of blocks (protected by cs_main). */
 extern CChain& chainActive;
 
@@ -424,6 +498,9 @@ extern std::unique_ptr<CCoinsViewCache> pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern std::unique_ptr<CBlockTreeDB> pblocktree;
 
+/** Memory mappings of finalized block files, used to read blocks without going through stdio */
+extern CMappedFileCache g_mapped_block_files;
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
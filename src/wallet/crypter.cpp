@@ -118,20 +118,21 @@ static bool EncryptSecret(const CKeyingMaterial& vMasterKey, const CKeyingMateri
     return cKeyCrypter.Encrypt(*((const CKeyingMaterial*)&vchPlaintext), vchCiphertext);
 }
 
-static bool DecryptSecret(const CKeyingMaterial& vMasterKey, const std::vector<unsigned char>& vchCiphertext, const uint256& nIV, CKeyingMaterial& vchPlaintext)
+static bool DecryptSecret(const AES256CBCDecrypt& dec, const std::vector<unsigned char>& vchCiphertext, const uint256& nIV, CKeyingMaterial& vchPlaintext)
 {
-    CCrypter cKeyCrypter;
-    std::vector<unsigned char> chIV(WALLET_CRYPTO_IV_SIZE);
-    memcpy(chIV.data(), &nIV, WALLET_CRYPTO_IV_SIZE);
-    if(!cKeyCrypter.SetKey(vMasterKey, chIV))
+    // plaintext will always be equal to or lesser than length of ciphertext
+    vchPlaintext.resize(vchCiphertext.size());
+    int nLen = dec.Decrypt(nIV.begin(), vchCiphertext.data(), vchCiphertext.size(), vchPlaintext.data());
+    if (nLen == 0)
         return false;
-    return cKeyCrypter.Decrypt(vchCiphertext, *((CKeyingMaterial*)&vchPlaintext));
+    vchPlaintext.resize(nLen);
+    return true;
 }
 
-static bool DecryptKey(const CKeyingMaterial& vMasterKey, const std::vector<unsigned char>& vchCryptedSecret, const CPubKey& vchPubKey, CKey& key)
+static bool DecryptKey(const AES256CBCDecrypt& dec, const std::vector<unsigned char>& vchCryptedSecret, const CPubKey& vchPubKey, CKey& key)
 {
     CKeyingMaterial vchSecret;
-    if(!DecryptSecret(vMasterKey, vchCryptedSecret, vchPubKey.GetHash(), vchSecret))
+    if(!DecryptSecret(dec, vchCryptedSecret, vchPubKey.GetHash(), vchSecret))
         return false;
 
     if (vchSecret.size() != 32)
@@ -141,6 +142,14 @@ static bool DecryptKey(const CKeyingMaterial& vMasterKey, const std::vector<unsi
     return key.VerifyPubKey(vchPubKey);
 }
 
+static bool DecryptKey(const CKeyingMaterial& vMasterKey, const std::vector<unsigned char>& vchCryptedSecret, const CPubKey& vchPubKey, CKey& key)
+{
+    if (vMasterKey.size() != WALLET_CRYPTO_KEY_SIZE)
+        return false;
+    AES256CBCDecrypt dec(vMasterKey.data(), true);
+    return DecryptKey(dec, vchCryptedSecret, vchPubKey, key);
+}
+
 bool CCryptoKeyStore::SetCrypted()
 {
     LOCK(cs_KeyStore);
@@ -169,6 +178,8 @@ bool CCryptoKeyStore::Lock()
     {
         LOCK(cs_KeyStore);
         vMasterKey.clear();
+        mapDecryptedKeys.clear();
+        listDecryptedKeys.clear();
     }
 
     NotifyStatusChanged(this);
@@ -182,6 +193,12 @@ bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
         if (!SetCrypted())
             return false;
 
+        if (vMasterKeyIn.size() != WALLET_CRYPTO_KEY_SIZE)
+            return false;
+
+        // Every key is encrypted under the master key with its own IV, so
+        // expand the master key once for all of them.
+        AES256CBCDecrypt dec(vMasterKeyIn.data(), true);
         bool keyPass = false;
         bool keyFail = false;
         CryptedKeyMap::const_iterator mi = mapCryptedKeys.begin();
@@ -190,7 +207,7 @@ bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
             const CPubKey &vchPubKey = (*mi).second.first;
             const std::vector<unsigned char> &vchCryptedSecret = (*mi).second.second;
             CKey key;
-            if (!DecryptKey(vMasterKeyIn, vchCryptedSecret, vchPubKey, key))
+            if (!DecryptKey(dec, vchCryptedSecret, vchPubKey, key))
             {
                 keyFail = true;
                 break;
@@ -220,13 +237,8 @@ bool CCryptoKeyStore::AddKeyPubKey(const CKey& key, const CPubKey &pubkey)
         return CBasicKeyStore::AddKeyPubKey(key, pubkey);
     }
 
-    if (IsLocked()) {
-        return false;
-    }
-
     std::vector<unsigned char> vchCryptedSecret;
-    CKeyingMaterial vchSecret(key.begin(), key.end());
-    if (!EncryptSecret(vMasterKey, vchSecret, pubkey.GetHash(), vchCryptedSecret)) {
+    if (!EncryptKey(key, pubkey, vchCryptedSecret)) {
         return false;
     }
 
@@ -236,6 +248,17 @@ bool CCryptoKeyStore::AddKeyPubKey(const CKey& key, const CPubKey &pubkey)
     return true;
 }
 
+bool CCryptoKeyStore::EncryptKey(const CKey& key, const CPubKey& pubkey, std::vector<unsigned char>& vchCryptedSecret) const
+{
+    LOCK(cs_KeyStore);
+    if (IsLocked()) {
+        return false;
+    }
+
+    CKeyingMaterial vchSecret(key.begin(), key.end());
+    return EncryptSecret(vMasterKey, vchSecret, pubkey.GetHash(), vchCryptedSecret);
+}
+
 
 bool CCryptoKeyStore::AddCryptedKey(const CPubKey &vchPubKey, const std::vector<unsigned char> &vchCryptedSecret)
 {
@@ -265,12 +288,27 @@ bool CCryptoKeyStore::GetKey(const CKeyID &address, CKey& keyOut) const
         return CBasicKeyStore::GetKey(address, keyOut);
     }
 
+    auto it = mapDecryptedKeys.find(address);
+    if (it != mapDecryptedKeys.end()) {
+        listDecryptedKeys.splice(listDecryptedKeys.begin(), listDecryptedKeys, it->second);
+        keyOut = it->second->second;
+        return true;
+    }
+
     CryptedKeyMap::const_iterator mi = mapCryptedKeys.find(address);
     if (mi != mapCryptedKeys.end())
     {
         const CPubKey &vchPubKey = (*mi).second.first;
         const std::vector<unsigned char> &vchCryptedSecret = (*mi).second.second;
-        return DecryptKey(vMasterKey, vchCryptedSecret, vchPubKey, keyOut);
+        if (!DecryptKey(vMasterKey, vchCryptedSecret, vchPubKey, keyOut))
+            return false;
+        if (listDecryptedKeys.size() >= WALLET_DECRYPTED_KEY_CACHE_SIZE) {
+            mapDecryptedKeys.erase(listDecryptedKeys.back().first);
+            listDecryptedKeys.pop_back();
+        }
+        listDecryptedKeys.emplace_front(address, keyOut);
+        mapDecryptedKeys.emplace(address, listDecryptedKeys.begin());
+        return true;
     }
     return false;
 }
@@ -10,10 +10,14 @@
 #include <support/allocators/secure.h>
 
 #include <atomic>
+#include <list>
+#include <map>
 
 const unsigned int WALLET_CRYPTO_KEY_SIZE = 32;
 const unsigned int WALLET_CRYPTO_SALT_SIZE = 8;
 const unsigned int WALLET_CRYPTO_IV_SIZE = 16;
+//! Number of decrypted keys an unlocked wallet keeps around
+const unsigned int WALLET_DECRYPTED_KEY_CACHE_SIZE = 256;
 
 /**
  * Private key encryption is done based on a CMasterKey,
@@ -125,6 +129,15 @@ private:
     //! keeps track of whether Unlock has run a thorough check before
     bool fDecryptionThoroughlyChecked;
 
+    //! Keys decrypted and checked against their public key since the last
+    //! unlock, so keys that sign repeatedly (such as the staking keys) are
+    //! not decrypted every time. CKey keeps the secrets in locked memory.
+    //! The list is ordered from most to least recently used, which is the
+    //! one dropped when the cache is full; the map indexes it.
+    typedef std::list<std::pair<CKeyID, CKey> > DecryptedKeyList;
+    mutable DecryptedKeyList listDecryptedKeys;
+    mutable std::map<CKeyID, DecryptedKeyList::iterator> mapDecryptedKeys;
+
 protected:
     bool SetCrypted();
 
@@ -134,6 +147,10 @@ protected:
     bool Unlock(const CKeyingMaterial& vMasterKeyIn);
     CryptedKeyMap mapCryptedKeys;
 
+    //! Encrypt a key with the master key, as AddKeyPubKey stores it. Fails if
+    //! the store is locked.
+    bool EncryptKey(const CKey& key, const CPubKey& pubkey, std::vector<unsigned char>& vchCryptedSecret) const;
+
 public:
     CCryptoKeyStore() : fUseCrypto(false), fDecryptionThoroughlyChecked(false)
     {
@@ -85,6 +85,19 @@ void EnsureWalletIsUnlocked(CWallet * const pwallet)
         throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: Wallet unlocked for block minting only.");
 }
 
+void EnsureRescanNotPruned(const CBlockIndex* pindexStart, const CBlockIndex* pindexStop)
+{
+    AssertLockHeld(cs_main);
+
+    if (!fPruneMode)
+        return;
+    for (const CBlockIndex* block = pindexStop ? pindexStop : chainActive.Tip(); block && block->nHeight >= pindexStart->nHeight; block = block->pprev) {
+        if (!(block->nStatus & BLOCK_HAVE_DATA)) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Can't rescan beyond pruned data. Use RPC call getblockchaininfo to determine your pruned height.");
+        }
+    }
+}
+
 void WalletTxToJSON(const CWalletTx& wtx, UniValue& entry)
 {
     int confirms = wtx.GetDepthInMainChain();
@@ -2252,6 +2265,7 @@ UniValue keypoolrefill(const JSONRPCRequest& request)
             "keypoolrefill ( newsize )\n"
             "\nFills the keypool."
             + HelpRequiringPassphrase(pwallet) + "\n"
+            "Keys are generated and stored in batches of 1000, each of which is logged.\n"
             "\nArguments\n"
             "1. newsize     (numeric, optional, default=100) The new keypool size\n"
             "\nExamples:\n"
@@ -3296,6 +3310,9 @@ UniValue rescanblockchain(const JSONRPCRequest& request)
                 throw JSONRPCError(RPC_INVALID_PARAMETER, "stop_height must be greater then start_height");
             }
         }
+
+        // We can't rescan beyond non-pruned blocks, stop and throw an error
+        EnsureRescanNotPruned(pindexStart, pindexStop);
     }
 
     CBlockIndex *stopBlock = pwallet->ScanForWalletTransactions(pindexStart, pindexStop, reserver, true);
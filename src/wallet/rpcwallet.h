@@ -7,6 +7,7 @@
 
 #include <string>
 
+class CBlockIndex;
 class CRPCTable;
 class CWallet;
 class JSONRPCRequest;
@@ -24,5 +25,7 @@ CWallet *GetWalletForJSONRPCRequest(const JSONRPCRequest& request);
 std::string HelpRequiringPassphrase(CWallet *);
 void EnsureWalletIsUnlocked(CWallet *);
 bool EnsureWalletIsAvailable(CWallet *, bool avoidException);
+/** Throw unless the blocks of the active chain from pindexStart up to pindexStop, or the tip if null, are all on disk. Requires cs_main. */
+void EnsureRescanNotPruned(const CBlockIndex* pindexStart, const CBlockIndex* pindexStop);
 
 #endif //BITCOIN_WALLET_RPCWALLET_H
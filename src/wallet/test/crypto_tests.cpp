@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <random.h>
 #include <test/test_bitcoin.h>
 #include <utilstrencodings.h>
 #include <wallet/crypter.h>
@@ -123,4 +124,65 @@ BOOST_AUTO_TEST_CASE(decrypt) {
     }
 }
 
+class TestCryptoKeyStore : public CCryptoKeyStore
+{
+public:
+    using CCryptoKeyStore::EncryptKeys;
+    using CCryptoKeyStore::Unlock;
+};
+
+BOOST_AUTO_TEST_CASE(decrypted_key_cache) {
+    TestCryptoKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    const CKeyID keyid = key.GetPubKey().GetID();
+    BOOST_CHECK(keystore.AddKey(key));
+
+    CKeyingMaterial vMasterKey(WALLET_CRYPTO_KEY_SIZE);
+    GetStrongRandBytes(vMasterKey.data(), vMasterKey.size());
+    BOOST_CHECK(keystore.EncryptKeys(vMasterKey));
+    BOOST_CHECK(keystore.Lock());
+
+    // Keys come back the same whether freshly decrypted or cached, and the
+    // cache does not outlive the unlock.
+    CKey keyOut;
+    BOOST_CHECK(!keystore.GetKey(keyid, keyOut));
+    BOOST_CHECK(keystore.Unlock(vMasterKey));
+    for (int i = 0; i < 2; i++) {
+        BOOST_CHECK(keystore.GetKey(keyid, keyOut));
+        BOOST_CHECK(keyOut == key);
+    }
+    BOOST_CHECK(keystore.Lock());
+    BOOST_CHECK(!keystore.GetKey(keyid, keyOut));
+    BOOST_CHECK(keystore.Unlock(vMasterKey));
+    BOOST_CHECK(keystore.GetKey(keyid, keyOut));
+    BOOST_CHECK(keyOut == key);
+}
+
+BOOST_AUTO_TEST_CASE(decrypted_key_cache_full) {
+    TestCryptoKeyStore keystore;
+    std::vector<CKey> keys(WALLET_DECRYPTED_KEY_CACHE_SIZE + 16);
+    for (CKey& key : keys) {
+        key.MakeNewKey(true);
+        BOOST_CHECK(keystore.AddKey(key));
+    }
+
+    CKeyingMaterial vMasterKey(WALLET_CRYPTO_KEY_SIZE);
+    GetStrongRandBytes(vMasterKey.data(), vMasterKey.size());
+    BOOST_CHECK(keystore.EncryptKeys(vMasterKey));
+    BOOST_CHECK(keystore.Unlock(vMasterKey));
+
+    // Cycle through more keys than the cache holds while one key keeps being
+    // used in between; every lookup must still return the right key.
+    CKey keyOut;
+    for (int round = 0; round < 2; round++) {
+        for (const CKey& key : keys) {
+            BOOST_CHECK(keystore.GetKey(key.GetPubKey().GetID(), keyOut));
+            BOOST_CHECK(keyOut == key);
+            BOOST_CHECK(keystore.GetKey(keys[0].GetPubKey().GetID(), keyOut));
+            BOOST_CHECK(keyOut == keys[0]);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
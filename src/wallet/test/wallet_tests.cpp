@@ -700,4 +700,90 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2);
 }
 
+BOOST_AUTO_TEST_CASE(keypool_topup_hd_batch)
+{
+    // Keys generated in batches are the same children of m/0'/0' and
+    // m/0'/1' that DeriveNewChildKey hands out one by one.
+    LOCK(pwalletMain->cs_wallet);
+    pwalletMain->SetMinVersion(FEATURE_LATEST);
+    BOOST_REQUIRE(pwalletMain->SetHDMasterKey(pwalletMain->GenerateNewHDMasterKey()));
+    BOOST_REQUIRE(pwalletMain->TopUpKeyPool(40));
+    BOOST_CHECK_EQUAL(pwalletMain->KeypoolCountExternalKeys(), 40U);
+    BOOST_CHECK_EQUAL(pwalletMain->GetKeyPoolSize(), 80U);
+
+    const uint32_t HARDENED = 0x80000000;
+    CKey seed;
+    BOOST_REQUIRE(pwalletMain->GetKey(pwalletMain->GetHDChain().masterKeyID, seed));
+    CExtKey masterKey, accountKey;
+    masterKey.SetMaster(seed.begin(), seed.size());
+    masterKey.Derive(accountKey, HARDENED);
+    for (unsigned int chain = 0; chain < 2; chain++) {
+        CExtKey chainKey;
+        accountKey.Derive(chainKey, HARDENED + chain);
+        for (unsigned int i = 0; i < 40; i++) {
+            CExtKey childKey;
+            chainKey.Derive(childKey, i | HARDENED);
+            const CKeyID keyid = childKey.key.GetPubKey().GetID();
+            BOOST_CHECK(pwalletMain->HaveKey(keyid));
+            BOOST_CHECK_EQUAL(pwalletMain->mapKeyMetadata[keyid].hdKeypath, "m/0'/" + std::to_string(chain) + "'/" + std::to_string(i) + "'");
+        }
+    }
+    BOOST_CHECK_EQUAL(pwalletMain->GetHDChain().nExternalChainCounter, 40U);
+    BOOST_CHECK_EQUAL(pwalletMain->GetHDChain().nInternalChainCounter, 40U);
+}
+
+BOOST_AUTO_TEST_CASE(keypool_topup_batch)
+{
+    // Without an HD seed the batch draws random keys, all of which end up in
+    // the wallet and in its key pool.
+    LOCK(pwalletMain->cs_wallet);
+    BOOST_REQUIRE(!pwalletMain->IsHDEnabled());
+    const std::set<CKeyID> setKeysBefore = pwalletMain->GetKeys();
+    BOOST_REQUIRE(pwalletMain->TopUpKeyPool(40));
+    BOOST_CHECK_EQUAL(pwalletMain->KeypoolCountExternalKeys(), 40U);
+    BOOST_CHECK_EQUAL(pwalletMain->GetKeyPoolSize(), 40U);
+
+    const std::set<CKeyID> setKeys = pwalletMain->GetKeys();
+    BOOST_CHECK_EQUAL(setKeys.size(), setKeysBefore.size() + 40);
+    for (const CKeyID& keyid : setKeys) {
+        if (setKeysBefore.count(keyid)) continue;
+        CKey key;
+        BOOST_CHECK(pwalletMain->GetKey(keyid, key));
+        BOOST_CHECK(key.GetPubKey().GetID() == keyid);
+        BOOST_CHECK(pwalletMain->mapKeyMetadata[keyid].hdKeypath.empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(keypool_topup_hd_batches)
+{
+    // A top-up larger than one batch continues the derivation across the
+    // batch boundary.
+    LOCK(pwalletMain->cs_wallet);
+    pwalletMain->SetMinVersion(FEATURE_LATEST);
+    BOOST_REQUIRE(pwalletMain->SetHDMasterKey(pwalletMain->GenerateNewHDMasterKey()));
+    BOOST_REQUIRE(pwalletMain->TopUpKeyPool(1500));
+    BOOST_CHECK_EQUAL(pwalletMain->KeypoolCountExternalKeys(), 1500U);
+    BOOST_CHECK_EQUAL(pwalletMain->GetKeyPoolSize(), 3000U);
+
+    const uint32_t HARDENED = 0x80000000;
+    CKey seed;
+    BOOST_REQUIRE(pwalletMain->GetKey(pwalletMain->GetHDChain().masterKeyID, seed));
+    CExtKey masterKey, accountKey;
+    masterKey.SetMaster(seed.begin(), seed.size());
+    masterKey.Derive(accountKey, HARDENED);
+    for (unsigned int chain = 0; chain < 2; chain++) {
+        CExtKey chainKey;
+        accountKey.Derive(chainKey, HARDENED + chain);
+        for (unsigned int i : {0U, 999U, 1000U, 1499U}) {
+            CExtKey childKey;
+            chainKey.Derive(childKey, i | HARDENED);
+            const CKeyID keyid = childKey.key.GetPubKey().GetID();
+            BOOST_CHECK(pwalletMain->HaveKey(keyid));
+            BOOST_CHECK_EQUAL(pwalletMain->mapKeyMetadata[keyid].hdKeypath, "m/0'/" + std::to_string(chain) + "'/" + std::to_string(i) + "'");
+        }
+    }
+    BOOST_CHECK_EQUAL(pwalletMain->GetHDChain().nExternalChainCounter, 1500U);
+    BOOST_CHECK_EQUAL(pwalletMain->GetHDChain().nInternalChainCounter, 1500U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -30,10 +30,11 @@
 
 #include <kernel.h>
 #include <bignum.h>
-#include <txdb.h>
+#include <index/txindex.h>
 
 #include <assert.h>
 #include <future>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -47,6 +48,8 @@ OutputType g_change_type = OUTPUT_TYPE_NONE;
 
 const char * DEFAULT_WALLET_DAT = "wallet.dat";
 const uint32_t BIP32_HARDENED_KEY_LIMIT = 0x80000000;
+//! Keys TopUpKeyPool generates per database transaction
+static const int64_t KEYPOOL_BATCH_SIZE = 1000;
 
 const uint256 CMerkleTx::ABANDON_HASH(uint256S("0000000000000000000000000000000000000000000000000000000000000001"));
 
@@ -168,14 +171,12 @@ CPubKey CWallet::GenerateNewKey(CWalletDB &walletdb, bool internal)
     return pubkey;
 }
 
-void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKey& secret, bool internal)
+void CWallet::DeriveChainKey(CExtKey& chainChildKey, bool internal)
 {
     // for now we use a fixed keypath scheme of m/0'/0'/k
     CKey key;                      //master key seed (256bit)
     CExtKey masterKey;             //hd master key
     CExtKey accountKey;            //key at m/0'
-    CExtKey chainChildKey;         //key at m/0'/0' (external) or m/0'/1' (internal)
-    CExtKey childKey;              //key at m/0'/0'/<n>'
 
     // try to get the master key
     if (!GetKey(hdChain.masterKeyID, key))
@@ -190,6 +191,14 @@ void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKe
     // derive m/0'/0' (external chain) OR m/0'/1' (internal chain)
     assert(internal ? CanSupportFeature(FEATURE_HD_SPLIT) : true);
     accountKey.Derive(chainChildKey, BIP32_HARDENED_KEY_LIMIT+(internal ? 1 : 0));
+}
+
+void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKey& secret, bool internal)
+{
+    CExtKey chainChildKey;         //key at m/0'/0' (external) or m/0'/1' (internal)
+    CExtKey childKey;              //key at m/0'/0'/<n>'
+
+    DeriveChainKey(chainChildKey, internal);
 
     // derive child key at next index, skip keys already known to the wallet
     do {
@@ -214,6 +223,135 @@ void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKe
         throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
 }
 
+/** Fewest new keys worth handing to another thread */
+static const size_t MIN_NEW_KEYS_PER_THREAD = 16;
+
+/** Compute the public keys of new keys and check them against the keys, as
+ *  GenerateNewKey does, spread over as many threads as there are cores. */
+static std::vector<CPubKey> GetNewPubKeys(const std::vector<CKey>& vKeys)
+{
+    std::vector<CPubKey> vPubKeys(vKeys.size());
+    auto compute = [&vKeys, &vPubKeys](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; i++) {
+            vPubKeys[i] = vKeys[i].GetPubKey();
+            assert(vKeys[i].VerifyPubKey(vPubKeys[i]));
+        }
+    };
+    const size_t nThreads = std::max<size_t>(1, std::min<size_t>(GetNumCores(), vKeys.size() / MIN_NEW_KEYS_PER_THREAD));
+    const size_t nPerThread = (vKeys.size() + nThreads - 1) / nThreads;
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < nThreads; i++) {
+        threads.emplace_back(compute, std::min(vKeys.size(), i * nPerThread), std::min(vKeys.size(), (i + 1) * nPerThread));
+    }
+    compute(0, std::min(vKeys.size(), nPerThread));
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return vPubKeys;
+}
+
+std::vector<CNewKey> CWallet::GenerateNewKeys(CWalletDB& walletdb, bool internal, unsigned int nCount, CHDChain& hdChainNew)
+{
+    AssertLockHeld(cs_wallet);
+    bool fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY); // default to compressed public keys if we want 0.6.0 wallets
+    const bool fHD = IsHDEnabled();
+    internal = internal && CanSupportFeature(FEATURE_HD_SPLIT);
+
+    int64_t nCreationTime = GetTime();
+    CExtKey chainChildKey;
+    if (fHD) {
+        DeriveChainKey(chainChildKey, internal);
+    }
+    hdChainNew = hdChain;
+
+    std::vector<CNewKey> vResult;
+    vResult.reserve(nCount);
+    while (vResult.size() < nCount) {
+        // Derive (or draw) the secrets in order, which is cheap; computing
+        // their public keys is what takes time.
+        std::vector<CKey> vKeys(nCount - vResult.size());
+        std::vector<uint32_t> vChildIndex(vKeys.size());
+        for (size_t i = 0; i < vKeys.size(); i++) {
+            if (fHD) {
+                uint32_t& nCounter = internal ? hdChainNew.nInternalChainCounter : hdChainNew.nExternalChainCounter;
+                ChainCode cc;
+                chainChildKey.key.Derive(vKeys[i], cc, nCounter | BIP32_HARDENED_KEY_LIMIT, chainChildKey.chaincode);
+                vChildIndex[i] = nCounter++;
+            } else {
+                vKeys[i].MakeNewKey(fCompressed);
+            }
+        }
+        const std::vector<CPubKey> vPubKeys = GetNewPubKeys(vKeys);
+
+        for (size_t i = 0; i < vKeys.size(); i++) {
+            CNewKey newKey;
+            newKey.key = vKeys[i];
+            newKey.pubkey = vPubKeys[i];
+            newKey.metadata = CKeyMetadata(nCreationTime);
+            if (fHD) {
+                // skip keys already known to the wallet, like DeriveNewChildKey
+                if (HaveKey(newKey.pubkey.GetID()))
+                    continue;
+                newKey.metadata.hdKeypath = std::string(internal ? "m/0'/1'/" : "m/0'/0'/") + std::to_string(vChildIndex[i]) + "'";
+                newKey.metadata.hdMasterKeyID = hdChain.masterKeyID;
+            }
+
+            // Write what AddKeyPubKeyWithDB would, including dropping the
+            // key's scripts from watch-only
+            if (IsCrypted()) {
+                if (!EncryptKey(newKey.key, newKey.pubkey, newKey.vchCryptedSecret) ||
+                    !walletdb.WriteCryptedKey(newKey.pubkey, newKey.vchCryptedSecret, newKey.metadata)) {
+                    throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+                }
+            } else if (!walletdb.WriteKey(newKey.pubkey, newKey.key.GetPrivKey(), newKey.metadata)) {
+                throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+            }
+            for (const CScript& script : {GetScriptForDestination(newKey.pubkey.GetID()), GetScriptForRawPubKey(newKey.pubkey)}) {
+                if (HaveWatchOnly(script) && !walletdb.EraseWatchOnly(script)) {
+                    throw std::runtime_error(std::string(__func__) + ": erasing watch-only script failed");
+                }
+            }
+            vResult.push_back(std::move(newKey));
+        }
+    }
+
+    // update the chain model in the database
+    if (fHD && !walletdb.WriteHDChain(hdChainNew))
+        throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
+    return vResult;
+}
+
+void CWallet::AddNewKeys(CWalletDB& walletdb, const std::vector<CNewKey>& vNewKeys, const CHDChain& hdChainNew)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+
+    bool fWatchOnlyRemoved = false;
+    for (const CNewKey& newKey : vNewKeys) {
+        mapKeyMetadata[newKey.pubkey.GetID()] = newKey.metadata;
+        UpdateTimeFirstKey(newKey.metadata.nCreateTime);
+        if (IsCrypted()) {
+            LoadCryptedKey(newKey.pubkey, newKey.vchCryptedSecret);
+        } else {
+            LoadKey(newKey.key, newKey.pubkey);
+        }
+        for (const CScript& script : {GetScriptForDestination(newKey.pubkey.GetID()), GetScriptForRawPubKey(newKey.pubkey)}) {
+            if (HaveWatchOnly(script)) {
+                CCryptoKeyStore::RemoveWatchOnly(script);
+                fWatchOnlyRemoved = true;
+            }
+        }
+    }
+    if (fWatchOnlyRemoved && !HaveWatchOnly()) {
+        NotifyWatchonlyChanged(false);
+    }
+    hdChain = hdChainNew;
+
+    // Compressed public keys were introduced in version 0.6.0
+    if (CanSupportFeature(FEATURE_COMPRPUBKEY)) {
+        SetMinVersion(FEATURE_COMPRPUBKEY, &walletdb);
+    }
+}
+
 bool CWallet::AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey& secret, const CPubKey &pubkey)
 {
     AssertLockHeld(cs_wallet); // mapKeyMetadata
@@ -235,11 +373,11 @@ bool CWallet::AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey& secret, const
     CScript script;
     script = GetScriptForDestination(pubkey.GetID());
     if (HaveWatchOnly(script)) {
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(walletdb, script);
     }
     script = GetScriptForRawPubKey(pubkey);
     if (HaveWatchOnly(script)) {
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(walletdb, script);
     }
 
     if (!IsCrypted()) {
@@ -351,13 +489,19 @@ bool CWallet::AddWatchOnly(const CScript& dest, int64_t nCreateTime)
 }
 
 bool CWallet::RemoveWatchOnly(const CScript &dest)
+{
+    CWalletDB walletdb(*dbw);
+    return RemoveWatchOnlyWithDB(walletdb, dest);
+}
+
+bool CWallet::RemoveWatchOnlyWithDB(CWalletDB &walletdb, const CScript &dest)
 {
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
         return false;
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
-    if (!CWalletDB(*dbw).EraseWatchOnly(dest))
+    if (!walletdb.EraseWatchOnly(dest))
         return false;
 
     return true;
@@ -2606,6 +2750,8 @@ bool CWallet::SignTransaction(CMutableTransaction &tx)
 
     // sign the new tx
     CTransaction txNewConst(tx);
+    PrecomputedTransactionData txdata(txNewConst);
+    txdata.PrecomputeLegacy(txNewConst);
     int nIn = 0;
     for (const auto& input : tx.vin) {
         std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(input.prevout.hash);
@@ -2615,7 +2761,7 @@ bool CWallet::SignTransaction(CMutableTransaction &tx)
         const CScript& scriptPubKey = mi->second.tx->vout[input.prevout.n].scriptPubKey;
         const CAmount& amount = mi->second.tx->vout[input.prevout.n].nValue;
         SignatureData sigdata;
-        if (!ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, amount, SIGHASH_ALL), scriptPubKey, sigdata)) {
+        if (!ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, amount, SIGHASH_ALL, &txdata), scriptPubKey, sigdata)) {
             return false;
         }
         UpdateTransaction(tx, nIn, sigdata);
@@ -2966,13 +3112,15 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
         if (sign)
         {
             CTransaction txNewConst(txNew);
+            PrecomputedTransactionData txdata(txNewConst);
+            txdata.PrecomputeLegacy(txNewConst);
             int nIn = 0;
             for (const auto& coin : setCoins)
             {
                 const CScript& scriptPubKey = coin.txout.scriptPubKey;
                 SignatureData sigdata;
 
-                if (!ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, coin.txout.nValue, SIGHASH_ALL), scriptPubKey, sigdata))
+                if (!ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, coin.txout.nValue, SIGHASH_ALL, &txdata), scriptPubKey, sigdata))
                 {
                     strFailReason = _("Signing transaction failed");
                     return false;
@@ -3302,28 +3450,63 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
             // don't create extra internal keys
             missingInternal = 0;
         }
-        bool internal = false;
+        // Generate the keys in batches, each written in one database
+        // transaction, external keys first.
+        const int64_t nTotal = missingInternal + missingExternal;
+        const bool fShowProgress = nTotal > KEYPOOL_BATCH_SIZE;
+        if (fShowProgress) {
+            ShowProgress(_("Generating keys..."), 0);
+        }
         CWalletDB walletdb(*dbw);
-        for (int64_t i = missingInternal + missingExternal; i--;)
-        {
-            if (i < missingInternal) {
-                internal = true;
-            }
-
-            assert(m_max_keypool_index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
-            int64_t index = ++m_max_keypool_index;
-
-            CPubKey pubkey(GenerateNewKey(walletdb, internal));
-            if (!walletdb.WritePool(index, CKeyPool(pubkey, internal))) {
-                throw std::runtime_error(std::string(__func__) + ": writing generated key failed");
-            }
+        int64_t nDone = 0;
+        for (bool internal : {false, true}) {
+            int64_t nMissing = internal ? missingInternal : missingExternal;
+            while (nMissing > 0) {
+                const unsigned int nBatch = std::min<int64_t>(nMissing, KEYPOOL_BATCH_SIZE);
+                CHDChain hdChainNew;
+                std::vector<CNewKey> vNewKeys;
+                if (!walletdb.TxnBegin()) {
+                    throw std::runtime_error(std::string(__func__) + ": starting database transaction failed");
+                }
+                try {
+                    vNewKeys = GenerateNewKeys(walletdb, internal, nBatch, hdChainNew);
+                    int64_t index = m_max_keypool_index;
+                    for (const CNewKey& newKey : vNewKeys) {
+                        assert(index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
+                        if (!walletdb.WritePool(++index, CKeyPool(newKey.pubkey, internal))) {
+                            throw std::runtime_error(std::string(__func__) + ": writing generated key failed");
+                        }
+                    }
+                    if (!walletdb.TxnCommit()) {
+                        throw std::runtime_error(std::string(__func__) + ": committing generated keys failed");
+                    }
+                } catch (...) {
+                    // Nothing of the batch has been added to the wallet in
+                    // memory yet, so aborting the transaction undoes it all.
+                    walletdb.TxnAbort();
+                    throw;
+                }
 
-            if (internal) {
-                setInternalKeyPool.insert(index);
-            } else {
-                setExternalKeyPool.insert(index);
+                AddNewKeys(walletdb, vNewKeys, hdChainNew);
+                for (const CNewKey& newKey : vNewKeys) {
+                    int64_t index = ++m_max_keypool_index;
+                    if (internal) {
+                        setInternalKeyPool.insert(index);
+                    } else {
+                        setExternalKeyPool.insert(index);
+                    }
+                    m_pool_key_to_index[newKey.pubkey.GetID()] = index;
+                }
+                nMissing -= nBatch;
+                nDone += nBatch;
+                if (fShowProgress) {
+                    ShowProgress(_("Generating keys..."), std::max(1, std::min(99, (int)(nDone * 100 / nTotal))));
+                    LogPrintf("keypool generated %d of %d keys\n", nDone, nTotal);
+                }
             }
-            m_pool_key_to_index[pubkey.GetID()] = index;
+        }
+        if (fShowProgress) {
+            ShowProgress(_("Generating keys..."), 100);
         }
         if (missingInternal + missingExternal > 0) {
             LogPrintf("keypool added %d keys (%d internal), size=%u (%u internal)\n", missingInternal + missingExternal, missingInternal, setInternalKeyPool.size() + setExternalKeyPool.size(), setInternalKeyPool.size());
@@ -3988,6 +4171,21 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
 
     if (chainActive.Tip() && chainActive.Tip() != pindexRescan)
     {
+        //We can't rescan beyond non-pruned blocks, stop and throw an error
+        //this might happen if a user uses an old wallet within a pruned node
+        // or if they ran -disablewallet for a longer time, then decided to re-enable
+        if (fPruneMode)
+        {
+            CBlockIndex *block = chainActive.Tip();
+            while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA) && block->pprev->nTx > 0 && pindexRescan != block)
+                block = block->pprev;
+
+            if (pindexRescan != block) {
+                InitError(_("Prune: last wallet synchronisation goes beyond pruned data. You need to -reindex (download the whole blockchain again in case of pruned node)"));
+                return nullptr;
+            }
+        }
+
         uiInterface.InitMessage(_("Rescanning..."));
         LogPrintf("Rescanning last %i blocks (from block %i)...\n", chainActive.Height() - pindexRescan->nHeight, pindexRescan->nHeight);
 
@@ -4256,7 +4454,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     bnTargetPerCoinDay.SetCompact(nBits);
 
     // Transaction index is required to get to block header
-    if (!fTxIndex)
+    if (!g_txindex)
         return error("CreateCoinStake : transaction index unavailable");
     const Consensus::Params& params = Params().GetConsensus();
 
@@ -4287,24 +4485,13 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     CScript scriptPubKeyKernel;
     for (const auto& pcoin : setCoins)
     {
-        CDiskTxPos postx;
-        if (!pblocktree->ReadTxIndex(pcoin.outpoint.hash, postx))
+        CStakeKernelPrevout kernel;
+        if (!GetStakeKernelPrevout(pcoin.outpoint, chainActive.Tip(), kernel))
             continue;
-
-        // Read block header
-        CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-        CBlockHeader header;
-        CTransactionRef tx;
-        try {
-            file >> header;
-            fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-            file >> tx;
-        } catch (std::exception &e) {
-            return error("%s() : deserialize or I/O error in CreateCoinStake()", __PRETTY_FUNCTION__);
-        }
+        const int64_t nTimeBlockFrom = kernel.pindexFrom->GetBlockTime();
 
         static int nMaxStakeSearchInterval = 60;
-        if (header.GetBlockTime() + params.nStakeMinAge > txNew.nTime - nMaxStakeSearchInterval)
+        if (nTimeBlockFrom + params.nStakeMinAge > txNew.nTime - nMaxStakeSearchInterval)
             continue; // only count coins meeting min age requirement
 
         bool fKernelFound = false;
@@ -4314,7 +4501,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
             // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
             uint256 hashProofOfStake = uint256();
             COutPoint prevoutStake = pcoin.outpoint;
-            if (CheckStakeKernelHash(nBits, chainActive.Tip(), header, postx.nTxOffset + CBlockHeader::NORMAL_SERIALIZE_SIZE, tx, prevoutStake, txNew.nTime - n, hashProofOfStake))
+            if (CheckStakeKernelHash(nBits, chainActive.Tip(), kernel, prevoutStake, txNew.nTime - n, hashProofOfStake))
             {
                 // Found a kernel
                 if (gArgs.GetBoolArg("-debug", false) && gArgs.GetBoolArg("-printcoinstake", false))
@@ -4339,15 +4526,17 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
                 }
                 if (whichType == TX_PUBKEYHASH || whichType == TX_WITNESS_V0_KEYHASH) // pay to address type or witness keyhash
                 {
-                    // convert to pay to public key type
-                    CKey key;
-                    if (!keystore.GetKey(CKeyID(uint160(vSolutions[0])), key))
+                    // convert to pay to public key type; only the public key
+                    // is needed here, so don't decrypt the private key yet
+                    const CKeyID keyid{uint160(vSolutions[0])};
+                    CPubKey pubkey;
+                    if (!keystore.HaveKey(keyid) || !keystore.GetPubKey(keyid, pubkey))
                     {
                         if (gArgs.GetBoolArg("-debug", false) && gArgs.GetBoolArg("-printcoinstake", false))
                             LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
                         break;  // unable to find corresponding public key
                     }
-                    scriptPubKeyOut << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+                    scriptPubKeyOut << ToByteVector(pubkey) << OP_CHECKSIG;
                 }
                 else
                     scriptPubKeyOut = scriptPubKeyKernel;
@@ -4355,9 +4544,9 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
                 txNew.nTime -= n;
                 txNew.vin.push_back(CTxIn(pcoin.outpoint.hash, pcoin.outpoint.n));
                 nCredit += pcoin.txout.nValue;
-                vwtxPrev.push_back(tx);
+                vwtxPrev.push_back(mapWallet.at(pcoin.outpoint.hash).tx);
                 txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
-                if (nCredit >= nSplitThreshold && header.GetBlockTime() + nStakeSplitAge > txNew.nTime)
+                if (nCredit >= nSplitThreshold && nTimeBlockFrom + nStakeSplitAge > txNew.nTime)
                     txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); // @dev: creates empty vout for splitting stake #nSplitThreshold
                 if (gArgs.GetBoolArg("-debug", false) && gArgs.GetBoolArg("-printcoinstake", false))
                     LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
@@ -4372,22 +4561,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
         return false;
     for (const auto& pcoin : setCoins)
     {
-        CDiskTxPos postx;
-        if (!pblocktree->ReadTxIndex(pcoin.outpoint.hash, postx))
-            continue;
-
-        // Read block header
-        CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-        CBlockHeader header;
-        CTransactionRef tx;
-        try {
-            file >> header;
-            fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-            file >> tx;
-        } catch (std::exception &e) {
-            return error("%s() : deserialize or I/O error in CreateCoinStake()", __PRETTY_FUNCTION__);
-        }
-
+        const CTransactionRef& tx = mapWallet.at(pcoin.outpoint.hash).tx;
 
         // Attempt to add more inputs
         // Only add coins of the same key/address as kernel
@@ -4441,12 +4615,19 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
         else
             txNew.vout[1].nValue = nCredit;
 
-        // Sign
+        // Sign, sharing the precomputed signature hash parts between the inputs
+        CTransaction txNewConst(txNew);
+        PrecomputedTransactionData txdata(txNewConst);
+        txdata.PrecomputeLegacy(txNewConst);
         int nIn = 0;
         for (const auto& pcoin : vwtxPrev)
         {
-            if (!SignSignature(*this, *pcoin, txNew, nIn++, SIGHASH_ALL))
+            const CTxOut& txout = pcoin->vout[txNew.vin[nIn].prevout.n];
+            SignatureData sigdata;
+            if (!ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, txout.nValue, SIGHASH_ALL, &txdata), txout.scriptPubKey, sigdata))
                 return error("CreateCoinStake : failed to sign coinstake");
+            UpdateTransaction(txNew, nIn, sigdata);
+            nIn++;
         }
 
         // Limit size
@@ -645,6 +645,17 @@ private:
 
 
 class WalletRescanReserver; //forward declarations for ScanForWalletTransactions/RescanFromTime
+
+/** A key generated by CWallet::GenerateNewKeys, written to the database but not yet added to the wallet */
+struct CNewKey
+{
+    CKey key;
+    CPubKey pubkey;
+    CKeyMetadata metadata;
+    //! The key encrypted with the wallet master key, for encrypted wallets
+    std::vector<unsigned char> vchCryptedSecret;
+};
+
 /** 
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -700,6 +711,9 @@ private:
     /* the HD chain data model (external chain counters) */
     CHDChain hdChain;
 
+    /* HD derive the key of the internal or external chain, whose children are the wallet keys */
+    void DeriveChainKey(CExtKey& chainChildKey, bool internal);
+
     /* HD derive new child key (on internal or external chain) */
     void DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKey& secret, bool internal = false);
 
@@ -871,6 +885,16 @@ public:
      * Generate a new key
      */
     CPubKey GenerateNewKey(CWalletDB& walletdb, bool internal = false);
+    /**
+     * Generate nCount new keys like GenerateNewKey, computing and checking
+     * their public keys on several threads. The keys, and the HD chain with
+     * its counters advanced past them (hdChainNew), are only written to
+     * walletdb; AddNewKeys takes them up in memory once the database
+     * transaction holding the writes has been committed.
+     */
+    std::vector<CNewKey> GenerateNewKeys(CWalletDB& walletdb, bool internal, unsigned int nCount, CHDChain& hdChainNew);
+    //! Adds keys written by GenerateNewKeys to the wallet in memory.
+    void AddNewKeys(CWalletDB& walletdb, const std::vector<CNewKey>& vNewKeys, const CHDChain& hdChainNew);
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey) override;
     bool AddKeyPubKeyWithDB(CWalletDB &walletdb,const CKey& key, const CPubKey &pubkey);
@@ -904,6 +928,7 @@ public:
     //! Adds a watch-only address to the store, and saves it to disk.
     bool AddWatchOnly(const CScript& dest, int64_t nCreateTime);
     bool RemoveWatchOnly(const CScript &dest) override;
+    bool RemoveWatchOnlyWithDB(CWalletDB &walletdb, const CScript &dest);
     //! Adds a watch-only address to the store, without saving it to disk (used by LoadWallet)
     bool LoadWatchOnly(const CScript &dest);
 
@@ -170,6 +170,17 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     LogPrint(BCLog::ZMQ, "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
+    if (RPCSerializationFlags() == 0) {
+        // The block is published exactly as stored on disk
+        std::vector<uint8_t> block;
+        if (!ReadRawBlockFromDisk(block, pindex, Params().MessageStart()))
+        {
+            zmqError("Can't read block from disk");
+            return false;
+        }
+        return SendMessage(MSG_RAWBLOCK, block.data(), block.size());
+    }
+
     const Consensus::Params& consensusParams = Params().GetConsensus();
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
     {
@@ -131,7 +131,7 @@ class BlockchainTest(BitcoinTestFramework):
 
     def _test_gettxoutsetinfo(self):
         node = self.nodes[0]
-        res = node.gettxoutsetinfo()
+        res = node.gettxoutsetinfo(True)
 
         assert_equal(res['total_amount'], Decimal('8725.00000000'))
         assert_equal(res['transactions'], 200)
@@ -145,11 +145,18 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(len(res['bestblock']), 64)
         assert_equal(len(res['hash_serialized_2']), 64)
 
+        self.log.info("Test that gettxoutsetinfo() answers from the UTXO set commitment by default")
+        res_commitment = node.gettxoutsetinfo()
+        for field in ['height', 'bestblock', 'txouts', 'bogosize', 'muhash', 'total_amount']:
+            assert_equal(res_commitment[field], res[field])
+        assert 'transactions' not in res_commitment
+        assert 'hash_serialized_2' not in res_commitment
+
         self.log.info("Test that gettxoutsetinfo() works for blockchain with just the genesis block")
         b1hash = node.getblockhash(1)
         node.invalidateblock(b1hash)
 
-        res2 = node.gettxoutsetinfo()
+        res2 = node.gettxoutsetinfo(True)
         assert_equal(res2['transactions'], 0)
         assert_equal(res2['total_amount'], Decimal('0'))
         assert_equal(res2['height'], 0)
@@ -161,7 +168,7 @@ class BlockchainTest(BitcoinTestFramework):
         self.log.info("Test that gettxoutsetinfo() returns the same result after invalidate/reconsider block")
         node.reconsiderblock(b1hash)
 
-        res3 = node.gettxoutsetinfo()
+        res3 = node.gettxoutsetinfo(True)
         assert_equal(res['total_amount'], res3['total_amount'])
         assert_equal(res['transactions'], res3['transactions'])
         assert_equal(res['height'], res3['height'])
@@ -169,6 +176,7 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(res['bogosize'], res3['bogosize'])
         assert_equal(res['bestblock'], res3['bestblock'])
         assert_equal(res['hash_serialized_2'], res3['hash_serialized_2'])
+        assert_equal(res['muhash'], res3['muhash'])
 
     def _test_getblockheader(self):
         node = self.nodes[0]
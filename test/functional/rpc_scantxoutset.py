@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+# Copyright (c) 2012-2019 The Donu developers
+# Distributed under the MIT/X11 software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the scantxoutset rpc call.
+
+Test the start, status and abort actions, scanning by address and by raw
+script, the fields of the unspents found, and that the parallel scan finds
+the same as a single-threaded one.
+"""
+
+from decimal import Decimal
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_greater_than,
+    assert_raises_rpc_error,
+)
+
+class ScantxoutsetTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def run_test(self):
+        node = self.nodes[0]
+
+        self.log.info("Mining blocks...")
+        addr_coinbase = node.getnewaddress("", "legacy")
+        node.generatetoaddress(60, addr_coinbase)
+        node.generate(60)
+
+        addr_legacy = node.getnewaddress("", "legacy")
+        addr_p2sh_segwit = node.getnewaddress("", "p2sh-segwit")
+        addr_bech32 = node.getnewaddress("", "bech32")
+        txids = {}
+        txids[addr_legacy] = node.sendtoaddress(addr_legacy, 0.001)
+        txids[addr_p2sh_segwit] = node.sendtoaddress(addr_p2sh_segwit, 0.002)
+        txids[addr_bech32] = node.sendtoaddress(addr_bech32, 0.004)
+        node.generate(1)
+        height = node.getblockcount()
+
+        self.log.info("Test status and abort without a scan in progress")
+        assert_equal(node.scantxoutset("status"), None)
+        assert_equal(node.scantxoutset("abort"), False)
+        assert_raises_rpc_error(-8, "Invalid command", node.scantxoutset, "restart", [])
+        assert_raises_rpc_error(-8, "scanobjects argument is required", node.scantxoutset, "start")
+
+        self.log.info("Test bad scan objects")
+        spk_bech32 = node.validateaddress(addr_bech32)["scriptPubKey"]
+        assert_raises_rpc_error(-5, "Invalid address", node.scantxoutset, "start", ["notanaddress"])
+        assert_raises_rpc_error(-8, "exactly one of address or script", node.scantxoutset, "start", [{"address": addr_bech32, "script": spk_bech32}])
+        assert_raises_rpc_error(-8, "exactly one of address or script", node.scantxoutset, "start", [{}])
+        assert_raises_rpc_error(-8, "either a string or an object", node.scantxoutset, "start", [1])
+
+        self.log.info("Test scanning by address")
+        result = node.scantxoutset("start", [addr_legacy, {"address": addr_p2sh_segwit}, addr_bech32])
+        assert_equal(result["success"], True)
+        assert_equal(result["height"], height)
+        assert_equal(result["bestblock"], node.getbestblockhash())
+        assert_greater_than(result["searched_items"], height)
+        assert_equal(result["total_amount"], Decimal("0.007"))
+        assert_equal(len(result["unspents"]), 3)
+        for unspent in result["unspents"]:
+            tx = node.decoderawtransaction(node.gettransaction(unspent["txid"])["hex"])
+            assert unspent["txid"] in txids.values()
+            assert_equal(tx["vout"][unspent["vout"]]["scriptPubKey"]["hex"], unspent["scriptPubKey"])
+            assert_equal(unspent["height"], height)
+            assert_equal(unspent["coinbase"], False)
+            assert_equal(unspent["coinstake"], False)
+            assert_equal(unspent["time"], tx["time"])
+
+        self.log.info("Test scanning by raw script")
+        result = node.scantxoutset("start", [{"script": spk_bech32}])
+        assert_equal(result["total_amount"], Decimal("0.004"))
+        assert_equal(len(result["unspents"]), 1)
+        assert_equal(result["unspents"][0]["txid"], txids[addr_bech32])
+        assert_equal(result["unspents"][0]["scriptPubKey"], spk_bech32)
+
+        self.log.info("Test the fields of coinbase outputs")
+        # The sends above may have spent some of them
+        coinbases = {}
+        for h in range(1, 61):
+            coinbase = node.getblock(node.getblockhash(h), 2)["tx"][0]
+            if node.gettxout(coinbase["txid"], 0) is not None:
+                coinbases[coinbase["txid"]] = (h, coinbase["time"])
+        assert_greater_than(len(coinbases), 50)
+        result = node.scantxoutset("start", [addr_coinbase])
+        assert_equal(len(result["unspents"]), len(coinbases))
+        for unspent in result["unspents"]:
+            assert_equal((unspent["height"], unspent["time"]), coinbases[unspent["txid"]])
+            assert_equal(unspent["vout"], 0)
+            assert_equal(unspent["coinbase"], True)
+            assert_equal(unspent["coinstake"], False)
+
+        # The unspents of the coinbase address are spread over the whole
+        # txid space, and so over the ranges the threads scan
+        self.log.info("Test that parallel and single-threaded scans agree")
+        scan_objects = [addr_coinbase, addr_legacy, addr_p2sh_segwit, {"script": spk_bech32}]
+        key = lambda unspent: (unspent["txid"], unspent["vout"])
+        self.restart_node(0, ["-scanthreads=1"])
+        expected = self.nodes[0].scantxoutset("start", scan_objects)
+        assert_equal(expected["success"], True)
+        assert_equal(len(expected["unspents"]), len(coinbases) + 3)
+        for threads in [3, 16]:
+            self.restart_node(0, ["-scanthreads=%d" % threads])
+            result = self.nodes[0].scantxoutset("start", scan_objects)
+            assert_equal(result["success"], True)
+            assert_equal(result["searched_items"], expected["searched_items"])
+            assert_equal(result["total_amount"], expected["total_amount"])
+            assert_equal(sorted(result["unspents"], key=key), sorted(expected["unspents"], key=key))
+
+if __name__ == '__main__':
+    ScantxoutsetTest().main()
@@ -102,6 +102,7 @@ BASE_SCRIPTS= [
     'p2p_disconnect_ban.py',
     'rpc_decodescript.py',
     'rpc_blockchain.py',
+    'rpc_scantxoutset.py',
     'rpc_deprecated.py',
     'wallet_disable.py',
     'rpc_net.py',